@@ -0,0 +1,243 @@
+#define _GNU_SOURCE  // For pthread_attr_setaffinity_np, pthread_getaffinity_np and the CPU_* macros
+#include <stdio.h>    // For printf and snprintf
+#include <stdlib.h>   // For strtol
+#include <string.h>   // For strcmp
+#include <pthread.h>  // Thread attributes and affinity
+#include <unistd.h>   // For sysconf and access
+#ifdef __linux__
+#include <sched.h>    // For cpu_set_t
+#endif
+#include "affinity.h"
+
+// affinity.c
+// Placement of the server's threads. The CPU lists come from the command line; every thread
+// started through affinity_create_thread (or pinned with affinity_pin_self) is recorded so the
+// report can read back the mask each one actually runs with, together with the NUMA nodes those
+// CPUs belong to (from /sys, so no NUMA library is needed).
+
+#define AFFINITY_MAX_CPUS 1024  // Highest CPU number accepted + 1
+#define AFFINITY_MAX_THREADS 64  // Threads recorded per role (the pool's MAX_THREADS)
+#define AFFINITY_MAX_NODES 64  // NUMA nodes looked for in /sys
+
+static const char *role_names[AFFINITY_ROLES] = { "receive", "workers", "notifier", "database" };
+
+// One role's CPU list and the threads placed with it
+typedef struct {
+    int cpus[AFFINITY_MAX_CPUS];  // In the order given on the command line
+    int count;  // 0 = not pinned
+    pthread_t threads[AFFINITY_MAX_THREADS];  // Threads of the role, by index
+    int thread_count;
+} RolePlacement;
+
+static RolePlacement placements[AFFINITY_ROLES];
+static pthread_mutex_t placement_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int affinity_set_option(const char *name, const char *value) {
+    int role = 0;
+    while (role < AFFINITY_ROLES && strcmp(name, role_names[role]) != 0) {
+        role++;
+    }
+    if (role == AFFINITY_ROLES) {
+        return -1;
+    }
+
+    // Parse "0-3,8,10-11"
+    RolePlacement *placement = &placements[role];
+    placement->count = 0;
+    const char *p = value;
+    while (*p != '\0') {
+        char *end;
+        long first = strtol(p, &end, 10), last = first;
+        if (end == p || first < 0) {
+            return -1;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) {
+                return -1;
+            }
+        }
+        if (last >= AFFINITY_MAX_CPUS || placement->count + (last - first + 1) > AFFINITY_MAX_CPUS) {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            placement->cpus[placement->count++] = (int)cpu;
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+        p = end;
+    }
+    return placement->count > 0 ? 0 : -1;
+}
+
+// Remember a thread of a role for the report
+static void record_thread(int role, int index, pthread_t thread) {
+    pthread_mutex_lock(&placement_mutex);
+    RolePlacement *placement = &placements[role];
+    if (index >= 0 && index < AFFINITY_MAX_THREADS) {
+        placement->threads[index] = thread;
+        if (index >= placement->thread_count) {
+            placement->thread_count = index + 1;
+        }
+    }
+    pthread_mutex_unlock(&placement_mutex);
+}
+
+#ifdef __linux__
+// The CPUs a role's thread may run on: one CPU per worker, the whole list otherwise
+static void placement_set(int role, int index, cpu_set_t *set) {
+    const RolePlacement *placement = &placements[role];
+    CPU_ZERO(set);
+    if (role == AFFINITY_WORKERS) {
+        CPU_SET(placement->cpus[index % placement->count], set);
+        return;
+    }
+    for (int i = 0; i < placement->count; i++) {
+        CPU_SET(placement->cpus[i], set);
+    }
+}
+
+// NUMA node of a CPU, or -1 if the kernel does not say
+static int cpu_node(int cpu) {
+    char path[96];
+    for (int node = 0; node < AFFINITY_MAX_NODES; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+        if (access(path, F_OK) == 0) {
+            return node;
+        }
+    }
+    return -1;
+}
+
+// Number of NUMA nodes the kernel reports (at least 1)
+static int node_count() {
+    char path[64];
+    int nodes = 0;
+    for (int node = 0; node < AFFINITY_MAX_NODES; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", node);
+        if (access(path, F_OK) == 0) {
+            nodes++;
+        }
+    }
+    return nodes > 0 ? nodes : 1;
+}
+
+// Append a CPU mask as ranges with the nodes it covers, e.g. "CPUs 0-3,8 (node 0)"
+static size_t format_mask(char *buffer, size_t size, const cpu_set_t *set) {
+    size_t used = 0;
+    int first = -1, nodes_seen = 0;
+    unsigned long long nodes = 0;  // Bit per node
+    used += snprintf(buffer + used, size - used, CPU_COUNT(set) == 1 ? "CPU " : "CPUs ");
+    for (int cpu = 0; cpu <= CPU_SETSIZE && used < size; cpu++) {
+        if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, set)) {
+            int node = cpu_node(cpu);
+            if (node >= 0) {
+                nodes |= 1ull << node;
+            }
+            if (first < 0) {
+                first = cpu;
+            }
+        } else if (first >= 0) {
+            // Close the range; the first one follows the "CPUs " prefix without a comma
+            used += snprintf(buffer + used, size - used, first == cpu - 1 ? "%s%d" : "%s%d-%d",
+                             buffer[used - 1] == ' ' ? "" : ",", first, cpu - 1);
+            first = -1;
+        }
+    }
+    for (int node = 0; node < AFFINITY_MAX_NODES && used < size; node++) {
+        if (nodes & (1ull << node)) {
+            used += snprintf(buffer + used, size - used, nodes_seen++ ? ",%d" : " (node %d", node);
+        }
+    }
+    if (nodes_seen && used < size) {
+        used += snprintf(buffer + used, size - used, ")");
+    }
+    return used < size ? used : size - 1;
+}
+#endif
+
+int affinity_create_thread(pthread_t *thread, int role, int index, void *(*start)(void *), void *arg) {
+    int result = -1;
+#ifdef __linux__
+    if (placements[role].count > 0) {
+        // Start the thread on its CPUs, so even its first allocations are node-local
+        pthread_attr_t attr;
+        cpu_set_t set;
+        placement_set(role, index, &set);
+        pthread_attr_init(&attr);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        result = pthread_create(thread, &attr, start, arg);
+        pthread_attr_destroy(&attr);
+        if (result != 0) {
+            printf("Placement of %s thread %d failed; starting it unpinned.\n", role_names[role], index);
+        }
+    }
+#endif
+    if (result != 0) {
+        result = pthread_create(thread, NULL, start, arg);
+    }
+    if (result == 0) {
+        record_thread(role, index, *thread);
+    }
+    return result;
+}
+
+void affinity_pin_self(int role) {
+#ifdef __linux__
+    if (placements[role].count > 0) {
+        cpu_set_t set;
+        placement_set(role, 0, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            printf("Placement of the %s thread failed; it stays unpinned.\n", role_names[role]);
+        }
+    }
+#endif
+    record_thread(role, 0, pthread_self());
+}
+
+size_t affinity_report(char *buffer, size_t size) {
+    size_t used = 0;
+    int pinned = 0;
+    for (int role = 0; role < AFFINITY_ROLES; role++) {
+        pinned |= placements[role].count > 0;
+    }
+#ifdef __linux__
+    used += snprintf(buffer, size, "Placement: %s (%ld CPUs online, %d NUMA nodes)\n", pinned ? "pinned" : "not pinned",
+                     sysconf(_SC_NPROCESSORS_ONLN), node_count());
+    if (!pinned) {
+        return used < size ? used : size - 1;
+    }
+    pthread_mutex_lock(&placement_mutex);
+    for (int role = 0; role < AFFINITY_ROLES && used < size; role++) {
+        const RolePlacement *placement = &placements[role];
+        used += snprintf(buffer + used, size - used, "  %s: ", role_names[role]);
+        if (used >= size) {
+            break;  // Truncated: size - used would wrap
+        }
+        if (placement->count == 0 || placement->thread_count == 0) {
+            used += snprintf(buffer + used, size - used, placement->count ? "not started\n" : "unpinned\n");
+            continue;
+        }
+        for (int i = 0; i < placement->thread_count && used < size; i++) {
+            cpu_set_t set;
+            if (role == AFFINITY_WORKERS) {
+                used += snprintf(buffer + used, size - used, "%s%d on ", i ? ", " : "", i);
+            }
+            if (used < size && pthread_getaffinity_np(placement->threads[i], sizeof(set), &set) == 0) {
+                used += format_mask(buffer + used, size - used, &set);
+            }
+        }
+        if (used < size) {
+            used += snprintf(buffer + used, size - used, "\n");
+        }
+    }
+    pthread_mutex_unlock(&placement_mutex);
+#else
+    used += snprintf(buffer, size, pinned ? "Placement: CPU pinning is not supported on this platform\n" : "");
+#endif
+    return used < size ? used : (size > 0 ? size - 1 : 0);
+}
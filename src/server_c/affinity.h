@@ -0,0 +1,46 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stddef.h>   // For size_t
+#include <pthread.h>  // For pthread_t
+
+// affinity.h
+// CPU placement of the server's long-lived threads. Each role can be given a CPU list on the
+// command line (--cpu-ROLE LIST, e.g. --cpu-workers 2-7,10): the receive thread, the notifier
+// and the database event loop run on the whole list, worker i on the i-th CPU of its list
+// (wrapping around). Threads are created with their placement already set, so whatever they
+// allocate and first touch (work deques, request arenas, trace rings) comes from their local
+// NUMA node under the kernel's default first-touch policy. Roles without a list are left to
+// the scheduler. Linux only; elsewhere the options are accepted and reported as unsupported.
+
+enum {
+    AFFINITY_RECEIVE,   // The thread running the receive loop
+    AFFINITY_WORKERS,   // Thread pool workers
+    AFFINITY_NOTIFIER,  // follow_flight_id update sender
+    AFFINITY_DATABASE,  // Database event loop
+    AFFINITY_ROLES
+};
+
+/**
+ * @brief Set one role's CPU list from the command line (--cpu-NAME LIST): NAME is receive,
+ *        workers, notifier or database; LIST is comma-separated CPUs and ranges.
+ * @return 0 on success, -1 for an unknown role or a malformed list.
+ */
+int affinity_set_option(const char *name, const char *value);
+
+/**
+ * @brief pthread_create with the role's placement (index picks a worker's CPU).
+ */
+int affinity_create_thread(pthread_t *thread, int role, int index, void *(*start)(void *), void *arg);
+
+/**
+ * @brief Apply the role's placement to the calling thread.
+ */
+void affinity_pin_self(int role);
+
+/**
+ * @brief Write the placement the threads actually run with into buffer; returns the length written.
+ */
+size_t affinity_report(char *buffer, size_t size);
+
+#endif // AFFINITY_H
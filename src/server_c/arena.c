@@ -0,0 +1,192 @@
+#include <stdint.h>  // For uintptr_t
+#include <stdio.h>   // For perror
+#include <stdlib.h>  // For malloc and free
+#include <string.h>  // For memcpy
+#include <pthread.h> // For pthread_once
+#include "server.h"  // struct client_data
+#include "arena.h"   // Arena definitions
+#include "task_queue.h"  // Lock-free ring reused as the client_data free list
+#include "memory_budget.h"  // Chunks and request slots are charged as buffers
+
+#define CLIENT_DATA_SLAB_SIZE 1024  // client_data objects preallocated for in-flight requests
+#define ARENA_KEEP_CHUNKS 4  // Standard chunks an arena keeps across resets
+
+// Round a size up to the arena alignment
+static size_t align_up(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+// Allocate a chunk with room for at least min_size bytes
+static ArenaChunk *chunk_create(size_t min_size) {
+    size_t capacity = min_size > ARENA_CHUNK_SIZE ? align_up(min_size) : ARENA_CHUNK_SIZE;
+    if (memory_charge(MEMORY_BUFFERS, sizeof(ArenaChunk) + capacity) != 0) {
+        return NULL;  // Over the memory budget: the request fails as if out of memory
+    }
+    ArenaChunk *chunk = (ArenaChunk *)malloc(sizeof(ArenaChunk) + capacity);
+    if (chunk == NULL) {
+        perror("Memory allocation failed for arena chunk");
+        memory_release(MEMORY_BUFFERS, sizeof(ArenaChunk) + capacity);
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->capacity = capacity;
+    chunk->used = 0;
+    return chunk;
+}
+
+// Bump-allocate from the current chunk, moving to (or creating) the next chunk when it is full
+void *arena_alloc(Arena *arena, size_t size) {
+    size = align_up(size == 0 ? 1 : size);
+
+    if (arena->current == NULL) {
+        arena->first = arena->current = chunk_create(size);  // First use of this arena
+        if (arena->current == NULL) {
+            return NULL;
+        }
+    }
+
+    ArenaChunk *chunk = arena->current;
+    if (chunk->capacity - chunk->used < size) {
+        ArenaChunk *next = chunk->next;
+        if (next != NULL && next->capacity >= size) {
+            next->used = 0;  // Chunk kept from an earlier request; its contents are stale
+        } else {
+            // No reusable chunk is big enough: splice a new one in after the current chunk
+            next = chunk_create(size);
+            if (next == NULL) {
+                return NULL;
+            }
+            next->next = chunk->next;
+            chunk->next = next;
+        }
+        arena->current = chunk = next;
+    }
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->last = ptr;
+    return ptr;
+}
+
+// Extend the last allocation in place if possible, otherwise copy into a fresh block
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size) {
+    if (ptr != NULL && ptr == arena->last) {
+        ArenaChunk *chunk = arena->current;
+        size_t offset = (size_t)((unsigned char *)ptr - chunk->data);
+        if (offset + align_up(new_size) <= chunk->capacity) {
+            chunk->used = offset + align_up(new_size);  // Room left in the chunk: just move the bump pointer
+            return ptr;
+        }
+    }
+
+    void *grown = arena_alloc(arena, new_size);
+    if (grown != NULL && ptr != NULL) {
+        memcpy(grown, ptr, old_size < new_size ? old_size : new_size);
+    }
+    return grown;
+}
+
+// Free one chunk and give back its charge
+static void chunk_destroy(ArenaChunk *chunk) {
+    memory_release(MEMORY_BUFFERS, sizeof(ArenaChunk) + chunk->capacity);
+    free(chunk);
+}
+
+// Drop every allocation; later chunks are reset lazily as arena_alloc reaches them. Oversized
+// chunks and standard ones beyond ARENA_KEEP_CHUNKS served an unusually large request and are
+// freed, so an arena does not keep its high-water mark for the life of the thread.
+void arena_reset(Arena *arena) {
+    ArenaChunk **link = &arena->first;
+    int kept = 0;
+    while (*link != NULL) {
+        ArenaChunk *chunk = *link;
+        if (chunk->capacity > ARENA_CHUNK_SIZE || kept == ARENA_KEEP_CHUNKS) {
+            *link = chunk->next;
+            chunk_destroy(chunk);
+        } else {
+            kept++;
+            link = &chunk->next;
+        }
+    }
+    if (arena->first != NULL) {
+        arena->first->used = 0;
+    }
+    arena->current = arena->first;
+    arena->last = NULL;
+}
+
+// Free the whole chunk chain
+void arena_destroy(Arena *arena) {
+    ArenaChunk *chunk = arena->first;
+    while (chunk != NULL) {
+        ArenaChunk *next = chunk->next;
+        chunk_destroy(chunk);
+        chunk = next;
+    }
+    arena->first = arena->current = NULL;
+    arena->last = NULL;
+}
+
+// Each worker thread gets its own arena, so allocation never takes a lock
+static _Thread_local Arena thread_arena;
+
+Arena *request_arena() {
+    return &thread_arena;
+}
+
+// client_data slab: one block of preallocated objects recycled through a lock-free ring
+static struct client_data *client_data_slab = NULL;  // Backing block for the recycled objects
+static TaskQueue client_data_free_list;  // Slab objects that are not in use
+static pthread_once_t client_data_slab_once = PTHREAD_ONCE_INIT;
+
+// Allocate the slab and put every object on the free list
+static void client_data_slab_init() {
+    client_data_slab = (struct client_data *)malloc(CLIENT_DATA_SLAB_SIZE * sizeof(struct client_data));
+    if (client_data_slab == NULL || task_queue_init(&client_data_free_list, CLIENT_DATA_SLAB_SIZE) != 0) {
+        perror("Memory allocation failed for client_data slab");
+        exit(EXIT_FAILURE);
+    }
+    memory_charge_fixed(MEMORY_BUFFERS, CLIENT_DATA_SLAB_SIZE * sizeof(struct client_data));
+    memory_charge_fixed(MEMORY_QUEUES, (client_data_free_list.mask + 1) * sizeof(TaskQueueCell));
+    for (int i = 0; i < CLIENT_DATA_SLAB_SIZE; i++) {
+        Task entry = { NULL, &client_data_slab[i] };
+        task_queue_push(&client_data_free_list, entry);
+    }
+}
+
+// Check whether an object belongs to the slab block
+static int in_client_data_slab(struct client_data *data) {
+    return data >= client_data_slab && data < client_data_slab + CLIENT_DATA_SLAB_SIZE;
+}
+
+// Take a client_data from the slab, falling back to malloc when every slab object is in flight
+struct client_data *client_data_acquire() {
+    pthread_once(&client_data_slab_once, client_data_slab_init);
+
+    Task entry;
+    if (task_queue_pop(&client_data_free_list, &entry)) {
+        return (struct client_data *)entry.argument;
+    }
+    if (memory_charge(MEMORY_BUFFERS, sizeof(struct client_data)) != 0) {
+        return NULL;  // Over the memory budget: the datagram is dropped
+    }
+    struct client_data *data = (struct client_data *)malloc(sizeof(struct client_data));
+    if (data == NULL) {
+        memory_release(MEMORY_BUFFERS, sizeof(struct client_data));
+    }
+    return data;
+}
+
+// Return a client_data to the slab (or to malloc if it was an overflow allocation)
+void client_data_release(struct client_data *data) {
+    if (data == NULL) {
+        return;
+    }
+    if (in_client_data_slab(data)) {
+        Task entry = { NULL, data };
+        task_queue_push(&client_data_free_list, entry);  // Ring holds the whole slab, so this cannot fail
+    } else {
+        free(data);
+        memory_release(MEMORY_BUFFERS, sizeof(struct client_data));
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>  // For size_t
+
+#define ARENA_CHUNK_SIZE (64 * 1024)  // Default chunk size; larger requests get a dedicated chunk
+#define ARENA_ALIGNMENT 16  // Every allocation is aligned for any scalar type
+
+// One block of arena memory; chunks are chained and kept across resets
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;  // Next chunk in the chain
+    size_t capacity;  // Usable bytes in data
+    size_t used;  // Bytes handed out from data since the last reset
+    _Alignas(ARENA_ALIGNMENT) unsigned char data[];  // Chunk payload
+} ArenaChunk;
+
+// Bump allocator for memory whose lifetime is a single request
+typedef struct {
+    ArenaChunk *first;  // Head of the chunk chain
+    ArenaChunk *current;  // Chunk allocations are currently served from
+    void *last;  // Most recent allocation, which arena_grow can extend in place
+} Arena;
+
+/**
+ * @brief Allocate size bytes from the arena; memory is released by arena_reset.
+ * @return Pointer to the memory, or NULL if a new chunk could not be allocated.
+ */
+void *arena_alloc(Arena *arena, size_t size);
+
+/**
+ * @brief Grow an allocation, in place when it is the arena's most recent one.
+ * @return Pointer to a block of new_size bytes holding the first old_size bytes of ptr.
+ */
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+/**
+ * @brief Release every allocation at once in O(1); chunks are kept for reuse.
+ */
+void arena_reset(Arena *arena);
+
+/**
+ * @brief Free all chunks of an arena.
+ */
+void arena_destroy(Arena *arena);
+
+/**
+ * @brief Arena owned by the calling thread, created on first use.
+ */
+Arena *request_arena();
+
+#endif // ARENA_H
@@ -0,0 +1,316 @@
+#include <stdio.h>   // For printf and snprintf
+#include <stdlib.h>  // For atoi
+#include <string.h>  // For strncmp, strchr and memcpy
+#include <unistd.h>  // For close
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>  // For the capture socket's receive timeout
+#endif
+
+#include "server.h"
+#include "arena.h"  // The combined reply lives in the request arena
+#include "fault.h"  // Replies pass through the fault injection layer
+
+// batch.c
+// "batch [atomic] <request>; <request>; ..." runs several requests in one datagram and one worker
+// pass and answers with a single combined reply. Each operation goes through handleRequest with
+// a per-worker capture socket as its client, so it is handled (and, in a partitioned deployment,
+// forwarded) exactly as if it had been sent on its own. With "atomic", the reservations and
+// baggage requests of the batch are applied all-or-nothing before any operation runs.
+
+#define BATCH_MAX_OPS 32  // Operations in one batch
+#define BATCH_OP_TIMEOUT_MS 1000  // How long to wait for one operation's reply
+#define BATCH_OP_REPLY_SIZE 65536  // Largest reply accepted from one operation
+#define BATCH_REPLY_SIZE 16384  // Largest combined reply
+
+static _Thread_local int capture_sockfd = -1;  // Per-worker socket that receives operation replies
+
+// Requests that may appear in a batch: each answers with exactly one datagram
+static const char *batchable[] = { "query_flight_id", "query_flight_info", "query_flight_window", "query_flight_filter",
+                                   "query_baggage_availability", "make_seat_reservation", "add_baggage" };
+
+// One operation of a batch
+typedef struct {
+    char *text;  // The request, terminated in place
+    int mutation;  // 1 for make_seat_reservation, 2 for add_baggage, 0 otherwise
+    int flight_id;  // Flight a mutation applies to
+    int amount;  // Seats or baggage a mutation takes
+    int remaining;  // Counter left after an atomic mutation
+    char reply[BUFFER_SIZE];  // Reply prepared by the atomic phase
+} BatchOp;
+
+// Open this worker's capture socket on an ephemeral port of the address the ops' replies are
+// sent to: the node's own address in a partitioned deployment, where an op may be forwarded to
+// another node that replies to it directly (as partition.c's forwarding socket does), otherwise
+// the request socket's address
+static int capture_socket(int sockfd, struct sockaddr_in *bound) {
+    socklen_t length = sizeof(*bound);
+    if (capture_sockfd < 0) {
+        struct sockaddr_in addr;
+        if (partition_self_address(&addr) != 0) {
+            getsockname(sockfd, (struct sockaddr *)&addr, &length);
+            if (addr.sin_addr.s_addr == htonl(INADDR_ANY)) {
+                addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  // Replies cannot be sent to the wildcard address
+            }
+        }
+        addr.sin_port = 0;
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            perror("Batch capture socket creation failed");
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+        struct timeval timeout = { BATCH_OP_TIMEOUT_MS / 1000, (BATCH_OP_TIMEOUT_MS % 1000) * 1000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        capture_sockfd = fd;
+        length = sizeof(*bound);
+    }
+    getsockname(capture_sockfd, (struct sockaddr *)bound, &length);
+    return capture_sockfd;
+}
+
+// Trim leading and trailing blanks in place
+static char *trim(char *text) {
+    while (*text == ' ' || *text == '\t' || *text == '\n' || *text == '\r') {
+        text++;
+    }
+    char *end = text + strlen(text);
+    while (end > text && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r')) {
+        *--end = '\0';
+    }
+    return text;
+}
+
+static int is_batchable(const char *request) {
+    for (size_t i = 0; i < sizeof(batchable) / sizeof(batchable[0]); i++) {
+        if (strncmp(request, batchable[i], strlen(batchable[i])) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Take (or, with a negative amount, give back) an operation's seats or baggage in the catalog
+static int adjust_op(BatchOp *op, int amount, int *remaining) {
+    return op->mutation == 1 ? update_flight_seats(op->flight_id, amount, remaining)
+                             : update_flight_baggage(op->flight_id, amount, remaining);
+}
+
+// Same for the database
+static int persist_op(BatchOp *op, int amount) {
+    return op->mutation == 1 ? update_seats(op->flight_id, amount) : update_baggage(op->flight_id, amount);
+}
+
+// Apply every mutation of an atomic batch or none of them. Returns -1 on success, otherwise
+// the index of the operation that failed, with its reason written to its reply.
+static int apply_atomically(BatchOp *ops, int count) {
+    int failed = -1;
+    int admitted = 0, persisted = 0;
+
+    // Admit against the catalog first, in order; a refusal hands back what was taken
+    for (; admitted < count; admitted++) {
+        BatchOp *op = &ops[admitted];
+        if (!op->mutation) {
+            continue;
+        }
+        int status = -2;
+        if (replication_is_read_only()) {
+            snprintf(op->reply, sizeof(op->reply), "Read-only replica: send reservations and baggage requests to the primary.\n");
+        } else if (!partition_owns(op->flight_id)) {
+            snprintf(op->reply, sizeof(op->reply), "Flight %d is served by another node; it cannot join an atomic batch.\n", op->flight_id);
+        } else if ((status = op->amount > 0 ? adjust_op(op, op->amount, &op->remaining) : -2) == 1) {
+            continue;
+        } else if (status == 0) {
+            strcpy(op->reply, "Flight not found.\n");
+        } else if (status == -2) {
+            strcpy(op->reply, op->mutation == 1 ? "Reservation failed: Invalid number of seats.\n"
+                                                : "Baggage reservation failed: Invalid number of baggages.\n");
+        } else {
+            strcpy(op->reply, op->mutation == 1 ? "Reservation failed: Not enough seats available.\n"
+                                                : "Baggage reservation failed: Not enough space for baggage.\n");
+        }
+        failed = admitted;
+        break;
+    }
+
+    // Then persist, outside any lock; a database refusal undoes the rows already written
+    for (; failed < 0 && persisted < count; persisted++) {
+        if (ops[persisted].mutation && persist_op(&ops[persisted], ops[persisted].amount) != 1) {
+            strcpy(ops[persisted].reply, "Database update failed.\n");
+            failed = persisted;
+            break;
+        }
+    }
+
+    if (failed >= 0) {
+        for (int i = 0; i < persisted; i++) {
+            if (ops[i].mutation) {
+                persist_op(&ops[i], -ops[i].amount);
+            }
+        }
+        for (int i = 0; i < admitted; i++) {
+            if (ops[i].mutation) {
+                adjust_op(&ops[i], -ops[i].amount, NULL);
+            }
+        }
+        return failed;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (ops[i].mutation == 1) {
+            snprintf(ops[i].reply, sizeof(ops[i].reply), "Reservation confirmed for Flight ID: %d\nSeats remaining: %d\n",
+                     ops[i].flight_id, ops[i].remaining);
+        } else if (ops[i].mutation == 2) {
+            snprintf(ops[i].reply, sizeof(ops[i].reply),
+                     "Baggage reservation confirmed for Flight ID: %d\nBaggage space remaining: %d\n",
+                     ops[i].flight_id, ops[i].remaining);
+        }
+    }
+    return -1;
+}
+
+// Run one request through the normal request path and capture its reply
+ssize_t run_captured_request(int sockfd, char *request, MYSQL *conn, char *reply, size_t size) {
+    struct sockaddr_in capture_addr;
+    int capture_fd = capture_socket(sockfd, &capture_addr);
+    if (capture_fd < 0) {
+        return -1;
+    }
+    while (recv(capture_fd, reply, size, MSG_DONTWAIT) >= 0) {
+        // Discard a late reply to an earlier request that timed out
+    }
+    int wait_inline = db_wait_inline, suppressed = history_suppressed;  // Restored for a caller that is itself captured
+    db_wait_inline = 1;  // The reply must be on the capture socket before this returns
+    history_suppressed = 1;  // The caller keeps or forwards the reply; the history is for clients' requests
+    handleRequest(request, capture_addr, capture_fd, sizeof(capture_addr), conn);
+    db_wait_inline = wait_inline;
+    history_suppressed = suppressed;
+    ssize_t received = recv(capture_fd, reply, size - 1, 0);
+    if (received < 0) {
+        return snprintf(reply, size, "No reply within %d ms.\n", BATCH_OP_TIMEOUT_MS);
+    }
+    reply[received] = '\0';
+    return received;
+}
+
+// Record the batch's reply in the request history and send it: a retransmitted batch, atomic
+// or not, gets the reply it was first given rather than running its operations again
+static void send_batch_reply(int sockfd, struct sockaddr_in *client_addr, const char *request, const char *reply, size_t length) {
+    ReplyVec vec;
+    reply_vec_set(&vec, reply, length);
+    store_in_history_vec(client_addr, request, &vec, 1);
+    fault_sendto(sockfd, reply, length, 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+}
+
+// Function to handle batch requests
+void handle_batch(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn) {
+    Arena *arena = request_arena();
+    size_t request_len = strlen(request);
+    char *response = (char *)arena_alloc(arena, BATCH_REPLY_SIZE);
+    char *reply = (char *)arena_alloc(arena, BATCH_OP_REPLY_SIZE);
+    BatchOp *ops = (BatchOp *)arena_alloc(arena, BATCH_MAX_OPS * sizeof(BatchOp));
+    char *list = (char *)arena_alloc(arena, request_len + 1);  // Split copy: the request stays whole as the history key
+    if (response == NULL || reply == NULL || ops == NULL || list == NULL) {
+        const char *error = "Batch failed: out of memory.\n";
+        fault_sendto(sockfd, error, strlen(error), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+        return;
+    }
+
+    // Split "batch [atomic] op; op; ..." into operations, in the copy
+    memcpy(list, request, request_len + 1);
+    list += 5;
+    int atomic = 0;
+    while (*list == ' ') {
+        list++;
+    }
+    if (strncmp(list, "atomic", 6) == 0 && (list[6] == ' ' || list[6] == '\0')) {
+        atomic = 1;
+        list += 6;
+    }
+    int count = 0;
+    const char *error = NULL;
+    while (list != NULL && error == NULL) {
+        char *separator = strchr(list, ';');
+        if (separator != NULL) {
+            *separator = '\0';
+        }
+        char *text = trim(list);
+        list = separator ? separator + 1 : NULL;
+        if (*text == '\0') {
+            continue;
+        }
+        if (count == BATCH_MAX_OPS) {
+            error = "Batch failed: too many operations.\n";
+        } else if (!is_batchable(text)) {
+            error = "Batch failed: only queries, reservations and baggage requests can be batched.\n";
+        } else {
+            BatchOp *op = &ops[count++];
+            op->text = text;
+            op->mutation = strncmp(text, "make_seat_reservation", 21) == 0 ? 1 : strncmp(text, "add_baggage", 11) == 0 ? 2 : 0;
+            op->flight_id = op->amount = 0;
+            op->reply[0] = '\0';
+            if (op->mutation) {
+                sscanf(text + (op->mutation == 1 ? 21 : 11), "%d %d", &op->flight_id, &op->amount);
+            }
+        }
+    }
+    if (error == NULL && count == 0) {
+        error = "Usage: batch [atomic] <request>; <request>; ...\n";
+    }
+    if (error != NULL) {
+        send_batch_reply(sockfd, client_addr, request, error, strlen(error));
+        return;
+    }
+    printf("Received batch of %d operations%s\n", count, atomic ? " (atomic)" : "");
+
+    size_t used = 0;
+    if (atomic) {
+        int failed = apply_atomically(ops, count);
+        if (failed >= 0) {
+            used = snprintf(response, BATCH_REPLY_SIZE, "Batch of %d operations: none applied.\n[%d] %s\n%s", count,
+                            failed + 1, ops[failed].text, ops[failed].reply);
+            send_batch_reply(sockfd, client_addr, request, response, used < BATCH_REPLY_SIZE ? used : BATCH_REPLY_SIZE - 1);
+            return;
+        }
+    }
+
+    // Run the operations in order and append each reply under its header
+    used = snprintf(response, BATCH_REPLY_SIZE, "Batch of %d operations%s:\n", count, atomic ? ", all reservations applied" : "");
+    for (int i = 0; i < count; i++) {
+        const char *text = reply;
+        ssize_t length;
+        if (atomic && ops[i].mutation) {
+            text = ops[i].reply;  // Already applied above
+            length = strlen(text);
+        } else {
+            length = run_captured_request(sockfd, ops[i].text, conn, reply, BATCH_OP_REPLY_SIZE);
+        }
+        if (length < 0) {
+            error = "Batch failed: could not run operations.\n";
+            send_batch_reply(sockfd, client_addr, request, error, strlen(error));
+            return;
+        }
+        int header = snprintf(response + used, BATCH_REPLY_SIZE - used, "[%d] %s\n", i + 1, ops[i].text);
+        if (header < 0 || used + header + length >= BATCH_REPLY_SIZE) {
+            used += snprintf(response + used, BATCH_REPLY_SIZE - used, "[%d] Reply truncated: batch reply is full.\n", i + 1);
+            break;
+        }
+        used += header;
+        memcpy(response + used, text, length);
+        used += length;
+        if (length > 0 && text[length - 1] != '\n') {
+            response[used++] = '\n';
+        }
+    }
+    if (used >= BATCH_REPLY_SIZE) {
+        used = BATCH_REPLY_SIZE - 1;
+    }
+
+    send_batch_reply(sockfd, client_addr, request, response, used);
+    printf("Response sent to client.\n");
+}
@@ -0,0 +1,164 @@
+// bench_catalog_reads.c
+// Reader scaling under heavy booking: N threads look up random flights with get_flight
+// (epoch snapshot + seqlock, no locks) while two writer threads keep taking and returning
+// seats. For comparison the same lookups are run through the locked path the catalog used
+// before: catalog_lock shared plus the flight's lock stripe.
+//
+//   gcc -O2 -I<mariadb include> bench_catalog_reads.c data_storage.c route_index.c flight_locks.c epoch.c fragments.c memory_budget.c -o bench_catalog_reads -lpthread
+//   ./bench_catalog_reads [flights] [lookups_per_thread]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "server.h"
+
+#define DEFAULT_FLIGHTS 100000  // Catalog size
+#define DEFAULT_LOOKUPS 1000000  // Lookups per reader thread
+#define WRITER_THREADS 2  // Threads booking and releasing seats throughout the run
+
+// The catalog reports its changes to replication and to follow_flight_id subscribers, and
+// renders reply fragments with the server's month names; none of that is linked in here
+const char *months[] = {
+    "January", "February", "March", "April", "May", "June",
+    "July", "August", "September", "October", "November", "December"
+};
+
+void replication_record_counters(int flight_id, int seats, int baggage) {
+    (void)flight_id;
+    (void)seats;
+    (void)baggage;
+}
+
+void replication_record_flight(int flight_id, int source_id, int destination_id, uint64_t departure, float airfare, int seats, int baggage) {
+    (void)flight_id;
+    (void)source_id;
+    (void)destination_id;
+    (void)departure;
+    (void)airfare;
+    (void)seats;
+    (void)baggage;
+}
+
+void notify_flight_changed(int flight_id) {
+    (void)flight_id;
+}
+
+static int flight_count = DEFAULT_FLIGHTS;
+static long lookups_per_thread = DEFAULT_LOOKUPS;
+static atomic_int stop_writers;
+static pthread_barrier_t start_barrier;
+
+// Cheap per-thread pseudo-random flight ids
+static unsigned next_random(unsigned *state) {
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+// The pre-snapshot read path: shared catalog lock, then the flight's stripe for the counters
+static int locked_get_flight(int flight_id, Flight *out) {
+    pthread_rwlock_rdlock(&catalog_lock);
+    int slot = find_flight_slot(flight_id);
+    if (slot >= 0) {
+        out->flight_id = catalog.flight_id[slot];
+        out->airfare = catalog.airfare[slot];
+        flight_lock(flight_id);
+        out->seat_availability = catalog.seat_availability[slot];
+        out->baggage_availability = catalog.baggage_availability[slot];
+        flight_unlock(flight_id);
+    }
+    pthread_rwlock_unlock(&catalog_lock);
+    return slot >= 0;
+}
+
+static void *snapshot_reader(void *arg) {
+    unsigned state = (unsigned)(size_t)arg;
+    Flight flight;
+    long found = 0;
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; i < lookups_per_thread; i++) {
+        found += get_flight(next_random(&state) % flight_count, &flight);
+    }
+    return (void *)found;
+}
+
+static void *locked_reader(void *arg) {
+    unsigned state = (unsigned)(size_t)arg;
+    Flight flight;
+    long found = 0;
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; i < lookups_per_thread; i++) {
+        found += locked_get_flight(next_random(&state) % flight_count, &flight);
+    }
+    return (void *)found;
+}
+
+static void *writer(void *arg) {
+    unsigned state = (unsigned)(size_t)arg;
+    while (!atomic_load(&stop_writers)) {
+        int flight_id = next_random(&state) % flight_count;
+        update_flight_seats(flight_id, 1, NULL);
+        update_flight_seats(flight_id, -1, NULL);
+    }
+    return NULL;
+}
+
+// Monotonic clock in seconds
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run one configuration and return lookups per second, in millions
+static double run(void *(*reader)(void *), int num_readers) {
+    pthread_t readers[64], writers[WRITER_THREADS];
+    pthread_barrier_init(&start_barrier, NULL, num_readers + 1);
+    atomic_store(&stop_writers, 0);
+    for (int i = 0; i < WRITER_THREADS; i++) {
+        pthread_create(&writers[i], NULL, writer, (void *)(size_t)(i + 1000));
+    }
+    for (int i = 0; i < num_readers; i++) {
+        pthread_create(&readers[i], NULL, reader, (void *)(size_t)(i + 1));
+    }
+
+    double start = now_seconds();
+    pthread_barrier_wait(&start_barrier);
+    for (int i = 0; i < num_readers; i++) {
+        pthread_join(readers[i], NULL);
+    }
+    double elapsed = now_seconds() - start;
+
+    atomic_store(&stop_writers, 1);
+    for (int i = 0; i < WRITER_THREADS; i++) {
+        pthread_join(writers[i], NULL);
+    }
+    pthread_barrier_destroy(&start_barrier);
+    return (double)lookups_per_thread * num_readers / elapsed / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        flight_count = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        lookups_per_thread = atol(argv[2]);
+    }
+
+    initialize_flights(1024);
+    DepartureTime departure = { 2024, 1, 1, 8, 0 };
+    for (int i = 0; i < flight_count; i++) {
+        add_flight(i, "Singapore", "Tokyo", departure, 300.0f, 1000, 1000);
+    }
+
+    printf("%-8s %16s %16s %8s\n", "readers", "locked Mreads/s", "snapshot Mreads/s", "speedup");
+    for (int num_readers = 1; num_readers <= 64; num_readers *= 2) {
+        double locked_rate = run(locked_reader, num_readers);
+        double snapshot_rate = run(snapshot_reader, num_readers);
+        printf("%-8d %16.2f %16.2f %7.2fx\n", num_readers, locked_rate, snapshot_rate, snapshot_rate / locked_rate);
+    }
+
+    cleanup_flights();
+    return 0;
+}
@@ -0,0 +1,103 @@
+// bench_filter_scan.c
+// Scan-rate benchmark for the multi-criteria flight filter: the vectorised filter_scan
+// against a plain scalar loop over the same catalog-shaped columns.
+//
+//   gcc -O2 bench_filter_scan.c filter_scan.c -o bench_filter_scan
+//   ./bench_filter_scan [num_flights]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "filter_scan.h"
+
+#define DEFAULT_FLIGHTS 10000000  // Flights in the synthetic catalog
+#define ROUNDS 20  // Full scans per measurement
+
+// Monotonic clock in seconds
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Plain loop with no bitmap or blocking, the way an ad-hoc scan would be written
+static size_t naive_scan(const int32_t *seats, const float *airfare, const int32_t *baggage, size_t count,
+                         int32_t min_seats, float max_fare, int32_t min_baggage) {
+    size_t matches = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (seats[i] >= min_seats && airfare[i] <= max_fare && baggage[i] >= min_baggage) {
+            matches++;
+        }
+    }
+    return matches;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = argc > 1 ? (size_t)atol(argv[1]) : DEFAULT_FLIGHTS;
+
+    // Columns shaped like the catalog: same value ranges as database_insert.sql
+    int32_t *seats = malloc(count * sizeof(int32_t));
+    float *airfare = malloc(count * sizeof(float));
+    int32_t *baggage = malloc(count * sizeof(int32_t));
+    uint64_t *bitmap = malloc((count / FILTER_BLOCK + 1) * sizeof(uint64_t));
+    size_t words;  // Bitmap words written by the last scan
+    if (!seats || !airfare || !baggage || !bitmap) {
+        perror("Failed to allocate columns");
+        return EXIT_FAILURE;
+    }
+    srand(6103);
+    for (size_t i = 0; i < count; i++) {
+        seats[i] = 50 + rand() % 100;
+        airfare[i] = (float)(200 + rand() % 1000);
+        baggage[i] = 20 + rand() % 50;
+    }
+
+    int32_t min_seats = 100, min_baggage = 40;  // About 15% of flights match
+    float max_fare = 700.0f;
+
+    double start = now_seconds();
+    size_t naive_matches = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        naive_matches = naive_scan(seats, airfare, baggage, count, min_seats, max_fare, min_baggage);
+    }
+    double naive_time = now_seconds() - start;
+
+    start = now_seconds();
+    size_t scalar_matches = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        scalar_matches = filter_scan_scalar(seats, airfare, baggage, count, min_seats, max_fare, min_baggage, bitmap, (size_t)-1, &words);
+    }
+    double scalar_time = now_seconds() - start;
+
+    start = now_seconds();
+    size_t simd_matches = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        simd_matches = filter_scan(seats, airfare, baggage, count, min_seats, max_fare, min_baggage, bitmap, (size_t)-1, &words);
+    }
+    double simd_time = now_seconds() - start;
+
+    start = now_seconds();
+    for (int r = 0; r < ROUNDS; r++) {
+        filter_scan(seats, airfare, baggage, count, min_seats, max_fare, min_baggage, bitmap, 50, &words);
+    }
+    double limited_time = now_seconds() - start;
+
+    if (naive_matches != scalar_matches || scalar_matches != simd_matches) {
+        printf("Mismatch: naive=%zu scalar=%zu simd=%zu\n", naive_matches, scalar_matches, simd_matches);
+        return EXIT_FAILURE;
+    }
+
+    double scanned = (double)count * ROUNDS;
+    printf("flights: %zu, matches: %zu, filter_scan uses %s\n", count, simd_matches, filter_scan_isa());
+    printf("%-22s %14.1f Mflights/s\n", "scalar loop", scanned / naive_time / 1e6);
+    printf("%-22s %14.1f Mflights/s\n", "scalar bitmap", scanned / scalar_time / 1e6);
+    printf("%-22s %14.1f Mflights/s (%.2fx scalar loop)\n", "vectorised bitmap", scanned / simd_time / 1e6, naive_time / simd_time);
+    printf("%-22s %14.2f us per query\n", "vectorised, limit 50", limited_time / ROUNDS * 1e6);
+
+    free(seats);
+    free(airfare);
+    free(baggage);
+    free(bitmap);
+    return 0;
+}
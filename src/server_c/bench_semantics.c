@@ -0,0 +1,195 @@
+// bench_semantics.c
+// What an invocation semantics costs on a lossy network. Client threads issue requests with
+// the usual retry-on-timeout loop against a server started with --fault-* options; the bench
+// reports goodput (operations completed per second), retries and latency including retries,
+// then the server-side effect from query_server_stats: how many requests were executed, how
+// many of those re-executed a duplicate, and how many were answered from the reply cache.
+// Run it once against an at-least-once and once against an at-most-once server to compare.
+//
+// Every operation appends a unique tag to the request text ("query_flight_info 101 7-42") so
+// that distinct operations are distinct requests to the at-most-once history; the handlers
+// ignore trailing fields. Replies carry no request id, so a late reply to an earlier attempt
+// is taken as the answer, as the real client would.
+//
+//   gcc -O2 bench_semantics.c -o bench_semantics -lpthread
+//   ./server at-most-once --port 8080 --fault-drop 0.1 --fault-delay 0.05 --fault-seed 7
+//   ./bench_semantics [--clients N] [--ops N] [--timeout MS] [--retries N] [--request TEXT] 127.0.0.1:8080
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#define DEFAULT_CLIENTS 4  // Concurrent client threads
+#define DEFAULT_OPS 500  // Operations per client
+#define DEFAULT_TIMEOUT_MS 100  // Wait for a reply before retrying
+#define DEFAULT_RETRIES 10  // Retries before an operation is given up
+#define REPLY_SIZE 65536
+
+static struct sockaddr_in server_addr;
+static int clients = DEFAULT_CLIENTS, ops = DEFAULT_OPS, timeout_ms = DEFAULT_TIMEOUT_MS, retries = DEFAULT_RETRIES;
+static const char *request_text = "query_flight_info 101";
+
+// What one client thread saw
+typedef struct {
+    int index;
+    long completed, failed, retries;
+    double *latency_ms;  // One per completed operation
+} ClientResult;
+
+// Server-side request counters, from the Requests line of query_server_stats
+typedef struct {
+    unsigned long long handled, executed, reexecuted, cache_hits;
+} ServerCounters;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// A UDP socket to the server with a receive timeout
+static int open_client_socket(int wait_ms) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct timeval tv = { wait_ms / 1000, (wait_ms % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    connect(fd, (struct sockaddr *)&server_addr, sizeof(server_addr));
+    return fd;
+}
+
+static void *run_client(void *arg) {
+    ClientResult *result = (ClientResult *)arg;
+    int fd = open_client_socket(timeout_ms);
+    char request[1024], reply[REPLY_SIZE];
+    for (int op = 0; op < ops; op++) {
+        int length = snprintf(request, sizeof(request), "%s %d-%d", request_text, result->index, op);
+        double start = now_ms();
+        int done = 0;
+        for (int attempt = 0; attempt <= retries && !done; attempt++) {
+            if (attempt > 0) {
+                result->retries++;
+            }
+            send(fd, request, length, 0);
+            done = recv(fd, reply, sizeof(reply), 0) >= 0;
+        }
+        if (done) {
+            result->latency_ms[result->completed++] = now_ms() - start;
+        } else {
+            result->failed++;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+// Fetch the server's request counters; stats replies can themselves be dropped, so retry
+static int read_server_counters(ServerCounters *counters) {
+    int fd = open_client_socket(500);
+    char reply[REPLY_SIZE];
+    for (int attempt = 0; attempt < 20; attempt++) {
+        send(fd, "query_server_stats", 18, 0);
+        ssize_t n = recv(fd, reply, sizeof(reply) - 1, 0);
+        if (n < 0) {
+            continue;
+        }
+        reply[n] = '\0';
+        const char *line = strstr(reply, "Requests: ");
+        if (line != NULL && sscanf(line, "Requests: %llu handled, %llu executed, %llu re-executed duplicates, %llu reply-cache hits",
+                                   &counters->handled, &counters->executed, &counters->reexecuted, &counters->cache_hits) == 4) {
+            close(fd);
+            return 0;
+        }
+    }
+    close(fd);
+    return -1;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[]) {
+    const char *target = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+            clients = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            ops = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            timeout_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--retries") == 0 && i + 1 < argc) {
+            retries = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--request") == 0 && i + 1 < argc) {
+            request_text = argv[++i];
+        } else {
+            target = argv[i];
+        }
+    }
+    char host[64];
+    int port = 0;
+    if (target == NULL || sscanf(target, "%63[^:]:%d", host, &port) != 2 || clients < 1 || ops < 1 || timeout_ms < 1) {
+        fprintf(stderr, "Usage: %s [--clients N] [--ops N] [--timeout MS] [--retries N] [--request TEXT] HOST:PORT\n", argv[0]);
+        return 1;
+    }
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &server_addr.sin_addr) != 1) {
+        fprintf(stderr, "Invalid server address: %s\n", target);
+        return 1;
+    }
+
+    ServerCounters before = {0}, after = {0};
+    int have_counters = read_server_counters(&before) == 0;
+
+    pthread_t *threads = malloc(clients * sizeof(pthread_t));
+    ClientResult *results = calloc(clients, sizeof(ClientResult));
+    double start = now_ms();
+    for (int i = 0; i < clients; i++) {
+        results[i].index = i;
+        results[i].latency_ms = malloc(ops * sizeof(double));
+        pthread_create(&threads[i], NULL, run_client, &results[i]);
+    }
+    for (int i = 0; i < clients; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double seconds = (now_ms() - start) / 1e3;
+    have_counters = have_counters && read_server_counters(&after) == 0;
+
+    // Merge the per-client results
+    long completed = 0, failed = 0, retried = 0;
+    double *latencies = malloc((size_t)clients * ops * sizeof(double));
+    for (int i = 0; i < clients; i++) {
+        memcpy(latencies + completed, results[i].latency_ms, results[i].completed * sizeof(double));
+        completed += results[i].completed;
+        failed += results[i].failed;
+        retried += results[i].retries;
+    }
+    qsort(latencies, completed, sizeof(double), compare_double);
+
+    printf("Operations: %ld completed, %ld failed, %ld retries in %.2f s\n", completed, failed, retried, seconds);
+    printf("Goodput:    %.0f ops/s\n", completed / seconds);
+    if (completed > 0) {
+        printf("Latency:    p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+               latencies[completed / 2], latencies[(long)(completed * 0.9)],
+               latencies[(long)(completed * 0.99)], latencies[completed - 1]);
+    }
+    if (have_counters) {
+        // The two stats queries are counted too
+        unsigned long long handled = after.handled - before.handled - 1;
+        unsigned long long hits = after.cache_hits - before.cache_hits;
+        printf("Server:     %llu requests handled, %llu executed, %llu re-executed duplicates, %llu reply-cache hits (%.1f%%)\n",
+               handled, after.executed - before.executed - 1, after.reexecuted - before.reexecuted, hits,
+               handled ? 100.0 * hits / handled : 0.0);
+    } else {
+        printf("Server:     counters unavailable\n");
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+// bench_task_queue.c
+// Contention benchmark: lock-free MPMC TaskQueue vs. the mutex/condvar circular queue
+// the thread pool used before. Every thread repeatedly enqueues one task and dequeues one,
+// so all threads hammer both ends of the shared queue.
+//
+//   gcc -O2 bench_task_queue.c task_queue.c -o bench_task_queue -lpthread
+//   ./bench_task_queue [ops_per_thread]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>
+#include "task_queue.h"
+
+#define QUEUE_CAPACITY 1024  // Same order of magnitude as the pool's queues
+#define DEFAULT_OPS 200000  // Enqueue/dequeue pairs per thread
+
+// The previous thread-pool queue: circular Task array, one mutex, one condition variable
+typedef struct {
+    Task *task_queue;
+    int queue_size;
+    int queue_front;
+    int queue_rear;
+    int queue_capacity;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} MutexQueue;
+
+static MutexQueue mutex_queue;
+static TaskQueue lockfree_queue;
+static pthread_barrier_t start_barrier;
+static long ops_per_thread = DEFAULT_OPS;
+
+// Enqueue into the mutex queue, signalling one waiter
+static void mutex_queue_push(Task task) {
+    pthread_mutex_lock(&mutex_queue.mutex);
+    while (mutex_queue.queue_size == mutex_queue.queue_capacity) {
+        pthread_mutex_unlock(&mutex_queue.mutex);  // Full: let a consumer in
+        pthread_mutex_lock(&mutex_queue.mutex);
+    }
+    mutex_queue.task_queue[mutex_queue.queue_rear] = task;
+    mutex_queue.queue_rear = (mutex_queue.queue_rear + 1) % mutex_queue.queue_capacity;
+    mutex_queue.queue_size++;
+    pthread_cond_signal(&mutex_queue.cond);
+    pthread_mutex_unlock(&mutex_queue.mutex);
+}
+
+// Dequeue from the mutex queue, waiting on the condition variable while it is empty
+static Task mutex_queue_pop() {
+    pthread_mutex_lock(&mutex_queue.mutex);
+    while (mutex_queue.queue_size == 0) {
+        pthread_cond_wait(&mutex_queue.cond, &mutex_queue.mutex);
+    }
+    Task task = mutex_queue.task_queue[mutex_queue.queue_front];
+    mutex_queue.queue_front = (mutex_queue.queue_front + 1) % mutex_queue.queue_capacity;
+    mutex_queue.queue_size--;
+    pthread_mutex_unlock(&mutex_queue.mutex);
+    return task;
+}
+
+// Worker body for the mutex queue
+static void *mutex_worker(void *arg) {
+    Task task = { NULL, arg };
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; i < ops_per_thread; i++) {
+        mutex_queue_push(task);
+        task = mutex_queue_pop();
+    }
+    return NULL;
+}
+
+// Worker body for the lock-free queue
+static void *lockfree_worker(void *arg) {
+    Task task = { NULL, arg };
+    pthread_barrier_wait(&start_barrier);
+    for (long i = 0; i < ops_per_thread; i++) {
+        while (task_queue_push(&lockfree_queue, task) != 0) {
+            sched_yield();  // Full: give consumers the CPU when threads outnumber cores
+        }
+        while (!task_queue_pop(&lockfree_queue, &task)) {
+            sched_yield();  // Empty: same, for producers
+        }
+    }
+    return NULL;
+}
+
+// Monotonic clock in seconds
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run one configuration and return throughput in million operations per second
+static double run(void *(*worker)(void *), int num_threads) {
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+
+    for (int i = 0; i < num_threads; i++) {
+        pthread_create(&threads[i], NULL, worker, NULL);
+    }
+    double start = now_seconds();
+    pthread_barrier_wait(&start_barrier);  // Release all threads at once
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = now_seconds() - start;
+
+    pthread_barrier_destroy(&start_barrier);
+    free(threads);
+    return (2.0 * ops_per_thread * num_threads) / elapsed / 1e6;  // One push plus one pop per iteration
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        ops_per_thread = atol(argv[1]);
+    }
+
+    mutex_queue.task_queue = malloc(QUEUE_CAPACITY * sizeof(Task));
+    mutex_queue.queue_capacity = QUEUE_CAPACITY;
+    pthread_mutex_init(&mutex_queue.mutex, NULL);
+    pthread_cond_init(&mutex_queue.cond, NULL);
+    if (mutex_queue.task_queue == NULL || task_queue_init(&lockfree_queue, QUEUE_CAPACITY) != 0) {
+        perror("Failed to allocate queues");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-8s %16s %16s %8s\n", "threads", "mutex Mops/s", "lock-free Mops/s", "speedup");
+    for (int num_threads = 1; num_threads <= 64; num_threads *= 2) {
+        double mutex_rate = run(mutex_worker, num_threads);
+        double lockfree_rate = run(lockfree_worker, num_threads);
+        printf("%-8d %16.2f %16.2f %7.2fx\n", num_threads, mutex_rate, lockfree_rate, lockfree_rate / mutex_rate);
+    }
+
+    task_queue_destroy(&lockfree_queue);
+    free(mutex_queue.task_queue);
+    return 0;
+}
@@ -1,7 +1,11 @@
+#define _GNU_SOURCE  // For sendmmsg and struct mmsghdr
 #include <stdint.h> // Add this header to define uint8_t and uint32_t
 #include <stdio.h>  // Standard input-output for printf and snprintf
 #include <string.h> // For string manipulation functions like strncpy
 #include <unistd.h> // For sleep function
+#include <stdlib.h> // For atoi
+#include <stdatomic.h> // Subscriber count read by writers without the lock
+#include <time.h>   // For clock_gettime and the notifier's timed waits
 
 #ifdef _WIN32
 #include <winsock2.h>  // Windows-specific socket library
@@ -17,142 +21,467 @@
 
 #include <pthread.h>  // For pthread functions to enable multithreading
 #include "server.h"   // Custom header file that contains project-specific declarations
+#include "timer.h"    // Subscription leases
+#include "fault.h"    // Registration replies pass through the fault injection layer
+#include "affinity.h"  // The notifier starts on the CPUs given by --cpu-notifier
+#include "memory_budget.h"  // The subscription tables are charged as subscriptions
 
 // callback_handler.c
+// Seat availability updates for follow_flight_id subscribers. Catalog writers only mark a flight
+// dirty; one notifier thread waits NOTIFY_COALESCE_MS so a burst of bookings collapses into the
+// latest value, renders each flight's update once, and sends it to every subscriber with
+// sendmmsg. A subscriber is sent at most one update per NOTIFY_MIN_INTERVAL_MS; changes in
+// between are held back and it receives the latest value when its interval is up. Every
+// subscription is a lease on the timer wheel; following the flight again renews it.
 
 #define BUFFER_SIZE 1024  // Define the size of the buffer for data communication
+#define MAX_MONITORS 1024  // Subscribers at once
+#define FLIGHT_TABLE_SIZE 2048  // Followed-flight table (power of two, at least twice MAX_MONITORS)
+#define NOTIFY_COALESCE_MS 20  // Changes within this window are merged into one update
+#define NOTIFY_MIN_INTERVAL_MS 250  // Per-subscriber rate cap: at most one update per interval
+#define NOTIFY_BATCH 64  // Notifications per sendmmsg call
+#define NOTIFY_TEXT_SIZE 64  // Rendered update size
+#define MONITOR_DEFAULT_LEASE_S 600  // Lease when follow_flight_id gives no monitor interval
+#define MONITOR_MAX_LEASE_S 86400  // Longest lease a client may ask for
 
 // Structure for monitoring registered clients
 typedef struct
 {
     struct sockaddr_in client_addr;  // Store client's address (IP, port)
     int flight_id;                   // Flight ID the client is monitoring
-    int seat_availability;           // Current seat availability on the flight
+    int seat_availability;           // Seat availability last sent to the client (-1 before the first update)
+    uint64_t last_sent_ms;           // When the client was last sent an update
+    uint64_t lease_expires_ms;       // When the subscription ends unless renewed
+    Timer lease;                     // Fires at lease_expires_ms
+    int in_use;                      // 0 once the lease has expired and the entry can be reused
 } ClientMonitor;
 
-ClientMonitor client_monitors[100];  // Array to store up to 100 monitored clients
-int client_monitor_count = 0;        // Number of clients currently being monitored
+// A flight with at least one subscriber; entries are reused but never emptied, so probes stay valid
+typedef struct
+{
+    int flight_id;    // Followed flight, or FLIGHT_FREE
+    int subscribers;  // Subscribers following it (0 lets the entry be reused)
+    int dirty;        // Changed since the notifier last rendered it
+    int deferred;     // A rate-capped subscriber still owes an update
+    int rendered;     // Index into the notifier's rendered updates for the current pass, -1 if none
+} FollowedFlight;
+
+#define FLIGHT_FREE INT32_MIN  // flight_id of a never-used table entry
+
+static ClientMonitor client_monitors[MAX_MONITORS];  // Array to store the monitored clients
+static int client_monitor_count = 0;  // Entries in use or reusable (entries never move: their lease timers point at them)
+static _Atomic int followed_count = 0;  // Subscriptions in use, read by writers without the lock
+static FollowedFlight followed[FLIGHT_TABLE_SIZE];
+static int dirty_list[FLIGHT_TABLE_SIZE];  // Table entries marked dirty, in order
+static int dirty_count = 0;
+static uint64_t next_deferred_ms = 0;  // Earliest time a held-back update may be sent (0 if none)
+static int notifier_sockfd = -1;  // Socket updates are sent from
+
+// Notifier counters reported by query_server_stats
+static uint64_t changes_coalesced = 0, updates_held = 0;  // Guarded by monitor_mutex
+static _Atomic uint64_t updates_sent = 0, send_calls = 0;  // Written by the notifier outside the lock
 
-extern pthread_mutex_t flight_mutex; // Mutex for ensuring thread safety while accessing shared data
+// Guards the subscriber list, the followed-flight table and the dirty list; never held across I/O
+static pthread_mutex_t monitor_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t monitor_cond;  // Signalled when a flight becomes dirty (monotonic clock)
+
+/**
+ * @brief Find a flight's entry in the followed-flight table (caller holds monitor_mutex).
+ * @param create Whether to claim an entry if the flight has none.
+ * @return Index of the entry, or -1.
+ */
+static int followed_slot(int flight_id, int create)
+{
+    uint32_t bucket = ((uint32_t)flight_id * 0x9E3779B1u) >> 21;  // 11 bits: FLIGHT_TABLE_SIZE buckets
+    int reusable = -1;
+    for (int probe = 0; probe < FLIGHT_TABLE_SIZE; probe++)
+    {
+        int i = (bucket + probe) & (FLIGHT_TABLE_SIZE - 1);
+        if (followed[i].flight_id == flight_id)
+        {
+            return i;
+        }
+        if (reusable < 0 && followed[i].subscribers == 0 && !followed[i].dirty && !followed[i].deferred)
+        {
+            reusable = i;  // An idle entry can take the flight if it is not further along
+        }
+        if (followed[i].flight_id == FLIGHT_FREE)
+        {
+            break;
+        }
+    }
+    if (!create || reusable < 0)
+    {
+        return -1;
+    }
+    followed[reusable].flight_id = flight_id;
+    followed[reusable].rendered = -1;
+    return reusable;
+}
+
+// Queue a table entry for the notifier (caller holds monitor_mutex)
+static void mark_dirty(int slot)
+{
+    if (followed[slot].dirty)
+    {
+        changes_coalesced++;  // Already queued: the notifier will send the latest value once
+        return;
+    }
+    followed[slot].dirty = 1;
+    dirty_list[dirty_count++] = slot;
+    pthread_cond_signal(&monitor_cond);
+}
+
+/**
+ * @brief Timer callback: end a subscription whose lease ran out and tell the client.
+ * @param arg The ClientMonitor whose lease timer fired.
+ */
+static void lease_expired(void *arg)
+{
+    ClientMonitor *monitor = (ClientMonitor *)arg;
+    pthread_mutex_lock(&monitor_mutex);
+    if (!monitor->in_use || timer_now_ms() < monitor->lease_expires_ms)
+    {
+        pthread_mutex_unlock(&monitor_mutex);
+        return;  // Renewed while the timer was firing
+    }
+    monitor->in_use = 0;
+    followed[followed_slot(monitor->flight_id, 0)].subscribers--;
+    atomic_fetch_sub(&followed_count, 1);
+    struct sockaddr_in client_addr = monitor->client_addr;
+    int flight_id = monitor->flight_id;
+    pthread_mutex_unlock(&monitor_mutex);
+
+    char response[BUFFER_SIZE];
+    int length = snprintf(response, sizeof(response), "Monitoring of flight %d ended: monitor interval expired\n", flight_id);
+    sendto(notifier_sockfd, response, length, 0, (struct sockaddr *)&client_addr, sizeof(client_addr));
+}
 
 /**
  * @brief Register a client to monitor a specific flight's seat availability.
  * @param sockfd The socket file descriptor for communication.
  * @param client_addr The client's network address.
  * @param flight_id The ID of the flight the client wants to monitor.
+ * @param lease_seconds How long to monitor (the monitor interval); 0 for the default.
  */
-void register_flight_monitor(int sockfd, struct sockaddr_in *client_addr, int flight_id)
+void register_flight_monitor(int sockfd, struct sockaddr_in *client_addr, int flight_id, int lease_seconds)
 {
-    // Lock the mutex to ensure thread-safe access to shared data
-    pthread_mutex_lock(&flight_mutex);
-
-    // Register the client by storing its address and the flight it wants to monitor
-    client_monitors[client_monitor_count].client_addr = *client_addr;
-    client_monitors[client_monitor_count].flight_id = flight_id;
-    client_monitor_count++;  // Increment the count of monitored clients
+    if (lease_seconds <= 0)
+    {
+        lease_seconds = MONITOR_DEFAULT_LEASE_S;
+    }
+    else if (lease_seconds > MONITOR_MAX_LEASE_S)
+    {
+        lease_seconds = MONITOR_MAX_LEASE_S;
+    }
 
-    // Unlock the mutex after the shared data has been updated
-    pthread_mutex_unlock(&flight_mutex);
+    // Lock the subscriber list while the entry is added or renewed
+    pthread_mutex_lock(&monitor_mutex);
+    ClientMonitor *monitor = NULL;
+    int free_entry = -1;
+    for (int i = 0; i < client_monitor_count && monitor == NULL; i++)
+    {
+        if (!client_monitors[i].in_use)
+        {
+            free_entry = free_entry < 0 ? i : free_entry;
+        }
+        else if (client_monitors[i].flight_id == flight_id &&
+                 client_monitors[i].client_addr.sin_addr.s_addr == client_addr->sin_addr.s_addr &&
+                 client_monitors[i].client_addr.sin_port == client_addr->sin_port)
+        {
+            monitor = &client_monitors[i];  // Following again renews the existing subscription
+        }
+    }
+    if (monitor == NULL)
+    {
+        if (free_entry < 0 && client_monitor_count < MAX_MONITORS)
+        {
+            free_entry = client_monitor_count++;
+            timer_init(&client_monitors[free_entry].lease, lease_expired, &client_monitors[free_entry]);
+        }
+        int slot = free_entry >= 0 ? followed_slot(flight_id, 1) : -1;
+        if (slot >= 0)
+        {
+            // Register the client by storing its address and the flight it wants to monitor
+            monitor = &client_monitors[free_entry];
+            monitor->client_addr = *client_addr;
+            monitor->flight_id = flight_id;
+            monitor->seat_availability = -1;
+            monitor->last_sent_ms = 0;
+            monitor->in_use = 1;
+            atomic_fetch_add(&followed_count, 1);
+            followed[slot].subscribers++;
+            mark_dirty(slot);  // Send the current availability right away
+        }
+    }
+    if (monitor != NULL)
+    {
+        monitor->lease_expires_ms = timer_now_ms() + (uint64_t)lease_seconds * 1000;
+        timer_schedule(&monitor->lease, (uint64_t)lease_seconds * 1000);
+    }
+    pthread_mutex_unlock(&monitor_mutex);
 
-    // Send a response to the client confirming successful registration
+    // Send a response to the client confirming (or refusing) the registration
     char response[BUFFER_SIZE];
-    sprintf(response, "Registered for flight %d seat availability updates\n", flight_id);
-    sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+    if (monitor != NULL)
+    {
+        sprintf(response, "Registered for flight %d seat availability updates for %d seconds\n", flight_id, lease_seconds);
+    }
+    else
+    {
+        sprintf(response, "Registration failed: too many monitored clients\n");
+    }
+    fault_sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
 }
 
 /**
- * @brief Thread function that monitors flights and notifies clients of seat availability changes.
- * @param arg A pointer to the client data structure.
- * @return NULL
+ * @brief Tell the notifier a flight's counters changed; called by catalog writers after unlocking.
+ * @param flight_id The flight that changed.
  */
-void* monitor_flights(void* arg)
+void notify_flight_changed(int flight_id)
 {
-    struct client_data *data = (struct client_data *)arg;  // Cast the argument to the correct type
-    MYSQL *conn = connect_db();  // Establish a connection to the MySQL database
-
-    while (1)  // Infinite loop to continuously monitor flights
+    if (atomic_load_explicit(&followed_count, memory_order_relaxed) == 0)
+    {
+        return;  // Nobody follows any flight
+    }
+    pthread_mutex_lock(&monitor_mutex);
+    int slot = followed_slot(flight_id, 0);
+    if (slot >= 0 && followed[slot].subscribers > 0)
     {
-        // Lock the mutex to ensure only one thread accesses shared data at a time
-        pthread_mutex_lock(&flight_mutex);
+        mark_dirty(slot);
+    }
+    pthread_mutex_unlock(&monitor_mutex);
+}
 
-        // Loop through all the monitored clients
-        for (int i = 0; i < client_monitor_count; i++)
+// Send a batch of rendered updates, one datagram per subscriber
+static void send_updates(struct sockaddr_in *addrs, const char **texts, const int *lengths, int count)
+{
+#ifdef __linux__
+    struct mmsghdr messages[NOTIFY_BATCH];
+    struct iovec iov[NOTIFY_BATCH];
+    for (int i = 0; i < count; i++)
+    {
+        iov[i].iov_base = (void *)texts[i];
+        iov[i].iov_len = lengths[i];
+        memset(&messages[i].msg_hdr, 0, sizeof(messages[i].msg_hdr));
+        messages[i].msg_hdr.msg_name = &addrs[i];
+        messages[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        messages[i].msg_hdr.msg_iov = &iov[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    int sent = 0;
+    while (sent < count)
+    {
+        int n = sendmmsg(notifier_sockfd, messages + sent, count - sent, 0);
+        send_calls++;
+        if (n <= 0)
         {
-            int flight_id = client_monitors[i].flight_id;  // Get the flight ID being monitored by the client
+            perror("Failed to send updates with sendmmsg");
+            break;  // The socket buffer is full; these subscribers get the next change
+        }
+        sent += n;
+    }
+    updates_sent += sent;
+#else
+    for (int i = 0; i < count; i++)
+    {
+        if (sendto(notifier_sockfd, texts[i], lengths[i], 0, (struct sockaddr *)&addrs[i], sizeof(addrs[i])) >= 0)
+        {
+            updates_sent++;
+        }
+    }
+    send_calls += count;
+#endif
+}
 
-            // Formulate an SQL query to get the current seat availability for the flight
-            char query[256];
-            snprintf(query, sizeof(query), "SELECT seat_availability FROM flights WHERE flight_id = %d", flight_id);
+/**
+ * @brief Notifier thread: renders each changed flight once and fans the update out to its subscribers.
+ * @param arg Unused.
+ * @return NULL
+ */
+static void* notifier_thread(void* arg)
+{
+    (void)arg;
+    static int pending[FLIGHT_TABLE_SIZE];  // Table entries handled in this pass
+    static int pending_ids[FLIGHT_TABLE_SIZE];  // Their flights, copied under the lock
+    static char texts[FLIGHT_TABLE_SIZE][NOTIFY_TEXT_SIZE];  // One rendered update per flight
+    static int lengths[FLIGHT_TABLE_SIZE];
+    static int seats[FLIGHT_TABLE_SIZE];
+    struct sockaddr_in addrs[NOTIFY_BATCH];
+    const char *batch_texts[NOTIFY_BATCH];
+    int batch_lengths[NOTIFY_BATCH];
 
-            // Execute the query and check for errors
-            if (mysql_query(conn, query))
+    while (1)
+    {
+        // Wait for a change, or for a held-back update to come due
+        pthread_mutex_lock(&monitor_mutex);
+        while (dirty_count == 0 && (next_deferred_ms == 0 || timer_now_ms() < next_deferred_ms))
+        {
+            if (next_deferred_ms == 0)
             {
-                fprintf(stderr, "SELECT error: %s\n", mysql_error(conn));
-                continue;  // Skip to the next client if there is an error
+                pthread_cond_wait(&monitor_cond, &monitor_mutex);
             }
+            else
+            {
+                struct timespec until;
+                clock_gettime(CLOCK_MONOTONIC, &until);
+                uint64_t wait_ms = next_deferred_ms - timer_now_ms();
+                until.tv_sec += wait_ms / 1000;
+                until.tv_nsec += (wait_ms % 1000) * 1000000;
+                if (until.tv_nsec >= 1000000000)
+                {
+                    until.tv_sec++;
+                    until.tv_nsec -= 1000000000;
+                }
+                pthread_cond_timedwait(&monitor_cond, &monitor_mutex, &until);
+            }
+        }
+        pthread_mutex_unlock(&monitor_mutex);
 
-            // Store the result of the query
-            MYSQL_RES *res = mysql_store_result(conn);
-            if (res == NULL)
+        // Let the rest of a burst arrive; it is folded into the same pass
+        struct timespec window = { 0, NOTIFY_COALESCE_MS * 1000000L };
+        nanosleep(&window, NULL);
+
+        // Take the dirty flights, plus held-back ones whose subscribers may be sent to again
+        pthread_mutex_lock(&monitor_mutex);
+        uint64_t now = timer_now_ms();
+        int count = 0;
+        if (next_deferred_ms != 0 && now >= next_deferred_ms)
+        {
+            next_deferred_ms = 0;
+            for (int i = 0; i < FLIGHT_TABLE_SIZE; i++)
             {
-                fprintf(stderr, "mysql_store_result() failed: %s\n", mysql_error(conn));
-                continue;
+                if (followed[i].deferred && !followed[i].dirty)  // Dirty entries are taken below
+                {
+                    pending[count++] = i;
+                }
+                followed[i].deferred = 0;
             }
+        }
+        for (int i = 0; i < dirty_count; i++)
+        {
+            pending[count++] = dirty_list[i];
+            followed[dirty_list[i]].dirty = 0;
+        }
+        dirty_count = 0;
+        for (int i = 0; i < count; i++)
+        {
+            pending_ids[i] = followed[pending[i]].flight_id;
+        }
+        pthread_mutex_unlock(&monitor_mutex);
 
-            // Fetch the row containing the seat availability
-            MYSQL_ROW row = mysql_fetch_row(res);
-            if (row)  // If the row exists
+        // Render each flight's update once, outside the lock (get_flight reads the catalog lock-free)
+        for (int i = 0; i < count; i++)
+        {
+            Flight flight;
+            seats[i] = -1;
+            if (get_flight(pending_ids[i], &flight))
             {
-                int current_seat_availability = atoi(row[0]);  // Convert seat availability to integer
+                seats[i] = flight.seat_availability;
+                lengths[i] = snprintf(texts[i], NOTIFY_TEXT_SIZE, "Flight %d seat availability updated to %d\n",
+                                      flight.flight_id, flight.seat_availability);
+            }
+        }
 
-                // Compare the current seat availability with the last known value for the client
-                if (client_monitors[i].seat_availability != current_seat_availability)
+        // Pick the subscribers to send to and record what they were sent
+        int batch = 0;
+        pthread_mutex_lock(&monitor_mutex);
+        for (int i = 0; i < count; i++)
+        {
+            followed[pending[i]].rendered = seats[i] >= 0 ? i : -1;
+        }
+        for (int j = 0; j < client_monitor_count; j++)
+        {
+            ClientMonitor *monitor = &client_monitors[j];
+            if (!monitor->in_use)
+            {
+                continue;
+            }
+            int slot = followed_slot(monitor->flight_id, 0);
+            int k = slot >= 0 ? followed[slot].rendered : -1;
+            if (k < 0 || monitor->seat_availability == seats[k])
+            {
+                continue;  // No change for this subscriber
+            }
+            if (now - monitor->last_sent_ms < NOTIFY_MIN_INTERVAL_MS)
+            {
+                // Rate cap: hold the update back; the latest value goes out when the interval is up
+                uint64_t due = monitor->last_sent_ms + NOTIFY_MIN_INTERVAL_MS;
+                followed[slot].deferred = 1;
+                if (next_deferred_ms == 0 || due < next_deferred_ms)
                 {
-                    // Update the seat availability for the client
-                    client_monitors[i].seat_availability = current_seat_availability;
-                    printf("Seats availability changed for flight %d, notifying clients\n", flight_id);
-
-                    // Notify all clients monitoring this flight of the seat availability update
-                    for (int j = 0; j < client_monitor_count; j++)
-                    {
-                        if (client_monitors[j].flight_id == flight_id)
-                        {
-                            // Create a response message to send to the client
-                            char response[BUFFER_SIZE];
-                            snprintf(response, sizeof(response),
-                                     "Flight %d seat availability updated to %d\n",
-                                     flight_id, current_seat_availability);
-
-                            // Send the message to the client
-                            ssize_t sent_len = sendto(data->sockfd, response, strlen(response), 0,
-                                                      (struct sockaddr *)&client_monitors[j].client_addr,
-                                                      sizeof(client_monitors[j].client_addr));
-
-                            // Check if the message was sent successfully
-                            if (sent_len == -1)
-                            {
-                                perror("Failed to send data with sendto");  // Error handling for send failure
-                            }
-                            else
-                            {
-                                // Print the number of bytes sent successfully
-                                printf("Successfully sent %ld bytes to the client\n", sent_len);
-                            }
-                        }
-                    }
+                    next_deferred_ms = due;
                 }
+                updates_held++;
+                continue;
+            }
+            monitor->seat_availability = seats[k];
+            monitor->last_sent_ms = now;
+            addrs[batch] = monitor->client_addr;
+            batch_texts[batch] = texts[k];
+            batch_lengths[batch] = lengths[k];
+            if (++batch == NOTIFY_BATCH)
+            {
+                pthread_mutex_unlock(&monitor_mutex);
+                send_updates(addrs, batch_texts, batch_lengths, batch);
+                batch = 0;
+                pthread_mutex_lock(&monitor_mutex);
             }
-            mysql_free_result(res);  // Free the memory used by the result set
         }
+        for (int i = 0; i < count; i++)
+        {
+            followed[pending[i]].rendered = -1;
+        }
+        pthread_mutex_unlock(&monitor_mutex);
 
-        // Unlock the mutex after the shared data access is complete
-        pthread_mutex_unlock(&flight_mutex);
-
-        sleep(5);  // Pause for 5 seconds before the next iteration of monitoring
+        if (batch > 0)
+        {
+            send_updates(addrs, batch_texts, batch_lengths, batch);
+        }
     }
-
-    close_db(conn);  // Close the connection to the database
     return NULL;  // Return NULL as this function is used in a thread
 }
 
+/**
+ * @brief Start the notifier thread that sends seat availability updates.
+ * @param sockfd The server socket updates are sent from.
+ */
+void notifier_start(int sockfd)
+{
+    notifier_sockfd = sockfd;
+    memory_charge_fixed(MEMORY_SUBSCRIPTIONS, sizeof(client_monitors) + sizeof(followed) + sizeof(dirty_list));  // Sized for MAX_MONITORS
+    for (int i = 0; i < FLIGHT_TABLE_SIZE; i++)
+    {
+        followed[i].flight_id = FLIGHT_FREE;
+        followed[i].rendered = -1;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);  // Timed waits use the same clock as the rate cap
+    pthread_cond_init(&monitor_cond, &attr);
+    pthread_condattr_destroy(&attr);
 
+    pthread_t thread;
+    if (affinity_create_thread(&thread, AFFINITY_NOTIFIER, 0, notifier_thread, NULL) != 0)
+    {
+        perror("Failed to create notifier thread");
+        return;
+    }
+    pthread_detach(thread);
+}
+
+/**
+ * @brief Write the notifier counters into buffer.
+ * @return The length written.
+ */
+size_t notifier_stats_report(char *buffer, size_t size)
+{
+    pthread_mutex_lock(&monitor_mutex);
+    int written = snprintf(buffer, size,
+                           "Notifier: %d subscribers, %llu updates sent in %llu send calls, %llu changes coalesced, %llu held by rate cap\n",
+                           atomic_load(&followed_count), (unsigned long long)updates_sent, (unsigned long long)send_calls,
+                           (unsigned long long)changes_coalesced, (unsigned long long)updates_held);
+    pthread_mutex_unlock(&monitor_mutex);
+    return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+}
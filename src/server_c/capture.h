@@ -0,0 +1,47 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>  // For size_t
+#include <stdint.h>  // Fixed-width integer types
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <netinet/in.h>  // For struct sockaddr_in
+#endif
+
+// capture.h
+// Traffic capture: with --capture FILE the receive thread appends every inbound datagram, with
+// its source address and arrival time, to a binary capture file. replay re-sends a capture
+// against a server to benchmark it with real traffic shapes.
+//
+// File layout: the 8-byte magic, then one CaptureRecord header per datagram followed by its
+// length bytes of payload.
+
+#define CAPTURE_FILE_MAGIC "SCCAPT01"  // First 8 bytes of a capture file
+
+// Header of one captured datagram (16 bytes)
+typedef struct {
+    uint64_t timestamp_ns;  // Arrival time on the monotonic clock
+    uint32_t address;  // Client IPv4 address, network byte order
+    uint16_t port;  // Client port, network byte order
+    uint16_t length;  // Payload bytes that follow
+} CaptureRecord;
+
+/**
+ * @brief Create the capture file; every datagram passed to capture_datagram is appended to it.
+ * @return 0 on success, -1 if the file cannot be created.
+ */
+int capture_start(const char *path);
+
+/**
+ * @brief Append a received datagram to the capture (receive thread only; no-op when not capturing).
+ */
+void capture_datagram(const struct sockaddr_in *client_addr, const char *data, size_t length);
+
+/**
+ * @brief Write the capture counters into buffer; returns the length written.
+ */
+size_t capture_stats_report(char *buffer, size_t size);
+
+#endif // CAPTURE_H
@@ -18,6 +18,11 @@
 #define MAKE_SEAT_RESERVATION_REQUEST 0x03         // Request to make a seat reservation
 #define QUERY_BAGGAGE_AVAILABILITY_REQUEST 0x04    // Request baggage availability for a flight
 #define ADD_BAGGAGE_REQUEST 0x05                   // Request to add baggage to a flight
+#define QUERY_FLIGHT_WINDOW_REQUEST 0x06           // Request flights on a route within a departure window
+#define QUERY_FLIGHT_FILTER_REQUEST 0x07           // Request flights matching seat, airfare and baggage bounds
+#define QUERY_SERVER_STATS_REQUEST 0x08            // Request the server's runtime statistics
+#define PROMOTE_REPLICA_REQUEST 0x09               // Promote a backup server to primary
+#define BATCH_REQUEST 0x0A                         // Run several operations in one request
 
 // Structure to represent a general communication message
 typedef struct {
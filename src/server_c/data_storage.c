@@ -3,119 +3,543 @@
 #include <string.h>  // Provides string manipulation functions
 #include <stdio.h>   // Provides input/output functions like printf and perror
 #include <stdlib.h>  // Provides memory allocation and control functions like malloc and free
+#include <stdatomic.h>  // Lock-free publication of interned city names and catalog snapshots
+#include "epoch.h"  // Deferred freeing of replaced columns
+#include "fragments.h"  // Pre-rendered reply text kept per flight
+#include "memory_budget.h"  // Columns and indexes are charged to the catalog
 
-// Function to initialize the flight data with an initial capacity for storage
+// data_storage.c
+// In-memory flight catalog kept in structure-of-arrays form: the hot counters that every
+// booking touches live in their own dense columns, the descriptive fields in others, and
+// city names are interned so a flight record holds two 16-bit ids instead of two heap strings.
+//
+// Writers work on `catalog` under catalog_lock. Point lookups (get_flight) take no lock at all:
+// whenever the columns or the index are replaced, a copy of the catalog header is published
+// through catalog_snapshot and the old arrays are retired to epoch.c, and each flight's seat and
+// baggage counters carry a seqlock version so a reader retries instead of seeing a torn pair.
+// Each flight also keeps its reply fragments; the counters fragment is re-rendered by whoever
+// changes the counters, under the flight's stripe, and the old one is retired like a column.
+
+#define CITY_HASH_SIZE (2 * MAX_CITIES)  // Open-addressing table for city name lookups (power of two)
+#define INITIAL_INDEX_SIZE 256  // Initial slot count of the flight_id index (power of two)
+
+FlightCatalog catalog;  // The flight catalog shared by all request handlers
+pthread_rwlock_t catalog_lock = PTHREAD_RWLOCK_INITIALIZER;  // Counter writers and scans share, structural changes are exclusive
+static _Atomic(FlightCatalog *) catalog_snapshot = NULL;  // Column and index pointers for lock-free readers
+
+// Interned city names; an entry is written once and never moves, so readers need no lock
+static _Atomic(char *) city_names[MAX_CITIES];
+static atomic_int city_hash[CITY_HASH_SIZE];  // city id + 1 per bucket, 0 = empty
+static int city_count = 0;  // Number of interned cities (only changed under catalog_lock)
+
+// FNV-1a hash of a city name
+static uint32_t hash_name(const char *name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash = (hash ^ (uint8_t)*name++) * 16777619u;
+    }
+    return hash;
+}
+
+// Integer mixer for flight ids so that sequential ids spread over the index
+static uint32_t hash_flight_id(int flight_id) {
+    uint32_t x = (uint32_t)flight_id;
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Pack a departure time into one 64-bit value that sorts in chronological order
+uint64_t pack_departure_time(DepartureTime time) {
+    return ((uint64_t)(uint32_t)time.year << 32) |
+           ((uint64_t)(time.month & 0xFF) << 24) |
+           ((uint64_t)(time.day & 0xFF) << 16) |
+           ((uint64_t)(time.hour & 0xFF) << 8) |
+           (uint64_t)(time.minute & 0xFF);
+}
+
+// Unpack a 64-bit departure value back into its fields
+DepartureTime unpack_departure_time(uint64_t packed) {
+    DepartureTime time;
+    time.year = (int)(uint32_t)(packed >> 32);
+    time.month = (int)((packed >> 24) & 0xFF);
+    time.day = (int)((packed >> 16) & 0xFF);
+    time.hour = (int)((packed >> 8) & 0xFF);
+    time.minute = (int)(packed & 0xFF);
+    return time;
+}
+
+// Look up a city id without interning; returns -1 if the name has never been seen
+int find_city(const char *name) {
+    uint32_t bucket = hash_name(name) & (CITY_HASH_SIZE - 1);
+    for (;;) {
+        int entry = atomic_load_explicit(&city_hash[bucket], memory_order_acquire);
+        if (entry == 0) {
+            return -1;  // Reached an empty bucket: the name is not interned
+        }
+        const char *candidate = atomic_load_explicit(&city_names[entry - 1], memory_order_acquire);
+        if (strcmp(candidate, name) == 0) {
+            return entry - 1;
+        }
+        bucket = (bucket + 1) & (CITY_HASH_SIZE - 1);  // Linear probing
+    }
+}
+
+// Intern a city name and return its id; caller must hold catalog_lock for writing
+static int intern_city(const char *name) {
+    int id = find_city(name);
+    if (id >= 0) {
+        return id;
+    }
+    if (city_count >= MAX_CITIES) {
+        fprintf(stderr, "City table is full, cannot intern %s\n", name);
+        return -1;
+    }
+
+    char *copy = strdup(name);  // One allocation per distinct city, shared by every flight
+    if (copy == NULL) {
+        perror("Memory allocation failed for city name");
+        return -1;
+    }
+    memory_charge_fixed(MEMORY_CATALOG, strlen(name) + 1);  // Bounded by MAX_CITIES, kept for good
+    id = city_count++;
+    atomic_store_explicit(&city_names[id], copy, memory_order_release);  // Publish the name before the bucket
+
+    uint32_t bucket = hash_name(name) & (CITY_HASH_SIZE - 1);
+    while (atomic_load_explicit(&city_hash[bucket], memory_order_relaxed) != 0) {
+        bucket = (bucket + 1) & (CITY_HASH_SIZE - 1);
+    }
+    atomic_store_explicit(&city_hash[bucket], id + 1, memory_order_release);
+    return id;
+}
+
+// Return the name of an interned city
+const char *city_name(int city_id) {
+    if (city_id < 0 || city_id >= MAX_CITIES) {
+        return NULL;
+    }
+    return atomic_load_explicit(&city_names[city_id], memory_order_acquire);
+}
+
+// Insert a flight_id -> slot mapping into an index table of the given size. The slot is
+// stored last with release order, so a lock-free reader that sees it also sees the key and
+// the flight's columns.
+static void index_insert(int32_t *keys, _Atomic int32_t *slots, uint32_t mask, int flight_id, int slot) {
+    uint32_t bucket = hash_flight_id(flight_id) & mask;
+    while (atomic_load_explicit(&slots[bucket], memory_order_relaxed) >= 0) {
+        bucket = (bucket + 1) & mask;  // Linear probing
+    }
+    keys[bucket] = flight_id;
+    atomic_store_explicit(&slots[bucket], slot, memory_order_release);
+}
+
+// Probe an index for a flight_id; safe without locks against concurrent index_insert
+static int index_lookup(const FlightCatalog *table, int flight_id) {
+    uint32_t bucket = hash_flight_id(flight_id) & table->index_mask;
+    int32_t slot;
+    while ((slot = atomic_load_explicit(&table->index_slots[bucket], memory_order_acquire)) >= 0) {
+        if (table->index_keys[bucket] == flight_id) {
+            return slot;  // Return the slot of the matching flight
+        }
+        bucket = (bucket + 1) & table->index_mask;
+    }
+    return -1;  // Return -1 if no flight is found with the given ID
+}
+
+// Publish the current column and index pointers to lock-free readers and retire the previous
+// header; caller must hold catalog_lock for writing
+static int publish_snapshot() {
+    FlightCatalog *snapshot = (FlightCatalog *)malloc(sizeof(FlightCatalog));
+    if (snapshot == NULL) {
+        perror("Memory allocation failed for catalog snapshot");
+        return -1;
+    }
+    *snapshot = catalog;
+    epoch_retire(atomic_exchange(&catalog_snapshot, snapshot));
+    return 0;
+}
+
+// Double the flight_id index once it is half full; caller must hold catalog_lock for writing
+static int index_grow() {
+    uint32_t size = (catalog.index_mask + 1) * 2;
+    if (memory_charge(MEMORY_CATALOG, size * 2 * sizeof(int32_t)) != 0) {
+        fprintf(stderr, "Memory budget reached: the flight index cannot grow\n");
+        return -1;
+    }
+    int32_t *keys = (int32_t *)malloc(size * sizeof(int32_t));
+    _Atomic int32_t *slots = (_Atomic int32_t *)malloc(size * sizeof(int32_t));
+    if (keys == NULL || slots == NULL) {
+        perror("Memory allocation failed for flight index");
+        free(keys);
+        free((void *)slots);
+        memory_release(MEMORY_CATALOG, size * 2 * sizeof(int32_t));
+        return -1;
+    }
+    memset((void *)slots, 0xFF, size * sizeof(int32_t));  // -1 marks an empty bucket
+
+    for (int i = 0; i < catalog.count; i++) {
+        index_insert(keys, slots, size - 1, catalog.flight_id[i], i);  // Rehash every flight
+    }
+
+    int32_t *old_keys = catalog.index_keys;
+    _Atomic int32_t *old_slots = catalog.index_slots;
+    catalog.index_keys = keys;
+    catalog.index_slots = slots;
+    catalog.index_mask = size - 1;
+    if (publish_snapshot() != 0) {
+        catalog.index_keys = old_keys;  // Keep writers and readers on the same table
+        catalog.index_slots = old_slots;
+        catalog.index_mask = (size - 1) / 2;
+        free(keys);
+        free((void *)slots);
+        memory_release(MEMORY_CATALOG, size * 2 * sizeof(int32_t));
+        return -1;
+    }
+    epoch_retire_charged(old_keys, MEMORY_CATALOG, size / 2 * sizeof(int32_t));  // Readers may still be probing the old table
+    epoch_retire_charged((void *)old_slots, MEMORY_CATALOG, size / 2 * sizeof(int32_t));
+    return 0;
+}
+
+// Apply a macro to every catalog column and its element type
+#define FOR_EACH_COLUMN(apply)                    \
+    apply(seat_availability, int32_t);            \
+    apply(baggage_availability, int32_t);         \
+    apply(flight_id, int32_t);                    \
+    apply(source_city, uint16_t);                 \
+    apply(destination_city, uint16_t);            \
+    apply(departure, uint64_t);                   \
+    apply(airfare, float);                        \
+    apply(counter_version, _Atomic uint32_t);     \
+    apply(detail_fragment, ReplyFragment *);      \
+    apply(route_fragment, ReplyFragment *);       \
+    apply(counters_fragment, ReplyFragment *_Atomic)
+
+// Retire a column of table; its bytes stay charged until readers are done with it
+#define RETIRE_COLUMN(column, type) \
+    epoch_retire_charged((void *)table.column, MEMORY_CATALOG, (size_t)table.capacity * sizeof(type))
+
+// Grow every column to a new capacity; caller must hold catalog_lock for writing. Columns are
+// copied rather than realloc'd because lock-free readers may still be using the old ones.
+static int catalog_grow(int capacity) {
+    FlightCatalog grown;
+
+#define GROW_COLUMN(column, type)                                                        \
+    do {                                                                                 \
+        grown.column = (type *)malloc(capacity * sizeof(type));                          \
+        if (grown.column == NULL) {                                                      \
+            perror("Memory allocation failed for catalog column " #column);              \
+            goto fail;                                                                   \
+        }                                                                                \
+        if (catalog.count > 0) {                                                         \
+            memcpy((void *)grown.column, (void *)catalog.column, catalog.count * sizeof(type)); \
+        }                                                                                \
+    } while (0)
+
+    size_t row_bytes = 0;
+#define ADD_ROW_BYTES(column, type) row_bytes += sizeof(type)
+    FOR_EACH_COLUMN(ADD_ROW_BYTES);
+#undef ADD_ROW_BYTES
+    if (memory_charge(MEMORY_CATALOG, (size_t)capacity * row_bytes) != 0) {
+        fprintf(stderr, "Memory budget reached: the catalog cannot grow to %d flights\n", capacity);
+        return -1;
+    }
+
+    memset((void *)&grown, 0, sizeof(grown));  // Unallocated columns stay NULL for the failure path
+    FOR_EACH_COLUMN(GROW_COLUMN);
+
+    {
+        FlightCatalog table = catalog;  // The old columns
+        grown.count = catalog.count;
+        grown.capacity = capacity;
+        grown.index_keys = catalog.index_keys;
+        grown.index_slots = catalog.index_slots;
+        grown.index_mask = catalog.index_mask;
+        catalog = grown;
+        if (publish_snapshot() != 0) {
+            catalog = table;  // Readers and writers keep using the old columns
+            goto fail;
+        }
+        FOR_EACH_COLUMN(RETIRE_COLUMN);
+    }
+    return 0;
+
+fail:
+#define FREE_COLUMN(column, type) free((void *)grown.column)
+    FOR_EACH_COLUMN(FREE_COLUMN);
+#undef FREE_COLUMN
+    memory_release(MEMORY_CATALOG, (size_t)capacity * row_bytes);
+    return -1;
+#undef GROW_COLUMN
+}
+
+// Function to initialize the flight catalog with an initial capacity for storage
 void initialize_flights(int initial_capacity) {
-    max_flights = initial_capacity;  // Set the maximum number of flights we can handle initially
-    flights = (Flight *)malloc(max_flights * sizeof(Flight));  // Allocate memory for storing flight data
-    if (flights == NULL) {  // Check if memory allocation failed
+    pthread_rwlock_wrlock(&catalog_lock);
+    memset(&catalog, 0, sizeof(catalog));
+
+    if (initial_capacity < 1) {
+        initial_capacity = 1;
+    }
+    catalog.index_mask = INITIAL_INDEX_SIZE - 1;
+    catalog.index_keys = (int32_t *)malloc(INITIAL_INDEX_SIZE * sizeof(int32_t));
+    catalog.index_slots = (_Atomic int32_t *)malloc(INITIAL_INDEX_SIZE * sizeof(int32_t));
+    if (catalog.index_keys == NULL || catalog.index_slots == NULL) {
         perror("Memory allocation failed for flights");  // Print error message to stderr
         exit(EXIT_FAILURE);  // Exit the program if memory allocation fails
     }
+    memset((void *)catalog.index_slots, 0xFF, INITIAL_INDEX_SIZE * sizeof(int32_t));  // All buckets empty
+    memory_charge_fixed(MEMORY_CATALOG, INITIAL_INDEX_SIZE * 2 * sizeof(int32_t));
+    if (catalog_grow(initial_capacity) != 0) {  // Allocates the columns and publishes the first snapshot
+        perror("Memory allocation failed for flights");
+        exit(EXIT_FAILURE);
+    }
 
-    // Initialize example flight data manually for demonstration purposes
-    flights[0].flight_id = 1;  // Assign flight ID
-    flights[0].source_place = malloc(strlen("Singapore") + 1);  // Allocate memory for the source place string
-    flights[0].destination_place = malloc(strlen("Tokyo") + 1);  // Allocate memory for the destination place string
-    if (flights[0].source_place && flights[0].destination_place) {  // Check if both memory allocations succeeded
-        strcpy(flights[0].source_place, "Singapore");  // Copy the source place string into the allocated memory
-        strcpy(flights[0].destination_place, "Tokyo");  // Copy the destination place string into the allocated memory
-        flights[0].departure_time = (DepartureTime){2024, 10, 12, 8, 0};  // Set the flight's departure time
-        flights[0].airfare = 500.0;  // Set the airfare for the flight
-        flights[0].seat_availability = 50;  // Set the number of available seats
-        flights[0].baggage_availability = 100;  // Set the number of available baggage slots
-    } else {
-        perror("Memory allocation failed for flight strings");  // Error handling for string allocation failure
-        exit(EXIT_FAILURE);  // Exit if allocation fails
-    }
-
-    // Initialize a second example flight
-    flights[1].flight_id = 2;  // Assign flight ID
-    flights[1].source_place = malloc(strlen("Singapore") + 1);  // Allocate memory for source place
-    flights[1].destination_place = malloc(strlen("New York") + 1);  // Allocate memory for destination place
-    if (flights[1].source_place && flights[1].destination_place) {  // Check if allocation succeeded
-        strcpy(flights[1].source_place, "Singapore");  // Copy source place string
-        strcpy(flights[1].destination_place, "New York");  // Copy destination place string
-        flights[1].departure_time = (DepartureTime){2024, 10, 13, 23, 0};  // Set departure time
-        flights[1].airfare = 1200.0;  // Set airfare
-        flights[1].seat_availability = 30;  // Set seat availability
-        flights[1].baggage_availability = 50;  // Set baggage availability
+    pthread_rwlock_unlock(&catalog_lock);
+}
+
+// Function to find the catalog slot of a flight in O(1); caller must hold catalog_lock
+int find_flight_slot(int flight_id) {
+    return index_lookup(&catalog, flight_id);
+}
+
+// Read a flight's seat and baggage counters as a consistent pair. Writers make the version odd
+// while they update, so the reader retries until it sees the same even version on both sides.
+static void read_counters(const FlightCatalog *table, int slot, int *seats, int *baggage) {
+    for (;;) {
+        uint32_t before = atomic_load_explicit(&table->counter_version[slot], memory_order_acquire);
+        if (before & 1) {
+            cpu_relax();  // A writer is mid-update
+            continue;
+        }
+        *seats = __atomic_load_n(&table->seat_availability[slot], __ATOMIC_RELAXED);
+        *baggage = __atomic_load_n(&table->baggage_availability[slot], __ATOMIC_RELAXED);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&table->counter_version[slot], memory_order_relaxed) == before) {
+            return;
+        }
+        cpu_relax();  // A writer got in between the two version reads
+    }
+}
+
+// Copy a flight out of the catalog without taking any lock; city names point at interned
+// storage and must not be freed
+int get_flight(int flight_id, Flight *out) {
+    epoch_enter();  // Keeps the snapshot's arrays alive until we are done
+    const FlightCatalog *snapshot = atomic_load_explicit(&catalog_snapshot, memory_order_acquire);
+    int slot = snapshot != NULL ? index_lookup(snapshot, flight_id) : -1;
+    if (slot >= 0) {
+        out->flight_id = snapshot->flight_id[slot];
+        out->source_place = (char *)city_name(snapshot->source_city[slot]);
+        out->destination_place = (char *)city_name(snapshot->destination_city[slot]);
+        out->departure_time = unpack_departure_time(snapshot->departure[slot]);
+        out->airfare = snapshot->airfare[slot];
+        read_counters(snapshot, slot, &out->seat_availability, &out->baggage_availability);
+    }
+    epoch_exit();
+    return slot >= 0;  // Return 1 if found, 0 otherwise
+}
+
+// Point vec[0] and vec[1] at a flight's detail reply without taking any lock; returns 0 if the
+// flight is unknown. The caller must stay inside epoch_enter until it has sent the reply. If the
+// counters fragment could not be re-rendered, the counters are formatted into spare instead.
+int get_flight_detail_reply(int flight_id, ReplyVec *vec, char *spare, size_t spare_size) {
+    const FlightCatalog *snapshot = atomic_load_explicit(&catalog_snapshot, memory_order_acquire);
+    int slot = snapshot != NULL ? index_lookup(snapshot, flight_id) : -1;
+    if (slot < 0) {
+        return 0;
+    }
+    reply_vec_fragment(&vec[0], snapshot->detail_fragment[slot]);
+    ReplyFragment *counters = atomic_load_explicit(&snapshot->counters_fragment[slot], memory_order_acquire);
+    if (counters != NULL) {
+        reply_vec_fragment(&vec[1], counters);
     } else {
-        perror("Memory allocation failed for flight strings");  // Handle memory allocation failure
-        exit(EXIT_FAILURE);  // Exit if allocation fails
+        int seats, baggage;
+        read_counters(snapshot, slot, &seats, &baggage);
+        reply_vec_set(&vec[1], spare, format_counters(spare, spare_size, seats, baggage));
     }
+    return 2;
+}
 
-    flight_count = 2;  // Set initial flight count to 2 since two flights are initialized
+// Re-render a flight's seat and baggage lines from its current counters and retire the old
+// ones; caller holds the flight's stripe, so the fragments are replaced in counter order. The
+// fragments are recycled and retired in per-thread batches, so this neither allocates nor locks.
+static void refresh_counters_fragment(int slot) {
+    ReplyFragment *fragment = render_counters_fragment(catalog.seat_availability[slot], catalog.baggage_availability[slot]);
+    fragment_retire(atomic_exchange_explicit(&catalog.counters_fragment[slot], fragment, memory_order_acq_rel));
 }
 
-// Function to find a flight by its ID
-Flight* find_flight_by_id(int flight_id) {
-    for (int i = 0; i < flight_count; i++) {  // Loop through all the flights
-        if (flights[i].flight_id == flight_id) {  // Check if the current flight matches the requested flight ID
-            return &flights[i];  // Return the pointer to the matching flight
+// Take amount from one counter column of a flight (a negative amount gives it back).
+// The catalog lock is only held shared, so updates to different flights proceed in parallel
+// and serialise on their lock stripe alone.
+static int adjust_counter(int baggage, int flight_id, int amount, int *remaining) {
+    int result = 0;  // 0 means the flight was not found
+    pthread_rwlock_rdlock(&catalog_lock);
+    int slot = find_flight_slot(flight_id);
+    if (slot >= 0) {
+        int32_t *column = baggage ? catalog.baggage_availability : catalog.seat_availability;  // Columns only move under the write lock
+        flight_lock(flight_id);  // Serialises writers of this flight; readers use the version instead
+        if (column[slot] >= amount) {  // Check if there is enough left
+            uint32_t version = atomic_load_explicit(&catalog.counter_version[slot], memory_order_relaxed);
+            atomic_store_explicit(&catalog.counter_version[slot], version + 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);  // Odd version is visible before the new value
+            __atomic_store_n(&column[slot], column[slot] - amount, __ATOMIC_RELAXED);
+            atomic_store_explicit(&catalog.counter_version[slot], version + 2, memory_order_release);
+            refresh_counters_fragment(slot);
+            result = 1;  // Return 1 to indicate a successful update
+        } else {
+            result = -1;  // Return -1 if there isn't enough left
+        }
+        if (remaining != NULL) {
+            *remaining = column[slot];
+        }
+        if (result == 1) {  // Replicate the new values in the order they were applied
+            replication_record_counters(flight_id, catalog.seat_availability[slot], catalog.baggage_availability[slot]);
         }
+        flight_unlock(flight_id);
     }
-    return NULL;  // Return NULL if no flight is found with the given ID
+    pthread_rwlock_unlock(&catalog_lock);
+    if (result == 1) {
+        notify_flight_changed(flight_id);  // Subscribers are updated by the notifier thread
+    }
+    return result;
 }
 
 // Function to update the seat availability for a specific flight
-int update_flight_seats(int flight_id, int seats) {
-    Flight *flight = find_flight_by_id(flight_id);  // Find the flight by ID
-    if (flight != NULL) {  // If the flight is found
-        if (flight->seat_availability >= seats) {  // Check if there are enough seats available
-            flight->seat_availability -= seats;  // Reduce the seat availability by the requested number of seats
-            return 1;  // Return 1 to indicate a successful update
-        } else {
-            return -1;  // Return -1 if there aren't enough seats available
-        }
+int update_flight_seats(int flight_id, int seats, int *remaining) {
+    return adjust_counter(0, flight_id, seats, remaining);
+}
+
+// Function to update the baggage availability for a specific flight
+int update_flight_baggage(int flight_id, int baggage, int *remaining) {
+    return adjust_counter(1, flight_id, baggage, remaining);
+}
+
+// Overwrite a flight's counters with known values (used by backups applying the primary's records)
+int set_flight_counters(int flight_id, int seats, int baggage) {
+    pthread_rwlock_rdlock(&catalog_lock);
+    int slot = find_flight_slot(flight_id);
+    if (slot >= 0) {
+        flight_lock(flight_id);
+        uint32_t version = atomic_load_explicit(&catalog.counter_version[slot], memory_order_relaxed);
+        atomic_store_explicit(&catalog.counter_version[slot], version + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        __atomic_store_n(&catalog.seat_availability[slot], seats, __ATOMIC_RELAXED);
+        __atomic_store_n(&catalog.baggage_availability[slot], baggage, __ATOMIC_RELAXED);
+        atomic_store_explicit(&catalog.counter_version[slot], version + 2, memory_order_release);
+        refresh_counters_fragment(slot);
+        replication_record_counters(flight_id, seats, baggage);
+        flight_unlock(flight_id);
+    }
+    pthread_rwlock_unlock(&catalog_lock);
+    if (slot >= 0) {
+        notify_flight_changed(flight_id);
+    }
+    return slot >= 0;
+}
+
+// Read the seat and baggage counters of a catalog slot as a consistent pair; caller must hold catalog_lock
+void read_slot_counters(int slot, int *seats, int *baggage) {
+    read_counters(&catalog, slot, seats, baggage);
+}
+
+// Copy the flight stored in a catalog slot; returns 0 once slot is past the last flight
+int get_flight_by_slot(int slot, Flight *out) {
+    pthread_rwlock_rdlock(&catalog_lock);
+    int found = slot >= 0 && slot < catalog.count;
+    if (found) {
+        out->flight_id = catalog.flight_id[slot];
+        out->source_place = (char *)city_name(catalog.source_city[slot]);
+        out->destination_place = (char *)city_name(catalog.destination_city[slot]);
+        out->departure_time = unpack_departure_time(catalog.departure[slot]);
+        out->airfare = catalog.airfare[slot];
+        read_counters(&catalog, slot, &out->seat_availability, &out->baggage_availability);
     }
-    return 0;  // Return 0 if the flight was not found
+    pthread_rwlock_unlock(&catalog_lock);
+    return found;
 }
 
 // Function to add a new flight to the system
-int add_flight(int flight_id, const char *source, const char *destination, 
-               DepartureTime departure_time, float airfare, 
+int add_flight(int flight_id, const char *source, const char *destination,
+               DepartureTime departure_time, float airfare,
                int seat_availability, int baggage_availability) {
-    if (flight_count >= max_flights) {  // Check if the current flight count exceeds the allocated space
-        max_flights *= 2;  // Double the flight capacity
-        flights = (Flight *)realloc(flights, max_flights * sizeof(Flight));  // Reallocate memory for more flights
-        if (flights == NULL) {  // Check if reallocation failed
-            perror("Memory reallocation failed");  // Print error message
-            return -1;  // Return -1 to indicate failure
-        }
+    // Render the flight's reply fragments before taking the lock
+    ReplyFragment *detail = render_detail_fragment(flight_id, source, destination, pack_departure_time(departure_time), airfare);
+    ReplyFragment *route = render_route_fragment(flight_id, pack_departure_time(departure_time));
+    ReplyFragment *counters = render_counters_fragment(seat_availability, baggage_availability);
+    if (detail == NULL || route == NULL || counters == NULL) {
+        fragment_free(detail);
+        fragment_free(route);
+        fragment_free(counters);
+        return -1;
     }
+    pthread_rwlock_wrlock(&catalog_lock);
 
-    flights[flight_count].flight_id = flight_id;  // Set the flight ID
+    if (find_flight_slot(flight_id) >= 0) {
+        pthread_rwlock_unlock(&catalog_lock);
+        fragment_free(detail);
+        fragment_free(route);
+        fragment_free(counters);
+        return 0;  // Return 0 if a flight with this ID already exists
+    }
 
-    // Allocate memory for and copy the source and destination strings
-    flights[flight_count].source_place = malloc(strlen(source) + 1);
-    flights[flight_count].destination_place = malloc(strlen(destination) + 1);
-    if (flights[flight_count].source_place == NULL || flights[flight_count].destination_place == NULL) {
-        perror("Memory allocation failed for flight strings");  // Handle memory allocation failure
-        return -1;  // Return -1 if memory allocation fails
+    int source_id = -1, destination_id = -1;
+    if ((catalog.count >= catalog.capacity && catalog_grow(catalog.capacity * 2) != 0) ||  // Double the capacity
+        ((uint32_t)(catalog.count + 1) * 2 > catalog.index_mask + 1 && index_grow() != 0) ||  // Keep the index at most half full
+        (source_id = intern_city(source)) < 0 || (destination_id = intern_city(destination)) < 0) {
+        pthread_rwlock_unlock(&catalog_lock);
+        fragment_free(detail);
+        fragment_free(route);
+        fragment_free(counters);
+        return -1;  // Return -1 to indicate failure
     }
-    strcpy(flights[flight_count].source_place, source);  // Copy source place string
-    strcpy(flights[flight_count].destination_place, destination);  // Copy destination place string
 
-    // Set the rest of the flight details
-    flights[flight_count].departure_time = departure_time;  // Set the departure time
-    flights[flight_count].airfare = airfare;  // Set the airfare
-    flights[flight_count].seat_availability = seat_availability;  // Set the seat availability
-    flights[flight_count].baggage_availability = baggage_availability;  // Set the baggage availability
-    flight_count++;  // Increment the flight count
+    // Fill in the new slot column by column
+    int slot = catalog.count;
+    catalog.flight_id[slot] = flight_id;
+    catalog.source_city[slot] = (uint16_t)source_id;
+    catalog.destination_city[slot] = (uint16_t)destination_id;
+    catalog.departure[slot] = pack_departure_time(departure_time);
+    catalog.airfare[slot] = airfare;
+    catalog.seat_availability[slot] = seat_availability;
+    catalog.baggage_availability[slot] = baggage_availability;
+    atomic_init(&catalog.counter_version[slot], 0);
+    catalog.detail_fragment[slot] = detail;
+    catalog.route_fragment[slot] = route;
+    atomic_init(&catalog.counters_fragment[slot], counters);
+    if (route_index_add(source_id, destination_id, catalog.departure[slot], slot) != 0) {
+        pthread_rwlock_unlock(&catalog_lock);
+        fragment_free(detail);
+        fragment_free(route);
+        fragment_free(counters);
+        return -1;  // Leave the slot unused so the catalog and route index stay consistent
+    }
+    index_insert(catalog.index_keys, catalog.index_slots, catalog.index_mask, flight_id, slot);  // Publishes the flight
+    catalog.count++;  // Increment the flight count
+    replication_record_flight(flight_id, source_id, destination_id, catalog.departure[slot], airfare,
+                              seat_availability, baggage_availability);
 
+    pthread_rwlock_unlock(&catalog_lock);
     return 1;  // Return 1 to indicate successful flight addition
 }
 
 // Function to clean up allocated memory for flight data
 void cleanup_flights() {
-    if (flights != NULL) {  // Check if the flights array is not NULL
-        for (int i = 0; i < flight_count; i++) {  // Loop through all the flights
-            free(flights[i].source_place);  // Free the memory allocated for the source place
-            free(flights[i].destination_place);  // Free the memory allocated for the destination place
-        }
-        free(flights);  // Free the memory allocated for the flights array
-        flights = NULL;  // Set the flights pointer to NULL to avoid dangling pointers
+    pthread_rwlock_wrlock(&catalog_lock);
+    epoch_retire(atomic_exchange(&catalog_snapshot, NULL));  // Unpublish before retiring the arrays
+    for (int slot = 0; slot < catalog.count; slot++) {
+        fragment_retire(catalog.detail_fragment[slot]);
+        fragment_retire(catalog.route_fragment[slot]);
+        fragment_retire(atomic_load(&catalog.counters_fragment[slot]));
     }
+    FlightCatalog table = catalog;
+    FOR_EACH_COLUMN(RETIRE_COLUMN);
+    size_t index_bytes = ((size_t)catalog.index_mask + 1) * sizeof(int32_t);
+    epoch_retire_charged(catalog.index_keys, MEMORY_CATALOG, index_bytes);
+    epoch_retire_charged((void *)catalog.index_slots, MEMORY_CATALOG, index_bytes);
+    route_index_clear();
+    memset(&catalog, 0, sizeof(catalog));  // Avoid dangling column pointers
+    pthread_rwlock_unlock(&catalog_lock);
 }
-
@@ -4,6 +4,7 @@
 #include <stdio.h>  // Standard input/output functions
 #include <stdlib.h>  // Standard library functions like memory allocation
 #include <string.h>  // String manipulation functions
+#include "db_pool.h"  // Request-path statements run on the non-blocking pool
 
 // Database connection information
 #define HOST "localhost"  // MySQL server host
@@ -30,12 +31,33 @@ MYSQL* connect_db() {
     return conn;  // Return the connected MySQL handler
 }
 
-// Function to query flight data from the database
+// Function to open a connection for the non-blocking pool; NULL if the server refuses it
+MYSQL* connect_db_nonblocking() {
+    MYSQL *conn = mysql_init(NULL);  // Initialize a MySQL connection handler
+    if (conn == NULL) {
+        printf("mysql_init() failed\n");
+        return NULL;
+    }
+    mysql_options(conn, MYSQL_OPT_NONBLOCK, 0);  // Enable the _start/_cont calls (default stack size)
+
+    // Connecting blocks; it happens once, at startup
+    if (mysql_real_connect(conn, HOST, USER, PASS, DB, 0, NULL, 0) == NULL) {
+        printf("mysql_real_connect() failed: %s\n", mysql_error(conn));
+        mysql_close(conn);
+        return NULL;
+    }
+
+    return conn;
+}
+
+// Function to load flight data from the database into the in-memory catalog
 void query_flights(MYSQL *conn) {
     const char *query = "SELECT flight_id, source_place, destination_place, "
                         "departure_year, departure_month, departure_day, "
                         "departure_hour, departure_minute, airfare, "
-                        "seat_availability, baggage_availability FROM flights";
+                        "seat_availability, baggage_availability FROM flights "
+                        "ORDER BY departure_year, departure_month, departure_day, "
+                        "departure_hour, departure_minute";  // Departure order lets the route index append
 
     // Execute the query on the MySQL connection
     if (mysql_query(conn, query)) {
@@ -50,103 +72,74 @@ void query_flights(MYSQL *conn) {
     }
 
     MYSQL_ROW row;  // Row structure to hold each row of the result set
+    int loaded = 0;  // Number of flights added to the catalog
     while ((row = mysql_fetch_row(result))) {  // Fetch each row from the result
-        Flight flight;  // Declare a flight structure to store flight data
-
-        flight.flight_id = atoi(row[0]);  // Convert flight_id from string to integer
-        flight.source_place = strdup(row[1]);  // Duplicate the source_place string
-        flight.destination_place = strdup(row[2]);  // Duplicate the destination_place string
+        if (!partition_owns(atoi(row[0]))) {
+            continue;  // Another node of a partitioned deployment serves this flight
+        }
+        DepartureTime departure_time;  // Departure time assembled from the five date/time columns
 
         // Populate the DepartureTime structure with year, month, day, hour, and minute
-        flight.departure_time.year = atoi(row[3]);
-        flight.departure_time.month = atoi(row[4]);
-        flight.departure_time.day = atoi(row[5]);
-        flight.departure_time.hour = atoi(row[6]);
-        flight.departure_time.minute = atoi(row[7]);
-
-        flight.airfare = atof(row[8]);  // Convert airfare from string to float
-        flight.seat_availability = atoi(row[9]);  // Convert seat availability from string to integer
-        flight.baggage_availability = atoi(row[10]);  // Convert baggage availability from string to integer
-
+        departure_time.year = atoi(row[3]);
+        departure_time.month = atoi(row[4]);
+        departure_time.day = atoi(row[5]);
+        departure_time.hour = atoi(row[6]);
+        departure_time.minute = atoi(row[7]);
+
+        // Store the flight in the catalog; city names are interned there, so nothing is duplicated here
+        if (add_flight(atoi(row[0]), row[1], row[2], departure_time,
+                       atof(row[8]), atoi(row[9]), atoi(row[10])) > 0) {
+            loaded++;
+        }
     }
+    printf("Loaded %d flights into the catalog.\n", loaded);
 
     mysql_free_result(result);  // Free the result set after processing all rows
 }
 
-// Function to update seat availability for a specific flight
-void update_seats(MYSQL *conn, int flight_id, int seats_reserved) {
-    char query[256];  // Buffer to hold the SQL query
-
-    // First, query the current seat availability
-    sprintf(query, "SELECT seat_availability FROM flights WHERE flight_id = %d", flight_id);
-    if (mysql_query(conn, query)) {  // Execute the query
-        printf("SELECT QUERY failed: %s\n", mysql_error(conn));  // Print error message if query fails
-        return;
-    }
-
-    MYSQL_RES *result = mysql_store_result(conn);  // Store the result of the query
-    if (result == NULL) {
-        printf("mysql_store_result() failed: %s\n", mysql_error(conn));  // Print error if result is null
-        return;
-    }
+// Subtract amount from a counter column in one conditional statement, so the check and the
+// update cannot interleave with another writer. The flight is updated only if the statement
+// affects one row; it affects none if the flight is missing or short of capacity.
+static void format_counter_update(char *query, size_t size, const char *column, int flight_id, int amount) {
+    snprintf(query, size,
+             "UPDATE flights SET %s = %s - %d WHERE flight_id = %d AND %s >= %d",
+             column, column, amount, flight_id, column, amount);
+}
 
-    MYSQL_ROW row = mysql_fetch_row(result);  // Fetch the first row
-    if (row) {
-        int available_seats = atoi(row[0]);  // Get the current seat availability
-        if (available_seats < seats_reserved) {
-            printf("Not enough seats available.\n");  // Print message if there are insufficient seats
-        } else {
-            // If enough seats are available, update the seat count
-            sprintf(query, "UPDATE flights SET seat_availability = seat_availability - %d WHERE flight_id = %d", seats_reserved, flight_id);
-            if (mysql_query(conn, query)) {  // Execute the update query
-                printf("UPDATE QUERY failed: %s\n", mysql_error(conn));  // Print error if the update fails
-            } else {
-                printf("Seats updated successfully.\n");  // Print success message
-            }
-        }
-    } else {
-        printf("Flight not found.\n");  // Print message if flight ID is not found
+// Run a counter update on the pool and wait for it. Returns 1 if the row was updated, 0 if
+// the flight is missing or short of capacity, -1 on a database error.
+static int update_counter(const char *column, int flight_id, int amount) {
+    char query[256];  // Buffer to hold the SQL query
+    format_counter_update(query, sizeof(query), column, flight_id, amount);
+    DbResult result;
+    db_execute(query, 0, &result);
+    if (result.failed) {
+        return -1;  // The pool has logged the error
     }
+    return result.affected_rows == 1 ? 1 : 0;
+}
 
-    mysql_free_result(result);  // Free the result set
+// Function to update seat availability for a specific flight
+int update_seats(int flight_id, int seats_reserved) {
+    return update_counter("seat_availability", flight_id, seats_reserved);
 }
 
 // Function to update baggage availability for a specific flight
-void update_baggage(MYSQL *conn, int flight_id, int baggage_added) {
-    char query[256];  // Buffer to hold the SQL query
-
-    // Query the current baggage availability
-    sprintf(query, "SELECT baggage_availability FROM flights WHERE flight_id = %d", flight_id);
-    if (mysql_query(conn, query)) {  // Execute the query
-        printf("SELECT QUERY failed: %s\n", mysql_error(conn));  // Print error if query fails
-        return;
-    }
-
-    MYSQL_RES *result = mysql_store_result(conn);  // Store the result of the query
-    if (result == NULL) {
-        printf("mysql_store_result() failed: %s\n", mysql_error(conn));  // Print error if result is null
-        return;
-    }
+int update_baggage(int flight_id, int baggage_added) {
+    return update_counter("baggage_availability", flight_id, baggage_added);
+}
 
-    MYSQL_ROW row = mysql_fetch_row(result);  // Fetch the first row
-    if (row) {
-        int available_baggage = atoi(row[0]);  // Get the current baggage availability
-        if (available_baggage < baggage_added) {
-            printf("Not enough baggage space available.\n");  // Print message if insufficient baggage space
-        } else {
-            // Update the baggage count if enough space is available
-            sprintf(query, "UPDATE flights SET baggage_availability = baggage_availability - %d WHERE flight_id = %d", baggage_added, flight_id);
-            if (mysql_query(conn, query)) {  // Execute the update query
-                printf("UPDATE QUERY failed: %s\n", mysql_error(conn));  // Print error if update fails
-            } else {
-                printf("Baggage updated successfully.\n");  // Print success message
-            }
-        }
-    } else {
-        printf("Flight not found.\n");  // Print message if flight ID is not found
-    }
+// Same updates without waiting: done(result, state) runs on a pool worker when the statement completes
+void update_seats_async(int flight_id, int seats_reserved, DbCallback done, const void *state, size_t state_size) {
+    char query[256];
+    format_counter_update(query, sizeof(query), "seat_availability", flight_id, seats_reserved);
+    db_submit(query, 0, done, state, state_size);
+}
 
-    mysql_free_result(result);  // Free the result set
+void update_baggage_async(int flight_id, int baggage_added, DbCallback done, const void *state, size_t state_size) {
+    char query[256];
+    format_counter_update(query, sizeof(query), "baggage_availability", flight_id, baggage_added);
+    db_submit(query, 0, done, state, state_size);
 }
 
 // Function to close the MySQL database connection
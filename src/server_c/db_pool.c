@@ -0,0 +1,442 @@
+#include <stdatomic.h>  // Counters read by query_server_stats
+#include <stddef.h>     // For offsetof and max_align_t
+#include <stdint.h>     // Fixed-width integer types
+#include <stdio.h>      // For printf and snprintf
+#include <stdlib.h>     // For malloc and free
+#include <string.h>     // For strlen and memcpy
+#include <pthread.h>    // Event loop thread, queue mutex and synchronous waiters
+#include <time.h>       // For clock_gettime
+
+#ifdef _WIN32
+#include <winsock2.h>
+#define poll WSAPoll  // Same interface; there is no wake pipe, so the loop polls every DB_POLL_MS
+#else
+#include <poll.h>     // Readiness of the connections' sockets
+#include <unistd.h>   // For pipe, read and write
+#include <fcntl.h>    // Non-blocking wake pipe
+#endif
+
+#include "server.h"
+#include "db_pool.h"
+#include "arena.h"   // Continuations release their request arena like handle_client does
+#include "trace.h"   // Queries are a traced stage of the request that issued them
+#include "affinity.h"  // The event loop starts on the CPUs given by --cpu-database
+#include "memory_budget.h"  // Queued jobs are charged as queues
+#include "task_queue.h"  // Free list of the job slab
+
+// db_pool.c
+// Workers append jobs to a queue and write a byte to the wake pipe; the event loop thread
+// starts queued jobs on idle connections, then polls the connections' sockets for whatever
+// each one's library call is waiting for and calls the matching _cont function when it is
+// ready. A finished job is handed back to the worker pool as a task that runs its
+// continuation, or, for db_execute, wakes the thread waiting for it. A job carries its query
+// text and its continuation's state, and comes from a slab recycled through a lock-free free
+// list like client_data, so a query costs no allocation while fewer than DB_JOB_SLAB_SIZE are
+// outstanding.
+
+#define DB_POLL_MS 10  // Longest sleep when jobs cannot wake the loop (Windows)
+#define DB_JOB_SLAB_SIZE 256  // Jobs preallocated for queries queued or in flight
+
+enum { CONN_IDLE, CONN_QUERY, CONN_STORE };
+
+// One query, from submission until its continuation has run
+typedef struct DbJob {
+    struct DbJob *next;  // Next job in the queue
+    const char *query;  // query_text, or the caller's string for db_execute
+    size_t length;
+    int want_rows;
+    DbCallback done;  // NULL for db_execute
+    uint32_t trace_id;  // Trace id of the request that issued the query
+    uint64_t submitted_ns;
+    DbResult result;
+    pthread_mutex_t *wait_mutex;  // db_execute's waiter
+    pthread_cond_t *wait_cond;
+    int *finished;
+    _Alignas(max_align_t) unsigned char state[DB_STATE_SIZE];  // Copy of the continuation's state
+    char query_text[DB_QUERY_SIZE];  // Copy of a submitted query
+} DbJob;
+
+// A pooled connection and the job running on it
+typedef struct {
+    MYSQL *mysql;
+    int state;  // CONN_IDLE, CONN_QUERY or CONN_STORE
+    int wait_status;  // MYSQL_WAIT_* the current library call is waiting for
+    uint64_t deadline_ms;  // When MYSQL_WAIT_TIMEOUT expires
+    int query_error;  // Result of mysql_real_query
+    DbJob *job;
+} DbConnection;
+
+static DbConnection *connections = NULL;
+static int connection_count = 0;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DbJob *queue_head = NULL, *queue_tail = NULL;
+static int wake_pipe[2] = { -1, -1 };
+static pthread_t loop_thread;
+static DbJob *job_slab = NULL;  // Backing block for the recycled jobs
+static TaskQueue job_free_list;  // Slab jobs that are not in use
+
+_Thread_local int db_request_deferred = 0;
+_Thread_local int db_wait_inline = 0;
+
+// Counters reported by query_server_stats
+static _Atomic uint64_t queries_submitted, queries_completed, queries_failed, total_latency_ns;
+static _Atomic int jobs_queued, jobs_in_flight, max_in_flight;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Allocate the job slab and put every job on the free list
+static int job_slab_init() {
+    job_slab = (DbJob *)malloc(DB_JOB_SLAB_SIZE * sizeof(DbJob));
+    if (job_slab == NULL || task_queue_init(&job_free_list, DB_JOB_SLAB_SIZE) != 0) {
+        perror("Memory allocation failed for the database job slab");
+        return -1;
+    }
+    memory_charge_fixed(MEMORY_QUEUES, DB_JOB_SLAB_SIZE * sizeof(DbJob) + (job_free_list.mask + 1) * sizeof(TaskQueueCell));
+    for (int i = 0; i < DB_JOB_SLAB_SIZE; i++) {
+        Task entry = { NULL, &job_slab[i] };
+        task_queue_push(&job_free_list, entry);
+    }
+    return 0;
+}
+
+// Take a job from the slab, falling back to malloc when every slab job is outstanding; NULL over the budget
+static DbJob *job_acquire() {
+    Task entry;
+    if (task_queue_pop(&job_free_list, &entry)) {
+        return (DbJob *)entry.argument;
+    }
+    if (memory_charge(MEMORY_QUEUES, sizeof(DbJob)) != 0) {
+        return NULL;
+    }
+    DbJob *job = (DbJob *)malloc(sizeof(DbJob));
+    if (job == NULL) {
+        memory_release(MEMORY_QUEUES, sizeof(DbJob));
+    }
+    return job;
+}
+
+// Return a job to the slab (or to malloc if it was an overflow allocation)
+static void job_release(DbJob *job) {
+    if (job >= job_slab && job < job_slab + DB_JOB_SLAB_SIZE) {
+        Task entry = { NULL, job };
+        task_queue_push(&job_free_list, entry);  // Ring holds the whole slab, so this cannot fail
+    } else {
+        free(job);
+        memory_release(MEMORY_QUEUES, sizeof(DbJob));
+    }
+}
+
+// Pool task: run a finished job's continuation as part of the request that issued it
+static void run_continuation(void *arg) {
+    DbJob *job = (DbJob *)arg;
+    trace_current = job->trace_id;
+    TRACE(TRACE_HANDLE, TRACE_BEGIN);
+    job->done(&job->result, job->state);
+    TRACE(TRACE_HANDLE, TRACE_END);
+    trace_current = 0;
+    arena_reset(request_arena());
+    job_release(job);
+}
+
+// Hand a finished job to its continuation or its waiter (event loop thread)
+static void complete_job(DbJob *job) {
+    atomic_fetch_add(&queries_completed, 1);
+    atomic_fetch_add(&total_latency_ns, now_ns() - job->submitted_ns);
+    if (job->result.failed) {
+        atomic_fetch_add(&queries_failed, 1);
+    }
+    if (job->done == NULL) {
+        pthread_mutex_lock(job->wait_mutex);
+        *job->finished = 1;
+        pthread_cond_signal(job->wait_cond);
+        pthread_mutex_unlock(job->wait_mutex);
+        return;
+    }
+    if (thread_pool_add_task(run_continuation, job) != 0) {
+        run_continuation(job);  // Pool saturated: finish the request here rather than lose it
+    }
+}
+
+// Drive a connection's job until the library has to wait or the job is finished
+static void advance(DbConnection *conn, int status) {
+    while (status == 0) {
+        DbJob *job = conn->job;
+        if (conn->state == CONN_QUERY && !conn->query_error && job->want_rows) {
+            conn->state = CONN_STORE;
+            status = mysql_store_result_start(&job->result.result, conn->mysql);
+            continue;
+        }
+        if (conn->state == CONN_QUERY) {
+            job->result.failed = conn->query_error != 0;
+            job->result.affected_rows = conn->query_error ? 0 : mysql_affected_rows(conn->mysql);
+        } else {
+            job->result.failed = job->result.result == NULL;
+        }
+        if (job->result.failed) {
+            fprintf(stderr, "Database query failed: %s\n", mysql_error(conn->mysql));
+        }
+        if (job->trace_id) {
+            trace_record(job->trace_id, TRACE_DB, TRACE_END, 0);
+        }
+        conn->job = NULL;
+        conn->state = CONN_IDLE;
+        atomic_fetch_sub(&jobs_in_flight, 1);
+        complete_job(job);
+        return;
+    }
+    conn->wait_status = status;
+    if (status & MYSQL_WAIT_TIMEOUT) {
+        conn->deadline_ms = now_ns() / 1000000 + mysql_get_timeout_value_ms(conn->mysql);
+    }
+}
+
+// Start a job on an idle connection
+static void start_job(DbConnection *conn, DbJob *job) {
+    conn->job = job;
+    conn->state = CONN_QUERY;
+    int in_flight = atomic_fetch_add(&jobs_in_flight, 1) + 1;
+    int seen = atomic_load(&max_in_flight);
+    while (in_flight > seen && !atomic_compare_exchange_weak(&max_in_flight, &seen, in_flight)) {
+    }
+    if (job->trace_id) {
+        trace_record(job->trace_id, TRACE_DB, TRACE_BEGIN, 0);
+    }
+    advance(conn, mysql_real_query_start(&conn->query_error, conn->mysql, job->query, job->length));
+}
+
+// Continue a connection's job with the conditions that became ready
+static void resume_job(DbConnection *conn, int ready) {
+    int status = conn->state == CONN_QUERY ? mysql_real_query_cont(&conn->query_error, conn->mysql, ready)
+                                           : mysql_store_result_cont(&conn->job->result.result, conn->mysql, ready);
+    advance(conn, status);
+}
+
+// Give queued jobs to idle connections; jobs that finish at once free their connection again
+static void start_queued_jobs() {
+    for (int i = 0; i < connection_count; i++) {
+        while (connections[i].state == CONN_IDLE) {
+            pthread_mutex_lock(&queue_mutex);
+            DbJob *job = queue_head;
+            if (job != NULL) {
+                queue_head = job->next;
+                if (queue_head == NULL) {
+                    queue_tail = NULL;
+                }
+                atomic_fetch_sub(&jobs_queued, 1);
+            }
+            pthread_mutex_unlock(&queue_mutex);
+            if (job == NULL) {
+                return;
+            }
+            start_job(&connections[i], job);
+        }
+    }
+}
+
+// The event loop: one thread multiplexing every pooled connection
+static void *db_loop(void *arg) {
+    (void)arg;
+    struct pollfd *fds = (struct pollfd *)malloc((connection_count + 1) * sizeof(struct pollfd));
+    int *owners = (int *)malloc((connection_count + 1) * sizeof(int));
+    while (1) {
+        start_queued_jobs();
+
+        // Wait on the wake pipe and on every busy connection's socket
+        int count = 0, timeout = -1;
+        uint64_t now_ms = now_ns() / 1000000;
+#ifdef _WIN32
+        timeout = DB_POLL_MS;
+#else
+        fds[count].fd = wake_pipe[0];
+        fds[count].events = POLLIN;
+        owners[count++] = -1;
+#endif
+        for (int i = 0; i < connection_count; i++) {
+            DbConnection *conn = &connections[i];
+            if (conn->state == CONN_IDLE) {
+                continue;
+            }
+            fds[count].fd = mysql_get_socket(conn->mysql);
+            fds[count].events = (conn->wait_status & MYSQL_WAIT_READ ? POLLIN : 0) |
+                                (conn->wait_status & MYSQL_WAIT_WRITE ? POLLOUT : 0) |
+                                (conn->wait_status & MYSQL_WAIT_EXCEPT ? POLLPRI : 0);
+            owners[count++] = i;
+            if (conn->wait_status & MYSQL_WAIT_TIMEOUT) {
+                int left = conn->deadline_ms > now_ms ? (int)(conn->deadline_ms - now_ms) : 0;
+                timeout = timeout < 0 || left < timeout ? left : timeout;
+            }
+        }
+        if (poll(fds, count, timeout) < 0) {
+            perror("Database poll failed");
+            continue;
+        }
+
+        now_ms = now_ns() / 1000000;
+        for (int k = 0; k < count; k++) {
+            if (owners[k] < 0) {
+#ifndef _WIN32
+                char drain[256];
+                while (read(wake_pipe[0], drain, sizeof(drain)) > 0) {
+                    // New jobs are picked up at the top of the loop
+                }
+#endif
+                continue;
+            }
+            DbConnection *conn = &connections[owners[k]];
+            int ready = (fds[k].revents & (POLLIN | POLLHUP | POLLERR) ? MYSQL_WAIT_READ : 0) |
+                        (fds[k].revents & POLLOUT ? MYSQL_WAIT_WRITE : 0) |
+                        (fds[k].revents & POLLPRI ? MYSQL_WAIT_EXCEPT : 0);
+            if (ready == 0 && (conn->wait_status & MYSQL_WAIT_TIMEOUT) && now_ms >= conn->deadline_ms) {
+                ready = MYSQL_WAIT_TIMEOUT;
+            }
+            if (ready != 0) {
+                resume_job(conn, ready);
+            }
+        }
+    }
+    return NULL;
+}
+
+int db_pool_start(int count) {
+    if (count <= 0) {
+        count = DB_POOL_DEFAULT_CONNECTIONS;
+    }
+    if (count > DB_POOL_MAX_CONNECTIONS) {
+        count = DB_POOL_MAX_CONNECTIONS;
+    }
+    if (job_slab_init() != 0) {
+        return -1;
+    }
+    connections = (DbConnection *)calloc(count, sizeof(DbConnection));
+    for (int i = 0; i < count; i++) {
+        MYSQL *mysql = connect_db_nonblocking();
+        if (mysql == NULL) {
+            break;  // Keep the connections the server allows
+        }
+        connections[connection_count].mysql = mysql;
+        connections[connection_count++].state = CONN_IDLE;
+    }
+    if (connection_count == 0) {
+        printf("Database pool: no connection could be opened.\n");
+        return -1;
+    }
+#ifndef _WIN32
+    if (pipe(wake_pipe) != 0) {
+        perror("Database pool wake pipe creation failed");
+        return -1;
+    }
+    fcntl(wake_pipe[0], F_SETFL, fcntl(wake_pipe[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(wake_pipe[1], F_SETFL, fcntl(wake_pipe[1], F_GETFL, 0) | O_NONBLOCK);
+#endif
+    if (affinity_create_thread(&loop_thread, AFFINITY_DATABASE, 0, db_loop, NULL) != 0) {
+        perror("Database event loop creation failed");
+        return -1;
+    }
+    pthread_detach(loop_thread);
+    printf("Database pool started with %d connections.\n", connection_count);
+    return 0;
+}
+
+// Queue a job and wake the event loop
+static void enqueue_job(DbJob *job) {
+    atomic_fetch_add(&queries_submitted, 1);
+    atomic_fetch_add(&jobs_queued, 1);
+    job->next = NULL;
+    job->submitted_ns = now_ns();
+    pthread_mutex_lock(&queue_mutex);
+    if (queue_tail != NULL) {
+        queue_tail->next = job;
+    } else {
+        queue_head = job;
+    }
+    queue_tail = job;
+    pthread_mutex_unlock(&queue_mutex);
+#ifndef _WIN32
+    char byte = 0;
+    if (write(wake_pipe[1], &byte, 1) < 0) {
+        // Pipe full: the loop is already awake and will see the job
+    }
+#endif
+}
+
+void db_submit(const char *query, int want_rows, DbCallback done, const void *state, size_t state_size) {
+    if (db_wait_inline) {
+        DbResult result;
+        _Alignas(max_align_t) unsigned char copy[DB_STATE_SIZE];  // done gets its own copy, as from a job
+        db_execute(query, want_rows, &result);
+        memcpy(copy, state, state_size < sizeof(copy) ? state_size : sizeof(copy));
+        done(&result, copy);
+        return;
+    }
+    size_t length = strlen(query);
+    DbJob *job = NULL;
+    if (length < DB_QUERY_SIZE && state_size <= DB_STATE_SIZE && connection_count > 0) {
+        job = job_acquire();  // NULL over the memory budget: the query fails
+    } else if (connection_count > 0) {
+        fprintf(stderr, "Database query or its state too large for a job: %s\n", query);
+    }
+    db_request_deferred = 1;  // The request finishes in the continuation
+    if (job == NULL) {
+        _Alignas(max_align_t) unsigned char copy[DB_STATE_SIZE];
+        DbResult result = { 1, 0, NULL };
+        memcpy(copy, state, state_size < sizeof(copy) ? state_size : sizeof(copy));
+        done(&result, copy);
+        return;
+    }
+    memcpy(job->query_text, query, length + 1);
+    memcpy(job->state, state, state_size);
+    job->query = job->query_text;
+    job->length = length;
+    job->want_rows = want_rows;
+    job->done = done;
+    job->trace_id = trace_current;
+    memset(&job->result, 0, sizeof(job->result));
+    enqueue_job(job);
+}
+
+void db_execute(const char *query, int want_rows, DbResult *result) {
+    if (connection_count == 0) {
+        result->failed = 1;
+        result->affected_rows = 0;
+        result->result = NULL;
+        return;
+    }
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+    int finished = 0;
+    DbJob job;
+    memset(&job, 0, offsetof(DbJob, state));  // The inline buffers are not used by a waiting job
+    job.query = query;
+    job.length = strlen(query);
+    job.want_rows = want_rows;
+    job.trace_id = trace_current;
+    job.wait_mutex = &mutex;
+    job.wait_cond = &cond;
+    job.finished = &finished;
+    enqueue_job(&job);
+
+    pthread_mutex_lock(&mutex);
+    while (!finished) {
+        pthread_cond_wait(&cond, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&cond);
+    *result = job.result;
+}
+
+size_t db_pool_stats_report(char *buffer, size_t size) {
+    uint64_t completed = atomic_load(&queries_completed);
+    int written = snprintf(buffer, size,
+                           "Database pool: %d connections, %d in flight (max %d), %d queued, %llu queries, %llu failed, "
+                           "%.3f ms average\n",
+                           connection_count, atomic_load(&jobs_in_flight), atomic_load(&max_in_flight),
+                           atomic_load(&jobs_queued), (unsigned long long)completed,
+                           (unsigned long long)atomic_load(&queries_failed),
+                           completed ? atomic_load(&total_latency_ns) / 1e6 / completed : 0.0);
+    return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+}
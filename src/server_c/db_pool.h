@@ -0,0 +1,58 @@
+#ifndef DB_POOL_H
+#define DB_POOL_H
+
+#include <stddef.h>  // For size_t
+#include <mysql/mysql.h>
+
+// db_pool.h
+// Non-blocking database access for the request path. A pool of connections is driven by one
+// event loop thread with the MariaDB non-blocking API (mysql_real_query_start / _cont), so a
+// handler hands its query over and returns instead of holding a worker while the database
+// works; the query's continuation runs on a pool worker once the result is in. With N pooled
+// connections, N queries are in flight at once whatever the number of workers.
+
+#define DB_POOL_DEFAULT_CONNECTIONS 16  // Connections opened when --db-connections is not given
+#define DB_POOL_MAX_CONNECTIONS 512
+#define DB_QUERY_SIZE 512  // Longest query db_submit accepts, including the terminator
+#define DB_STATE_SIZE 1152  // Largest continuation state db_submit carries
+
+// Outcome of one query, handed to its continuation
+typedef struct {
+    int failed;  // 1 if the query (or fetching its result) failed
+    unsigned long long affected_rows;  // For statements
+    MYSQL_RES *result;  // For queries that return rows; the continuation frees it
+} DbResult;
+
+// Continuation of a query; runs on a pool worker, in the trace context of the request that
+// issued it, with the copy of the state given to db_submit
+typedef void (*DbCallback)(DbResult *result, void *state);
+
+extern _Thread_local int db_request_deferred;  // Set when the current request left work to a continuation
+extern _Thread_local int db_wait_inline;  // Set by callers that need the reply before they return: db_submit waits instead
+
+/**
+ * @brief Open the pooled connections and start the event loop thread.
+ * @return 0 on success, -1 if no connection could be opened.
+ */
+int db_pool_start(int connections);
+
+/**
+ * @brief Run a query asynchronously; done(result, state) runs on a pool worker when it completes
+ *        (or in place, before db_submit returns, while db_wait_inline is set).
+ * @param want_rows 1 to store the rows the query returns, 0 for a statement.
+ * @param state The continuation's state (at most DB_STATE_SIZE bytes), copied into the query's
+ *        job, so the caller may keep it on its stack; done receives the copy.
+ */
+void db_submit(const char *query, int want_rows, DbCallback done, const void *state, size_t state_size);
+
+/**
+ * @brief Run a query on the pool and wait for it (for callers that cannot continue later).
+ */
+void db_execute(const char *query, int want_rows, DbResult *result);
+
+/**
+ * @brief Write the pool's counters into buffer; returns the length written.
+ */
+size_t db_pool_stats_report(char *buffer, size_t size);
+
+#endif // DB_POOL_H
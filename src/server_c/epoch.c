@@ -0,0 +1,248 @@
+#include <stdatomic.h>  // Epoch counters and reader records
+#include <stdint.h>     // Fixed-width integer types
+#include <stdio.h>      // For perror
+#include <stdlib.h>     // For malloc and free
+#include <pthread.h>    // For the retire-list mutex and thread-exit hook
+#include "epoch.h"
+#include "memory_budget.h"  // Charged retirements are released when they are freed
+
+// epoch.c
+// Each reader thread owns a cache-line-sized record holding the global epoch it observed on
+// entry (0 while outside a critical section), so entering and leaving never write shared
+// lines. Retired memory is tagged with the epoch current at retirement and the epoch is then
+// advanced; memory is freed when every active record shows a later epoch. Threads beyond
+// MAX_EPOCH_READERS fall back to a shared counter that simply holds reclamation back.
+// Batched retirements are tagged with the current epoch without advancing it and kept in the
+// retiring thread's own batch; the epoch is advanced and the readers scanned once per full
+// batch. Entries that readers still hold back when the batch fills up again, and the batch of
+// an exiting thread, move to the shared list.
+
+#define MAX_EPOCH_READERS 256  // Reader records available to threads
+#define EPOCH_BATCH_SIZE 64  // Batched retirements a thread collects before reclaiming them
+
+// One reader's published epoch, on its own cache line
+typedef struct {
+    _Alignas(64) _Atomic uint64_t epoch;  // Epoch seen on entry, 0 when idle
+    atomic_int in_use;  // Claimed by a live thread
+} EpochRecord;
+
+// A retired allocation waiting for its grace period
+typedef struct Retired {
+    void *ptr;  // Memory to free
+    void (*recycle)(void *ptr);  // Called instead of free, if set
+    int kind;  // Memory kind charged for ptr
+    size_t bytes;  // Released from kind when ptr is freed (0 if not charged)
+    uint64_t epoch;  // Global epoch when it was retired
+    struct Retired *next;
+} Retired;
+
+// A thread's batched retirements waiting for their grace period
+typedef struct {
+    struct {
+        void *ptr;
+        void (*recycle)(void *ptr);
+        uint64_t epoch;  // Global epoch when it was retired (not advanced for it)
+    } entries[EPOCH_BATCH_SIZE];
+    int count;
+    int registered;  // The thread-exit hook knows about this batch
+} RetireBatch;
+
+static EpochRecord records[MAX_EPOCH_READERS];
+static _Alignas(64) _Atomic uint64_t global_epoch = 1;  // Readers never see epoch 0
+static _Alignas(64) atomic_int overflow_readers = 0;  // Readers without a record
+static Retired *retired = NULL;  // Pending frees, newest first
+static pthread_mutex_t retire_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t record_key;
+static pthread_once_t record_key_once = PTHREAD_ONCE_INIT;
+static _Thread_local EpochRecord *my_record = NULL;
+static _Thread_local int my_record_missing = 0;  // No free record was available
+static _Thread_local RetireBatch my_batch;
+static pthread_key_t batch_key;
+static pthread_once_t batch_key_once = PTHREAD_ONCE_INIT;
+
+// Release a thread's record when it exits so the slot can be reused
+static void release_record(void *record) {
+    atomic_store(&((EpochRecord *)record)->epoch, 0);
+    atomic_store(&((EpochRecord *)record)->in_use, 0);
+}
+
+static void create_record_key() {
+    pthread_key_create(&record_key, release_record);
+}
+
+// Claim a free record for the calling thread
+static EpochRecord *claim_record() {
+    pthread_once(&record_key_once, create_record_key);
+    for (int i = 0; i < MAX_EPOCH_READERS; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&records[i].in_use, &expected, 1)) {
+            pthread_setspecific(record_key, &records[i]);
+            return &records[i];
+        }
+    }
+    return NULL;
+}
+
+// Begin a read-side critical section
+void epoch_enter() {
+    if (my_record == NULL && !my_record_missing) {
+        my_record = claim_record();
+        my_record_missing = (my_record == NULL);
+    }
+    if (my_record == NULL) {
+        atomic_fetch_add(&overflow_readers, 1);  // Blocks all reclamation until we leave
+        return;
+    }
+    // Sequentially consistent store: the record must be visible before any shared pointer is loaded
+    atomic_store(&my_record->epoch, atomic_load(&global_epoch));
+}
+
+// End the read-side critical section
+void epoch_exit() {
+    if (my_record == NULL) {
+        atomic_fetch_sub(&overflow_readers, 1);
+        return;
+    }
+    atomic_store_explicit(&my_record->epoch, 0, memory_order_release);
+}
+
+// Oldest epoch any active reader may be using, or UINT64_MAX if none is active
+static uint64_t oldest_active_epoch() {
+    if (atomic_load(&overflow_readers) > 0) {
+        return 0;  // An untracked reader is active: nothing can be freed yet
+    }
+    uint64_t oldest = UINT64_MAX;
+    for (int i = 0; i < MAX_EPOCH_READERS; i++) {
+        uint64_t epoch = atomic_load(&records[i].epoch);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+
+// Free retired memory whose grace period has passed; caller holds retire_mutex
+static void reclaim_locked() {
+    uint64_t oldest = oldest_active_epoch();
+    Retired **link = &retired;
+    while (*link != NULL) {
+        Retired *entry = *link;
+        if (entry->epoch < oldest) {  // Every active reader entered after this was unpublished
+            *link = entry->next;
+            if (entry->recycle != NULL) {
+                entry->recycle(entry->ptr);
+            } else {
+                free(entry->ptr);
+            }
+            if (entry->bytes != 0) {
+                memory_release(entry->kind, entry->bytes);
+            }
+            free(entry);
+        } else {
+            link = &entry->next;
+        }
+    }
+}
+
+// Defer freeing ptr until no reader can still see it
+void epoch_retire(void *ptr) {
+    epoch_retire_charged(ptr, 0, 0);
+}
+
+// Same, releasing the budget charged for ptr once it is freed
+void epoch_retire_charged(void *ptr, int kind, size_t bytes) {
+    if (ptr == NULL) {
+        return;
+    }
+    Retired *entry = (Retired *)malloc(sizeof(Retired));
+    if (entry == NULL) {
+        perror("Memory allocation failed for retired entry");
+        return;  // Leak rather than free memory a reader may be using
+    }
+
+    pthread_mutex_lock(&retire_mutex);
+    entry->ptr = ptr;
+    entry->recycle = NULL;
+    entry->kind = kind;
+    entry->bytes = bytes;
+    entry->epoch = atomic_fetch_add(&global_epoch, 1);  // Readers entering from now on start later
+    entry->next = retired;
+    retired = entry;
+    reclaim_locked();
+    pthread_mutex_unlock(&retire_mutex);
+}
+
+// Move a batched retirement to the shared list, keeping its epoch
+static void hand_over(void *ptr, void (*recycle)(void *ptr), uint64_t epoch) {
+    Retired *entry = (Retired *)malloc(sizeof(Retired));
+    if (entry == NULL) {
+        perror("Memory allocation failed for retired entry");
+        return;  // Leak rather than recycle memory a reader may be using
+    }
+    entry->ptr = ptr;
+    entry->recycle = recycle;
+    entry->bytes = 0;  // Batched memory stays charged while it waits to be recycled
+    entry->epoch = epoch;
+    pthread_mutex_lock(&retire_mutex);
+    entry->next = retired;
+    retired = entry;
+    pthread_mutex_unlock(&retire_mutex);
+}
+
+// Thread-exit hook: nobody would reclaim the exiting thread's batch, so the shared list takes it
+static void hand_over_batch(void *arg) {
+    RetireBatch *batch = (RetireBatch *)arg;
+    for (int i = 0; i < batch->count; i++) {
+        hand_over(batch->entries[i].ptr, batch->entries[i].recycle, batch->entries[i].epoch);
+    }
+    batch->count = 0;
+}
+
+static void create_batch_key() {
+    pthread_key_create(&batch_key, hand_over_batch);
+}
+
+// Advance the epoch past a full batch and recycle what no reader can still see
+static void reclaim_batch(RetireBatch *batch) {
+    atomic_fetch_add(&global_epoch, 1);  // Readers entering from now on start after the whole batch
+    uint64_t oldest = oldest_active_epoch();
+    int kept = 0;
+    for (int i = 0; i < batch->count; i++) {
+        if (batch->entries[i].epoch < oldest) {
+            batch->entries[i].recycle(batch->entries[i].ptr);
+        } else {
+            batch->entries[kept++] = batch->entries[i];
+        }
+    }
+    batch->count = kept;
+}
+
+// Defer recycling ptr until no reader can still see it, without a lock or an allocation
+void epoch_retire_batched(void *ptr, void (*recycle)(void *ptr)) {
+    if (ptr == NULL) {
+        return;
+    }
+    RetireBatch *batch = &my_batch;
+    if (!batch->registered) {
+        pthread_once(&batch_key_once, create_batch_key);
+        pthread_setspecific(batch_key, batch);
+        batch->registered = 1;
+    }
+    if (batch->count == EPOCH_BATCH_SIZE) {
+        reclaim_batch(batch);
+        if (batch->count == EPOCH_BATCH_SIZE) {  // A long reader holds the whole batch back
+            hand_over_batch(batch);
+        }
+    }
+    batch->entries[batch->count].ptr = ptr;
+    batch->entries[batch->count].recycle = recycle;
+    batch->entries[batch->count].epoch = atomic_load(&global_epoch);  // Readers that can see ptr entered no later
+    batch->count++;
+}
+
+// Free whatever retired memory has passed its grace period
+void epoch_reclaim() {
+    pthread_mutex_lock(&retire_mutex);
+    reclaim_locked();
+    pthread_mutex_unlock(&retire_mutex);
+}
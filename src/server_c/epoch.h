@@ -0,0 +1,48 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stddef.h>  // For size_t
+
+// epoch.h
+// Epoch-based reclamation for RCU-style snapshots. Readers bracket every access to a
+// published structure with epoch_enter/epoch_exit, which only touch a per-thread record.
+// Writers publish a replacement, then hand the old memory to epoch_retire; it is freed once
+// every reader that might still see it has left its critical section.
+
+/**
+ * @brief Begin a read-side critical section. Never blocks; sections do not nest.
+ */
+void epoch_enter();
+
+/**
+ * @brief End the read-side critical section started by epoch_enter.
+ */
+void epoch_exit();
+
+/**
+ * @brief Free ptr once no reader can still hold a reference obtained before this call.
+ * @param ptr Memory that has already been unpublished (may be NULL).
+ */
+void epoch_retire(void *ptr);
+
+/**
+ * @brief Like epoch_retire, and give bytes charged to memory kind kind (memory_budget.h) back to
+ *        the budget when ptr is freed, so memory readers still hold stays accounted for.
+ */
+void epoch_retire_charged(void *ptr, int kind, size_t bytes);
+
+/**
+ * @brief Hand ptr to recycle once no reader can still hold a reference obtained before this
+ *        call. Retirements are collected in a per-thread batch and reclaimed together, so this
+ *        neither allocates nor takes a lock; recycle runs on the retiring thread, or on any
+ *        thread if the batch had to be handed over to the shared list.
+ * @param ptr Memory that has already been unpublished (may be NULL).
+ */
+void epoch_retire_batched(void *ptr, void (*recycle)(void *ptr));
+
+/**
+ * @brief Free whatever retired memory has passed its grace period.
+ */
+void epoch_reclaim();
+
+#endif // EPOCH_H
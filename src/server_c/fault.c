@@ -0,0 +1,296 @@
+#include <stdatomic.h>  // Counters updated by every worker
+#include <stdint.h>     // Fixed-width integer types
+#include <stdio.h>      // For snprintf
+#include <stdlib.h>     // For malloc, strtod and strtoull
+#include <string.h>     // For memcpy and strcmp
+#include <pthread.h>    // For the generator and reorder mutex
+#include "fault.h"
+#include "memory_budget.h"  // Held datagrams are charged as queues
+#include "timer.h"      // Delayed and reordered datagrams are released by timers
+
+// fault.c
+// A faulted datagram is copied into a HeldDatagram whose timer releases it on the receive
+// thread: after the delay, on the next tick for a duplicate, or right after the next datagram
+// in the same direction has gone through for a reorder (with REORDER_MAX_MS as a fallback when
+// no other traffic comes). Released inbound datagrams go through the server's normal dispatch;
+// released replies are sent on the request socket.
+//
+// Re-execution is detected with a direct-mapped table of recent (client, request) fingerprints,
+// the same identity the at-most-once history uses; a collision only forgets an older entry.
+
+#define FAULT_INBOUND 0
+#define FAULT_OUTBOUND 1
+#define FAULT_DEFAULT_DELAY_MS 100  // Mean delay of a delayed datagram
+#define REORDER_MAX_MS 50  // How long a reordered datagram waits for one to overtake it
+#define RECENT_REQUESTS 8192  // Fingerprints remembered for re-execution counting (power of two)
+
+enum { FAULT_DROP, FAULT_DUPLICATE, FAULT_DELAY, FAULT_REORDER, FAULT_KINDS };
+
+// A datagram held back by the layer
+typedef struct {
+    Timer timer;  // Releases it
+    int direction;  // FAULT_INBOUND or FAULT_OUTBOUND
+    struct sockaddr_in addr;  // Client it came from or goes to
+    size_t length;
+    char data[];
+} HeldDatagram;
+
+static double probability[FAULT_KINDS];  // Chance of each fault per datagram
+static int delay_ms = FAULT_DEFAULT_DELAY_MS;
+static uint64_t seed = 1;
+static int enabled = 0;  // 1 once started with a non-zero probability
+static int request_sockfd = -1;
+static void (*deliver_inbound)(const char *data, size_t length, const struct sockaddr_in *client_addr) = NULL;
+
+static pthread_mutex_t fault_mutex = PTHREAD_MUTEX_INITIALIZER;  // Guards rng_state and reorder_slot
+static uint64_t rng_state;
+static HeldDatagram *reorder_slot[2];  // Datagram waiting to be overtaken, per direction
+
+static _Atomic uint64_t injected[2][FAULT_KINDS];
+static _Atomic uint64_t requests_handled, requests_executed, requests_reexecuted, cache_hits;
+static _Atomic uint64_t recent_requests[RECENT_REQUESTS];
+
+int fault_set_option(const char *name, const char *value) {
+    char *end;
+    if (strcmp(name, "delay-ms") == 0) {
+        long ms = strtol(value, &end, 10);
+        if (*end != '\0' || ms < 0) {
+            return -1;
+        }
+        delay_ms = (int)ms;
+        return 0;
+    }
+    if (strcmp(name, "seed") == 0) {
+        seed = strtoull(value, &end, 10);
+        return *end == '\0' ? 0 : -1;
+    }
+
+    static const char *names[FAULT_KINDS] = { "drop", "duplicate", "delay", "reorder" };
+    for (int kind = 0; kind < FAULT_KINDS; kind++) {
+        if (strcmp(name, names[kind]) == 0) {
+            double p = strtod(value, &end);
+            if (*end != '\0' || p < 0 || p > 1) {
+                return -1;
+            }
+            probability[kind] = p;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// xorshift64*: uniform in [0, 1) (caller holds fault_mutex)
+static double next_uniform() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Timer callback: let a held datagram continue on its way
+static void release_held(void *arg) {
+    HeldDatagram *held = (HeldDatagram *)arg;
+    pthread_mutex_lock(&fault_mutex);
+    if (reorder_slot[held->direction] == held) {
+        reorder_slot[held->direction] = NULL;  // Nothing overtook it in time
+    }
+    pthread_mutex_unlock(&fault_mutex);
+    if (held->direction == FAULT_INBOUND) {
+        deliver_inbound(held->data, held->length, &held->addr);
+    } else {
+        sendto(request_sockfd, held->data, held->length, 0, (struct sockaddr *)&held->addr, sizeof(held->addr));
+    }
+    memory_release(MEMORY_QUEUES, sizeof(HeldDatagram) + held->length);
+    free(held);
+}
+
+// Copy a datagram and arrange for it to be released after delay (ms); NULL if out of memory
+static HeldDatagram *hold(int direction, const void *data, size_t length, const struct sockaddr_in *addr, uint64_t delay) {
+    if (memory_charge(MEMORY_QUEUES, sizeof(HeldDatagram) + length) != 0) {
+        return NULL;
+    }
+    HeldDatagram *held = (HeldDatagram *)malloc(sizeof(HeldDatagram) + length);
+    if (held == NULL) {
+        memory_release(MEMORY_QUEUES, sizeof(HeldDatagram) + length);
+        return NULL;
+    }
+    held->direction = direction;
+    held->addr = *addr;
+    held->length = length;
+    memcpy(held->data, data, length);
+    timer_init(&held->timer, release_held, held);
+    timer_schedule(&held->timer, delay);
+    return held;
+}
+
+// Pick the fault for one datagram, or -1 for none; a datagram passing through releases the one
+// waiting to be overtaken in its direction
+static int choose_fault(int direction) {
+    pthread_mutex_lock(&fault_mutex);
+    double roll = next_uniform(), bound = 0;
+    int fault = -1;
+    for (int kind = 0; kind < FAULT_KINDS && fault < 0; kind++) {
+        bound += probability[kind];
+        if (roll < bound) {
+            fault = kind;
+        }
+    }
+    if (fault != FAULT_REORDER && reorder_slot[direction] != NULL) {
+        // This datagram overtakes the held one, which follows on the next tick. If its timer
+        // already fired, the callback is about to release it anyway.
+        HeldDatagram *held = reorder_slot[direction];
+        reorder_slot[direction] = NULL;
+        if (timer_cancel(&held->timer)) {
+            timer_schedule(&held->timer, 0);
+        }
+    }
+    pthread_mutex_unlock(&fault_mutex);
+    if (fault >= 0) {
+        atomic_fetch_add_explicit(&injected[direction][fault], 1, memory_order_relaxed);
+    }
+    return fault;
+}
+
+// Apply a fault that holds the datagram; returns 1 if it was held
+static int hold_for_fault(int fault, int direction, const void *data, size_t length, const struct sockaddr_in *addr) {
+    if (fault == FAULT_DELAY) {
+        pthread_mutex_lock(&fault_mutex);
+        uint64_t delay = delay_ms / 2 + (uint64_t)(next_uniform() * delay_ms);  // Mean delay_ms
+        pthread_mutex_unlock(&fault_mutex);
+        return hold(direction, data, length, addr, delay) != NULL;
+    }
+    if (fault == FAULT_REORDER) {
+        pthread_mutex_lock(&fault_mutex);
+        int free_slot = reorder_slot[direction] == NULL;
+        HeldDatagram *held = free_slot ? hold(direction, data, length, addr, REORDER_MAX_MS) : NULL;
+        if (held != NULL) {
+            reorder_slot[direction] = held;
+        }
+        pthread_mutex_unlock(&fault_mutex);
+        return held != NULL;  // With one already waiting, this datagram just goes through
+    }
+    return 0;
+}
+
+void fault_start(int sockfd, void (*deliver)(const char *data, size_t length, const struct sockaddr_in *client_addr)) {
+    request_sockfd = sockfd;
+    deliver_inbound = deliver;
+    rng_state = seed ? seed : 1;  // xorshift must not start at 0
+    enabled = probability[FAULT_DROP] + probability[FAULT_DUPLICATE] + probability[FAULT_DELAY] + probability[FAULT_REORDER] > 0;
+    if (enabled) {
+        printf("Fault injection: drop %.3f, duplicate %.3f, delay %.3f (%d ms), reorder %.3f, seed %llu\n",
+               probability[FAULT_DROP], probability[FAULT_DUPLICATE], probability[FAULT_DELAY], delay_ms,
+               probability[FAULT_REORDER], (unsigned long long)seed);
+    }
+}
+
+int fault_inbound(const char *data, size_t length, const struct sockaddr_in *client_addr) {
+    if (!enabled) {
+        return 0;
+    }
+    int fault = choose_fault(FAULT_INBOUND);
+    if (fault == FAULT_DROP) {
+        return 1;
+    }
+    if (fault == FAULT_DUPLICATE) {
+        hold(FAULT_INBOUND, data, length, client_addr, 0);  // The copy arrives on the next tick
+        return 0;
+    }
+    return hold_for_fault(fault, FAULT_INBOUND, data, length, client_addr);
+}
+
+ssize_t fault_sendto(int sockfd, const void *buffer, size_t length, int flags, const struct sockaddr *addr, socklen_t addr_len) {
+    if (!enabled || sockfd != request_sockfd || addr_len != sizeof(struct sockaddr_in)) {
+        return sendto(sockfd, buffer, length, flags, addr, addr_len);
+    }
+    int fault = choose_fault(FAULT_OUTBOUND);
+    if (fault == FAULT_DROP) {
+        return (ssize_t)length;  // Lost on the way: the sender cannot tell
+    }
+    if (fault == FAULT_DUPLICATE) {
+        sendto(sockfd, buffer, length, flags, addr, addr_len);
+    } else if (hold_for_fault(fault, FAULT_OUTBOUND, buffer, length, (const struct sockaddr_in *)addr)) {
+        return (ssize_t)length;
+    }
+    return sendto(sockfd, buffer, length, flags, addr, addr_len);
+}
+
+ssize_t fault_sendv(int sockfd, const ReplyVec *vec, int count, int flags, const struct sockaddr *addr, socklen_t addr_len) {
+    if (!enabled || sockfd != request_sockfd || addr_len != sizeof(struct sockaddr_in)) {
+        return reply_sendv(sockfd, vec, count, flags, addr, addr_len);
+    }
+    size_t length = reply_flatten(vec, count, NULL, 0);  // Held datagrams need their own copy anyway
+    if (memory_charge(MEMORY_BUFFERS, length + 1) != 0) {
+        return -1;
+    }
+    char *buffer = (char *)malloc(length + 1);
+    if (buffer == NULL) {
+        memory_release(MEMORY_BUFFERS, length + 1);
+        return -1;
+    }
+    reply_flatten(vec, count, buffer, length + 1);
+    ssize_t sent = fault_sendto(sockfd, buffer, length, flags, addr, addr_len);
+    free(buffer);
+    memory_release(MEMORY_BUFFERS, length + 1);
+    return sent;
+}
+
+void fault_account_request(const struct sockaddr_in *client_addr, const char *request, int cache_hit) {
+    atomic_fetch_add_explicit(&requests_handled, 1, memory_order_relaxed);
+    if (cache_hit) {
+        atomic_fetch_add_explicit(&cache_hits, 1, memory_order_relaxed);
+        return;
+    }
+    atomic_fetch_add_explicit(&requests_executed, 1, memory_order_relaxed);
+
+    // FNV-1a over the client address, port and request text
+    uint64_t hash = 1469598103934665603ull;
+    const unsigned char *bytes = (const unsigned char *)&client_addr->sin_addr.s_addr;
+    for (size_t i = 0; i < sizeof(client_addr->sin_addr.s_addr); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    hash = (hash ^ (client_addr->sin_port & 0xff)) * 1099511628211ull;
+    hash = (hash ^ (client_addr->sin_port >> 8)) * 1099511628211ull;
+    for (const unsigned char *c = (const unsigned char *)request; *c; c++) {
+        hash = (hash ^ *c) * 1099511628211ull;
+    }
+    hash |= 1;  // 0 marks an empty slot
+    uint64_t previous = atomic_exchange_explicit(&recent_requests[hash & (RECENT_REQUESTS - 1)], hash, memory_order_relaxed);
+    if (previous == hash) {
+        atomic_fetch_add_explicit(&requests_reexecuted, 1, memory_order_relaxed);
+    }
+}
+
+size_t fault_stats_report(char *buffer, size_t size) {
+    int written;
+    if (enabled) {
+        written = snprintf(buffer, size,
+                           "Faults: inbound %llu dropped, %llu duplicated, %llu delayed, %llu reordered; "
+                           "outbound %llu dropped, %llu duplicated, %llu delayed, %llu reordered (seed %llu)\n",
+                           (unsigned long long)atomic_load(&injected[FAULT_INBOUND][FAULT_DROP]),
+                           (unsigned long long)atomic_load(&injected[FAULT_INBOUND][FAULT_DUPLICATE]),
+                           (unsigned long long)atomic_load(&injected[FAULT_INBOUND][FAULT_DELAY]),
+                           (unsigned long long)atomic_load(&injected[FAULT_INBOUND][FAULT_REORDER]),
+                           (unsigned long long)atomic_load(&injected[FAULT_OUTBOUND][FAULT_DROP]),
+                           (unsigned long long)atomic_load(&injected[FAULT_OUTBOUND][FAULT_DUPLICATE]),
+                           (unsigned long long)atomic_load(&injected[FAULT_OUTBOUND][FAULT_DELAY]),
+                           (unsigned long long)atomic_load(&injected[FAULT_OUTBOUND][FAULT_REORDER]),
+                           (unsigned long long)seed);
+    } else {
+        written = snprintf(buffer, size, "Faults: off\n");
+    }
+    if (written < 0 || (size_t)written >= size) {
+        return written < 0 ? 0 : size - 1;
+    }
+
+    uint64_t handled = atomic_load(&requests_handled), hits = atomic_load(&cache_hits);
+    int more = snprintf(buffer + written, size - written,
+                        "Requests: %llu handled, %llu executed, %llu re-executed duplicates, %llu reply-cache hits (%.1f%%)\n",
+                        (unsigned long long)handled, (unsigned long long)atomic_load(&requests_executed),
+                        (unsigned long long)atomic_load(&requests_reexecuted), (unsigned long long)hits,
+                        handled ? 100.0 * hits / handled : 0.0);
+    if (more < 0) {
+        return written;
+    }
+    return (size_t)written + more < size ? (size_t)written + more : size - 1;
+}
@@ -0,0 +1,65 @@
+#ifndef FAULT_H
+#define FAULT_H
+
+#include <stddef.h>  // For size_t
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>  // For socklen_t
+#else
+#include <netinet/in.h>  // For struct sockaddr_in
+#include <sys/socket.h>  // For socklen_t
+#include <sys/types.h>   // For ssize_t
+#endif
+
+#include "fragments.h"  // For ReplyVec
+
+// fault.h
+// Network fault injection on the request socket, for measuring what at-least-once and
+// at-most-once cost on a lossy network. Each datagram, inbound or outbound, suffers at most one
+// fault: it is dropped, duplicated, delayed or reordered with the configured probabilities,
+// drawn from a seeded generator. The layer also counts how requests were served (executed,
+// re-executed as duplicates, answered from the reply cache) whether or not faults are enabled.
+
+/**
+ * @brief Set one option from the command line (--fault-NAME VALUE): drop, duplicate, delay and
+ *        reorder take a probability between 0 and 1, delay-ms the mean delay and seed the seed.
+ * @return 0 on success, -1 for an unknown option or invalid value.
+ */
+int fault_set_option(const char *name, const char *value);
+
+/**
+ * @brief Attach the layer to the request socket. Held inbound datagrams are later handed to
+ *        deliver on the receive thread, as if they had just been received.
+ */
+void fault_start(int sockfd, void (*deliver)(const char *data, size_t length, const struct sockaddr_in *client_addr));
+
+/**
+ * @brief Apply inbound faults to a datagram just received (receive thread only).
+ * @return 1 if the layer consumed it (dropped or held for later), 0 if the caller should process it now.
+ */
+int fault_inbound(const char *data, size_t length, const struct sockaddr_in *client_addr);
+
+/**
+ * @brief sendto for replies: applies outbound faults when sockfd is the request socket.
+ */
+ssize_t fault_sendto(int sockfd, const void *buffer, size_t length, int flags, const struct sockaddr *addr, socklen_t addr_len);
+
+/**
+ * @brief Gathered fault_sendto: sends the vector with reply_sendv, or flattens it first when
+ *        faults are being injected on sockfd.
+ */
+ssize_t fault_sendv(int sockfd, const ReplyVec *vec, int count, int flags, const struct sockaddr *addr, socklen_t addr_len);
+
+/**
+ * @brief Count a request served by a worker: answered from the reply cache, or executed
+ *        (and then whether the same client sent the same request recently).
+ */
+void fault_account_request(const struct sockaddr_in *client_addr, const char *request, int cache_hit);
+
+/**
+ * @brief Write the fault and request-accounting counters into buffer; returns the length written.
+ */
+size_t fault_stats_report(char *buffer, size_t size);
+
+#endif // FAULT_H
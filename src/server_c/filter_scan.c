@@ -0,0 +1,141 @@
+#include <stdint.h>  // Fixed-width integer types
+#include <stddef.h>  // For size_t
+#include "filter_scan.h"  // Scan declarations
+
+// filter_scan.c
+// Multi-criteria scans over the catalog's columns. Each block of 64 flights produces one
+// bitmap word; the AVX2 path compares 8 flights per instruction, SSE2 compares 4, and the
+// scalar loop is used everywhere else. The AVX2 path is chosen at run time so the server
+// binary does not need to be built with -mavx2.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define FILTER_SCAN_X86 1
+#include <immintrin.h>  // SSE2 and AVX2 intrinsics
+#endif
+
+// Scalar comparison of flights [base, base + n) into one bitmap word
+static uint64_t match_block_scalar(const int32_t *seats, const float *airfare, const int32_t *baggage,
+                                   size_t base, size_t n, int32_t min_seats, float max_fare, int32_t min_baggage) {
+    uint64_t word = 0;
+    for (size_t i = 0; i < n; i++) {
+        int match = (seats[base + i] >= min_seats) &
+                    (airfare[base + i] <= max_fare) &
+                    (baggage[base + i] >= min_baggage);
+        word |= (uint64_t)match << i;
+    }
+    return word;
+}
+
+size_t filter_scan_scalar(const int32_t *seats, const float *airfare, const int32_t *baggage, size_t count,
+                          int32_t min_seats, float max_fare, int32_t min_baggage,
+                          uint64_t *bitmap, size_t limit, size_t *words) {
+    size_t matches = 0;
+    size_t base = 0;
+    for (; base < count && matches < limit; base += FILTER_BLOCK) {
+        size_t n = count - base < FILTER_BLOCK ? count - base : FILTER_BLOCK;
+        uint64_t word = match_block_scalar(seats, airfare, baggage, base, n, min_seats, max_fare, min_baggage);
+        bitmap[base / FILTER_BLOCK] = word;
+        matches += (size_t)__builtin_popcountll(word);
+    }
+    *words = (base < count ? base : count + FILTER_BLOCK - 1) / FILTER_BLOCK;  // Blocks scanned, the last one partial
+    return matches;
+}
+
+#ifdef FILTER_SCAN_X86
+
+// SSE2: 4 flights per comparison. SSE2 has no signed >=, so a >= b is tested as a > b - 1.
+static size_t filter_scan_sse2(const int32_t *seats, const float *airfare, const int32_t *baggage, size_t count,
+                               int32_t min_seats, float max_fare, int32_t min_baggage,
+                               uint64_t *bitmap, size_t limit, size_t *words) {
+    const __m128i seat_floor = _mm_set1_epi32(min_seats - 1);
+    const __m128i baggage_floor = _mm_set1_epi32(min_baggage - 1);
+    const __m128 fare_cap = _mm_set1_ps(max_fare);
+    int floors_exact = min_seats != INT32_MIN && min_baggage != INT32_MIN;  // min - 1 must not wrap
+    size_t matches = 0;
+    size_t base = 0;
+
+    for (; base + FILTER_BLOCK <= count && matches < limit && floors_exact; base += FILTER_BLOCK) {
+        uint64_t word = 0;
+        for (size_t i = 0; i < FILTER_BLOCK; i += 4) {
+            __m128i s = _mm_loadu_si128((const __m128i *)(seats + base + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(baggage + base + i));
+            __m128 f = _mm_loadu_ps(airfare + base + i);
+            __m128i ok = _mm_and_si128(_mm_cmpgt_epi32(s, seat_floor), _mm_cmpgt_epi32(b, baggage_floor));
+            __m128 all = _mm_and_ps(_mm_castsi128_ps(ok), _mm_cmple_ps(f, fare_cap));
+            word |= (uint64_t)_mm_movemask_ps(all) << i;
+        }
+        bitmap[base / FILTER_BLOCK] = word;
+        matches += (size_t)__builtin_popcountll(word);
+    }
+
+    // Tail block (and the INT32_MIN corner case) falls back to the scalar comparison
+    for (; base < count && matches < limit; base += FILTER_BLOCK) {
+        size_t n = count - base < FILTER_BLOCK ? count - base : FILTER_BLOCK;
+        uint64_t word = match_block_scalar(seats, airfare, baggage, base, n, min_seats, max_fare, min_baggage);
+        bitmap[base / FILTER_BLOCK] = word;
+        matches += (size_t)__builtin_popcountll(word);
+    }
+    *words = (base < count ? base : count + FILTER_BLOCK - 1) / FILTER_BLOCK;  // Blocks scanned, the last one partial
+    return matches;
+}
+
+// AVX2: 8 flights per comparison, compiled for AVX2 regardless of the global build flags
+__attribute__((target("avx2")))
+static size_t filter_scan_avx2(const int32_t *seats, const float *airfare, const int32_t *baggage, size_t count,
+                               int32_t min_seats, float max_fare, int32_t min_baggage,
+                               uint64_t *bitmap, size_t limit, size_t *words) {
+    const __m256i seat_floor = _mm256_set1_epi32(min_seats - 1);
+    const __m256i baggage_floor = _mm256_set1_epi32(min_baggage - 1);
+    const __m256 fare_cap = _mm256_set1_ps(max_fare);
+    int floors_exact = min_seats != INT32_MIN && min_baggage != INT32_MIN;
+    size_t matches = 0;
+    size_t base = 0;
+
+    for (; base + FILTER_BLOCK <= count && matches < limit && floors_exact; base += FILTER_BLOCK) {
+        uint64_t word = 0;
+        for (size_t i = 0; i < FILTER_BLOCK; i += 8) {
+            __m256i s = _mm256_loadu_si256((const __m256i *)(seats + base + i));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(baggage + base + i));
+            __m256 f = _mm256_loadu_ps(airfare + base + i);
+            __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi32(s, seat_floor), _mm256_cmpgt_epi32(b, baggage_floor));
+            __m256 all = _mm256_and_ps(_mm256_castsi256_ps(ok), _mm256_cmp_ps(f, fare_cap, _CMP_LE_OQ));
+            word |= (uint64_t)(uint32_t)_mm256_movemask_ps(all) << i;
+        }
+        bitmap[base / FILTER_BLOCK] = word;
+        matches += (size_t)__builtin_popcountll(word);
+    }
+
+    for (; base < count && matches < limit; base += FILTER_BLOCK) {
+        size_t n = count - base < FILTER_BLOCK ? count - base : FILTER_BLOCK;
+        uint64_t word = match_block_scalar(seats, airfare, baggage, base, n, min_seats, max_fare, min_baggage);
+        bitmap[base / FILTER_BLOCK] = word;
+        matches += (size_t)__builtin_popcountll(word);
+    }
+    *words = (base < count ? base : count + FILTER_BLOCK - 1) / FILTER_BLOCK;  // Blocks scanned, the last one partial
+    return matches;
+}
+
+#endif // FILTER_SCAN_X86
+
+// Run the widest implementation this CPU supports
+size_t filter_scan(const int32_t *seats, const float *airfare, const int32_t *baggage, size_t count,
+                   int32_t min_seats, float max_fare, int32_t min_baggage,
+                   uint64_t *bitmap, size_t limit, size_t *words) {
+#ifdef FILTER_SCAN_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return filter_scan_avx2(seats, airfare, baggage, count, min_seats, max_fare, min_baggage, bitmap, limit, words);
+    }
+    return filter_scan_sse2(seats, airfare, baggage, count, min_seats, max_fare, min_baggage, bitmap, limit, words);
+#else
+    return filter_scan_scalar(seats, airfare, baggage, count, min_seats, max_fare, min_baggage, bitmap, limit, words);
+#endif
+}
+
+// Report which implementation filter_scan uses
+const char *filter_scan_isa() {
+#ifdef FILTER_SCAN_X86
+    return __builtin_cpu_supports("avx2") ? "AVX2" : "SSE2";
+#else
+    return "scalar";
+#endif
+}
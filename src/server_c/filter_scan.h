@@ -0,0 +1,36 @@
+#ifndef FILTER_SCAN_H
+#define FILTER_SCAN_H
+
+#include <stddef.h>  // For size_t
+#include <stdint.h>  // For int32_t and uint64_t
+
+#define FILTER_BLOCK 64  // Flights covered by one selection bitmap word
+
+/**
+ * @brief Select flights with seats >= min_seats, airfare <= max_fare and baggage >= min_baggage.
+ *
+ * Bit (i % 64) of bitmap[i / 64] is set for every matching flight i in [0, count).
+ * The scan stops after the bitmap word in which the running match count reaches limit;
+ * words past the stopping point are left untouched, so the caller must only read the
+ * first *words words of the bitmap.
+ *
+ * @param words Set to the number of bitmap words written.
+ * @return Number of matches marked in the bitmap (may exceed limit by up to 63).
+ */
+size_t filter_scan(const int32_t *seats, const float *airfare, const int32_t *baggage, size_t count,
+                   int32_t min_seats, float max_fare, int32_t min_baggage,
+                   uint64_t *bitmap, size_t limit, size_t *words);
+
+/**
+ * @brief Reference scalar implementation of filter_scan with identical results.
+ */
+size_t filter_scan_scalar(const int32_t *seats, const float *airfare, const int32_t *baggage, size_t count,
+                          int32_t min_seats, float max_fare, int32_t min_baggage,
+                          uint64_t *bitmap, size_t limit, size_t *words);
+
+/**
+ * @brief Name of the instruction set filter_scan dispatches to on this machine.
+ */
+const char *filter_scan_isa();
+
+#endif // FILTER_SCAN_H
@@ -0,0 +1,109 @@
+#include <stdint.h>  // Fixed-width integer types
+#include <stdio.h>   // For snprintf
+#include <pthread.h> // For mutexes
+#include <time.h>    // For clock_gettime
+#include "server.h"  // Lock declarations
+
+// flight_locks.c
+// Striped locks for per-flight state. A flight_id hashes to one of FLIGHT_LOCK_STRIPES
+// cache-line-aligned mutexes, so operations on different flights almost never share a lock.
+// Every stripe also records how often it was taken, how often a caller had to wait, and
+// the total wait and hold times; the counters are only written while the stripe is held.
+
+#define FLIGHT_LOCK_STRIPES 256  // Number of stripes (power of two)
+
+// One lock stripe with its statistics, padded to its own cache lines
+typedef struct {
+    _Alignas(64) pthread_mutex_t mutex;  // The stripe lock
+    uint64_t acquisitions;  // Times the stripe was taken
+    uint64_t contended;  // Acquisitions that found the stripe already held
+    uint64_t wait_ns;  // Total time spent waiting for the stripe
+    uint64_t hold_ns;  // Total time the stripe was held
+    uint64_t max_hold_ns;  // Longest single hold
+    uint64_t acquired_at;  // Timestamp of the current acquisition
+} FlightLockStripe;
+
+static FlightLockStripe stripes[FLIGHT_LOCK_STRIPES];
+static pthread_once_t stripes_once = PTHREAD_ONCE_INIT;
+
+// Initialise every stripe mutex
+static void init_stripes() {
+    for (int i = 0; i < FLIGHT_LOCK_STRIPES; i++) {
+        pthread_mutex_init(&stripes[i].mutex, NULL);
+    }
+}
+
+// Monotonic clock in nanoseconds
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Map a flight_id to its stripe
+static FlightLockStripe *stripe_for(int flight_id) {
+    uint32_t x = (uint32_t)flight_id * 2654435761u;  // Fibonacci hashing spreads consecutive ids
+    return &stripes[x >> 24 & (FLIGHT_LOCK_STRIPES - 1)];
+}
+
+// Lock the stripe that protects a flight, recording contention and wait time
+void flight_lock(int flight_id) {
+    pthread_once(&stripes_once, init_stripes);
+    FlightLockStripe *stripe = stripe_for(flight_id);
+
+    if (pthread_mutex_trylock(&stripe->mutex) == 0) {
+        stripe->acquired_at = now_ns();  // Uncontended fast path: no wait to measure
+    } else {
+        uint64_t start = now_ns();
+        pthread_mutex_lock(&stripe->mutex);
+        stripe->acquired_at = now_ns();
+        stripe->contended++;
+        stripe->wait_ns += stripe->acquired_at - start;
+    }
+    stripe->acquisitions++;
+}
+
+// Unlock a flight's stripe, recording how long it was held
+void flight_unlock(int flight_id) {
+    FlightLockStripe *stripe = stripe_for(flight_id);
+    uint64_t held = now_ns() - stripe->acquired_at;
+    stripe->hold_ns += held;
+    if (held > stripe->max_hold_ns) {
+        stripe->max_hold_ns = held;
+    }
+    pthread_mutex_unlock(&stripe->mutex);
+}
+
+// Write a summary of the lock statistics into buffer; returns the length written
+size_t flight_lock_stats_report(char *buffer, size_t size) {
+    pthread_once(&stripes_once, init_stripes);
+    uint64_t acquisitions = 0, contended = 0, wait_ns = 0, hold_ns = 0, max_hold_ns = 0;
+    int hottest = 0;
+
+    // Take each stripe briefly so its counters are read consistently
+    for (int i = 0; i < FLIGHT_LOCK_STRIPES; i++) {
+        pthread_mutex_lock(&stripes[i].mutex);
+        acquisitions += stripes[i].acquisitions;
+        contended += stripes[i].contended;
+        wait_ns += stripes[i].wait_ns;
+        hold_ns += stripes[i].hold_ns;
+        if (stripes[i].max_hold_ns > max_hold_ns) {
+            max_hold_ns = stripes[i].max_hold_ns;
+        }
+        if (stripes[i].contended > stripes[hottest].contended) {
+            hottest = i;
+        }
+        pthread_mutex_unlock(&stripes[i].mutex);
+    }
+
+    int written = snprintf(buffer, size,
+                           "Flight locks: %d stripes, %llu acquisitions, %llu contended (%.2f%%)\n"
+                           "  wait: total %.3f ms, avg %.1f us per contended acquisition\n"
+                           "  hold: avg %.1f us, max %.1f us; most contended stripe #%d (%llu waits)\n",
+                           FLIGHT_LOCK_STRIPES, (unsigned long long)acquisitions, (unsigned long long)contended,
+                           acquisitions ? 100.0 * contended / acquisitions : 0.0,
+                           wait_ns / 1e6, contended ? wait_ns / 1e3 / contended : 0.0,
+                           acquisitions ? hold_ns / 1e3 / acquisitions : 0.0, max_hold_ns / 1e3,
+                           hottest, (unsigned long long)stripes[hottest].contended);
+    return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+}
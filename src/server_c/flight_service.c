@@ -5,6 +5,11 @@
 #include <unistd.h>   // For sleep() function (POSIX)
 #include <stdlib.h>   // For memory allocation and process control functions
 #include <mysql/mysql.h>  // MySQL library for database interaction
+#include "arena.h"    // Per-worker request arenas
+#include "filter_scan.h"  // Vectorised column scans
+#include "trace.h"    // Replies are a traced stage
+#include "fault.h"    // Replies pass through the fault injection layer
+#include "epoch.h"    // Reply fragments stay alive while they are being sent
 
 #ifdef __linux__
 // Includes necessary headers for socket programming on Linux
@@ -20,6 +25,9 @@
 
 #define BUFFER_SIZE 1024  // Defines buffer size for communication
 #define MAX_LUGGAGE 400   // Maximum luggage capacity
+#define FILTER_DEFAULT_LIMIT 50  // Flights returned by query_flight_filter when no limit is given
+#define FILTER_MAX_LIMIT 1000    // Upper bound on the limit a client may request
+#define FILTER_SCAN_CHUNK 4096   // Catalog slots scanned per bitmap (multiple of FILTER_BLOCK)
 
 // Month names used for formatting departure time
 const char *months[] = {
@@ -27,80 +35,73 @@ const char *months[] = {
     "July", "August", "September", "October", "November", "December"
 };
 
-// Function to handle flight queries based on source and destination (already modified)
-void handle_query_flight(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn) {
-    char source[50], destination[50];  // Buffers to store source and destination strings
+// Where to send the reply of a request that continues after a database call
+typedef struct {
+    int sockfd;
+    struct sockaddr_in client_addr;
+} PendingQuery;
+
+// Continuation of handle_query_flight: format the matching flight IDs
+static void finish_query_flight(DbResult *result, void *state) {
+    PendingQuery *pending = (PendingQuery *)state;
+    int sockfd = pending->sockfd;
+    struct sockaddr_in *client_addr = &pending->client_addr;
     int found = 0;  // Tracks if a matching flight is found
 
-    // Extract source and destination from the client's request
-    sscanf(request, "query_flight_id %s %s", source, destination);
-    printf("Received query: source=%s, destination=%s\n", source, destination);
-
-    // Build an SQL query to find matching flights
-    char query[256];
-    snprintf(query, sizeof(query),
-             "SELECT flight_id FROM flights WHERE source_place='%s' AND destination_place='%s'",
-             source, destination);
-
-    // Execute the SQL query
-    if (mysql_query(conn, query)) {
-        // If the query fails, send an error message back to the client
-        fprintf(stderr, "SELECT error: %s\n", mysql_error(conn));
+    if (result->failed) {
+        // If the query fails, send an error message back to the client (the pool has logged why)
         char response[BUFFER_SIZE];
         snprintf(response, sizeof(response), "Database query failed.\n");
-        sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
-        return;
-    }
-
-    MYSQL_RES *res = mysql_store_result(conn);  // Store the query result
-    if (res == NULL) {
-        // If storing the result fails, send an error message to the client
-        fprintf(stderr, "mysql_store_result() failed: %s\n", mysql_error(conn));
-        char response[BUFFER_SIZE];
-        snprintf(response, sizeof(response), "Database error occurred.\n");
-        sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+        fault_sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
         return;
     }
+    MYSQL_RES *res = result->result;
 
-    // Dynamically allocate memory for the response
-    char *response = (char *)malloc(BUFFER_SIZE * sizeof(char));
+    // Build the response in the worker's request arena; it is released when the continuation completes
+    Arena *arena = request_arena();
+    size_t response_size = BUFFER_SIZE;
+    size_t response_len = 0;  // Tracked explicitly so appends do not rescan the buffer
+    char *response = (char *)arena_alloc(arena, response_size);
     if (response == NULL) {
         // Handle memory allocation failure
         perror("Memory allocation failed");
         mysql_free_result(res);  // Free the query result
         return;
     }
-    int response_size = BUFFER_SIZE;
-    memset(response, 0, response_size);  // Initialize the response buffer to zero
+    response[0] = '\0';
 
     MYSQL_ROW row;  // Variable to hold each row of the result set
     while ((row = mysql_fetch_row(res))) {  // Fetch each row
         char flight_info[100];  // Buffer to store formatted flight information
-        snprintf(flight_info, sizeof(flight_info), "Flight ID: %s\n", row[0]);
+        int info_len = snprintf(flight_info, sizeof(flight_info), "Flight ID: %s\n", row[0]);
 
-        // If the response buffer isn't large enough, dynamically expand it
-        if (strlen(response) + strlen(flight_info) >= response_size) {
+        // If the response buffer isn't large enough, grow it inside the arena
+        if (response_len + info_len >= response_size) {
+            response = (char *)arena_grow(arena, response, response_size, response_size * 2);
             response_size *= 2;  // Double the buffer size
-            response = (char *)realloc(response, response_size * sizeof(char));
             if (response == NULL) {
-                // Handle memory reallocation failure
-                perror("Memory reallocation failed");
+                // Handle memory allocation failure
+                perror("Memory allocation failed");
                 mysql_free_result(res);  // Free the query result
                 return;
             }
         }
 
-        strcat(response, flight_info);  // Append flight information to the response
+        memcpy(response + response_len, flight_info, info_len + 1);  // Append flight information to the response
+        response_len += info_len;
         found++;  // Increment the found counter
     }
 
     // If no matching flights were found, send an error message to the client
     if (!found) {
         strcpy(response, "No flights found.\n");
+        response_len = strlen(response);
     }
 
     // Send the response to the client
-    ssize_t sent_len = sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+    TRACE(TRACE_SEND, TRACE_BEGIN);
+    ssize_t sent_len = fault_sendto(sockfd, response, response_len, 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+    TRACE(TRACE_SEND, TRACE_END);
     if (sent_len < 0) {
         // Handle potential errors in sending the response
         perror("Failed to send response");
@@ -109,101 +110,143 @@ void handle_query_flight(int sockfd, struct sockaddr_in *client_addr, char *requ
         // Print log message
     }
 
-    // Free dynamically allocated memory and the query result
-    free(response);
+    // Free the query result (the response lives in the request arena)
     mysql_free_result(res);
 }
 
-// Function to handle detailed flight queries based on flight_id (already modified)
-void handle_query_details(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn) {
-    int flight_id;
-    int found = 0;
-    char query[256];  // SQL query buffer
-    char response[BUFFER_SIZE];  // Response buffer
-    memset(response, 0, BUFFER_SIZE);  // Clear the response buffer
+// Function to handle flight queries based on source and destination (already modified)
+void handle_query_flight(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn) {
+    (void)conn;
+    char source[50], destination[50];  // Buffers to store source and destination strings
 
-    // Extract the flight ID from the request
-    sscanf(request, "query_flight_info %d", &flight_id);
-    printf("Received query: flight_id=%d\n", flight_id);
+    // Extract source and destination from the client's request
+    sscanf(request, "query_flight_id %s %s", source, destination);
+    printf("Received query: source=%s, destination=%s\n", source, destination);
 
-    // Build the SQL query to retrieve flight details
-    snprintf(query, sizeof(query), "SELECT flight_id, source_place, destination_place, departure_year, "
-                                   "departure_month, departure_day, departure_hour, departure_minute, "
-                                   "airfare, seat_availability, baggage_availability FROM flights WHERE flight_id = %d", flight_id);
+    // Build an SQL query to find matching flights
+    char query[256];
+    snprintf(query, sizeof(query),
+             "SELECT flight_id FROM flights WHERE source_place='%s' AND destination_place='%s'",
+             source, destination);
 
-    // Execute the SQL query
-    if (mysql_query(conn, query)) {
-        // Handle query failure and send error response
-        fprintf(stderr, "SELECT error: %s\n", mysql_error(conn));
-        snprintf(response, sizeof(response), "Database query failed.\n");
-        sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
-        return;
-    }
+    // Hand the query to the database pool; the reply is sent by finish_query_flight
+    PendingQuery pending;
+    pending.sockfd = sockfd;
+    pending.client_addr = *client_addr;
+    db_submit(query, 1, finish_query_flight, &pending, sizeof(pending));
+}
 
-    MYSQL_RES *res = mysql_store_result(conn);  // Store the query result
-    if (res == NULL) {
-        // Handle result storage failure and send error response
-        fprintf(stderr, "mysql_store_result() failed: %s\n", mysql_error(conn));
-        snprintf(response, sizeof(response), "Database error occurred.\n");
-        sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
-        return;
+// Send a flight's detail reply, answered from its pre-rendered fragments without locking,
+// formatting or copying, and record it in the request history. Nothing is logged: the receive
+// thread answers detail queries with this directly.
+void send_flight_details(int sockfd, struct sockaddr_in *client_addr, const char *request, int flight_id) {
+    ReplyVec reply[2];  // Descriptive lines and counter lines
+    char spare[128];  // Counter lines, if their fragment is missing
+
+    epoch_enter();  // Keeps the fragments alive until the reply has been sent
+    int count = get_flight_detail_reply(flight_id, reply, spare, sizeof(spare));
+    if (count == 0) {
+        // If no flight is found, send an error response
+        static const char not_found[] = "Flight not found.\n";
+        reply_vec_set(&reply[0], not_found, sizeof(not_found) - 1);
+        count = 1;
     }
+    store_in_history_vec(client_addr, request, reply, count);  // Store the response in the request history
 
-    MYSQL_ROW row;  // Variable to hold each row of the result set
+    // Send the response to the client
+    TRACE(TRACE_SEND, TRACE_BEGIN);
+    fault_sendv(sockfd, reply, count, 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+    TRACE(TRACE_SEND, TRACE_END);
+    epoch_exit();
+}
 
-    // Loop through the query results
-    while ((row = mysql_fetch_row(res))) {
-        char departure_time[100];  // Buffer to hold the formatted departure time
-
-        // Format the departure time as: Month day, year hour:minute
-        snprintf(departure_time, sizeof(departure_time), "%s %02d, %d %02d:%02d",
-                 months[atoi(row[4]) - 1],  // Month
-                 atoi(row[5]),               // Day
-                 atoi(row[3]),               // Year
-                 atoi(row[6]),               // Hour
-                 atoi(row[7]));              // Minute
-
-        // Format and append the flight details to the response
-        snprintf(response + strlen(response), sizeof(response) - strlen(response),
-                 "Flight ID: %s\n"
-                 "Source: %s\n"
-                 "Destination: %s\n"
-                 "Departure Time: %s\n"
-                 "Airfare: %s\n"
-                 "Seats Available: %s\n"
-                 "Baggage Availability: %s kg\n\n",
-                 row[0],  // flight_id
-                 row[1],  // source_place
-                 row[2],  // destination_place
-                 departure_time,  // Formatted departure time
-                 row[8],  // airfare
-                 row[9], // seat_availability
-                 row[10]  // baggage_availability
-        );
-
-        found = 1;  // Mark the flight as found
-    }
+// Function to handle detailed flight queries based on flight_id
+void handle_query_details(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn) {
+    (void)conn;
+    int flight_id = 0;
 
-    // If no flight is found, send an error response
-    if (!found) {
-        snprintf(response, sizeof(response), "Flight not found.\n");
-    }
+    // Extract the flight ID from the request
+    sscanf(request, "query_flight_info %d", &flight_id);
+    printf("Received query: flight_id=%d\n", flight_id);
+
+    send_flight_details(sockfd, client_addr, request, flight_id);
+
+    // Log the response
+    printf("Response sent to client.\n");
+}
+
+// Record a reply in the request history and send it
+static void send_reply(int sockfd, struct sockaddr_in *client_addr, const char *request, const char *response) {
     store_in_history(client_addr, request, response);  // Store the response in the request history
 
     // Send the response to the client
-    sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
-
-    // Free the query result
-    mysql_free_result(res);
+    TRACE(TRACE_SEND, TRACE_BEGIN);
+    fault_sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+    TRACE(TRACE_SEND, TRACE_END);
 
     // Log the response
     printf("Response sent to client.\n");
 }
 
+// A reservation or baggage request admitted by the catalog, waiting for its database update
+typedef struct {
+    int sockfd;
+    struct sockaddr_in client_addr;
+    int baggage;  // 1 for add_baggage, 0 for make_seat_reservation
+    int flight_id, amount, remaining;
+    char request[BUFFER_SIZE];  // For the request history
+} PendingUpdate;
+
+// Continuation of handle_reservation and handle_add_baggage: confirm, or hand the amount back
+static void finish_update(DbResult *result, void *state) {
+    PendingUpdate *pending = (PendingUpdate *)state;
+    char response[BUFFER_SIZE];  // Response buffer
+    if (result->failed || result->affected_rows != 1) {
+        // If the database refuses, hand the seats or space back to the catalog
+        if (pending->baggage) {
+            update_flight_baggage(pending->flight_id, -pending->amount, NULL);
+        } else {
+            update_flight_seats(pending->flight_id, -pending->amount, NULL);
+        }
+        snprintf(response, sizeof(response), "Database update failed.\n");
+    } else if (pending->baggage) {
+        // Send a confirmation response with the remaining baggage space
+        snprintf(response, sizeof(response),
+                 "Baggage reservation confirmed for Flight ID: %d\nBaggage space remaining: %d\n",
+                 pending->flight_id, pending->remaining);
+    } else {
+        // Send a confirmation response with the remaining seat count
+        snprintf(response, sizeof(response),
+                 "Reservation confirmed for Flight ID: %d\nSeats remaining: %d\n",
+                 pending->flight_id, pending->remaining);
+    }
+    send_reply(pending->sockfd, &pending->client_addr, pending->request, response);
+}
+
+// Persist an admitted update outside any lock; the reply is sent by finish_update, which also
+// hands the amount back if the update cannot be made
+static void submit_update(int sockfd, struct sockaddr_in *client_addr, const char *request,
+                         int baggage, int flight_id, int amount, int remaining) {
+    PendingUpdate pending;  // Copied into the query's job
+    pending.sockfd = sockfd;
+    pending.client_addr = *client_addr;
+    pending.baggage = baggage;
+    pending.flight_id = flight_id;
+    pending.amount = amount;
+    pending.remaining = remaining;
+    snprintf(pending.request, sizeof(pending.request), "%s", request);
+    if (baggage) {
+        update_baggage_async(flight_id, amount, finish_update, &pending, sizeof(pending));
+    } else {
+        update_seats_async(flight_id, amount, finish_update, &pending, sizeof(pending));
+    }
+}
+
 // Function to handle seat reservation requests
 void handle_reservation(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn) {
-    int flight_id, seats;  // Variables to hold flight ID and number of seats to reserve
-    char query[256];  // SQL query buffer
+    (void)conn;
+    int flight_id = 0, seats = 0;  // Variables to hold flight ID and number of seats to reserve
+    int remaining = 0;  // Seats left after the reservation
     char response[BUFFER_SIZE];  // Response buffer
     memset(response, 0, BUFFER_SIZE);  // Clear the response buffer
 
@@ -211,76 +254,33 @@ void handle_reservation(int sockfd, struct sockaddr_in *client_addr, char *reque
     sscanf(request, "make_seat_reservation %d %d", &flight_id, &seats);
     printf("Received reservation request: Flight ID=%d, Seats=%d\n", flight_id, seats);
 
-    // Build an SQL query to check available seats
-    snprintf(query, sizeof(query), "SELECT seat_availability FROM flights WHERE flight_id=%d", flight_id);
-
-    // Execute the SQL query
-    if (mysql_query(conn, query)) {
-        // Handle query failure and send error response
-        fprintf(stderr, "SELECT error: %s\n", mysql_error(conn));
-        snprintf(response, sizeof(response), "Database query failed.\n");
-        sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
-        return;
-    }
-
-    MYSQL_RES *res = mysql_store_result(conn);  // Store the query result
-    if (res == NULL) {
-        // Handle result storage failure and send error response
-        fprintf(stderr, "mysql_store_result() failed: %s\n", mysql_error(conn));
-        snprintf(response, sizeof(response), "Database error occurred.\n");
-        sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
-        return;
-    }
+    // Admit the reservation against the catalog; only the flight's lock stripe is taken
+    int status = seats > 0 ? update_flight_seats(flight_id, seats, &remaining) : -2;
 
-    MYSQL_ROW row = mysql_fetch_row(res);  // Fetch the result row
-
-    if (row) {
-        int seat_availability = atoi(row[0]);  // Get available seat count
-        if (seat_availability == 0) {
-            // If no seats are available, send a failure response
-            strcpy(response, "Reservation failed: No seats available.\n");
-        } else if (seat_availability < seats) {
-            // If not enough seats are available, send a failure response
-            strcpy(response, "Reservation failed: Not enough seats available. Reduce your reservation.\n");
-        } else {
-            // If seats are available, update the seat availability
-            int new_seat_availability = seat_availability - seats;
-            snprintf(query, sizeof(query),
-                     "UPDATE flights SET seat_availability=%d WHERE flight_id=%d",
-                     new_seat_availability, flight_id);
-
-            // Execute the update query
-            if (mysql_query(conn, query)) {
-                // Handle query failure and send an error response
-                fprintf(stderr, "UPDATE error: %s\n", mysql_error(conn));
-                snprintf(response, sizeof(response), "Database update failed.\n");
-            } else {
-                // Send a confirmation response with the remaining seat count
-                snprintf(response, sizeof(response),
-                         "Reservation confirmed for Flight ID: %d\nSeats remaining: %d\n",
-                         flight_id, new_seat_availability);
-            }
-        }
-    } else {
+    if (status == 0) {
         // If no matching flight is found, send an error response
         strcpy(response, "Flight not found.\n");
+    } else if (status == -2) {
+        strcpy(response, "Reservation failed: Invalid number of seats.\n");
+    } else if (status < 0 && remaining == 0) {
+        // If no seats are available, send a failure response
+        strcpy(response, "Reservation failed: No seats available.\n");
+    } else if (status < 0) {
+        // If not enough seats are available, send a failure response
+        strcpy(response, "Reservation failed: Not enough seats available. Reduce your reservation.\n");
+    } else {
+        submit_update(sockfd, client_addr, request, 0, flight_id, seats, remaining);
+        return;  // Confirmed (or handed back) when the database update completes
     }
 
-    // Free the query result
-    mysql_free_result(res);
-    store_in_history(client_addr, request, response);  // Store the response in the request history
-
-    // Send the response to the client
-    sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
-
-    // Log the response
-    printf("Response sent to client.\n");
+    send_reply(sockfd, client_addr, request, response);
 }
 
 // Function to handle baggage addition requests
 void handle_add_baggage(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn) {
-    int flight_id, baggages;  // Variables to hold flight ID and baggage count
-    char query[256];  // SQL query buffer
+    (void)conn;
+    int flight_id = 0, baggages = 0;  // Variables to hold flight ID and baggage count
+    int remaining = 0;  // Baggage space left after the request
     char response[BUFFER_SIZE];  // Response buffer
     memset(response, 0, BUFFER_SIZE);  // Clear the response buffer
 
@@ -288,122 +288,245 @@ void handle_add_baggage(int sockfd, struct sockaddr_in *client_addr, char *reque
     sscanf(request, "add_baggage %d %d", &flight_id, &baggages);
     printf("Received baggage reservation request: Flight ID=%d, Baggages=%d\n", flight_id, baggages);
 
-    // Build an SQL query to check available baggage space
-    snprintf(query, sizeof(query), "SELECT baggage_availability FROM flights WHERE flight_id=%d", flight_id);
+    // Admit the request against the catalog; only the flight's lock stripe is taken
+    int status = baggages > 0 ? update_flight_baggage(flight_id, baggages, &remaining) : -2;
 
-    // Execute the SQL query
-    if (mysql_query(conn, query)) {
-        // Handle query failure and send error response
-        fprintf(stderr, "SELECT error: %s\n", mysql_error(conn));
-        snprintf(response, sizeof(response), "Database query failed.\n");
-        sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
-        return;
+    if (status == 0) {
+        // If no matching flight is found, send an error response
+        strcpy(response, "Flight not found.\n");
+    } else if (status == -2) {
+        strcpy(response, "Baggage reservation failed: Invalid number of baggages.\n");
+    } else if (status < 0 && remaining == 0) {
+        // If no baggage space is available, send a failure response
+        strcpy(response, "Baggage reservation failed: No baggage space available.\n");
+    } else if (status < 0) {
+        // If not enough baggage space is available, send a failure response
+        strcpy(response, "Baggage reservation failed: Not enough space for baggage. Reduce your request.\n");
+    } else {
+        submit_update(sockfd, client_addr, request, 1, flight_id, baggages, remaining);
+        return;  // Confirmed (or handed back) when the database update completes
     }
 
-    MYSQL_RES *res = mysql_store_result(conn);  // Store the query result
-    if (res == NULL) {
-        // Handle result storage failure and send error response
-        fprintf(stderr, "mysql_store_result() failed: %s\n", mysql_error(conn));
-        snprintf(response, sizeof(response), "Database error occurred.\n");
-        sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
-        return;
-    }
+    send_reply(sockfd, client_addr, request, response);
+}
 
-    MYSQL_ROW row = mysql_fetch_row(res);  // Fetch the result row
+// Send a flight's baggage availability, served from the catalog without locking, and record it
+// in the request history. Like send_flight_details, it logs nothing.
+void send_baggage_availability(int sockfd, struct sockaddr_in *client_addr, const char *request, int flight_id) {
+    Flight flight;  // Copy of the catalog record
+    char response[BUFFER_SIZE];  // Response buffer
 
-    if (row) {
-        int baggage_availability = atoi(row[0]);  // Get available baggage space
-        if (baggage_availability == 0) {
-            // If no baggage space is available, send a failure response
-            strcpy(response, "Baggage reservation failed: No baggage space available.\n");
-        } else if (baggage_availability < baggages) {
-            // If not enough baggage space is available, send a failure response
-            strcpy(response, "Baggage reservation failed: Not enough space for baggage. Reduce your request.\n");
-        } else {
-            // If space is available, update the baggage availability
-            int new_baggage_availability = baggage_availability - baggages;
-            snprintf(query, sizeof(query),
-                     "UPDATE flights SET baggage_availability=%d WHERE flight_id=%d",
-                     new_baggage_availability, flight_id);
-
-            // Execute the update query
-            if (mysql_query(conn, query)) {
-                // Handle query failure and send an error response
-                fprintf(stderr, "UPDATE error: %s\n", mysql_error(conn));
-                snprintf(response, sizeof(response), "Database update failed.\n");
-            } else {
-                // Send a confirmation response with the remaining baggage space
-                snprintf(response, sizeof(response),
-                         "Baggage reservation confirmed for Flight ID: %d\nBaggage space remaining: %d\n",
-                         flight_id, new_baggage_availability);
-            }
-        }
+    if (get_flight(flight_id, &flight)) {
+        // Retrieve baggage availability and format the response
+        snprintf(response, sizeof(response), "Flight ID: %d\nBaggage space available: %d\n", flight_id, flight.baggage_availability);
     } else {
         // If no matching flight is found, send an error response
         strcpy(response, "Flight not found.\n");
     }
 
-    // Free the query result
-    mysql_free_result(res);
     store_in_history(client_addr, request, response);  // Store the response in the request history
 
     // Send the response to the client
-    sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
-
-    // Log the response
-    printf("Response sent to client.\n");
+    TRACE(TRACE_SEND, TRACE_BEGIN);
+    fault_sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+    TRACE(TRACE_SEND, TRACE_END);
 }
 
 // Function to handle baggage availability queries
 void handle_query_baggage_availability(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn) {
-    int flight_id;  // Variable to hold flight ID
-    char query[256];  // SQL query buffer
-    char response[BUFFER_SIZE];  // Response buffer
-    memset(response, 0, BUFFER_SIZE);  // Clear the response buffer
+    (void)conn;
+    int flight_id = 0;  // Variable to hold flight ID
 
     // Extract flight ID from the request
     sscanf(request, "query_baggage_availability %d", &flight_id);
     printf("Received query for baggage availability: Flight ID=%d\n", flight_id);
 
-    // Build an SQL query to retrieve baggage availability
-    snprintf(query, sizeof(query), "SELECT baggage_availability FROM flights WHERE flight_id = %d", flight_id);
+    send_baggage_availability(sockfd, client_addr, request, flight_id);
 
-    // Execute the SQL query
-    if (mysql_query(conn, query)) {
-        // Handle query failure and send error response
-        fprintf(stderr, "SELECT error: %s\n", mysql_error(conn));
-        snprintf(response, sizeof(response), "Database query failed.\n");
-        sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
-        return;
+    // Log the response
+    printf("Response sent to client.\n");
+}
+
+// Parse a window bound written as YYYY-MM-DD or YYYY-MM-DDTHH:MM; a date-only upper bound covers the whole day
+static int parse_window_bound(const char *text, int is_upper_bound, DepartureTime *out) {
+    int consumed = 0;
+    if (sscanf(text, "%d-%d-%d%n", &out->year, &out->month, &out->day, &consumed) != 3) {
+        return -1;
+    }
+    if (text[consumed] == '\0') {
+        out->hour = is_upper_bound ? 23 : 0;
+        out->minute = is_upper_bound ? 59 : 0;
+    } else if (sscanf(text + consumed, "T%d:%d", &out->hour, &out->minute) != 2) {
+        return -1;
     }
+    if (out->month < 1 || out->month > 12 || out->day < 1 || out->day > 31 ||
+        out->hour < 0 || out->hour > 23 || out->minute < 0 || out->minute > 59) {
+        return -1;
+    }
+    return 0;
+}
 
-    MYSQL_RES *res = mysql_store_result(conn);  // Store the query result
-    if (res == NULL) {
-        // Handle result storage failure and send error response
-        fprintf(stderr, "mysql_store_result() failed: %s\n", mysql_error(conn));
-        snprintf(response, sizeof(response), "Database error occurred.\n");
-        sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+// Function to handle route searches restricted to a departure window, served from the in-memory route index
+void handle_query_flight_window(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn) {
+    (void)conn;
+    char source[50], destination[50], from_text[32], to_text[32];  // Request fields
+    DepartureTime from, to;  // Window bounds
+
+    // Extract the route and the window from the client's request
+    if (sscanf(request, "query_flight_window %49s %49s %31s %31s", source, destination, from_text, to_text) != 4 ||
+        parse_window_bound(from_text, 0, &from) != 0 || parse_window_bound(to_text, 1, &to) != 0) {
+        const char *usage = "Usage: query_flight_window <source> <destination> <YYYY-MM-DD[THH:MM]> <YYYY-MM-DD[THH:MM]>\n";
+        fault_sendto(sockfd, usage, strlen(usage), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
         return;
     }
+    printf("Received window query: source=%s, destination=%s, from=%s, to=%s\n", source, destination, from_text, to_text);
 
-    MYSQL_ROW row = mysql_fetch_row(res);  // Fetch the result row
+    int source_id = find_city(source);
+    int destination_id = find_city(destination);
+    int found = 0;
+    ReplyVec *reply = NULL;  // One element per matching flight, pointing at its route fragment
+
+    epoch_enter();  // Keeps the fragments alive until the reply has been sent
+    pthread_rwlock_rdlock(&catalog_lock);
+    const int32_t *slots = NULL;
+    if (source_id >= 0 && destination_id >= 0) {
+        // Two binary searches locate the window; the matching slots are contiguous
+        found = route_index_range(source_id, destination_id,
+                                  pack_departure_time(from), pack_departure_time(to), &slots);
+    }
+    if (found > 0) {
+        reply = (ReplyVec *)arena_alloc(request_arena(), found * sizeof(ReplyVec));
+    }
+    for (int i = 0; i < found && reply != NULL; i++) {
+        reply_vec_fragment(&reply[i], catalog.route_fragment[slots[i]]);
+    }
+    pthread_rwlock_unlock(&catalog_lock);
 
-    if (row) {
-        // Retrieve baggage availability and format the response
-        snprintf(response, sizeof(response), "Flight ID: %d\nBaggage space available: %s\n", flight_id, row[0]);
+    static const char none[] = "No flights found.\n";
+    ReplyVec no_flights;
+    if (found > 0 && reply == NULL) {
+        epoch_exit();
+        perror("Memory allocation failed");
+        return;
+    }
+    if (!found) {
+        reply_vec_set(&no_flights, none, sizeof(none) - 1);
+        reply = &no_flights;
+        found = 1;
+    }
+
+    // Send the response to the client; the kernel gathers the fragments
+    TRACE(TRACE_SEND, TRACE_BEGIN);
+    ssize_t sent_len = fault_sendv(sockfd, reply, found, 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+    TRACE(TRACE_SEND, TRACE_END);
+    epoch_exit();
+    if (sent_len < 0) {
+        perror("Failed to send response");
     } else {
-        // If no matching flight is found, send an error response
-        strcpy(response, "Flight not found.\n");
+        printf("Response sent to client.\n");
     }
+}
 
-    // Free the query result
-    mysql_free_result(res);
-    store_in_history(client_addr, request, response);  // Store the response in the request history
+// Function to handle multi-criteria searches (seats >= n, airfare <= f, baggage >= b) with vectorised column scans
+void handle_query_flight_filter(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn) {
+    (void)conn;
+    int min_seats, min_baggage;  // Lower bounds on availability
+    float max_fare;  // Upper bound on the airfare
+    int limit = FILTER_DEFAULT_LIMIT;  // Maximum number of flights returned
+
+    // Extract the criteria from the client's request; the limit is optional
+    if (sscanf(request, "query_flight_filter %d %f %d %d", &min_seats, &max_fare, &min_baggage, &limit) < 3 || limit < 1) {
+        const char *usage = "Usage: query_flight_filter <min_seats> <max_airfare> <min_baggage> [limit]\n";
+        fault_sendto(sockfd, usage, strlen(usage), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+        return;
+    }
+    if (limit > FILTER_MAX_LIMIT) {
+        limit = FILTER_MAX_LIMIT;
+    }
+    printf("Received filter query: seats>=%d, airfare<=%.2f, baggage>=%d, limit=%d\n", min_seats, max_fare, min_baggage, limit);
 
-    // Send the response to the client
-    sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+    // Build the response in the worker's request arena
+    Arena *arena = request_arena();
+    size_t response_size = BUFFER_SIZE;
+    size_t response_len = 0;
+    char *response = (char *)arena_alloc(arena, response_size);
+    if (response == NULL) {
+        perror("Memory allocation failed");
+        return;
+    }
 
-    // Log the response
-    printf("Response sent to client.\n");
-}
+    int found = 0;
+    uint64_t bitmap[FILTER_SCAN_CHUNK / FILTER_BLOCK];  // Selection bitmap for one chunk of the catalog
+
+    pthread_rwlock_rdlock(&catalog_lock);
+    for (int base = 0; base < catalog.count && found < limit && response != NULL; base += FILTER_SCAN_CHUNK) {
+        int chunk = catalog.count - base < FILTER_SCAN_CHUNK ? catalog.count - base : FILTER_SCAN_CHUNK;
+
+        // The scan stops early once it has marked enough matches for the remaining limit; when the
+        // re-test below rejects some of them, the rest of the chunk is scanned from where it stopped
+        for (int start = 0; start < chunk && found < limit && response != NULL; ) {
+            size_t words;  // Bitmap words the scan wrote; the rest of the bitmap is stale
+            filter_scan(catalog.seat_availability + base + start, catalog.airfare + base + start,
+                        catalog.baggage_availability + base + start, (size_t)(chunk - start),
+                        min_seats, max_fare, min_baggage, bitmap, (size_t)(limit - found), &words);
+
+            // Walk the set bits of the written words in slot order
+            for (size_t word = 0; word < words && found < limit && response != NULL; word++) {
+                uint64_t bits = bitmap[word];
+                while (bits != 0 && found < limit) {
+                    int slot = base + start + (int)word * FILTER_BLOCK + __builtin_ctzll(bits);
+                    bits &= bits - 1;  // Clear the lowest set bit
+                    if (slot >= base + chunk) {
+                        break;
+                    }
+
+                    // Bookings may change the counters while the scan runs: test and print one consistent
+                    // reading of them (the airfare only changes under the catalog write lock)
+                    int seats, baggage;
+                    read_slot_counters(slot, &seats, &baggage);
+                    if (seats < min_seats || baggage < min_baggage) {
+                        continue;
+                    }
+
+                    char flight_info[128];  // Buffer to store formatted flight information
+                    int info_len = snprintf(flight_info, sizeof(flight_info),
+                                            "Flight ID: %d  Seats: %d  Airfare: %.2f  Baggage: %d kg\n",
+                                            catalog.flight_id[slot], seats, catalog.airfare[slot], baggage);
+
+                    // If the response buffer isn't large enough, grow it inside the arena
+                    if (response_len + info_len >= response_size) {
+                        response = (char *)arena_grow(arena, response, response_size, response_size * 2);
+                        response_size *= 2;
+                        if (response == NULL) {
+                            break;
+                        }
+                    }
+                    memcpy(response + response_len, flight_info, info_len + 1);
+                    response_len += info_len;
+                    found++;
+                }
+            }
+            start += (int)words * FILTER_BLOCK;
+        }
+    }
+    pthread_rwlock_unlock(&catalog_lock);
+
+    if (response == NULL) {
+        perror("Memory allocation failed");
+        return;
+    }
+    if (!found) {
+        strcpy(response, "No flights found.\n");
+        response_len = strlen(response);
+    }
 
+    // Send the response to the client
+    TRACE(TRACE_SEND, TRACE_BEGIN);
+    ssize_t sent_len = fault_sendto(sockfd, response, response_len, 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+    TRACE(TRACE_SEND, TRACE_END);
+    if (sent_len < 0) {
+        perror("Failed to send response");
+    } else {
+        printf("Response sent to client.\n");
+    }
+}
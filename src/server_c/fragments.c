@@ -0,0 +1,232 @@
+#include <stdarg.h>     // For the rendering helper
+#include <stdatomic.h>  // Counters read by query_server_stats
+#include <stdint.h>     // Fixed-width integer types
+#include <stdio.h>      // For vsnprintf and snprintf
+#include <stdlib.h>     // For malloc and free
+#include <string.h>     // For memcpy
+#include <pthread.h>    // Thread-exit hook of the counters cache
+#include "server.h"  // For unpack_departure_time
+#include "fragments.h"
+#include "epoch.h"   // Replaced fragments are freed after their readers
+#include "memory_budget.h"  // Fragments are charged to the catalog
+
+// fragments.c
+// Rendering of the per-flight reply fragments and the gathered send. The text is exactly what
+// the handlers used to format per request, so clients see no difference.
+
+extern const char *months[];  // Month names used for formatting departure time (flight_service.c)
+
+#define COUNTERS_TEXT_SIZE 80  // Room for the counters lines with any two int values
+#define COUNTERS_FRAGMENT_BYTES (sizeof(ReplyFragment) + COUNTERS_TEXT_SIZE)
+#define COUNTERS_CACHE_SIZE 128  // Retired counters fragments a thread keeps for reuse
+
+// Counters reported by query_server_stats
+static _Atomic uint64_t fragments_rendered, fragments_recycled, gathered_replies, gathered_bytes, flattened_replies;
+
+// Counters fragments whose readers are gone, ready to be rendered into again
+static _Thread_local ReplyFragment *counters_cache[COUNTERS_CACHE_SIZE];
+static _Thread_local int counters_cached;
+static _Thread_local int counters_cache_registered;  // The thread-exit hook knows about this cache
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+// Render a printf-style fragment into one allocation
+static ReplyFragment *render_fragment(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (length < 0) {
+        return NULL;
+    }
+    if (memory_charge(MEMORY_CATALOG, sizeof(ReplyFragment) + length + 1) != 0) {
+        return NULL;  // Over the memory budget
+    }
+    ReplyFragment *fragment = (ReplyFragment *)malloc(sizeof(ReplyFragment) + length + 1);
+    if (fragment == NULL) {
+        perror("Memory allocation failed for reply fragment");
+        memory_release(MEMORY_CATALOG, sizeof(ReplyFragment) + length + 1);
+        return NULL;
+    }
+    va_start(args, format);
+    vsnprintf(fragment->text, length + 1, format, args);
+    va_end(args);
+    fragment->length = (uint32_t)length;
+    fragment->capacity = 0;
+    atomic_fetch_add_explicit(&fragments_rendered, 1, memory_order_relaxed);
+    return fragment;
+}
+
+// Thread-exit hook: free the counters fragments the exiting thread kept
+static void free_counters_cache(void *arg) {
+    (void)arg;
+    while (counters_cached > 0) {
+        free(counters_cache[--counters_cached]);
+        memory_release(MEMORY_CATALOG, COUNTERS_FRAGMENT_BYTES);
+    }
+}
+
+static void create_cache_key() {
+    pthread_key_create(&cache_key, free_counters_cache);
+}
+
+// Keep a counters fragment for the calling thread's next rendering, or free it if the cache is full
+static void recycle_counters(void *ptr) {
+    ReplyFragment *fragment = (ReplyFragment *)ptr;
+    if (!counters_cache_registered) {
+        pthread_once(&cache_key_once, create_cache_key);
+        pthread_setspecific(cache_key, counters_cache);  // Any non-NULL value runs the hook
+        counters_cache_registered = 1;
+    }
+    if (counters_cached < COUNTERS_CACHE_SIZE) {
+        counters_cache[counters_cached++] = fragment;
+        return;
+    }
+    memory_release(MEMORY_CATALOG, COUNTERS_FRAGMENT_BYTES);
+    free(fragment);
+}
+
+ReplyFragment *render_detail_fragment(int flight_id, const char *source, const char *destination,
+                                      uint64_t departure, float airfare) {
+    DepartureTime departure_time = unpack_departure_time(departure);
+    return render_fragment("Flight ID: %d\n"
+                           "Source: %s\n"
+                           "Destination: %s\n"
+                           "Departure Time: %s %02d, %d %02d:%02d\n"
+                           "Airfare: %.2f\n",
+                           flight_id, source, destination,
+                           months[departure_time.month - 1], departure_time.day, departure_time.year,
+                           departure_time.hour, departure_time.minute, airfare);
+}
+
+void fragment_free(ReplyFragment *fragment) {
+    if (fragment != NULL && fragment->capacity != 0) {
+        recycle_counters(fragment);
+    } else if (fragment != NULL) {
+        memory_release(MEMORY_CATALOG, sizeof(ReplyFragment) + fragment->length + 1);
+        free(fragment);
+    }
+}
+
+void fragment_retire(ReplyFragment *fragment) {
+    if (fragment != NULL && fragment->capacity != 0) {
+        epoch_retire_batched(fragment, recycle_counters);  // Stays charged while it waits to be reused
+    } else if (fragment != NULL) {
+        epoch_retire_charged(fragment, MEMORY_CATALOG, sizeof(ReplyFragment) + fragment->length + 1);  // Freed within a grace period
+    }
+}
+
+#define COUNTERS_FORMAT "Seats Available: %d\nBaggage Availability: %d kg\n\n"  // The end of the detail reply
+
+size_t format_counters(char *buffer, size_t size, int seats, int baggage) {
+    int written = snprintf(buffer, size, COUNTERS_FORMAT, seats, baggage);
+    return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+}
+
+ReplyFragment *render_counters_fragment(int seats, int baggage) {
+    ReplyFragment *fragment;
+    if (counters_cached > 0) {
+        fragment = counters_cache[--counters_cached];
+        atomic_fetch_add_explicit(&fragments_recycled, 1, memory_order_relaxed);
+    } else {
+        if (memory_charge(MEMORY_CATALOG, COUNTERS_FRAGMENT_BYTES) != 0) {
+            return NULL;  // Over the memory budget
+        }
+        fragment = (ReplyFragment *)malloc(COUNTERS_FRAGMENT_BYTES);
+        if (fragment == NULL) {
+            perror("Memory allocation failed for reply fragment");
+            memory_release(MEMORY_CATALOG, COUNTERS_FRAGMENT_BYTES);
+            return NULL;
+        }
+        fragment->capacity = COUNTERS_TEXT_SIZE;
+    }
+    fragment->length = (uint32_t)format_counters(fragment->text, COUNTERS_TEXT_SIZE, seats, baggage);
+    atomic_fetch_add_explicit(&fragments_rendered, 1, memory_order_relaxed);
+    return fragment;
+}
+
+ReplyFragment *render_route_fragment(int flight_id, uint64_t departure) {
+    DepartureTime departure_time = unpack_departure_time(departure);
+    return render_fragment("Flight ID: %d  Departure: %s %02d, %d %02d:%02d\n",
+                           flight_id, months[departure_time.month - 1], departure_time.day,
+                           departure_time.year, departure_time.hour, departure_time.minute);
+}
+
+size_t reply_flatten(const ReplyVec *vec, int count, char *buffer, size_t size) {
+    size_t total = 0, used = 0;
+    for (int i = 0; i < count; i++) {
+        size_t length = vec[i].iov_len;
+        if (size > 0 && used < size - 1) {
+            size_t copy = length < size - 1 - used ? length : size - 1 - used;
+            memcpy(buffer + used, vec[i].iov_base, copy);
+            used += copy;
+        }
+        total += length;
+    }
+    if (size > 0) {
+        buffer[used] = '\0';
+    }
+    return total;
+}
+
+// Send a vector too long for sendmsg as one flat buffer
+static ssize_t send_flattened(int sockfd, const ReplyVec *vec, int count, int flags, const struct sockaddr *addr, socklen_t addr_len) {
+    size_t total = reply_flatten(vec, count, NULL, 0);
+    if (memory_charge(MEMORY_BUFFERS, total + 1) != 0) {
+        return -1;
+    }
+    char *buffer = (char *)malloc(total + 1);
+    if (buffer == NULL) {
+        perror("Memory allocation failed for reply");
+        memory_release(MEMORY_BUFFERS, total + 1);
+        return -1;
+    }
+    reply_flatten(vec, count, buffer, total + 1);
+    ssize_t sent = sendto(sockfd, buffer, total, flags, addr, addr_len);
+    free(buffer);
+    memory_release(MEMORY_BUFFERS, total + 1);
+    atomic_fetch_add_explicit(&flattened_replies, 1, memory_order_relaxed);
+    return sent;
+}
+
+ssize_t reply_sendv(int sockfd, const ReplyVec *vec, int count, int flags, const struct sockaddr *addr, socklen_t addr_len) {
+    if (count > FRAGMENT_MAX_VECS) {
+        return send_flattened(sockfd, vec, count, flags, addr, addr_len);
+    }
+#ifdef _WIN32
+    WSABUF buffers[FRAGMENT_MAX_VECS];
+    for (int i = 0; i < count; i++) {
+        buffers[i].buf = (char *)vec[i].iov_base;
+        buffers[i].len = (ULONG)vec[i].iov_len;
+    }
+    DWORD sent = 0;
+    if (WSASendTo(sockfd, buffers, (DWORD)count, &sent, (DWORD)flags, addr, addr_len, NULL, NULL) != 0) {
+        return -1;
+    }
+#else
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_name = (void *)addr;
+    message.msg_namelen = addr_len;
+    message.msg_iov = (struct iovec *)vec;
+    message.msg_iovlen = count;
+    ssize_t sent = sendmsg(sockfd, &message, flags);
+    if (sent < 0) {
+        return -1;
+    }
+#endif
+    atomic_fetch_add_explicit(&gathered_replies, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&gathered_bytes, (uint64_t)sent, memory_order_relaxed);
+    return (ssize_t)sent;
+}
+
+size_t fragment_stats_report(char *buffer, size_t size) {
+    int written = snprintf(buffer, size,
+                           "Reply fragments: %llu rendered (%llu into recycled counters fragments), %llu gathered replies (%llu bytes), %llu flattened\n",
+                           (unsigned long long)atomic_load(&fragments_rendered),
+                           (unsigned long long)atomic_load(&fragments_recycled),
+                           (unsigned long long)atomic_load(&gathered_replies),
+                           (unsigned long long)atomic_load(&gathered_bytes),
+                           (unsigned long long)atomic_load(&flattened_replies));
+    return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+}
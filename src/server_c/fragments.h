@@ -0,0 +1,109 @@
+#ifndef FRAGMENTS_H
+#define FRAGMENTS_H
+
+#include <stddef.h>  // For size_t
+#include <stdint.h>  // For uint32_t
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>  // For socklen_t
+#else
+#include <sys/socket.h>  // For sendmsg and socklen_t
+#include <sys/types.h>   // For ssize_t
+#include <sys/uio.h>     // For struct iovec
+#endif
+
+// fragments.h
+// Pre-rendered reply text. Every flight keeps the parts of its replies that only change when
+// the flight does: the descriptive lines of the detail reply and its line in route replies are
+// rendered once when the flight is added, the seat and baggage lines each time its counters
+// change. A handler answers by pointing a short vector at the fragments (and a header, if any)
+// and handing it to sendmsg, so the reply is neither formatted nor copied before the kernel
+// gathers it.
+//
+// Fragments are immutable once published. A replaced fragment is retired through epoch.c, so a
+// handler must stay inside epoch_enter/epoch_exit from reading a fragment pointer until the
+// reply has been sent. Counters fragments, replaced on every booking, all have the same size
+// and are recycled through per-thread caches instead of being freed.
+
+#define FRAGMENT_MAX_VECS 1024  // Longest vector sendmsg is given (IOV_MAX); longer replies are flattened
+
+// One piece of reply text
+typedef struct ReplyFragment {
+    uint32_t length;  // Bytes of text, without the terminating NUL
+    uint32_t capacity;  // Text bytes allocated for fixed-size fragments that are recycled, 0 otherwise
+    char text[];      // NUL-terminated for logging
+} ReplyFragment;
+
+// One element of a gathered reply
+#ifdef _WIN32
+typedef struct {
+    const void *iov_base;
+    size_t iov_len;
+} ReplyVec;
+#else
+typedef struct iovec ReplyVec;  // Handed to sendmsg as is
+#endif
+
+// Point a vector element at length bytes of text
+static inline void reply_vec_set(ReplyVec *vec, const void *base, size_t length) {
+    vec->iov_base = (void *)base;
+    vec->iov_len = length;
+}
+
+// Point a vector element at a fragment
+static inline void reply_vec_fragment(ReplyVec *vec, const ReplyFragment *fragment) {
+    reply_vec_set(vec, fragment->text, fragment->length);
+}
+
+/**
+ * @brief Render the descriptive lines of a flight's detail reply (Flight ID to Airfare);
+ *        departure is packed by pack_departure_time.
+ * @return A malloc'd fragment, or NULL if out of memory.
+ */
+ReplyFragment *render_detail_fragment(int flight_id, const char *source, const char *destination,
+                                      uint64_t departure, float airfare);
+
+/**
+ * @brief Render the seat and baggage lines that end a flight's detail reply, into a recycled
+ *        fragment when the calling thread has one.
+ */
+ReplyFragment *render_counters_fragment(int seats, int baggage);
+
+/**
+ * @brief Format the same lines into buffer, for when a fragment could not be rendered; returns the length written.
+ */
+size_t format_counters(char *buffer, size_t size, int seats, int baggage);
+
+/**
+ * @brief Render a flight's line in route search replies.
+ */
+ReplyFragment *render_route_fragment(int flight_id, uint64_t departure);
+
+/**
+ * @brief Free a fragment that was never published (NULL is ignored).
+ */
+void fragment_free(ReplyFragment *fragment);
+
+/**
+ * @brief Free a replaced fragment once its readers have left their epoch sections (NULL is ignored).
+ */
+void fragment_retire(ReplyFragment *fragment);
+
+/**
+ * @brief Gathered sendto: send the vector's elements as one datagram.
+ */
+ssize_t reply_sendv(int sockfd, const ReplyVec *vec, int count, int flags, const struct sockaddr *addr, socklen_t addr_len);
+
+/**
+ * @brief Copy the vector's elements into buffer (NUL-terminated, truncated to size).
+ * @return The total length of the elements, which may exceed size.
+ */
+size_t reply_flatten(const ReplyVec *vec, int count, char *buffer, size_t size);
+
+/**
+ * @brief Write the fragment counters into buffer; returns the length written.
+ */
+size_t fragment_stats_report(char *buffer, size_t size);
+
+#endif // FRAGMENTS_H
@@ -18,9 +18,25 @@
 
 #include <pthread.h>  // For threading functionality
 #include "server.h"   // Include the server header, which contains relevant function declarations
+#include "fault.h"    // Replies pass through the fault injection layer
+
+// Refuse a mutation on a read-only backup
+static void reject_on_backup(int sockfd, struct sockaddr_in *cliaddr, socklen_t len) {
+    const char *response = "Read-only replica: send reservations and baggage requests to the primary.\n";
+    fault_sendto(sockfd, response, strlen(response), 0, (const struct sockaddr *)cliaddr, len);
+}
 
 // Function to handle different client requests
 void handleRequest(char *request, struct sockaddr_in cliaddr, int sockfd, socklen_t len, MYSQL *conn) {
+    // In a partitioned deployment, requests for other nodes' flights are forwarded or fanned out
+    if (partition_route(request, &cliaddr, sockfd, len, conn)) {
+        return;
+    }
+    dispatch_request(request, cliaddr, sockfd, len, conn);
+}
+
+// Function to run a request against this server's own state
+void dispatch_request(char *request, struct sockaddr_in cliaddr, int sockfd, socklen_t len, MYSQL *conn) {
     char response[1024];  // Buffer to store the response sent back to the client
 
     // Parse the client's request and handle different types of requests accordingly
@@ -28,12 +44,23 @@ void handleRequest(char *request, struct sockaddr_in cliaddr, int sockfd, sockle
         // Handle a "test_connection" request to verify the server is reachable
         printf("Received test connection request from client\n");
         strcpy(response, "Connection OK");  // Simple response to confirm connection
+        fault_sendto(sockfd, response, strlen(response), 0, (const struct sockaddr *)&cliaddr, len);  // Proxies probe backends with this
     } 
     else if (strncmp(request, "query_flight_id", 15) == 0) {
         // Handle a request to query flight IDs based on source and destination
         printf("Received query_flight_id request\n");
         handle_query_flight(sockfd, &cliaddr, request, conn);  // Call function to handle flight ID query
     } 
+    else if (strncmp(request, "query_flight_window", 19) == 0) {
+        // Handle a request to search a route within a departure time window
+        printf("Received query_flight_window request\n");
+        handle_query_flight_window(sockfd, &cliaddr, request, conn);  // Call function to handle the window search
+    }
+    else if (strncmp(request, "query_flight_filter", 19) == 0) {
+        // Handle a request to search all flights by seats, airfare and baggage
+        printf("Received query_flight_filter request\n");
+        handle_query_flight_filter(sockfd, &cliaddr, request, conn);  // Call function to handle the filtered search
+    }
     else if (strncmp(request, "query_flight_info", 17) == 0) {
         // Handle a request to get detailed flight information
         printf("Received query_flight_info request\n");
@@ -42,7 +69,11 @@ void handleRequest(char *request, struct sockaddr_in cliaddr, int sockfd, sockle
     else if (strncmp(request, "make_seat_reservation", 21) == 0) {
         // Handle a request to make a seat reservation
         printf("Received make_seat_reservation request\n");
-        handle_reservation(sockfd, &cliaddr, request, conn);  // Call function to handle seat reservation
+        if (replication_is_read_only()) {
+            reject_on_backup(sockfd, &cliaddr, len);  // Backups only serve reads
+        } else {
+            handle_reservation(sockfd, &cliaddr, request, conn);  // Call function to handle seat reservation
+        }
     } 
     else if (strncmp(request, "query_baggage_availability", 26) == 0) {
         // Handle a request to check baggage availability
@@ -52,41 +83,44 @@ void handleRequest(char *request, struct sockaddr_in cliaddr, int sockfd, sockle
     else if (strncmp(request, "add_baggage", 11) == 0) {
         // Handle a request to add baggage to a flight
         printf("Received add_baggage request\n");
-        handle_add_baggage(sockfd, &cliaddr, request, conn);  // Call function to handle baggage addition
+        if (replication_is_read_only()) {
+            reject_on_backup(sockfd, &cliaddr, len);  // Backups only serve reads
+        } else {
+            handle_add_baggage(sockfd, &cliaddr, request, conn);  // Call function to handle baggage addition
+        }
     } 
+    else if (strncmp(request, "batch", 5) == 0) {
+        // Handle a batch of operations carried in one datagram
+        printf("Received batch request\n");
+        handle_batch(sockfd, &cliaddr, request, conn);  // Call function to run the operations and send one combined reply
+    }
+    else if (strncmp(request, "promote_replica", 15) == 0) {
+        // Handle a request to promote this backup to primary after the primary failed
+        printf("Received promote_replica request\n");
+        handle_promote_replica(sockfd, &cliaddr, request, conn);  // Call function to take over as primary
+    }
+    else if (strncmp(request, "query_server_stats", 18) == 0) {
+        // Handle a request for the server's runtime statistics
+        printf("Received query_server_stats request\n");
+        handle_query_server_stats(sockfd, &cliaddr, request, conn);  // Call function to report lock and server counters
+    }
     else if (strncmp(request, "follow_flight_id", 16) == 0) {
         // Handle a request to start monitoring a flight
         printf("Received follow_flight_id request\n");
 
-        // Parse the flight ID from the request
-        int flight_id;
-        sscanf(request, "follow_flight_id %d", &flight_id);  // Extract flight ID from the request string
+        // Parse the flight ID and the optional monitor interval (seconds) from the request
+        int flight_id = 0, lease_seconds = 0;
+        sscanf(request, "follow_flight_id %d %d", &flight_id, &lease_seconds);  // Extract flight ID from the request string
         printf("Received follow_flight_id request for flight_id: %d\n", flight_id);
 
-        // Register the client for monitoring the specified flight
-        register_flight_monitor(sockfd, &cliaddr, flight_id);
-
-        // Create a new thread to monitor flight seat availability
-        pthread_t monitor_thread;
-        struct client_data *data = malloc(sizeof(struct client_data));  // Allocate memory for client data
-        data->sockfd = sockfd;  // Store socket file descriptor
-        data->client_addr = cliaddr;  // Store client address
-        data->conn = conn;  // Store database connection
-
-        // Create a thread to monitor the flight's seat availability
-        if (pthread_create(&monitor_thread, NULL, monitor_flights, (void *)data) != 0) {
-            perror("Failed to create monitor thread");  // Error handling if thread creation fails
-        }
-        pthread_detach(monitor_thread);  // Detach the thread so it can run independently
-
-        // Send a confirmation response to the client
-        strcpy(response, "Flight monitoring started.\n");
+        // Register the client for monitoring the specified flight; the notifier thread sends the updates
+        register_flight_monitor(sockfd, &cliaddr, flight_id, lease_seconds);  // Also sends the confirmation
     } 
     else {
         // Handle an unknown or unsupported command
         printf("Unknown command received: %s\n", request);
         strcpy(response, "Unknown command");  // Respond with an error message
-        sendto(sockfd, response, strlen(response), 0, (const struct sockaddr *)&cliaddr, len);  // Send response to client
+        fault_sendto(sockfd, response, strlen(response), 0, (const struct sockaddr *)&cliaddr, len);  // Send response to client
     }
 
     // Log the response sent to the client
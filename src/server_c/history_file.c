@@ -0,0 +1,129 @@
+#include <stdatomic.h>  // Counters read by query_server_stats
+#include <stdint.h>     // Fixed-width integer types
+#include <stdio.h>      // For printf and snprintf
+#include <string.h>     // For memcmp and memcpy
+#include <time.h>       // For clock_gettime
+
+#ifndef _WIN32
+#include <fcntl.h>      // For open
+#include <sys/file.h>   // For flock
+#include <sys/mman.h>   // For mmap and msync
+#include <sys/stat.h>   // For fstat
+#include <unistd.h>     // For ftruncate and close
+#endif
+
+#include "history_file.h"
+#include "timer.h"   // Restored timestamps are rebased onto the wheel's clock
+
+// history_file.c
+// The file is mapped shared, so the history's own stores are the persistence and nothing is
+// copied. The timestamps in the entries are on the monotonic clock of the process that wrote
+// them; the header keeps that clock's offset from the wall clock, so the next process can tell
+// how old each restored reply really is. An flock on the file keeps a second server from
+// mapping the same history.
+
+// The file's header, padded to HISTORY_FILE_HEADER_SIZE
+typedef struct {
+    char magic[8];  // HISTORY_FILE_MAGIC
+    uint32_t entry_size;  // Bytes per entry
+    uint32_t capacity;  // Entries in the ring
+    HistoryRing ring;  // Updated by the history as it stores and expires replies
+    int64_t clock_offset_ms;  // Wall clock minus timer_now_ms() of the process using the file
+} HistoryFileHeader;
+
+_Static_assert(sizeof(HistoryFileHeader) <= HISTORY_FILE_HEADER_SIZE, "history file header too large");
+
+static void *mapping = NULL;
+static size_t mapping_length;
+static const char *history_path;
+static int restored;  // Entries found in the file at startup
+static _Atomic uint64_t checkpoints;
+
+static int64_t wall_clock_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void *history_file_open(const char *path, size_t entry_size, int capacity, HistoryRing **ring, int64_t *clock_shift_ms) {
+#ifdef _WIN32
+    (void)entry_size;
+    (void)capacity;
+    (void)ring;
+    (void)clock_shift_ms;
+    printf("History file %s: memory-mapped history is not supported on this platform\n", path);
+    return NULL;
+#else
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("History file open failed");
+        return NULL;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        printf("History file %s is in use by another server\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    // A file of any other size was not written by this build: start it again
+    size_t length = HISTORY_FILE_HEADER_SIZE + entry_size * (size_t)capacity;
+    struct stat st;
+    int fresh = fstat(fd, &st) != 0 || (size_t)st.st_size != length;
+    if (fresh && (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)length) != 0)) {
+        perror("History file resize failed");
+        close(fd);
+        return NULL;
+    }
+    void *memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);  // The mapping keeps the file, and the lock, open
+    if (memory == MAP_FAILED) {
+        perror("History file mmap failed");
+        return NULL;
+    }
+
+    HistoryFileHeader *header = (HistoryFileHeader *)memory;
+    if (!fresh && (memcmp(header->magic, HISTORY_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+                   header->entry_size != entry_size || header->capacity != (uint32_t)capacity ||
+                   header->ring.head < 0 || header->ring.head >= capacity ||
+                   header->ring.count < 0 || header->ring.count > capacity)) {
+        printf("History file %s does not match this server; starting with an empty history\n", path);
+        fresh = 1;
+    }
+    int64_t offset = wall_clock_ms() - (int64_t)timer_now_ms();
+    if (fresh) {
+        memset(header, 0, HISTORY_FILE_HEADER_SIZE);
+        header->entry_size = (uint32_t)entry_size;
+        header->capacity = (uint32_t)capacity;
+        memcpy(header->magic, HISTORY_FILE_MAGIC, sizeof(header->magic));
+        *clock_shift_ms = 0;
+    } else {
+        *clock_shift_ms = header->clock_offset_ms - offset;
+        restored = header->ring.count;
+    }
+    header->clock_offset_ms = offset;
+
+    mapping = memory;
+    mapping_length = length;
+    history_path = path;
+    *ring = &header->ring;
+    return (char *)memory + HISTORY_FILE_HEADER_SIZE;
+#endif
+}
+
+void history_file_checkpoint() {
+#ifndef _WIN32
+    if (mapping == NULL) {
+        return;
+    }
+    msync(mapping, mapping_length, MS_ASYNC);
+    atomic_fetch_add_explicit(&checkpoints, 1, memory_order_relaxed);
+#endif
+}
+
+size_t history_file_stats_report(char *buffer, size_t size) {
+    int written = mapping == NULL
+        ? snprintf(buffer, size, "History file: off\n")
+        : snprintf(buffer, size, "History file: %s, %d replies found at startup, %llu checkpoints\n",
+                   history_path, restored, (unsigned long long)atomic_load(&checkpoints));
+    return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+}
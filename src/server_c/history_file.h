@@ -0,0 +1,48 @@
+#ifndef HISTORY_FILE_H
+#define HISTORY_FILE_H
+
+#include <stddef.h>  // For size_t
+#include <stdint.h>  // Fixed-width integer types
+
+// history_file.h
+// Persistence of the at-most-once request history (--history-file FILE). The history's entries
+// and ring position live in a memory-mapped file rather than in the process, so every stored
+// reply is in the page cache the moment it is written: a server that crashes or is restarted
+// maps the same file and answers retransmissions of requests it ran before, such as a
+// make_seat_reservation whose reply was lost, from the restored replies instead of running
+// them again. A periodic checkpoint asks the kernel to write dirty pages back to disk.
+//
+// File layout: one HISTORY_FILE_HEADER_SIZE-byte header (magic, entry size, capacity, ring
+// position and the clock offset of the process that wrote the entries), then capacity entries.
+
+#define HISTORY_FILE_MAGIC "SCHIST01"  // First 8 bytes of a history file
+#define HISTORY_FILE_HEADER_SIZE 64  // Entries start at this offset
+
+// Where the stored entries are in the file's ring of entries; aligned so that both fields can
+// be replaced in a single store
+typedef struct {
+    _Alignas(8) int32_t head;  // Oldest entry
+    int32_t count;  // Entries in use, from head onwards
+} HistoryRing;
+
+/**
+ * @brief Map the history file at path, creating it, or starting it empty if it was written
+ *        with a different entry size or capacity. Only one server may use a file at a time.
+ * @param clock_shift_ms Set to what has to be added to the timer_now_ms() timestamps of the
+ *        restored entries to put them on this process's clock.
+ * @return The capacity entries of entry_size bytes, with *ring pointing at their position in
+ *         the file, or NULL if the file cannot be used.
+ */
+void *history_file_open(const char *path, size_t entry_size, int capacity, HistoryRing **ring, int64_t *clock_shift_ms);
+
+/**
+ * @brief Schedule the dirty pages of the mapping for writing back to disk (no-op without a file).
+ */
+void history_file_checkpoint();
+
+/**
+ * @brief Write the history file's counters into buffer; returns the length written.
+ */
+size_t history_file_stats_report(char *buffer, size_t size);
+
+#endif // HISTORY_FILE_H
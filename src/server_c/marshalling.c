@@ -4,6 +4,27 @@
 #include <string.h>  // Include string manipulation functions
 #include "server.h"  // Include server definitions
 
+// Write an integer in network byte order straight into a destination buffer
+static void write_int(uint8_t* dest, int value) {
+    uint32_t network_value = htonl(value);  // Convert integer from host to network byte order (big-endian)
+    memcpy(dest, &network_value, 4);  // Copy the 4 bytes into place
+}
+
+// Write a float's bit pattern in network byte order straight into a destination buffer
+static void write_float(uint8_t* dest, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);  // Reinterpret the float as its bit pattern
+    write_int(dest, (int)bits);
+}
+
+// Write a length-prefixed string into a destination buffer; returns the bytes written
+static uint32_t write_string(uint8_t* dest, const char* str) {
+    uint32_t str_len = strlen(str);  // Get the length of the string
+    write_int(dest, (int)str_len);  // Length prefix
+    memcpy(dest + 4, str, str_len);  // String data after the prefix
+    return 4 + str_len;
+}
+
 // Marshal an integer to a byte array (4 bytes)
 uint8_t* marshal_int(int value) {
     uint32_t network_value = htonl(value);  // Convert integer from host to network byte order (big-endian)
@@ -38,43 +59,37 @@ uint8_t* marshal_departure_time(const DepartureTime* departure, uint32_t* out_le
     *out_length = 5 * 4;  // Allocate 4 bytes for each of the 5 integer fields
     uint8_t* buffer = malloc(*out_length);  // Allocate memory for the departure time structure
 
-    // Marshal and copy each field into the buffer
-    memcpy(buffer, marshal_int(departure->year), 4);
-    memcpy(buffer + 4, marshal_int(departure->month), 4);
-    memcpy(buffer + 8, marshal_int(departure->day), 4);
-    memcpy(buffer + 12, marshal_int(departure->hour), 4);
-    memcpy(buffer + 16, marshal_int(departure->minute), 4);
+    // Write each field directly into the buffer
+    write_int(buffer, departure->year);
+    write_int(buffer + 4, departure->month);
+    write_int(buffer + 8, departure->day);
+    write_int(buffer + 12, departure->hour);
+    write_int(buffer + 16, departure->minute);
 
     return buffer;  // Return the marshaled departure time structure
 }
 
 // Marshal a Flight structure
 uint8_t* marshal_flight(const Flight* flight, uint32_t* out_length) {
-    uint32_t source_len, dest_len, time_len;
-
-    // Marshal the source and destination places and departure time
-    uint8_t* source = marshal_string(flight->source_place, &source_len);
-    uint8_t* dest = marshal_string(flight->destination_place, &dest_len);
-    uint8_t* time = marshal_departure_time(&(flight->departure_time), &time_len);
-
-    // Calculate the total size: flight_id (4 bytes), source, destination, departure time, airfare (4 bytes), seat availability (4 bytes), baggage availability (4 bytes)
-    *out_length = 4 + source_len + dest_len + time_len + 4 + 4 + 4;
-    uint8_t* buffer = malloc(*out_length);  // Allocate memory for the entire flight structure
+    // Calculate the total size: flight_id (4 bytes), source, destination, departure time (20 bytes), airfare (4 bytes), seat availability (4 bytes), baggage availability (4 bytes)
+    uint32_t source_len = 4 + strlen(flight->source_place);
+    uint32_t dest_len = 4 + strlen(flight->destination_place);
+    *out_length = 4 + source_len + dest_len + 20 + 4 + 4 + 4;
+    uint8_t* buffer = malloc(*out_length);  // One allocation for the entire flight structure
 
-    // Copy the marshaled fields into the buffer, updating the offset for each field
+    // Write the fields into the buffer, updating the offset for each field
     uint32_t offset = 0;
-    memcpy(buffer + offset, marshal_int(flight->flight_id), 4); offset += 4;
-    memcpy(buffer + offset, source, source_len); offset += source_len;
-    memcpy(buffer + offset, dest, dest_len); offset += dest_len;
-    memcpy(buffer + offset, time, time_len); offset += time_len;
-    memcpy(buffer + offset, marshal_float(flight->airfare), 4); offset += 4;
-    memcpy(buffer + offset, marshal_int(flight->seat_availability), 4); offset += 4;
-    memcpy(buffer + offset, marshal_int(flight->baggage_availability), 4);
-
-    // Free dynamically allocated memory for individual marshaled fields
-    free(source);
-    free(dest);
-    free(time);
+    write_int(buffer + offset, flight->flight_id); offset += 4;
+    offset += write_string(buffer + offset, flight->source_place);
+    offset += write_string(buffer + offset, flight->destination_place);
+    write_int(buffer + offset, flight->departure_time.year); offset += 4;
+    write_int(buffer + offset, flight->departure_time.month); offset += 4;
+    write_int(buffer + offset, flight->departure_time.day); offset += 4;
+    write_int(buffer + offset, flight->departure_time.hour); offset += 4;
+    write_int(buffer + offset, flight->departure_time.minute); offset += 4;
+    write_float(buffer + offset, flight->airfare); offset += 4;
+    write_int(buffer + offset, flight->seat_availability); offset += 4;
+    write_int(buffer + offset, flight->baggage_availability);
 
     return buffer;  // Return the marshaled flight structure
 }
@@ -86,8 +101,8 @@ uint8_t* marshal_message(const Message* message, uint32_t* out_length) {
 
     // Copy message fields into the buffer
     buffer[0] = message->message_type;  // 1 byte for message type
-    memcpy(buffer + 1, marshal_int(message->request_id), 4);  // 4 bytes for request ID
-    memcpy(buffer + 5, marshal_int(message->data_length), 4);  // 4 bytes for data length
+    write_int(buffer + 1, message->request_id);  // 4 bytes for request ID
+    write_int(buffer + 5, message->data_length);  // 4 bytes for data length
     memcpy(buffer + 9, message->data, message->data_length);  // Copy the actual data
 
     return buffer;  // Return the marshaled message
@@ -0,0 +1,104 @@
+#include <stdatomic.h>  // Charged bytes, updated by every thread
+#include <stdint.h>     // Fixed-width integer types
+#include <stdio.h>      // For snprintf and fopen
+#include <stdlib.h>     // For strtol
+#include <unistd.h>     // For sysconf
+#include "memory_budget.h"
+
+// memory_budget.c
+// One atomic total checked against the budget with compare-and-swap, so concurrent charges
+// can never overshoot it, plus a counter per subsystem for the report.
+
+static const char *kind_names[MEMORY_KINDS] = {
+    "catalog", "reply cache", "clients", "subscriptions", "queues", "buffers"
+};
+
+static uint64_t budget;  // Bytes; 0 = unlimited (set before any thread starts)
+static _Atomic uint64_t total, peak;
+static _Atomic uint64_t charged[MEMORY_KINDS];  // Bytes held per subsystem
+static _Atomic uint64_t refused[MEMORY_KINDS];  // Charges turned down per subsystem
+
+int memory_set_budget(const char *value) {
+    char *end;
+    long megabytes = strtol(value, &end, 10);
+    if (*end != '\0' || megabytes < 0) {
+        return -1;
+    }
+    budget = (uint64_t)megabytes << 20;
+    return 0;
+}
+
+// Raise the peak to the new total if it is higher
+static void note_peak(uint64_t now) {
+    uint64_t seen = atomic_load_explicit(&peak, memory_order_relaxed);
+    while (now > seen && !atomic_compare_exchange_weak_explicit(&peak, &seen, now, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+int memory_charge(int kind, size_t bytes) {
+    uint64_t now = atomic_load_explicit(&total, memory_order_relaxed);
+    do {
+        if (budget != 0 && now + bytes > budget) {
+            atomic_fetch_add_explicit(&refused[kind], 1, memory_order_relaxed);
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&total, &now, now + bytes, memory_order_relaxed, memory_order_relaxed));
+    atomic_fetch_add_explicit(&charged[kind], bytes, memory_order_relaxed);
+    note_peak(now + bytes);
+    return 0;
+}
+
+void memory_charge_fixed(int kind, size_t bytes) {
+    uint64_t now = atomic_fetch_add_explicit(&total, bytes, memory_order_relaxed) + bytes;
+    atomic_fetch_add_explicit(&charged[kind], bytes, memory_order_relaxed);
+    note_peak(now);
+}
+
+void memory_release(int kind, size_t bytes) {
+    atomic_fetch_sub_explicit(&total, bytes, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&charged[kind], bytes, memory_order_relaxed);
+}
+
+// Resident set size in bytes, or 0 if the platform does not say
+static uint64_t resident_bytes() {
+    uint64_t resident = 0;
+#ifdef __linux__
+    FILE *file = fopen("/proc/self/statm", "r");
+    unsigned long long pages_total, pages_resident;
+    if (file != NULL) {
+        if (fscanf(file, "%llu %llu", &pages_total, &pages_resident) == 2) {
+            resident = (uint64_t)pages_resident * (uint64_t)sysconf(_SC_PAGESIZE);
+        }
+        fclose(file);
+    }
+#endif
+    return resident;
+}
+
+size_t memory_stats_report(char *buffer, size_t size) {
+    uint64_t refusals = 0;
+    for (int kind = 0; kind < MEMORY_KINDS; kind++) {
+        refusals += atomic_load(&refused[kind]);
+    }
+    int written;
+    if (budget != 0) {
+        written = snprintf(buffer, size, "Memory: %llu KB accounted of %llu KB budget (peak %llu KB), %llu KB resident, %llu charges refused;",
+                           (unsigned long long)(atomic_load(&total) >> 10), (unsigned long long)(budget >> 10),
+                           (unsigned long long)(atomic_load(&peak) >> 10), (unsigned long long)(resident_bytes() >> 10),
+                           (unsigned long long)refusals);
+    } else {
+        written = snprintf(buffer, size, "Memory: %llu KB accounted, no budget (peak %llu KB), %llu KB resident;",
+                           (unsigned long long)(atomic_load(&total) >> 10), (unsigned long long)(atomic_load(&peak) >> 10),
+                           (unsigned long long)(resident_bytes() >> 10));
+    }
+    size_t used = written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+    for (int kind = 0; kind < MEMORY_KINDS && used + 1 < size; kind++) {
+        unsigned long long kilobytes = atomic_load(&charged[kind]) >> 10, refusals_here = atomic_load(&refused[kind]);
+        const char *separator = kind == MEMORY_KINDS - 1 ? "\n" : ",";
+        written = refusals_here
+                      ? snprintf(buffer + used, size - used, " %s %llu KB (%llu refused)%s", kind_names[kind], kilobytes, refusals_here, separator)
+                      : snprintf(buffer + used, size - used, " %s %llu KB%s", kind_names[kind], kilobytes, separator);
+        used = written < 0 ? used : ((size_t)written < size - used ? used + written : size - 1);
+    }
+    return used;
+}
@@ -0,0 +1,53 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <stddef.h>  // For size_t
+
+// memory_budget.h
+// Accounting of the server's long-lived and per-request heap memory by subsystem, and an
+// optional hard budget (--memory-budget MB). Structures sized at startup are charged with
+// memory_charge_fixed; memory a subsystem takes while it runs is charged with memory_charge
+// before it is allocated, and a refused charge makes the subsystem refuse the work instead of
+// growing: the catalog does not add the flight, sessions do not admit the request, the
+// database pool fails the query, the receive loop drops the datagram, and so on. Every charge
+// is paired with a memory_release when the memory is freed.
+
+enum {
+    MEMORY_CATALOG,        // Columns, indexes and reply fragments
+    MEMORY_REPLY_CACHE,    // Request history and replies kept for session retransmissions
+    MEMORY_CLIENTS,        // Sessions and rate limiter buckets
+    MEMORY_SUBSCRIPTIONS,  // follow_flight_id monitors
+    MEMORY_QUEUES,         // Task queues, database jobs, held datagrams and retired memory
+    MEMORY_BUFFERS,        // Request slots, request arenas and trace rings
+    MEMORY_KINDS
+};
+
+/**
+ * @brief Set the budget from the command line (--memory-budget MB; 0 = unlimited).
+ * @return 0 on success, -1 for an invalid value.
+ */
+int memory_set_budget(const char *value);
+
+/**
+ * @brief Charge bytes a subsystem is about to allocate.
+ * @return 0 if they fit in the budget, -1 if not (nothing is charged and the work should be refused).
+ */
+int memory_charge(int kind, size_t bytes);
+
+/**
+ * @brief Charge bytes that cannot be refused (structures sized at startup); they count toward the budget.
+ */
+void memory_charge_fixed(int kind, size_t bytes);
+
+/**
+ * @brief Give back bytes charged earlier, once they are freed.
+ */
+void memory_release(int kind, size_t bytes);
+
+/**
+ * @brief Write the accounted memory per subsystem, the budget and the resident set into buffer;
+ *        returns the length written.
+ */
+size_t memory_stats_report(char *buffer, size_t size);
+
+#endif // MEMORY_BUDGET_H
@@ -0,0 +1,429 @@
+#include <stdint.h>  // Fixed-width integer types
+#include <stdio.h>   // For printf, snprintf and sscanf
+#include <stdlib.h>  // For qsort
+#include <string.h>  // For strncmp and memcpy
+#include <unistd.h>  // For close
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>  // For the forwarding socket's receive timeout
+#endif
+
+#include "server.h"
+#include "arena.h"  // Answers and the merged reply live in the request arena
+#include "fault.h"  // Replies pass through the fault injection layer
+
+// partition.c
+// Partitioned deployment: every server is started with the same --node list, and flights are
+// assigned to nodes by a consistent-hash ring with PARTITION_VNODES points per node, so adding
+// a node takes over about 1/N of the flights and leaves the rest where they were. Each node
+// loads only the flights it owns. A request naming a flight another node owns is forwarded
+// there as "fwd <ip:port> <request>" and the owner replies straight to the client; route and
+// filter searches are sent to every node and the partial answers are merged.
+
+#define MAX_NODES 64  // Nodes in a partitioned deployment
+#define PARTITION_VNODES 128  // Ring points per node
+#define FORWARD_TIMEOUT_MS 1000  // How long a fan-out waits for the other nodes
+#define FANOUT_BUFFER_SIZE 65536  // Largest partial answer accepted from one node
+#define FANOUT_REPLY_SIZE 65507  // Largest merged reply: the UDP payload limit
+#define FILTER_DEFAULT_LIMIT 50  // Must match the limit query_flight_filter uses by default
+
+// One point on the ring
+typedef struct {
+    uint32_t hash;  // Position on the ring
+    int node;  // Index into nodes[]
+} RingPoint;
+
+static struct sockaddr_in nodes[MAX_NODES];  // Request address of every node
+static int node_count = 0;
+static int self_node = -1;  // Index of this server in nodes[], -1 when not partitioned
+static RingPoint ring[MAX_NODES * PARTITION_VNODES];
+static int ring_size = 0;
+static _Thread_local int forward_sockfd = -1;  // Per-worker socket used to gather fan-out replies
+
+extern const char *months[];  // Month names used in route search replies (flight_service.c)
+
+// Integer mixer that spreads flight ids and node hashes over the ring
+static uint32_t mix32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// FNV-1a hash of a string, mixed
+static uint32_t hash_string(const char *text) {
+    uint32_t hash = 2166136261u;
+    while (*text) {
+        hash = (hash ^ (uint8_t)*text++) * 16777619u;
+    }
+    return mix32(hash);
+}
+
+static int compare_points(const void *a, const void *b) {
+    uint32_t x = ((const RingPoint *)a)->hash, y = ((const RingPoint *)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+// Parse "host:port" into a socket address
+static int parse_node(const char *text, struct sockaddr_in *out) {
+    char host[64];
+    const char *colon = strrchr(text, ':');
+    if (colon == NULL || colon - text >= (int)sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, text, colon - text);
+    host[colon - text] = '\0';
+    memset(out, 0, sizeof(*out));
+    out->sin_family = AF_INET;
+    out->sin_port = htons(atoi(colon + 1));
+    return inet_pton(AF_INET, host, &out->sin_addr) == 1 ? 0 : -1;
+}
+
+// Format a node address as "ip:port"
+static void format_node(const struct sockaddr_in *addr, char *text, size_t size) {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+    snprintf(text, size, "%s:%d", ip, ntohs(addr->sin_port));
+}
+
+// Build the ring from a list of node addresses; points depend only on each node's address
+static void build_ring(const struct sockaddr_in *members, int count, RingPoint *points, int *size) {
+    char address[32], label[64];
+    *size = 0;
+    for (int node = 0; node < count; node++) {
+        format_node(&members[node], address, sizeof(address));
+        for (int v = 0; v < PARTITION_VNODES; v++) {
+            snprintf(label, sizeof(label), "%s#%d", address, v);
+            points[*size].hash = hash_string(label);
+            points[*size].node = node;
+            (*size)++;
+        }
+    }
+    qsort(points, *size, sizeof(RingPoint), compare_points);
+}
+
+// Node owning a flight on a ring: the first point at or after the flight's hash
+static int ring_owner(const RingPoint *points, int size, int flight_id) {
+    uint32_t hash = mix32((uint32_t)flight_id);
+    int low = 0, high = size;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (points[mid].hash < hash) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return points[low == size ? 0 : low].node;  // Wrap around past the last point
+}
+
+// Add a node ("host:port" of its request socket) to the deployment
+int partition_add_node(const char *address) {
+    if (node_count >= MAX_NODES || parse_node(address, &nodes[node_count]) != 0) {
+        return -1;
+    }
+    node_count++;
+    return 0;
+}
+
+// Whether an address belongs to this host: a socket can be bound to it
+static int is_local_address(const struct sockaddr_in *address) {
+    struct sockaddr_in addr = *address;
+    addr.sin_port = 0;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int local = fd >= 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    return local;
+}
+
+// Finish configuration once this server's own address is known; returns -1 if it is not a node.
+// A server bound to the wildcard address is the node on its port with one of this host's addresses.
+int partition_start(const char *self_ip, int self_port) {
+    if (node_count == 0) {
+        return 0;  // Not partitioned: this server owns every flight
+    }
+    int wildcard = inet_addr(self_ip) == htonl(INADDR_ANY);
+    for (int i = 0; i < node_count && self_node < 0; i++) {
+        if (ntohs(nodes[i].sin_port) == self_port &&
+            (wildcard ? is_local_address(&nodes[i]) : nodes[i].sin_addr.s_addr == inet_addr(self_ip))) {
+            self_node = i;
+        }
+    }
+    if (self_node < 0) {
+        fprintf(stderr, "This server (%s:%d) is not in the --node list\n", self_ip, self_port);
+        return -1;
+    }
+    build_ring(nodes, node_count, ring, &ring_size);
+    printf("Partitioning: node %d of %d, %d ring points\n", self_node + 1, node_count, ring_size);
+    return 0;
+}
+
+// The address the other nodes know this server by; -1 when not partitioned
+int partition_self_address(struct sockaddr_in *out) {
+    if (self_node < 0) {
+        return -1;
+    }
+    *out = nodes[self_node];
+    return 0;
+}
+
+// Whether this server owns a flight (always true when not partitioned)
+int partition_owns(int flight_id) {
+    return self_node < 0 || ring_owner(ring, ring_size, flight_id) == self_node;
+}
+
+// Whether a datagram comes from one of the nodes (only nodes may send "fwd" requests)
+static int from_node(const struct sockaddr_in *addr) {
+    for (int i = 0; i < node_count; i++) {
+        if (nodes[i].sin_addr.s_addr == addr->sin_addr.s_addr) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Whether a request is one another node forwarded; its client was already charged to the
+// rate limit at the node it sent the request to
+int partition_is_forward(const char *request, const struct sockaddr_in *sender) {
+    return self_node >= 0 && strncmp(request, "fwd ", 4) == 0 && from_node(sender);
+}
+
+// Open this worker's forwarding socket on the node's address and an ephemeral port
+static int forward_socket(struct sockaddr_in *bound) {
+    socklen_t length = sizeof(*bound);
+    if (forward_sockfd < 0) {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr = nodes[self_node];
+        addr.sin_port = 0;
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            perror("Forwarding socket creation failed");
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+        forward_sockfd = fd;
+    }
+    getsockname(forward_sockfd, (struct sockaddr *)bound, &length);
+    return forward_sockfd;
+}
+
+// Send "fwd <reply_to> <request>" to a node
+static void forward_to(int sockfd, int node, const struct sockaddr_in *reply_to, const char *request) {
+    char message[BUFFER_SIZE + 32], address[32];
+    format_node(reply_to, address, sizeof(address));
+    int length = snprintf(message, sizeof(message), "fwd %s %s", address, request);
+    sendto(sockfd, message, length, 0, (struct sockaddr *)&nodes[node], sizeof(nodes[node]));
+}
+
+// One merged result line with its sort key
+typedef struct {
+    uint64_t key;
+    const char *text;
+    int length;
+} ResultLine;
+
+static int compare_lines(const void *a, const void *b) {
+    uint64_t x = ((const ResultLine *)a)->key, y = ((const ResultLine *)b)->key;
+    return x < y ? -1 : x > y;
+}
+
+// Sort key of a route search line: its departure time, packed
+static uint64_t departure_key(const char *line) {
+    char month[16];
+    DepartureTime time = { 0, 1, 0, 0, 0 };
+    if (sscanf(line, "Flight ID: %*d  Departure: %15s %d, %d %d:%d", month, &time.day, &time.year,
+               &time.hour, &time.minute) == 5) {
+        for (int i = 0; i < 12; i++) {
+            if (strcmp(month, months[i]) == 0) {
+                time.month = i + 1;
+            }
+        }
+    }
+    return pack_departure_time(time);
+}
+
+// Send a request to every node (handling our own share locally), merge the "Flight ID" lines
+// of the answers and reply to the client. Route searches are merged in departure order,
+// filter searches are cut to the requested limit.
+static void fan_out(char *request, struct sockaddr_in *client_addr, int sockfd, socklen_t len, MYSQL *conn,
+                    int by_departure, int limit) {
+    struct sockaddr_in gather_addr;
+    int gather_fd = forward_socket(&gather_addr);
+    if (gather_fd < 0) {
+        const char *error = "Partition fan-out failed.\n";
+        fault_sendto(sockfd, error, strlen(error), 0, (struct sockaddr *)client_addr, len);
+        return;
+    }
+
+    char stale[256];
+    while (recv(gather_fd, stale, sizeof(stale), MSG_DONTWAIT) >= 0) {
+        // Discard late answers to an earlier fan-out that timed out
+    }
+
+    for (int node = 0; node < node_count; node++) {
+        if (node != self_node) {
+            forward_to(gather_fd, node, &gather_addr, request);
+        }
+    }
+    int suppressed = history_suppressed;
+    history_suppressed = 1;  // Our share answers the gather socket, not a client
+    dispatch_request(request, gather_addr, gather_fd, sizeof(gather_addr), conn);  // Our share, into the same socket
+    history_suppressed = suppressed;
+
+    // Gather one answer per node
+    Arena *arena = request_arena();
+    char *answers = (char *)arena_alloc(arena, (size_t)node_count * FANOUT_BUFFER_SIZE);
+    char *local_answer = NULL;
+    int answered = 0;
+    struct timeval timeout = { FORWARD_TIMEOUT_MS / 1000, (FORWARD_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(gather_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    while (answers != NULL && answered < node_count) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        char *answer = answers + (size_t)answered * FANOUT_BUFFER_SIZE;
+        ssize_t received = recvfrom(gather_fd, answer, FANOUT_BUFFER_SIZE - 1, 0, (struct sockaddr *)&from, &from_len);
+        if (received < 0) {
+            fprintf(stderr, "Partition fan-out: %d of %d nodes answered\n", answered, node_count);
+            break;  // Timed out: merge what we have
+        }
+        answer[received] = '\0';
+        if (from.sin_addr.s_addr == gather_addr.sin_addr.s_addr && from.sin_port == gather_addr.sin_port) {
+            local_answer = answer;
+        }
+        answered++;
+    }
+
+    // Collect the result lines of every answer
+    int line_capacity = 1024, line_count = 0;
+    ResultLine *lines = (ResultLine *)arena_alloc(arena, line_capacity * sizeof(ResultLine));
+    for (int i = 0; i < answered && lines != NULL; i++) {
+        const char *line = answers + (size_t)i * FANOUT_BUFFER_SIZE;
+        while (*line) {
+            const char *end = strchr(line, '\n');
+            int length = end ? (int)(end - line) + 1 : (int)strlen(line);
+            if (strncmp(line, "Flight ID:", 10) == 0) {
+                if (line_count == line_capacity) {
+                    ResultLine *grown = (ResultLine *)arena_grow(arena, lines, line_capacity * sizeof(ResultLine),
+                                                                 2 * line_capacity * sizeof(ResultLine));
+                    if (grown == NULL) {
+                        break;
+                    }
+                    lines = grown;
+                    line_capacity *= 2;
+                }
+                lines[line_count].key = by_departure ? departure_key(line) : 0;
+                lines[line_count].text = line;
+                lines[line_count].length = length;
+                line_count++;
+            }
+            line += length;
+        }
+    }
+
+    // Merge and reply; with no matches anywhere, our own answer carries the message. The reply
+    // must fit one datagram: lines that do not are replaced by a truncation marker.
+    static const char truncated[] = "Reply truncated: more flights match.\n";
+    char *response = (char *)arena_alloc(arena, FANOUT_REPLY_SIZE);
+    size_t response_len = 0;
+    if (response == NULL) {
+        const char *error = "Partition fan-out failed.\n";
+        fault_sendto(sockfd, error, strlen(error), 0, (struct sockaddr *)client_addr, len);
+        return;
+    }
+    if (lines != NULL && line_count > 0) {
+        if (by_departure) {
+            qsort(lines, line_count, sizeof(ResultLine), compare_lines);
+        }
+        int i = 0;
+        for (; i < line_count && i < limit &&
+               response_len + lines[i].length <= FANOUT_REPLY_SIZE - (sizeof(truncated) - 1); i++) {
+            memcpy(response + response_len, lines[i].text, lines[i].length);
+            response_len += lines[i].length;
+        }
+        if (i < line_count && i < limit) {
+            memcpy(response + response_len, truncated, sizeof(truncated) - 1);
+            response_len += sizeof(truncated) - 1;
+        }
+    } else {
+        const char *message = local_answer ? local_answer : "No flights found.\n";
+        response_len = strlen(message);
+        response_len = response_len < FANOUT_REPLY_SIZE ? response_len : FANOUT_REPLY_SIZE;
+        memcpy(response, message, response_len);
+    }
+    fault_sendto(sockfd, response, response_len, 0, (struct sockaddr *)client_addr, len);
+}
+
+// Route a request in a partitioned deployment. Returns 1 if it was forwarded or fanned out,
+// 0 if this node should handle it. "fwd" requests from other nodes are unwrapped in place.
+int partition_route(char *request, struct sockaddr_in *client_addr, int sockfd, socklen_t len, MYSQL *conn) {
+    if (self_node < 0) {
+        return 0;
+    }
+
+    // A request another node sent us: handle it here and answer whoever it names
+    char reply_to[64];
+    int consumed = 0;
+    if (sscanf(request, "fwd %63s %n", reply_to, &consumed) == 1 && consumed > 0) {
+        struct sockaddr_in target;
+        if (!from_node(client_addr) || parse_node(reply_to, &target) != 0) {
+            return 1;  // Drop forged or malformed forwards
+        }
+        dispatch_request(request + consumed, target, sockfd, sizeof(target), conn);
+        return 1;
+    }
+
+    // Requests that name one flight go to its owner, which replies to the client directly
+    static const char *by_flight[] = { "query_flight_info", "make_seat_reservation", "query_baggage_availability",
+                                       "add_baggage", "follow_flight_id" };
+    for (size_t i = 0; i < sizeof(by_flight) / sizeof(by_flight[0]); i++) {
+        size_t length = strlen(by_flight[i]);
+        int flight_id;
+        if (strncmp(request, by_flight[i], length) == 0 && sscanf(request + length, "%d", &flight_id) == 1) {
+            int owner = ring_owner(ring, ring_size, flight_id);
+            if (owner == self_node) {
+                return 0;
+            }
+            forward_to(sockfd, owner, client_addr, request);
+            return 1;
+        }
+    }
+
+    // Searches over all flights are answered by every partition and merged
+    if (strncmp(request, "query_flight_window", 19) == 0) {
+        fan_out(request, client_addr, sockfd, len, conn, 1, FANOUT_BUFFER_SIZE);
+        return 1;
+    }
+    if (strncmp(request, "query_flight_filter", 19) == 0) {
+        int min_seats, min_baggage, limit = FILTER_DEFAULT_LIMIT;
+        float max_fare;
+        sscanf(request, "query_flight_filter %d %f %d %d", &min_seats, &max_fare, &min_baggage, &limit);
+        fan_out(request, client_addr, sockfd, len, conn, 0, limit);
+        return 1;
+    }
+    return 0;
+}
+
+// Write a summary of the partitioning into buffer; returns the length written
+size_t partition_stats_report(char *buffer, size_t size) {
+    int written;
+    if (self_node < 0) {
+        written = snprintf(buffer, size, "Partitioning: off (this node owns every flight)\n");
+    } else {
+        char address[32];
+        format_node(&nodes[self_node], address, sizeof(address));
+        pthread_rwlock_rdlock(&catalog_lock);
+        int owned = catalog.count;
+        pthread_rwlock_unlock(&catalog_lock);
+        written = snprintf(buffer, size, "Partitioning: node %d of %d (%s), %d flights owned\n", self_node + 1,
+                           node_count, address, owned);
+    }
+    return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+}
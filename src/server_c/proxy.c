@@ -0,0 +1,478 @@
+#define _GNU_SOURCE  // For recvmmsg, sendmmsg and struct mmsghdr
+#include <stdint.h>  // Fixed-width integer types
+#include <stdio.h>   // For printf and snprintf
+#include <stdlib.h>  // For atoi and exit
+#include <string.h>  // For memset, memcpy and strcmp
+#include <unistd.h>  // For close
+#include <errno.h>   // For EAGAIN and ECONNREFUSED
+#include <time.h>    // For clock_gettime
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/epoll.h>  // Readiness of the public, upstream and health sockets
+#include <fcntl.h>
+#else
+#error "proxy.c relies on recvmmsg, sendmmsg and epoll and builds on Linux only"
+#endif
+
+// proxy.c
+// UDP front end for a set of flight servers. Clients keep sending to one address; the proxy
+// gives every client its own upstream socket to one backend, so the backend keeps seeing a
+// stable source address per client and its at-most-once history stays valid. Client datagrams
+// are read with recvmmsg, replies are sent back with sendmmsg, and every backend is probed with
+// test_connection; a backend that stops answering is taken out of rotation and its clients move
+// to the remaining backends.
+//
+// Build: gcc -O2 proxy.c -o proxy
+// Run:   ./proxy --port 8080 --backend 127.0.0.1:8081 --backend 127.0.0.1:8082
+
+#define PROXY_PORT 8080  // Public port clients send to
+#define PROXY_IP "172.20.10.10"  // Public address clients send to
+#define MAX_BACKENDS 64  // Backend servers behind the proxy
+#define MAX_SESSIONS 4096  // Clients tracked at once
+#define SESSION_BUCKETS 8192  // Hash buckets for the session table (power of two)
+#define BATCH_SIZE 32  // Datagrams moved per recvmmsg / sendmmsg call
+#define DATAGRAM_SIZE 65536  // Largest datagram forwarded in either direction
+#define HEALTH_INTERVAL_MS 1000  // How often each backend is probed
+#define HEALTH_FAILURES 3  // Missed probes before a backend is taken out of rotation
+#define SESSION_IDLE_MS 60000  // Sessions idle this long are closed
+
+// epoll tags: the kind of socket in the top bits, its index in the rest
+#define TAG_PUBLIC 0ull
+#define TAG_HEALTH 1ull
+#define TAG_SESSION 2ull
+#define TAG_SHIFT 32
+
+// A backend server
+typedef struct {
+    struct sockaddr_in addr;  // Request address of the server
+    int health_fd;  // Socket connected to the server, used for probes
+    int healthy;  // 1 while the server answers probes
+    uint64_t last_reply_ms;  // When the server last answered anything on the health socket
+    uint64_t last_probe_ms;  // When the last probe was sent
+    uint64_t requests;  // Datagrams forwarded to the server
+    uint64_t replies;  // Datagrams relayed back from the server
+    int sessions;  // Clients currently pinned to the server
+} Backend;
+
+// A client pinned to a backend
+typedef struct {
+    struct sockaddr_in client;  // Client address
+    int upstream_fd;  // Socket connected to the backend, -1 when the slot is free
+    int backend;  // Index into backends[]
+    uint64_t last_active_ms;  // Last datagram in either direction
+    int next;  // Next session in the same bucket, or the next free slot; -1 ends the list
+} Session;
+
+static Backend backends[MAX_BACKENDS];
+static int backend_count = 0;
+static Session sessions[MAX_SESSIONS];
+static int buckets[SESSION_BUCKETS];  // First session in each bucket, -1 if empty
+static int free_session = -1;  // Head of the free session list
+static int session_count = 0;
+static int epoll_fd = -1;
+static int public_fd = -1;
+static uint64_t dropped = 0;  // Client datagrams dropped because no session could be made
+
+// Batch buffers: one slot per datagram in a recvmmsg or sendmmsg call
+static char batch_data[BATCH_SIZE][DATAGRAM_SIZE];
+static struct iovec batch_iov[BATCH_SIZE];
+static struct mmsghdr batch_msgs[BATCH_SIZE];
+static struct sockaddr_in batch_addr[BATCH_SIZE];
+static int reply_count = 0;  // Replies queued in the batch buffers, waiting for sendmmsg
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Integer mixer used for the session table and backend choice
+static uint32_t mix32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint32_t client_hash(const struct sockaddr_in *client) {
+    return mix32(client->sin_addr.s_addr ^ mix32(client->sin_port));
+}
+
+// Parse "host:port" into a socket address
+static int parse_address(const char *text, struct sockaddr_in *out) {
+    char host[64];
+    const char *colon = strrchr(text, ':');
+    if (colon == NULL || colon - text >= (int)sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, text, colon - text);
+    host[colon - text] = '\0';
+    memset(out, 0, sizeof(*out));
+    out->sin_family = AF_INET;
+    out->sin_port = htons(atoi(colon + 1));
+    return inet_pton(AF_INET, host, &out->sin_addr) == 1 ? 0 : -1;
+}
+
+// Format an address as "ip:port"
+static void format_address(const struct sockaddr_in *addr, char *text, size_t size) {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+    snprintf(text, size, "%s:%d", ip, ntohs(addr->sin_port));
+}
+
+// Nonblocking UDP socket connected to a backend and registered with epoll under a tag
+static int open_upstream(const struct sockaddr_in *addr, uint64_t tag) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = tag };
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Pick a healthy backend for a new client by rendezvous hashing, so a client lands on the same
+// backend every time and losing one backend only moves that backend's clients
+static int choose_backend(const struct sockaddr_in *client) {
+    uint32_t key = client_hash(client);
+    int best = -1;
+    uint32_t best_score = 0;
+    for (int i = 0; i < backend_count; i++) {
+        if (!backends[i].healthy) {
+            continue;
+        }
+        uint32_t score = mix32(key ^ mix32((uint32_t)i + 1));
+        if (best < 0 || score > best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+// Close a session and return its slot to the free list
+static void close_session(int index) {
+    Session *session = &sessions[index];
+    int *link = &buckets[client_hash(&session->client) & (SESSION_BUCKETS - 1)];
+    while (*link != index) {
+        link = &sessions[*link].next;
+    }
+    *link = session->next;  // Unlink from its bucket
+
+    close(session->upstream_fd);  // Also removes the socket from epoll
+    session->upstream_fd = -1;
+    backends[session->backend].sessions--;
+    session->next = free_session;
+    free_session = index;
+    session_count--;
+}
+
+// Close sessions idle past SESSION_IDLE_MS, or every session of one backend when backend >= 0
+static void sweep_sessions(uint64_t now, int backend) {
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        if (sessions[i].upstream_fd < 0) {
+            continue;
+        }
+        if (backend >= 0 ? sessions[i].backend == backend : now - sessions[i].last_active_ms > SESSION_IDLE_MS) {
+            close_session(i);
+        }
+    }
+}
+
+// Find a client's session, opening one to a healthy backend if it has none
+static Session *find_session(const struct sockaddr_in *client, uint64_t now) {
+    int *bucket = &buckets[client_hash(client) & (SESSION_BUCKETS - 1)];
+    for (int i = *bucket; i >= 0; i = sessions[i].next) {
+        if (sessions[i].client.sin_addr.s_addr == client->sin_addr.s_addr &&
+            sessions[i].client.sin_port == client->sin_port) {
+            return &sessions[i];
+        }
+    }
+
+    if (free_session < 0) {
+        sweep_sessions(now, -1);  // Make room by closing idle sessions
+        if (free_session < 0) {
+            return NULL;
+        }
+    }
+    int backend = choose_backend(client);
+    if (backend < 0) {
+        return NULL;
+    }
+    int index = free_session;
+    int fd = open_upstream(&backends[backend].addr, (TAG_SESSION << TAG_SHIFT) | (uint64_t)index);
+    if (fd < 0) {
+        return NULL;
+    }
+    free_session = sessions[index].next;
+
+    Session *session = &sessions[index];
+    session->client = *client;
+    session->upstream_fd = fd;
+    session->backend = backend;
+    session->last_active_ms = now;
+    session->next = *bucket;
+    *bucket = index;
+    backends[backend].sessions++;
+    session_count++;
+    return session;
+}
+
+// Send every queued reply back to its client from the public socket
+static void flush_replies() {
+    int sent = 0;
+    while (sent < reply_count) {
+        int n = sendmmsg(public_fd, batch_msgs + sent, reply_count - sent, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            break;  // Socket buffer full or error: the rest are dropped, clients retry
+        }
+        sent += n;
+    }
+    reply_count = 0;
+}
+
+// Queue a reply to a client; the batch is flushed when full and after each epoll round
+static void queue_reply(const struct sockaddr_in *client, const char *data, size_t length) {
+    if (reply_count == BATCH_SIZE) {
+        flush_replies();
+    }
+    memcpy(batch_data[reply_count], data, length);
+    batch_addr[reply_count] = *client;
+    batch_iov[reply_count].iov_len = length;
+    batch_msgs[reply_count].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    reply_count++;
+}
+
+// Describe the backends for query_proxy_stats
+static size_t proxy_stats_report(char *buffer, size_t size) {
+    char address[32];
+    size_t used = snprintf(buffer, size, "Proxy: %d backends, %d sessions, %llu dropped\n",
+                           backend_count, session_count, (unsigned long long)dropped);
+    for (int i = 0; i < backend_count && used < size; i++) {
+        format_address(&backends[i].addr, address, sizeof(address));
+        used += snprintf(buffer + used, size - used, "Backend %s: %s, sessions %d, requests %llu, replies %llu\n",
+                         address, backends[i].healthy ? "up" : "down", backends[i].sessions,
+                         (unsigned long long)backends[i].requests, (unsigned long long)backends[i].replies);
+    }
+    return used < size ? used : size - 1;
+}
+
+// Read a batch of client datagrams and pass each one to its client's backend
+static void forward_requests(uint64_t now) {
+    // recvmmsg fills the batch slots; queued replies were flushed before this is called
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        batch_iov[i].iov_len = DATAGRAM_SIZE;
+        batch_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+    int n = recvmmsg(public_fd, batch_msgs, BATCH_SIZE, MSG_DONTWAIT, NULL);
+    char report[4096];
+    for (int i = 0; i < n; i++) {
+        const struct sockaddr_in *client = &batch_addr[i];
+        size_t length = batch_msgs[i].msg_len;
+
+        if (length >= 17 && strncmp(batch_data[i], "query_proxy_stats", 17) == 0) {
+            size_t used = proxy_stats_report(report, sizeof(report));
+            sendto(public_fd, report, used, 0, (const struct sockaddr *)client, sizeof(*client));
+            continue;
+        }
+
+        Session *session = find_session(client, now);
+        if (session == NULL) {
+            const char *response = "No backend server available, please retry.\n";
+            sendto(public_fd, response, strlen(response), 0, (const struct sockaddr *)client, sizeof(*client));
+            dropped++;
+            continue;
+        }
+        session->last_active_ms = now;
+        if (send(session->upstream_fd, batch_data[i], length, 0) >= 0) {
+            backends[session->backend].requests++;
+        }
+    }
+}
+
+// Drain a session's upstream socket, queueing each reply for its client
+static void relay_replies(int index, uint64_t now, char *buffer) {
+    Session *session = &sessions[index];
+    if (session->upstream_fd < 0) {
+        return;  // Closed earlier in this epoll round
+    }
+    ssize_t n;
+    while ((n = recv(session->upstream_fd, buffer, DATAGRAM_SIZE, 0)) >= 0) {
+        queue_reply(&session->client, buffer, (size_t)n);
+        backends[session->backend].replies++;
+        session->last_active_ms = now;
+    }
+}
+
+static void set_backend_health(int index, int healthy, uint64_t now) {
+    char address[32];
+    if (backends[index].healthy == healthy) {
+        return;
+    }
+    backends[index].healthy = healthy;
+    format_address(&backends[index].addr, address, sizeof(address));
+    if (healthy) {
+        printf("Backend %s is back in rotation.\n", address);
+    } else {
+        printf("Backend %s stopped answering; moving its %d clients.\n", address, backends[index].sessions);
+        sweep_sessions(now, index);  // Their next datagram opens a session on a healthy backend
+    }
+}
+
+// Drain a backend's health socket; any answer, including a cached one, shows the server is alive
+static void read_health(int index, uint64_t now, char *buffer) {
+    ssize_t n;
+    while ((n = recv(backends[index].health_fd, buffer, DATAGRAM_SIZE, 0)) >= 0) {
+        backends[index].last_reply_ms = now;
+        set_backend_health(index, 1, now);
+    }
+    if (errno == ECONNREFUSED) {
+        set_backend_health(index, 0, now);  // Nothing listens on the backend's port any more
+    }
+}
+
+// Probe backends that are due and retire the ones that stopped answering
+static void check_backends(uint64_t now) {
+    for (int i = 0; i < backend_count; i++) {
+        Backend *backend = &backends[i];
+        if (now - backend->last_probe_ms >= HEALTH_INTERVAL_MS) {
+            send(backend->health_fd, "test_connection", 15, 0);
+            backend->last_probe_ms = now;
+        }
+        if (now - backend->last_reply_ms > (uint64_t)HEALTH_FAILURES * HEALTH_INTERVAL_MS) {
+            set_backend_health(i, 0, now);
+        }
+    }
+}
+
+// Main function to set up the proxy
+int main(int argc, char *argv[]) {
+    const char *proxy_ip = PROXY_IP;
+    int proxy_port = PROXY_PORT;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bind") == 0 && i + 1 < argc) {
+            proxy_ip = argv[++i];
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            proxy_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc && backend_count < MAX_BACKENDS) {
+            if (parse_address(argv[++i], &backends[backend_count].addr) != 0) {
+                printf("Invalid backend address: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            backend_count++;
+        } else {
+            printf("Invalid option: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (backend_count == 0) {
+        printf("Usage: %s [--bind IP] [--port N] --backend HOST:PORT...\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0) {
+        perror("epoll_create1 failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Create the public UDP socket clients send to
+    struct sockaddr_in proxy_addr;
+    memset(&proxy_addr, 0, sizeof(proxy_addr));
+    proxy_addr.sin_family = AF_INET;
+    proxy_addr.sin_addr.s_addr = inet_addr(proxy_ip);
+    proxy_addr.sin_port = htons(proxy_port);
+    public_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (public_fd < 0 || bind(public_fd, (const struct sockaddr *)&proxy_addr, sizeof(proxy_addr)) < 0) {
+        perror("Bind failed");
+        exit(EXIT_FAILURE);
+    }
+    fcntl(public_fd, F_SETFL, fcntl(public_fd, F_GETFL, 0) | O_NONBLOCK);
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = TAG_PUBLIC << TAG_SHIFT };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, public_fd, &event);
+
+    // Every session slot starts on the free list
+    memset(buckets, -1, sizeof(buckets));
+    for (int i = MAX_SESSIONS - 1; i >= 0; i--) {
+        sessions[i].upstream_fd = -1;
+        sessions[i].next = free_session;
+        free_session = i;
+    }
+
+    // The batch slots always point at their own buffer and address
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        batch_iov[i].iov_base = batch_data[i];
+        batch_msgs[i].msg_hdr.msg_iov = &batch_iov[i];
+        batch_msgs[i].msg_hdr.msg_iovlen = 1;
+        batch_msgs[i].msg_hdr.msg_name = &batch_addr[i];
+    }
+
+    // Backends start in rotation and drop out if they miss HEALTH_FAILURES probes
+    uint64_t now = now_ms();
+    for (int i = 0; i < backend_count; i++) {
+        backends[i].health_fd = open_upstream(&backends[i].addr, (TAG_HEALTH << TAG_SHIFT) | (uint64_t)i);
+        if (backends[i].health_fd < 0) {
+            perror("Backend socket failed");
+            exit(EXIT_FAILURE);
+        }
+        backends[i].healthy = 1;
+        backends[i].last_reply_ms = now;
+        backends[i].last_probe_ms = now - HEALTH_INTERVAL_MS;  // Probe right away
+    }
+
+    printf("Proxy is running on port %d with %d backends...\n", proxy_port, backend_count);
+
+    static char buffer[DATAGRAM_SIZE];  // Receive buffer for replies before they are queued
+    struct epoll_event events[64];
+    uint64_t last_sweep = now;
+    while (1) {
+        check_backends(now_ms());
+
+        int ready = epoll_wait(epoll_fd, events, 64, HEALTH_INTERVAL_MS / 4);
+        if (ready < 0 && errno != EINTR) {
+            perror("epoll_wait failed");
+        }
+        now = now_ms();
+
+        int client_ready = 0;
+        for (int i = 0; i < ready; i++) {
+            uint64_t tag = events[i].data.u64 >> TAG_SHIFT;
+            int index = (int)(events[i].data.u64 & 0xffffffffu);
+            if (tag == TAG_PUBLIC) {
+                client_ready = 1;  // Handled after the replies so the batch buffers are free
+            } else if (tag == TAG_HEALTH) {
+                read_health(index, now, buffer);
+            } else {
+                relay_replies(index, now, buffer);
+            }
+        }
+        flush_replies();
+        if (client_ready) {
+            forward_requests(now);
+        }
+
+        if (now - last_sweep >= SESSION_IDLE_MS / 4) {
+            sweep_sessions(now, -1);
+            last_sweep = now;
+        }
+    }
+
+    close(public_fd);
+    close(epoll_fd);
+    return 0;
+}
@@ -0,0 +1,263 @@
+#include <stdatomic.h>  // Counters read by query_server_stats
+#include <stdint.h>     // Fixed-width integer types
+#include <stdio.h>      // For snprintf
+#include <stdlib.h>     // For strtol
+#include <string.h>     // For strcmp
+#include <pthread.h>    // Table mutex
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>   // For inet_ntop
+#else
+#include <arpa/inet.h>  // For inet_ntop and ntohs
+#include <sys/socket.h>
+#endif
+
+#include "rate_limit.h"
+#include "fault.h"   // Throttle replies pass through the fault injection layer
+#include "timer.h"   // The limiter's clock and the aging sweep
+#include "memory_budget.h"  // The bucket table is charged to clients
+
+// rate_limit.c
+// The buckets live in one open-addressing table of 32-byte entries, probed linearly from the
+// client's hash over at most RATE_MAX_PROBE slots. When every slot in a client's window is
+// taken, the client heard from least recently gives up its slot; a periodic sweep forgets
+// clients idle for RATE_IDLE_MS, whose buckets would be full again anyway, using
+// backward-shift deletion so that no tombstones build up. Tokens are counted in thousandths of
+// a request and refilled from the time elapsed since the client's previous request, so no
+// timer runs per client. Requests arrive on the receive thread; the mutex is only contended
+// by query_server_stats.
+
+#define RATE_TABLE_SIZE 8192  // Tracked clients (power of two)
+#define RATE_MAX_PROBE 16  // Slots a client may be from its hash
+#define RATE_IDLE_MS 60000  // A client quiet this long is forgotten
+#define RATE_SWEEP_MS 10000  // How often idle clients are looked for
+#define RATE_REPLY_INTERVAL_MS 1000  // Throttle replies to a client at most this often
+#define RATE_NOISIEST 5  // Clients listed by query_server_stats
+#define TOKEN 1000  // One request, in thousandths
+
+static const char throttle_reply[] = "Too many requests: slow down and retry later.\n";
+
+// One client's bucket; key 0 marks an empty slot
+typedef struct {
+    uint64_t key;  // (IP << 16 | port) + 1
+    uint32_t seen_ms;  // Last request, on the limiter's clock
+    uint32_t tokens;  // In thousandths of a request, at seen_ms
+    uint32_t requests;  // Since the client was first tracked
+    uint32_t throttled;  // Of those, refused
+    uint32_t replied_ms;  // Last throttle reply
+    uint32_t unused;  // Pads the entry to half a cache line
+} Bucket;
+
+static Bucket table[RATE_TABLE_SIZE];
+static pthread_mutex_t rate_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int tracked;  // Occupied slots (rate_mutex)
+static Timer sweep_timer;
+static uint64_t clock_base;  // timer_now_ms() at start; the limiter's clock is 32-bit
+
+// Settings from the command line
+static uint32_t rate_per_second;  // 0 = off
+static uint32_t burst;  // 0 = one second's worth
+static int reply_when_throttled = 1;
+
+// Counters reported by query_server_stats
+static _Atomic uint64_t admitted, throttle_replies, dropped, evicted, expired;
+
+int rate_limit_set_option(const char *name, const char *value) {
+    char *end;
+    if (strcmp(name, "action") == 0) {
+        if (strcmp(value, "reply") != 0 && strcmp(value, "drop") != 0) {
+            return -1;
+        }
+        reply_when_throttled = strcmp(value, "reply") == 0;
+        return 0;
+    }
+    long number = strtol(value, &end, 10);
+    if (*end != '\0' || number < 0 || number > 1000000) {
+        return -1;
+    }
+    if (strcmp(name, "limit") == 0) {
+        rate_per_second = (uint32_t)number;
+        return 0;
+    }
+    if (strcmp(name, "burst") == 0 && number > 0) {
+        burst = (uint32_t)number;
+        return 0;
+    }
+    return -1;
+}
+
+static uint32_t clock_ms() {
+    return (uint32_t)(timer_now_ms() - clock_base);
+}
+
+static unsigned home_of(uint64_t key) {
+    return (unsigned)((key * 0x9E3779B97F4A7C15ull) >> 40) & (RATE_TABLE_SIZE - 1);
+}
+
+// Start tracking a client with a full bucket
+static void bucket_reset(Bucket *bucket, uint64_t key, uint32_t now) {
+    bucket->key = key;
+    bucket->seen_ms = now;
+    bucket->tokens = burst * TOKEN;
+    bucket->requests = 0;
+    bucket->throttled = 0;
+    bucket->replied_ms = now - RATE_REPLY_INTERVAL_MS;
+}
+
+// The client's bucket, taking a slot for it if it is new (caller holds rate_mutex)
+static Bucket *bucket_find(uint64_t key, uint32_t now) {
+    unsigned home = home_of(key);
+    Bucket *stalest = NULL;
+    for (int probe = 0; probe < RATE_MAX_PROBE; probe++) {
+        Bucket *bucket = &table[(home + probe) & (RATE_TABLE_SIZE - 1)];
+        if (bucket->key == key) {
+            return bucket;
+        }
+        if (bucket->key == 0) {
+            bucket_reset(bucket, key, now);
+            tracked++;
+            return bucket;
+        }
+        if (stalest == NULL || now - bucket->seen_ms > now - stalest->seen_ms) {
+            stalest = bucket;
+        }
+    }
+    // Every slot in the window is taken: the client heard from least recently gives its up
+    bucket_reset(stalest, key, now);
+    atomic_fetch_add_explicit(&evicted, 1, memory_order_relaxed);
+    return stalest;
+}
+
+// Empty a slot and move later entries of the same probe runs back into it (caller holds rate_mutex)
+static void bucket_remove(unsigned slot) {
+    unsigned next = slot;
+    for (;;) {
+        table[slot].key = 0;
+        unsigned home;
+        do {
+            next = (next + 1) & (RATE_TABLE_SIZE - 1);
+            if (table[next].key == 0) {
+                return;
+            }
+            home = home_of(table[next].key);
+            // An entry may fill the hole only if its home is not cyclically within (slot, next]
+        } while (slot <= next ? (slot < home && home <= next) : (slot < home || home <= next));
+        table[slot] = table[next];
+        slot = next;
+    }
+}
+
+// Timer callback: forget clients that have been quiet for RATE_IDLE_MS, then re-arm
+static void sweep_buckets(void *arg) {
+    (void)arg;
+    uint32_t now = clock_ms();
+    pthread_mutex_lock(&rate_mutex);
+    for (unsigned slot = 0; slot < RATE_TABLE_SIZE; ) {
+        if (table[slot].key != 0 && now - table[slot].seen_ms >= RATE_IDLE_MS) {
+            bucket_remove(slot);  // Look at the slot again: another entry may have moved into it
+            tracked--;
+            atomic_fetch_add_explicit(&expired, 1, memory_order_relaxed);
+        } else {
+            slot++;
+        }
+    }
+    pthread_mutex_unlock(&rate_mutex);
+    timer_schedule(&sweep_timer, RATE_SWEEP_MS);
+}
+
+void rate_limit_start() {
+    if (rate_per_second == 0) {
+        return;
+    }
+    if (burst == 0) {
+        burst = rate_per_second;
+    }
+    clock_base = timer_now_ms();
+    memory_charge_fixed(MEMORY_CLIENTS, sizeof(table));  // Untouched, and not resident, while limiting is off
+    timer_init(&sweep_timer, sweep_buckets, NULL);
+    timer_schedule(&sweep_timer, RATE_SWEEP_MS);
+    printf("Rate limit: %u requests per second per client, burst %u.\n", rate_per_second, burst);
+}
+
+int rate_limit_admit(int sockfd, const struct sockaddr_in *client_addr) {
+    if (rate_per_second == 0) {
+        return 1;
+    }
+    uint64_t key = ((uint64_t)client_addr->sin_addr.s_addr << 16 | client_addr->sin_port) + 1;
+    uint32_t now = clock_ms();
+
+    pthread_mutex_lock(&rate_mutex);
+    Bucket *bucket = bucket_find(key, now);
+    uint64_t tokens = bucket->tokens + (uint64_t)(now - bucket->seen_ms) * rate_per_second;  // rate per ms, in thousandths
+    bucket->tokens = tokens < (uint64_t)burst * TOKEN ? (uint32_t)tokens : burst * TOKEN;
+    bucket->seen_ms = now;
+    bucket->requests++;
+    if (bucket->tokens >= TOKEN) {
+        bucket->tokens -= TOKEN;
+        pthread_mutex_unlock(&rate_mutex);
+        atomic_fetch_add_explicit(&admitted, 1, memory_order_relaxed);
+        return 1;
+    }
+    bucket->throttled++;
+    int reply = reply_when_throttled && now - bucket->replied_ms >= RATE_REPLY_INTERVAL_MS;
+    if (reply) {
+        bucket->replied_ms = now;
+    }
+    pthread_mutex_unlock(&rate_mutex);
+
+    if (reply) {
+        fault_sendto(sockfd, throttle_reply, sizeof(throttle_reply) - 1, 0, (const struct sockaddr *)client_addr, sizeof(*client_addr));
+        atomic_fetch_add_explicit(&throttle_replies, 1, memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+    }
+    return 0;
+}
+
+size_t rate_limit_stats_report(char *buffer, size_t size) {
+    if (rate_per_second == 0) {
+        int written = snprintf(buffer, size, "Rate limit: off\n");
+        return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+    }
+
+    // Copy out the clients refused most often, most first
+    Bucket noisiest[RATE_NOISIEST];
+    int count = 0, clients;
+    pthread_mutex_lock(&rate_mutex);
+    clients = tracked;
+    for (unsigned slot = 0; slot < RATE_TABLE_SIZE; slot++) {
+        const Bucket *bucket = &table[slot];
+        if (bucket->key == 0 || bucket->throttled == 0 ||
+            (count == RATE_NOISIEST && bucket->throttled <= noisiest[count - 1].throttled)) {
+            continue;
+        }
+        int i = count < RATE_NOISIEST ? count++ : count - 1;
+        while (i > 0 && noisiest[i - 1].throttled < bucket->throttled) {
+            noisiest[i] = noisiest[i - 1];
+            i--;
+        }
+        noisiest[i] = *bucket;
+    }
+    pthread_mutex_unlock(&rate_mutex);
+
+    uint64_t refused = atomic_load(&throttle_replies) + atomic_load(&dropped);
+    int written = snprintf(buffer, size,
+                           "Rate limit: %u requests/s, burst %u; %llu admitted, %llu throttled (%llu replied, %llu dropped); "
+                           "%d clients tracked, %llu evicted, %llu expired\n",
+                           rate_per_second, burst, (unsigned long long)atomic_load(&admitted), (unsigned long long)refused,
+                           (unsigned long long)atomic_load(&throttle_replies), (unsigned long long)atomic_load(&dropped),
+                           clients, (unsigned long long)atomic_load(&evicted), (unsigned long long)atomic_load(&expired));
+    size_t used = written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+    for (int i = 0; i < count && used + 1 < size; i++) {
+        struct in_addr ip;
+        char text[INET_ADDRSTRLEN];
+        ip.s_addr = (uint32_t)((noisiest[i].key - 1) >> 16);
+        inet_ntop(AF_INET, &ip, text, sizeof(text));
+        written = snprintf(buffer + used, size - used, "%s%s:%d (%u requests, %u throttled)%s",
+                           i ? ", " : "Noisiest clients: ", text, ntohs((uint16_t)(noisiest[i].key - 1)),
+                           noisiest[i].requests, noisiest[i].throttled, i == count - 1 ? "\n" : "");
+        used = written < 0 ? used : ((size_t)written < size - used ? used + written : size - 1);
+    }
+    return used;
+}
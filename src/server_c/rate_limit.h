@@ -0,0 +1,46 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stddef.h>  // For size_t
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <netinet/in.h>  // For struct sockaddr_in
+#endif
+
+// rate_limit.h
+// Per-client token buckets checked by the receive thread before a request is dispatched, so a
+// client retransmitting in a tight loop is refused before it costs a worker or a query. Each
+// client address (IP and port, as for sessions and the request history; the proxy gives every
+// client its own upstream port) may send --rate-limit requests per second on average and
+// --rate-burst at once. A client over its limit is told so at most once per second with a
+// short throttle reply and its other requests are dropped (--rate-action drop drops them all).
+// In a partitioned deployment a client is limited by the node it sends to; requests forwarded
+// between nodes are not charged again. Off unless --rate-limit is given.
+
+/**
+ * @brief Set an option from the command line (--rate-NAME VALUE): limit (requests per second,
+ *        0 = off), burst (requests) or action (reply or drop).
+ * @return 0 on success, -1 for an unknown option or an invalid value.
+ */
+int rate_limit_set_option(const char *name, const char *value);
+
+/**
+ * @brief Start aging out the buckets of clients that went quiet (call before the receive loop).
+ */
+void rate_limit_start();
+
+/**
+ * @brief Charge a request to its client's bucket; over the limit, the client may be sent the
+ *        throttle reply on sockfd.
+ * @return 1 if the request may be dispatched, 0 if it has to be dropped.
+ */
+int rate_limit_admit(int sockfd, const struct sockaddr_in *client_addr);
+
+/**
+ * @brief Write the limiter's counters and its noisiest clients into buffer; returns the length written.
+ */
+size_t rate_limit_stats_report(char *buffer, size_t size);
+
+#endif // RATE_LIMIT_H
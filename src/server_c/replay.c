@@ -0,0 +1,351 @@
+#include <stdint.h>  // Fixed-width integer types
+#include <stdio.h>   // For printf and fread
+#include <stdlib.h>  // For malloc, qsort and atof
+#include <string.h>  // For memcmp and strcmp
+#include <unistd.h>  // For close
+#include <time.h>    // For clock_gettime
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>  // Replies from every client socket
+#include <fcntl.h>
+#else
+#error "replay.c relies on epoll and builds on Linux only"
+#endif
+
+#include "capture.h"
+
+// replay.c
+// Re-sends a capture recorded with `server --capture FILE` against one or more servers and
+// reports how each kept up. Every client address in the capture gets its own socket, so the
+// server sees the same number of clients (and the same per-client request order) as it did in
+// production. The capture is played at its original pace, N times faster, or flat out.
+//
+// A reply is matched to the oldest unanswered request of its client; replies that arrive with
+// nothing outstanding (monitor updates, late duplicates) are counted as unsolicited. When more
+// than one server is given, they are replayed one after another and compared to the first.
+//
+// Build: gcc -O2 replay.c -o replay
+// Run:   ./replay capture.bin 127.0.0.1:8080
+//        ./replay --speed 10 capture.bin 127.0.0.1:8080 127.0.0.1:8081
+//        ./replay --flat --wait 2000 capture.bin 127.0.0.1:8080
+
+#define MAX_TARGETS 8  // Servers compared in one invocation
+#define DEFAULT_MAX_CLIENTS 1024  // Sockets opened per replay; further sources share them
+#define OUTSTANDING_PER_CLIENT 256  // Unanswered requests remembered per client
+#define DEFAULT_WAIT_MS 1000  // How long to wait for replies after the last send
+#define EPOLL_BATCH 64
+
+// One captured datagram, loaded into memory
+typedef struct {
+    uint64_t offset_ns;  // Arrival time relative to the first datagram
+    int client;  // Index of its client socket
+    uint16_t length;
+    const char *payload;
+} Datagram;
+
+// A client socket and the send times of its unanswered requests
+typedef struct {
+    int fd;
+    uint64_t sent_ns[OUTSTANDING_PER_CLIENT];  // FIFO of send times
+    int head, count;
+} Client;
+
+// Results of replaying the capture against one server
+typedef struct {
+    const char *target;
+    double seconds;  // From the first send to the last send
+    double reply_seconds;  // From the first send to the last matched reply
+    long sent, send_errors, replies, unsolicited, lost;
+    uint64_t last_reply_ns;
+    uint32_t *latency_us;  // One per matched reply
+    long latency_count;
+} Result;
+
+static Datagram *datagrams = NULL;
+static long datagram_count = 0;
+static int client_count = 0;
+static double speed = 1.0;  // 0 = flat out
+static int wait_ms = DEFAULT_WAIT_MS;
+static int max_clients = DEFAULT_MAX_CLIENTS;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Read the whole capture and give every distinct source address a client index
+static int load_capture(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror("Cannot open capture file");
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *bytes = (char *)malloc(size > 0 ? size : 1);
+    if (bytes == NULL || fread(bytes, 1, size, file) != (size_t)size) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    size_t magic_len = strlen(CAPTURE_FILE_MAGIC);
+    if ((size_t)size < magic_len || memcmp(bytes, CAPTURE_FILE_MAGIC, magic_len) != 0) {
+        fprintf(stderr, "%s is not a capture file\n", path);
+        return -1;
+    }
+
+    // Sources seen so far, in an open-addressing table keyed by address and port
+    int table_size = 1;
+    while (table_size < 2 * max_clients) {
+        table_size <<= 1;
+    }
+    uint64_t *source_keys = (uint64_t *)calloc(table_size, sizeof(uint64_t));
+    int *source_clients = (int *)malloc(table_size * sizeof(int));
+    long capacity = 1024, distinct = 0;
+    datagrams = (Datagram *)malloc(capacity * sizeof(Datagram));
+    uint64_t first_ns = 0;
+
+    size_t offset = magic_len;
+    while (offset + sizeof(CaptureRecord) <= (size_t)size) {
+        CaptureRecord record;
+        memcpy(&record, bytes + offset, sizeof(record));
+        offset += sizeof(record);
+        if (offset + record.length > (size_t)size) {
+            break;  // Truncated tail (the server was stopped mid-flush)
+        }
+        if (datagram_count == capacity) {
+            capacity *= 2;
+            datagrams = (Datagram *)realloc(datagrams, capacity * sizeof(Datagram));
+        }
+        if (datagram_count == 0) {
+            first_ns = record.timestamp_ns;
+        }
+
+        uint64_t key = ((uint64_t)record.address << 16 | record.port) + 1;  // 0 marks an empty slot
+        int slot = (int)((key * 0x9E3779B97F4A7C15ull) >> 40) & (table_size - 1);
+        while (source_keys[slot] != 0 && source_keys[slot] != key) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (source_keys[slot] == 0) {
+            if (distinct < 2L * max_clients - 1) {
+                source_keys[slot] = key;
+            }
+            source_clients[slot] = (int)(distinct++ % max_clients);  // Past max_clients, sources share sockets
+        }
+
+        Datagram *datagram = &datagrams[datagram_count++];
+        datagram->offset_ns = record.timestamp_ns >= first_ns ? record.timestamp_ns - first_ns : 0;
+        datagram->client = source_clients[slot];
+        datagram->length = record.length;
+        datagram->payload = bytes + offset;
+        offset += record.length;
+    }
+    free(source_keys);
+    free(source_clients);
+    client_count = distinct < max_clients ? (int)distinct : max_clients;
+    printf("Capture: %ld datagrams from %ld clients over %.3f s (%.0f req/s)\n", datagram_count, distinct,
+           datagram_count ? datagrams[datagram_count - 1].offset_ns / 1e9 : 0.0,
+           datagram_count > 1 && datagrams[datagram_count - 1].offset_ns
+               ? datagram_count / (datagrams[datagram_count - 1].offset_ns / 1e9) : 0.0);
+    return 0;
+}
+
+// Read every pending reply on a client socket and match it to the oldest outstanding request
+static void drain_client(Client *client, Result *result) {
+    char buffer[65536];
+    while (recv(client->fd, buffer, sizeof(buffer), 0) >= 0) {
+        if (client->count == 0) {
+            result->unsolicited++;
+            continue;
+        }
+        uint64_t sent = client->sent_ns[client->head];
+        client->head = (client->head + 1) % OUTSTANDING_PER_CLIENT;
+        client->count--;
+        result->replies++;
+        uint64_t now = now_ns();
+        result->latency_us[result->latency_count++] = (uint32_t)((now - sent) / 1000);
+        result->last_reply_ns = now;
+    }
+}
+
+// Wait up to timeout_ms for replies and process them
+static void poll_replies(int epoll_fd, Client *clients, Result *result, int timeout_ms) {
+    struct epoll_event events[EPOLL_BATCH];
+    int ready = epoll_wait(epoll_fd, events, EPOLL_BATCH, timeout_ms);
+    for (int i = 0; i < ready; i++) {
+        drain_client(&clients[events[i].data.u32], result);
+    }
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t percentile(const Result *result, double fraction) {
+    if (result->latency_count == 0) {
+        return 0;
+    }
+    long index = (long)(fraction * (result->latency_count - 1) + 0.5);
+    return result->latency_us[index];
+}
+
+// Replay the capture against one server
+static int replay(const char *target, Result *result) {
+    memset(result, 0, sizeof(*result));
+    result->target = target;
+    char host[64];
+    int port = 0;
+    if (sscanf(target, "%63[^:]:%d", host, &port) != 2 || port <= 0 || port > 65535) {
+        fprintf(stderr, "Invalid server address: %s\n", target);
+        return -1;
+    }
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &server_addr.sin_addr) != 1) {
+        fprintf(stderr, "Invalid server address: %s\n", target);
+        return -1;
+    }
+
+    Client *clients = (Client *)calloc(client_count, sizeof(Client));
+    result->latency_us = (uint32_t *)malloc((datagram_count + 1) * sizeof(uint32_t));
+    int epoll_fd = epoll_create1(0);
+    for (int i = 0; i < client_count; i++) {
+        // Connected sockets: the kernel filters out datagrams from anyone but the server
+        clients[i].fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (clients[i].fd < 0 || connect(clients[i].fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+            perror("Client socket setup failed");
+            return -1;
+        }
+        fcntl(clients[i].fd, F_SETFL, fcntl(clients[i].fd, F_GETFL, 0) | O_NONBLOCK);
+        struct epoll_event event = { .events = EPOLLIN, .data.u32 = (uint32_t)i };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, clients[i].fd, &event);
+    }
+
+    uint64_t start = now_ns(), last_send = start;
+    for (long i = 0; i < datagram_count; i++) {
+        const Datagram *datagram = &datagrams[i];
+        if (speed > 0) {
+            // Keep to the capture's pace, handling replies while waiting
+            uint64_t due = start + (uint64_t)(datagram->offset_ns / speed);
+            for (uint64_t now = now_ns(); now < due; now = now_ns()) {
+                poll_replies(epoll_fd, clients, result, (int)((due - now) / 1000000));
+            }
+        } else if ((i & 63) == 0) {
+            poll_replies(epoll_fd, clients, result, 0);  // Flat out: just keep the socket buffers drained
+        }
+
+        Client *client = &clients[datagram->client];
+        uint64_t sent_at = now_ns();
+        if (send(client->fd, datagram->payload, datagram->length, 0) < 0) {
+            result->send_errors++;
+            continue;
+        }
+        result->sent++;
+        last_send = sent_at;
+        if (client->count == OUTSTANDING_PER_CLIENT) {
+            // Oldest request of this client never got a reply; forget it
+            client->head = (client->head + 1) % OUTSTANDING_PER_CLIENT;
+            client->count--;
+        }
+        client->sent_ns[(client->head + client->count) % OUTSTANDING_PER_CLIENT] = last_send;
+        client->count++;
+    }
+    result->seconds = (last_send - start) / 1e9;
+
+    // Collect the stragglers
+    uint64_t deadline = now_ns() + (uint64_t)wait_ms * 1000000;
+    while (result->replies < result->sent && now_ns() < deadline) {
+        poll_replies(epoll_fd, clients, result, (int)((deadline - now_ns()) / 1000000) + 1);
+    }
+    result->lost = result->sent - result->replies;
+    result->reply_seconds = result->last_reply_ns > start ? (result->last_reply_ns - start) / 1e9 : 0;
+
+    for (int i = 0; i < client_count; i++) {
+        close(clients[i].fd);
+    }
+    close(epoll_fd);
+    free(clients);
+    qsort(result->latency_us, result->latency_count, sizeof(uint32_t), compare_u32);
+    return 0;
+}
+
+static void print_result(const Result *result) {
+    printf("\n%s\n", result->target);
+    printf("  Sent:    %ld in %.3f s (%.0f req/s), %ld send errors\n", result->sent, result->seconds,
+           result->seconds > 0 ? result->sent / result->seconds : 0.0, result->send_errors);
+    printf("  Replies: %ld (%.0f replies/s), %ld lost (%.2f%%), %ld unsolicited\n", result->replies,
+           result->reply_seconds > 0 ? result->replies / result->reply_seconds : 0.0, result->lost,
+           result->sent ? 100.0 * result->lost / result->sent : 0.0, result->unsolicited);
+    printf("  Latency: p50 %u us, p90 %u us, p99 %u us, p99.9 %u us, max %u us\n",
+           percentile(result, 0.50), percentile(result, 0.90), percentile(result, 0.99),
+           percentile(result, 0.999), percentile(result, 1.0));
+}
+
+// Change of a later server relative to the first, in percent
+static double change(double value, double baseline) {
+    return baseline > 0 ? 100.0 * (value - baseline) / baseline : 0.0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *capture_path = NULL;
+    const char *targets[MAX_TARGETS];
+    int target_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = atof(argv[++i]);  // 2 = twice as fast as captured
+        } else if (strcmp(argv[i], "--flat") == 0) {
+            speed = 0;
+        } else if (strcmp(argv[i], "--wait") == 0 && i + 1 < argc) {
+            wait_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+            max_clients = atoi(argv[++i]);
+        } else if (capture_path == NULL) {
+            capture_path = argv[i];
+        } else if (target_count < MAX_TARGETS) {
+            targets[target_count++] = argv[i];
+        }
+    }
+    if (capture_path == NULL || target_count == 0 || speed < 0 || max_clients <= 0) {
+        fprintf(stderr, "Usage: %s [--speed N | --flat] [--wait MS] [--clients N] <capture file> HOST:PORT...\n", argv[0]);
+        return 1;
+    }
+    if (load_capture(capture_path) != 0) {
+        return 1;
+    }
+    if (speed > 0) {
+        printf("Replaying at %gx the captured pace\n", speed);
+    } else {
+        printf("Replaying flat out\n");
+    }
+
+    Result results[MAX_TARGETS];
+    for (int i = 0; i < target_count; i++) {
+        if (replay(targets[i], &results[i]) != 0) {
+            return 1;
+        }
+        print_result(&results[i]);
+    }
+
+    // Compare every later server with the first
+    for (int i = 1; i < target_count; i++) {
+        const Result *base = &results[0], *other = &results[i];
+        printf("\n%s vs %s\n", other->target, base->target);
+        printf("  Reply rate %+.1f%%, lost %+ld, p50 %+.1f%%, p99 %+.1f%%, max %+.1f%%\n",
+               change(other->reply_seconds > 0 ? other->replies / other->reply_seconds : 0,
+                      base->reply_seconds > 0 ? base->replies / base->reply_seconds : 0),
+               other->lost - base->lost,
+               change(percentile(other, 0.50), percentile(base, 0.50)),
+               change(percentile(other, 0.99), percentile(base, 0.99)),
+               change(percentile(other, 1.0), percentile(base, 1.0)));
+    }
+    return 0;
+}
@@ -0,0 +1,689 @@
+#include <stdint.h>     // Fixed-width integer types
+#include <stdio.h>      // For printf, snprintf and sscanf
+#include <stdlib.h>     // For atoi
+#include <string.h>     // For memcpy, memmove and strchr
+#include <stdatomic.h>  // Sequence numbers, role and record stamps
+#include <errno.h>      // For EAGAIN / EINPROGRESS
+#include <time.h>       // For clock_gettime
+#include <unistd.h>     // For close and usleep
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>  // For TCP_NODELAY
+#include <sys/socket.h>
+#include <poll.h>       // For poll
+#include <fcntl.h>      // For non-blocking connect
+#endif
+
+#include <pthread.h>
+#include "server.h"
+#include "fault.h"  // Replies pass through the fault injection layer
+#include "timer.h"  // Promotion replies wait on the timer wheel, not on a worker
+
+// replication.c
+// Primary-backup replication of the flight catalog. The primary appends one record per
+// mutation (a flight's new seat/baggage counters, or a new flight) to a lock-free ring,
+// numbering them with a global sequence; the record is taken under the flight's lock stripe
+// (or the catalog write lock for new flights), so for every flight the sequence order is the
+// order the primary applied the changes in. Records carry absolute values, not deltas.
+//
+// A replication thread streams the ring to backups over TCP as text lines. A backup that
+// connects first receives a snapshot: the sequence S0 already assigned, every flight's current
+// state, then every record after S0. Because records are absolute, replaying them over a
+// snapshot that may already include some of them converges on the primary's state. Backups
+// apply records in order, serve read-only queries from their catalog, and are promoted with
+// the promote_replica request; remaining backups fail over to the next --primary they know.
+
+#define REPL_LOG_CAPACITY 65536  // Records kept for streaming (power of two)
+#define MAX_BACKUPS 16  // Backups a primary streams to
+#define MAX_PRIMARIES 8  // Primary candidates a backup may fail over between
+#define REPL_BUFFER_SIZE 65536  // Per-connection output/input buffer
+#define REPL_LINE_SIZE 256  // Upper bound on one record line
+#define REPL_POLL_MS 2  // Replication thread poll interval
+#define REPL_HEARTBEAT_MS 1000  // Ping interval on an idle stream
+#define REPL_TIMEOUT_MS 3000  // Silence after which a backup gives up on its primary
+#define REPL_CONNECT_TIMEOUT_MS 1000  // Connect attempt timeout for backups
+#define PROMOTE_WAITERS 8  // promote_replica requests waiting for the switch at once
+#define PROMOTE_POLL_MS 10  // How often a waiting promote_replica checks the role
+#define PROMOTE_TIMEOUT_MS 2000  // After this, a promote_replica is answered "pending"
+
+enum { REPL_STANDALONE, REPL_PRIMARY, REPL_BACKUP };  // Replication roles
+enum { REPL_OP_COUNTERS = 1, REPL_OP_FLIGHT = 2 };  // Record kinds
+
+// One mutation, stored in the ring at sequence & (REPL_LOG_CAPACITY - 1)
+typedef struct {
+    _Atomic uint64_t stamp;  // sequence + 1 once the record is complete
+    int op;  // REPL_OP_COUNTERS or REPL_OP_FLIGHT
+    int32_t flight_id;
+    int32_t seats;  // Seat availability after the mutation
+    int32_t baggage;  // Baggage availability after the mutation
+    uint16_t source_id;  // New flights only: interned cities
+    uint16_t destination_id;
+    uint64_t departure;  // New flights only: packed departure time
+    float airfare;  // New flights only
+} ReplRecord;
+
+// Stream state for one connected backup (primary side)
+typedef struct {
+    int fd;  // TCP connection, -1 if the slot is free
+    int snapshot_slot;  // Next catalog slot to send while a snapshot is in progress, -1 otherwise
+    uint64_t cursor;  // Next sequence to send after the snapshot
+    char out[REPL_BUFFER_SIZE];  // Pending output
+    size_t out_len, out_off;
+    char peer[INET_ADDRSTRLEN + 8];  // For log messages
+} BackupStream;
+
+// A promote_replica request waiting for the replication thread to switch roles
+typedef struct {
+    Timer timer;  // Checks the role every PROMOTE_POLL_MS on the receive thread
+    int in_use;  // (promote_mutex)
+    int sockfd;
+    struct sockaddr_in client_addr;
+    uint64_t deadline_ms;  // When to give up and answer "pending"
+} PromoteWaiter;
+
+static atomic_int role = REPL_STANDALONE;
+static atomic_int promote_requested = 0;
+static ReplRecord ring[REPL_LOG_CAPACITY];
+static _Atomic uint64_t next_seq = 1;  // Next sequence to assign (primary)
+static _Atomic uint64_t applied_seq = 0;  // Last sequence applied (backup)
+static _Atomic uint64_t primary_seq = 0;  // Last sequence the primary reported (backup)
+
+static int replicate_port = 0;  // Where this server accepts backups when it is primary
+static int listen_fd = -1;
+static BackupStream backups[MAX_BACKUPS];
+static uint64_t last_ping_ms = 0;
+
+static struct sockaddr_in primaries[MAX_PRIMARIES];  // Candidates a backup connects to
+static int primary_count = 0;
+static int current_primary = 0;
+static int primary_fd = -1;
+static char in_buffer[REPL_BUFFER_SIZE];
+static size_t in_len = 0;
+static uint64_t last_heard_ms = 0;
+static uint64_t snapshot_seq = 0;
+static atomic_int connected_backups = 0;
+static atomic_int primary_connected = 0;
+static PromoteWaiter promote_waiters[PROMOTE_WAITERS];
+static pthread_mutex_t promote_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Monotonic clock in milliseconds
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// Ring fields are read by the replication thread while an appender may be rewriting them
+#define store_field(field, value) __atomic_store((field), &(value), __ATOMIC_RELAXED)
+#define load_field(field, out) __atomic_load((field), (out), __ATOMIC_RELAXED)
+
+// Claim the next sequence number and fill its ring slot. The slot is a seqlock: its stamp is
+// cleared before the fields of an older record are overwritten, so a reader that copied them
+// meanwhile sees the stamp change and discards the copy.
+static void append_record(const ReplRecord *record) {
+    uint64_t seq = atomic_fetch_add(&next_seq, 1);
+    ReplRecord *slot = &ring[seq & (REPL_LOG_CAPACITY - 1)];
+    atomic_store_explicit(&slot->stamp, 0, memory_order_relaxed);  // Being written
+    atomic_thread_fence(memory_order_release);  // Cleared before any field changes
+    store_field(&slot->op, record->op);
+    store_field(&slot->flight_id, record->flight_id);
+    store_field(&slot->seats, record->seats);
+    store_field(&slot->baggage, record->baggage);
+    store_field(&slot->source_id, record->source_id);
+    store_field(&slot->destination_id, record->destination_id);
+    store_field(&slot->departure, record->departure);
+    store_field(&slot->airfare, record->airfare);
+    atomic_store_explicit(&slot->stamp, seq + 1, memory_order_release);  // Complete
+}
+
+// Record a flight's new counters; caller holds the flight's lock stripe
+void replication_record_counters(int flight_id, int seats, int baggage) {
+    if (atomic_load_explicit(&role, memory_order_relaxed) != REPL_PRIMARY) {
+        return;
+    }
+    ReplRecord record = { .op = REPL_OP_COUNTERS, .flight_id = flight_id, .seats = seats, .baggage = baggage };
+    append_record(&record);
+}
+
+// Record a new flight; caller holds catalog_lock for writing
+void replication_record_flight(int flight_id, int source_id, int destination_id, uint64_t departure,
+                               float airfare, int seats, int baggage) {
+    if (atomic_load_explicit(&role, memory_order_relaxed) != REPL_PRIMARY) {
+        return;
+    }
+    ReplRecord record = { .op = REPL_OP_FLIGHT, .flight_id = flight_id, .seats = seats, .baggage = baggage,
+                          .source_id = (uint16_t)source_id, .destination_id = (uint16_t)destination_id,
+                          .departure = departure, .airfare = airfare };
+    append_record(&record);
+}
+
+// Copy the record for seq out of the ring: 1 if copied, 0 if not written yet, -1 if overwritten
+static int read_record(uint64_t seq, ReplRecord *out) {
+    ReplRecord *slot = &ring[seq & (REPL_LOG_CAPACITY - 1)];
+    uint64_t stamp = atomic_load_explicit(&slot->stamp, memory_order_acquire);
+    if (stamp < seq + 1) {
+        return 0;
+    }
+    if (stamp > seq + 1) {
+        return -1;  // The ring wrapped past this backup
+    }
+    load_field(&slot->op, &out->op);
+    load_field(&slot->flight_id, &out->flight_id);
+    load_field(&slot->seats, &out->seats);
+    load_field(&slot->baggage, &out->baggage);
+    load_field(&slot->source_id, &out->source_id);
+    load_field(&slot->destination_id, &out->destination_id);
+    load_field(&slot->departure, &out->departure);
+    load_field(&slot->airfare, &out->airfare);
+    atomic_thread_fence(memory_order_acquire);  // The fields are read before the stamp is checked again
+    return atomic_load_explicit(&slot->stamp, memory_order_relaxed) == seq + 1 ? 1 : -1;  // 0 or newer: overwritten
+}
+
+// Format a flight's full state as a record body (used for snapshots and new flights). City
+// names may contain spaces ("New York"), so each is sent as its length, a colon and the name.
+static int format_flight(char *line, size_t size, int flight_id, const char *source, const char *destination,
+                         uint64_t departure, float airfare, int seats, int baggage) {
+    return snprintf(line, size, "flight %d %zu:%s %zu:%s %llu %.9g %d %d\n", flight_id, strlen(source), source,
+                    strlen(destination), destination, (unsigned long long)departure, airfare, seats, baggage);
+}
+
+// Parse a length-prefixed city name written by format_flight and the space after it; NULL if malformed
+static const char *parse_city(const char *text, char *name, size_t size) {
+    char *end;
+    long length = strtol(text, &end, 10);
+    if (end == text || *end != ':' || length <= 0 || (size_t)length >= size || strnlen(end + 1, length) < (size_t)length ||
+        end[1 + length] != ' ') {
+        return NULL;
+    }
+    memcpy(name, end + 1, length);
+    name[length] = '\0';
+    return end + 1 + length + 1;
+}
+
+// Parse a "host:port" address
+static int parse_address(const char *text, struct sockaddr_in *out) {
+    char host[64];
+    const char *colon = strrchr(text, ':');
+    if (colon == NULL || colon - text >= (int)sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, text, colon - text);
+    host[colon - text] = '\0';
+    memset(out, 0, sizeof(*out));
+    out->sin_family = AF_INET;
+    out->sin_port = htons(atoi(colon + 1));
+    return inet_pton(AF_INET, host, &out->sin_addr) == 1 ? 0 : -1;
+}
+
+/* ---------------------------------------------------------------- primary side */
+
+// Open the TCP listener backups connect to
+static int open_listener() {
+    if (replicate_port <= 0) {
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Replication socket creation failed");
+        return -1;
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(replicate_port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, MAX_BACKUPS) < 0) {
+        perror("Replication listener failed");
+        close(fd);
+        return -1;
+    }
+    set_nonblocking(fd);
+    printf("Replication: accepting backups on port %d\n", replicate_port);
+    return fd;
+}
+
+// Queue a snapshot for a backup: everything up to the current sequence, then the stream
+static void start_snapshot(BackupStream *backup) {
+    uint64_t last = atomic_load(&next_seq) - 1;  // Every record up to here is already in the catalog
+    backup->snapshot_slot = 0;
+    backup->cursor = last + 1;
+    backup->out_len += snprintf(backup->out + backup->out_len, sizeof(backup->out) - backup->out_len,
+                                "snapshot %llu\n", (unsigned long long)last);
+}
+
+// Accept a waiting backup
+static void accept_backup() {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int fd = accept(listen_fd, (struct sockaddr *)&addr, &addr_len);
+    if (fd < 0) {
+        return;
+    }
+    for (int i = 0; i < MAX_BACKUPS; i++) {
+        if (backups[i].fd < 0) {
+            BackupStream *backup = &backups[i];
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            set_nonblocking(fd);
+            backup->fd = fd;
+            backup->out_len = backup->out_off = 0;
+            snprintf(backup->peer, sizeof(backup->peer), "%s:%d", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+            start_snapshot(backup);
+            atomic_fetch_add(&connected_backups, 1);
+            printf("Replication: backup %s connected, sending snapshot\n", backup->peer);
+            return;
+        }
+    }
+    fprintf(stderr, "Replication: too many backups, refusing connection\n");
+    close(fd);
+}
+
+// Drop a backup connection
+static void drop_backup(BackupStream *backup, const char *reason) {
+    printf("Replication: backup %s disconnected (%s)\n", backup->peer, reason);
+    close(backup->fd);
+    backup->fd = -1;
+    atomic_fetch_sub(&connected_backups, 1);
+}
+
+// Fill a backup's output buffer with snapshot lines and records
+static void fill_backup(BackupStream *backup, int send_ping) {
+    char line[REPL_LINE_SIZE];
+    if (backup->out_off == backup->out_len) {
+        backup->out_off = backup->out_len = 0;  // Everything sent: reuse the buffer from the start
+    }
+
+    while (sizeof(backup->out) - backup->out_len > REPL_LINE_SIZE) {
+        int length;
+        if (backup->snapshot_slot >= 0) {
+            Flight flight;
+            if (get_flight_by_slot(backup->snapshot_slot, &flight)) {
+                length = format_flight(line, sizeof(line), flight.flight_id, flight.source_place,
+                                       flight.destination_place, pack_departure_time(flight.departure_time),
+                                       flight.airfare, flight.seat_availability, flight.baggage_availability);
+                backup->snapshot_slot++;
+            } else {
+                length = snprintf(line, sizeof(line), "snapshot_end\n");
+                backup->snapshot_slot = -1;
+            }
+        } else if (backup->cursor < atomic_load(&next_seq)) {
+            ReplRecord record;
+            int status = read_record(backup->cursor, &record);
+            if (status == 0) {
+                break;  // The writer has the sequence but has not filled the slot yet
+            }
+            if (status < 0) {
+                printf("Replication: backup %s fell behind the log, resending snapshot\n", backup->peer);
+                start_snapshot(backup);
+                continue;
+            }
+            if (record.op == REPL_OP_COUNTERS) {
+                length = snprintf(line, sizeof(line), "%llu set %d %d %d\n", (unsigned long long)backup->cursor,
+                                  record.flight_id, record.seats, record.baggage);
+            } else {
+                length = snprintf(line, sizeof(line), "%llu ", (unsigned long long)backup->cursor);
+                length += format_flight(line + length, sizeof(line) - length, record.flight_id,
+                                        city_name(record.source_id), city_name(record.destination_id),
+                                        record.departure, record.airfare, record.seats, record.baggage);
+            }
+            backup->cursor++;
+        } else {
+            if (send_ping) {
+                backup->out_len += snprintf(backup->out + backup->out_len, sizeof(backup->out) - backup->out_len,
+                                            "ping %llu\n", (unsigned long long)(backup->cursor - 1));
+            }
+            break;  // Caught up
+        }
+        memcpy(backup->out + backup->out_len, line, length);
+        backup->out_len += length;
+    }
+}
+
+// Send as much pending output as the socket takes
+static void flush_backup(BackupStream *backup) {
+    while (backup->out_off < backup->out_len) {
+        ssize_t sent = send(backup->fd, backup->out + backup->out_off, backup->out_len - backup->out_off, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                drop_backup(backup, strerror(errno));
+            }
+            return;
+        }
+        backup->out_off += sent;
+    }
+}
+
+// One iteration of the primary's replication loop
+static void primary_step() {
+    struct pollfd fds[MAX_BACKUPS + 1];
+    fds[0].fd = listen_fd;
+    fds[0].events = POLLIN;
+    for (int i = 0; i < MAX_BACKUPS; i++) {
+        fds[i + 1].fd = backups[i].fd;  // Negative descriptors are ignored by poll
+        fds[i + 1].events = POLLIN;
+    }
+    poll(fds, MAX_BACKUPS + 1, REPL_POLL_MS);
+
+    if (fds[0].revents & POLLIN) {
+        accept_backup();
+    }
+    uint64_t now = now_ms();
+    int send_ping = now - last_ping_ms >= REPL_HEARTBEAT_MS;
+    if (send_ping) {
+        last_ping_ms = now;
+    }
+    for (int i = 0; i < MAX_BACKUPS; i++) {
+        BackupStream *backup = &backups[i];
+        if (backup->fd < 0) {
+            continue;
+        }
+        if (fds[i + 1].fd == backup->fd && (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+            char discard[256];
+            if (recv(backup->fd, discard, sizeof(discard), MSG_DONTWAIT) <= 0) {  // Backups never send data
+                drop_backup(backup, "closed by peer");
+                continue;
+            }
+        }
+        fill_backup(backup, send_ping);
+        flush_backup(backup);
+    }
+}
+
+/* ---------------------------------------------------------------- backup side */
+
+// Connect to the current primary candidate, moving on to the next one on failure
+static void connect_primary() {
+    struct sockaddr_in *target = &primaries[current_primary];
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Replication socket creation failed");
+        usleep(REPL_HEARTBEAT_MS * 1000);
+        return;
+    }
+    set_nonblocking(fd);
+    int status = connect(fd, (struct sockaddr *)target, sizeof(*target));
+    if (status < 0 && errno == EINPROGRESS) {
+        struct pollfd pfd = { fd, POLLOUT, 0 };
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        status = (poll(&pfd, 1, REPL_CONNECT_TIMEOUT_MS) == 1 &&
+                  getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == 0 && error == 0) ? 0 : -1;
+    }
+    if (status < 0) {
+        close(fd);
+        current_primary = (current_primary + 1) % primary_count;  // Try the next candidate
+        usleep(REPL_HEARTBEAT_MS * 1000 / 2);
+        return;
+    }
+
+    primary_fd = fd;
+    in_len = 0;
+    last_heard_ms = now_ms();
+    atomic_store(&primary_connected, 1);
+    printf("Replication: connected to primary %s:%d\n", inet_ntoa(target->sin_addr), ntohs(target->sin_port));
+}
+
+// Close the link to the primary
+static void disconnect_primary(const char *reason) {
+    printf("Replication: lost primary (%s); promote_replica makes this server the primary\n", reason);
+    close(primary_fd);
+    primary_fd = -1;
+    atomic_store(&primary_connected, 0);
+    current_primary = (current_primary + 1) % primary_count;  // Fail over to the next candidate
+}
+
+// Insert or overwrite a flight received from the primary
+static void apply_flight(const char *body) {
+    int flight_id, seats, baggage, consumed = 0;
+    char source[64], destination[64];
+    unsigned long long departure;
+    float airfare;
+    const char *rest = NULL;
+    if (sscanf(body, "flight %d %n", &flight_id, &consumed) == 1 && consumed > 0 &&
+        (rest = parse_city(body + consumed, source, sizeof(source))) != NULL) {
+        rest = parse_city(rest, destination, sizeof(destination));
+    }
+    if (rest == NULL || sscanf(rest, "%llu %f %d %d", &departure, &airfare, &seats, &baggage) != 4) {
+        fprintf(stderr, "Replication: malformed flight record: %s\n", body);
+        return;
+    }
+    if (add_flight(flight_id, source, destination, unpack_departure_time(departure), airfare, seats, baggage) == 0) {
+        set_flight_counters(flight_id, seats, baggage);  // Already known: the record is authoritative
+    }
+}
+
+// Apply one line from the primary; returns -1 if the stream is out of order
+static int apply_line(const char *line) {
+    unsigned long long seq;
+    int consumed = 0;
+    last_heard_ms = now_ms();
+
+    if (sscanf(line, "snapshot %llu", &seq) == 1) {
+        snapshot_seq = seq;
+        printf("Replication: receiving snapshot at sequence %llu\n", seq);
+    } else if (strncmp(line, "snapshot_end", 12) == 0) {
+        atomic_store(&applied_seq, snapshot_seq);
+        atomic_store(&primary_seq, snapshot_seq);
+        printf("Replication: snapshot applied, streaming from sequence %llu\n", (unsigned long long)(snapshot_seq + 1));
+    } else if (strncmp(line, "flight ", 7) == 0) {
+        apply_flight(line);  // Snapshot entry
+    } else if (sscanf(line, "ping %llu", &seq) == 1) {
+        atomic_store(&primary_seq, seq);
+    } else if (sscanf(line, "%llu %n", &seq, &consumed) == 1 && consumed > 0) {
+        if (seq != atomic_load(&applied_seq) + 1) {
+            fprintf(stderr, "Replication: expected sequence %llu, got %llu\n",
+                    (unsigned long long)atomic_load(&applied_seq) + 1, (unsigned long long)seq);
+            return -1;
+        }
+        const char *body = line + consumed;
+        int flight_id, seats, baggage;
+        if (sscanf(body, "set %d %d %d", &flight_id, &seats, &baggage) == 3) {
+            set_flight_counters(flight_id, seats, baggage);
+        } else {
+            apply_flight(body);
+        }
+        atomic_store(&applied_seq, seq);
+        if (seq > atomic_load(&primary_seq)) {
+            atomic_store(&primary_seq, seq);
+        }
+    } else {
+        fprintf(stderr, "Replication: unknown record: %s\n", line);
+    }
+    return 0;
+}
+
+// One iteration of the backup's replication loop
+static void backup_step() {
+    if (primary_fd < 0) {
+        connect_primary();
+        return;
+    }
+
+    struct pollfd pfd = { primary_fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 100) > 0) {
+        ssize_t received = recv(primary_fd, in_buffer + in_len, sizeof(in_buffer) - in_len - 1, 0);
+        if (received <= 0) {
+            disconnect_primary(received == 0 ? "connection closed" : strerror(errno));
+            return;
+        }
+        in_len += received;
+        in_buffer[in_len] = '\0';
+
+        // Apply every complete line, keep a partial one for the next read
+        char *start = in_buffer, *newline;
+        while ((newline = strchr(start, '\n')) != NULL) {
+            *newline = '\0';
+            if (apply_line(start) != 0) {
+                disconnect_primary("stream out of order");
+                return;
+            }
+            start = newline + 1;
+        }
+        in_len -= start - in_buffer;
+        memmove(in_buffer, start, in_len);
+    }
+    if (now_ms() - last_heard_ms > REPL_TIMEOUT_MS) {
+        disconnect_primary("heartbeat timeout");
+    }
+}
+
+// Turn this backup into the primary, continuing the sequence it has applied
+static void become_primary() {
+    if (primary_fd >= 0) {
+        close(primary_fd);
+        primary_fd = -1;
+        atomic_store(&primary_connected, 0);
+    }
+    atomic_store(&next_seq, atomic_load(&applied_seq) + 1);
+    listen_fd = open_listener();
+    atomic_store(&role, listen_fd >= 0 ? REPL_PRIMARY : REPL_STANDALONE);
+    printf("Replication: promoted to primary at sequence %llu\n", (unsigned long long)atomic_load(&applied_seq));
+}
+
+// Replication thread body
+static void *replication_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        int current = atomic_load(&role);
+        if (current == REPL_BACKUP && atomic_exchange(&promote_requested, 0)) {
+            become_primary();
+        } else if (current == REPL_BACKUP) {
+            backup_step();
+        } else if (current == REPL_PRIMARY) {
+            primary_step();
+        } else {
+            usleep(REPL_HEARTBEAT_MS * 1000);
+        }
+    }
+    return NULL;
+}
+
+/* ---------------------------------------------------------------- configuration and requests */
+
+// Accept backups on port when this server is (or becomes) primary
+void replication_set_listen_port(int port) {
+    replicate_port = port;
+}
+
+// Add a primary candidate ("host:port"); any candidate makes this server start as a backup
+int replication_add_primary(const char *address) {
+    if (primary_count >= MAX_PRIMARIES || parse_address(address, &primaries[primary_count]) != 0) {
+        return -1;
+    }
+    primary_count++;
+    return 0;
+}
+
+// Pick the role from the configuration and start the replication thread
+void replication_start() {
+    for (int i = 0; i < MAX_BACKUPS; i++) {
+        backups[i].fd = -1;
+    }
+    if (primary_count > 0) {
+        atomic_store(&role, REPL_BACKUP);
+    } else if (replicate_port > 0 && (listen_fd = open_listener()) >= 0) {
+        atomic_store(&role, REPL_PRIMARY);
+    } else {
+        return;  // Standalone: nothing to replicate
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, replication_thread, NULL) != 0) {
+        perror("Failed to create replication thread");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(thread);
+    printf("Replication: running as %s\n", atomic_load(&role) == REPL_BACKUP ? "backup" : "primary");
+}
+
+// Whether this server must refuse mutations
+int replication_is_read_only() {
+    return atomic_load_explicit(&role, memory_order_relaxed) == REPL_BACKUP;
+}
+
+// Whether this server starts as a backup (its catalog comes from the primary, not the database)
+int replication_is_backup() {
+    return primary_count > 0;
+}
+
+// Answer a promote_replica request with the outcome of the promotion
+static void send_promote_reply(int sockfd, struct sockaddr_in *client_addr, int promoted) {
+    char response[BUFFER_SIZE];
+    if (promoted) {
+        snprintf(response, sizeof(response), "Promoted to primary at sequence %llu.\n",
+                 (unsigned long long)atomic_load(&applied_seq));
+    } else {
+        snprintf(response, sizeof(response), "Promotion pending.\n");
+    }
+    fault_sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+}
+
+// Timer callback: answer a waiting promote_replica once the role has switched or its wait is up
+static void check_promotion(void *arg) {
+    PromoteWaiter *waiter = (PromoteWaiter *)arg;
+    int promoted = atomic_load(&role) != REPL_BACKUP;
+    if (!promoted && timer_now_ms() < waiter->deadline_ms) {
+        timer_schedule(&waiter->timer, PROMOTE_POLL_MS);
+        return;
+    }
+    send_promote_reply(waiter->sockfd, &waiter->client_addr, promoted);
+    pthread_mutex_lock(&promote_mutex);
+    waiter->in_use = 0;
+    pthread_mutex_unlock(&promote_mutex);
+}
+
+// Function to handle promote_replica requests: turn a backup into the primary. The replication
+// thread switches roles between two records; the reply waits for that on the timer wheel, so
+// the worker is free at once.
+void handle_promote_replica(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn) {
+    (void)request;
+    (void)conn;
+
+    if (atomic_load(&role) != REPL_BACKUP) {
+        const char *response = "Promotion failed: this server is not a backup.\n";
+        fault_sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+        return;
+    }
+    atomic_store(&promote_requested, 1);
+
+    PromoteWaiter *waiter = NULL;
+    pthread_mutex_lock(&promote_mutex);
+    for (int i = 0; i < PROMOTE_WAITERS && waiter == NULL; i++) {
+        if (!promote_waiters[i].in_use) {
+            waiter = &promote_waiters[i];
+            waiter->in_use = 1;
+        }
+    }
+    pthread_mutex_unlock(&promote_mutex);
+    if (waiter == NULL) {
+        send_promote_reply(sockfd, client_addr, 0);  // Enough requests are already waiting
+        return;
+    }
+    waiter->sockfd = sockfd;
+    waiter->client_addr = *client_addr;
+    waiter->deadline_ms = timer_now_ms() + PROMOTE_TIMEOUT_MS;
+    timer_init(&waiter->timer, check_promotion, waiter);
+    timer_schedule(&waiter->timer, PROMOTE_POLL_MS);
+}
+
+// Write a summary of the replication state into buffer; returns the length written
+size_t replication_stats_report(char *buffer, size_t size) {
+    int written;
+    int current = atomic_load(&role);
+    if (current == REPL_PRIMARY) {
+        written = snprintf(buffer, size, "Replication: primary, last sequence %llu, %d backup(s) connected\n",
+                           (unsigned long long)atomic_load(&next_seq) - 1, atomic_load(&connected_backups));
+    } else if (current == REPL_BACKUP) {
+        uint64_t applied = atomic_load(&applied_seq), latest = atomic_load(&primary_seq);
+        written = snprintf(buffer, size, "Replication: backup (%s), applied sequence %llu, lag %llu\n",
+                           atomic_load(&primary_connected) ? "connected" : "primary unreachable",
+                           (unsigned long long)applied, (unsigned long long)(latest > applied ? latest - applied : 0));
+    } else {
+        written = snprintf(buffer, size, "Replication: standalone\n");
+    }
+    return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+}
@@ -0,0 +1,230 @@
+#include <stdint.h>  // Fixed-width integer types
+#include <stdio.h>   // For perror
+#include <stdlib.h>  // For malloc, realloc and free
+#include <string.h>  // For memmove and memset
+#include "server.h"  // Catalog declarations
+#include "memory_budget.h"  // The index is charged to the catalog
+
+// route_index.c
+// Ordered index of departures per (source, destination) route. Each route keeps two parallel
+// arrays sorted by packed departure time, so a time-window search is two binary searches and
+// a contiguous run of catalog slots. All functions expect the caller to hold catalog_lock
+// (for writing when adding, for reading when searching).
+
+#define INITIAL_ROUTE_TABLE_SIZE 64  // Buckets in the route hash table (power of two)
+#define INITIAL_ROUTE_CAPACITY 16  // Entries allocated for a new route
+
+// Departures on one route, sorted by (departure, slot)
+typedef struct {
+    uint32_t key;  // source_id << 16 | destination_id
+    int count;  // Number of flights on the route
+    int capacity;  // Allocated entries
+    uint64_t *departures;  // Packed departure times, ascending
+    int32_t *slots;  // Catalog slot of each departure
+} RouteEntry;
+
+static RouteEntry *routes = NULL;  // All routes, in creation order
+static int route_count = 0;
+static int route_capacity = 0;
+static int32_t *route_table = NULL;  // Open-addressing table of route numbers, -1 if empty
+static uint32_t route_table_mask = 0;
+static size_t route_bytes = 0;  // Charged to the memory budget; the flights were admitted by the catalog
+
+// Combine two city ids into a route key
+static uint32_t route_key(int source_id, int destination_id) {
+    return ((uint32_t)source_id << 16) | (uint32_t)destination_id;
+}
+
+// Mix a route key into a bucket number
+static uint32_t hash_route(uint32_t key) {
+    key ^= key >> 16;
+    key *= 0x45d9f3bu;
+    key ^= key >> 16;
+    return key;
+}
+
+// Find the route number for a key, or -1 if the route has no flights
+static int find_route(uint32_t key) {
+    if (route_table == NULL) {
+        return -1;
+    }
+    uint32_t bucket = hash_route(key) & route_table_mask;
+    while (route_table[bucket] >= 0) {
+        if (routes[route_table[bucket]].key == key) {
+            return route_table[bucket];
+        }
+        bucket = (bucket + 1) & route_table_mask;
+    }
+    return -1;
+}
+
+// Rebuild the route hash table with the given bucket count
+static int rehash_routes(uint32_t size) {
+    int32_t *table = (int32_t *)malloc(size * sizeof(int32_t));
+    if (table == NULL) {
+        perror("Memory allocation failed for route table");
+        return -1;
+    }
+    memset(table, 0xFF, size * sizeof(int32_t));
+    for (int i = 0; i < route_count; i++) {
+        uint32_t bucket = hash_route(routes[i].key) & (size - 1);
+        while (table[bucket] >= 0) {
+            bucket = (bucket + 1) & (size - 1);
+        }
+        table[bucket] = i;
+    }
+    size_t old_size = route_table != NULL ? route_table_mask + 1 : 0;
+    free(route_table);
+    route_table = table;
+    route_table_mask = size - 1;
+    memory_charge_fixed(MEMORY_CATALOG, (size - old_size) * sizeof(int32_t));
+    route_bytes += (size - old_size) * sizeof(int32_t);
+    return 0;
+}
+
+// Create an empty route and register it in the hash table
+static int create_route(uint32_t key) {
+    if (route_table == NULL && rehash_routes(INITIAL_ROUTE_TABLE_SIZE) != 0) {
+        return -1;
+    }
+    if ((uint32_t)(route_count + 1) * 2 > route_table_mask + 1 && rehash_routes((route_table_mask + 1) * 2) != 0) {
+        return -1;  // Keep the table at most half full
+    }
+    if (route_count == route_capacity) {
+        int capacity = route_capacity ? route_capacity * 2 : INITIAL_ROUTE_TABLE_SIZE;
+        RouteEntry *grown = (RouteEntry *)realloc(routes, capacity * sizeof(RouteEntry));
+        if (grown == NULL) {
+            perror("Memory allocation failed for routes");
+            return -1;
+        }
+        routes = grown;
+        memory_charge_fixed(MEMORY_CATALOG, (capacity - route_capacity) * sizeof(RouteEntry));
+        route_bytes += (capacity - route_capacity) * sizeof(RouteEntry);
+        route_capacity = capacity;
+    }
+
+    RouteEntry *route = &routes[route_count];
+    route->key = key;
+    route->count = 0;
+    route->capacity = INITIAL_ROUTE_CAPACITY;
+    route->departures = (uint64_t *)malloc(route->capacity * sizeof(uint64_t));
+    route->slots = (int32_t *)malloc(route->capacity * sizeof(int32_t));
+    if (route->departures == NULL || route->slots == NULL) {
+        perror("Memory allocation failed for route entries");
+        free(route->departures);
+        free(route->slots);
+        return -1;
+    }
+    memory_charge_fixed(MEMORY_CATALOG, route->capacity * (sizeof(uint64_t) + sizeof(int32_t)));
+    route_bytes += route->capacity * (sizeof(uint64_t) + sizeof(int32_t));
+
+    uint32_t bucket = hash_route(key) & route_table_mask;
+    while (route_table[bucket] >= 0) {
+        bucket = (bucket + 1) & route_table_mask;
+    }
+    route_table[bucket] = route_count;
+    return route_count++;
+}
+
+// First position in a route whose departure is >= departure
+static int lower_bound(const RouteEntry *route, uint64_t departure) {
+    int low = 0, high = route->count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (route->departures[mid] < departure) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// First position in a route whose departure is > departure
+static int upper_bound(const RouteEntry *route, uint64_t departure) {
+    int low = 0, high = route->count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (route->departures[mid] <= departure) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Add a flight to its route. Flights loaded in departure order are appended in O(1);
+// an out-of-order departure is inserted at its sorted position.
+int route_index_add(int source_id, int destination_id, uint64_t departure, int slot) {
+    uint32_t key = route_key(source_id, destination_id);
+    int number = find_route(key);
+    if (number < 0 && (number = create_route(key)) < 0) {
+        return -1;
+    }
+
+    RouteEntry *route = &routes[number];
+    if (route->count == route->capacity) {
+        int capacity = route->capacity * 2;
+        uint64_t *departures = (uint64_t *)realloc(route->departures, capacity * sizeof(uint64_t));
+        if (departures == NULL) {
+            perror("Memory allocation failed for route entries");
+            return -1;
+        }
+        route->departures = departures;
+        int32_t *slots = (int32_t *)realloc(route->slots, capacity * sizeof(int32_t));
+        if (slots == NULL) {
+            perror("Memory allocation failed for route entries");
+            return -1;
+        }
+        route->slots = slots;
+        memory_charge_fixed(MEMORY_CATALOG, route->capacity * (sizeof(uint64_t) + sizeof(int32_t)));  // Capacity doubles
+        route_bytes += route->capacity * (sizeof(uint64_t) + sizeof(int32_t));
+        route->capacity = capacity;
+    }
+
+    int position = route->count;
+    if (position > 0 && route->departures[position - 1] > departure) {
+        position = upper_bound(route, departure);  // Keep equal departures in insertion order
+        memmove(&route->departures[position + 1], &route->departures[position],
+                (route->count - position) * sizeof(uint64_t));
+        memmove(&route->slots[position + 1], &route->slots[position],
+                (route->count - position) * sizeof(int32_t));
+    }
+    route->departures[position] = departure;
+    route->slots[position] = slot;
+    route->count++;
+    return 0;
+}
+
+// Find the flights on a route departing within [from, to]. On return *slots points at the
+// first matching catalog slot inside the index; it stays valid while catalog_lock is held.
+int route_index_range(int source_id, int destination_id, uint64_t from, uint64_t to, const int32_t **slots) {
+    *slots = NULL;
+    int number = find_route(route_key(source_id, destination_id));
+    if (number < 0 || from > to) {
+        return 0;
+    }
+
+    const RouteEntry *route = &routes[number];
+    int first = lower_bound(route, from);
+    int last = upper_bound(route, to);
+    *slots = route->slots + first;
+    return last > first ? last - first : 0;
+}
+
+// Release every route
+void route_index_clear() {
+    for (int i = 0; i < route_count; i++) {
+        free(routes[i].departures);
+        free(routes[i].slots);
+    }
+    free(routes);
+    free(route_table);
+    routes = NULL;
+    route_table = NULL;
+    route_count = route_capacity = 0;
+    route_table_mask = 0;
+    memory_release(MEMORY_CATALOG, route_bytes);
+    route_bytes = 0;
+}
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdatomic.h>  // Inline and dispatched request counters
 
 #ifdef __linux__
 #include <arpa/inet.h>
@@ -21,6 +22,17 @@
 #include <pthread.h>
 #include "server.h"
 #include "communication.h"  // Include marshalling and unmarshalling functionality
+#include "arena.h"  // Per-worker request arenas
+#include "timer.h"  // Timer wheel driven by the receive loop
+#include "trace.h"  // Sampled request tracing
+#include "capture.h"  // Inbound traffic capture
+#include "fault.h"  // Network fault injection and request accounting
+#include "session.h"  // Sequence-numbered client sessions
+#include "db_pool.h"  // Non-blocking database pool
+#include "affinity.h"  // CPU placement of the server's threads
+#include "rate_limit.h"  // Per-client token buckets
+#include "memory_budget.h"  // Memory accounting and the optional budget
+#include "history_file.h"  // Request history kept in a memory-mapped file
 #include <mysql/mysql.h>
 #include <fcntl.h>  // For setting non-blocking mode
 
@@ -28,25 +40,40 @@
 #define BUFFER_SIZE 1024  // Buffer size for communication
 #define MAX_HISTORY 100  // Maximum number of request histories to store
 #define SERVER_IP "172.20.10.10"  // Server IP address
-
-// Flight and related data initialization
-Flight *flights = NULL;  // Initialize to NULL
-int flight_count = 0;
-int max_flights = 100;
-
-// Mutex for thread-safe operations
-pthread_mutex_t flight_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define DEFAULT_WORKER_THREADS 8  // Worker threads used when the core count cannot be determined
+#define INITIAL_FLIGHT_CAPACITY 1024  // Initial catalog size; the catalog doubles as flights are loaded
+#define HISTORY_TTL_MS 60000  // Cached replies older than this are dropped
+#define HISTORY_SWEEP_MS 1000  // How often expired replies are swept
 
 // Structure for storing request history
 typedef struct {
     struct sockaddr_in client_addr;  // Client address
     char request[BUFFER_SIZE];  // Original request
     char response[BUFFER_SIZE];  // Cached response
+    uint64_t stored_ms;  // When the response was cached
 } RequestHistory;
 
-RequestHistory history[MAX_HISTORY];  // History array to store requests and responses
-int history_count = 0;  // Current count of stored requests
+static RequestHistory history_memory[MAX_HISTORY];  // The history unless --history-file is given
+static HistoryRing history_memory_ring;
+static RequestHistory *history = history_memory;  // Ring of requests and responses, oldest at ring->head
+static HistoryRing *ring = &history_memory_ring;  // Position of the stored entries (in the file, if there is one)
+static pthread_mutex_t history_mutex = PTHREAD_MUTEX_INITIALIZER;  // Workers store and look up concurrently
+static Timer history_timer;  // Periodic sweep of expired replies
 int use_at_least_once = 0;  // Flag to toggle between at-least-once and at-most-once modes
+int worker_threads = 0;  // Number of worker threads in the pool (0 = one per online core)
+int db_connections = 0;  // Connections in the non-blocking database pool (0 = default)
+const char *server_ip = SERVER_IP;  // Address the request socket binds to
+int server_port = PORT;  // Port the request socket binds to
+const char *trace_path = NULL;  // Trace file, if tracing was requested
+int trace_sample_every = 0;  // Trace one request in this many (0 = default)
+const char *capture_path = NULL;  // Capture file, if capturing was requested
+const char *history_path = NULL;  // File the request history is kept in, if persistence was requested
+static int request_sockfd = -1;  // The socket clients send requests to
+_Thread_local int history_suppressed = 0;  // Captured requests answer the server, not a client
+static MYSQL *request_conn = NULL;  // Database connection handed to every request
+
+// Requests answered on the receive thread and handed to workers, reported by query_server_stats
+static _Atomic uint64_t inline_connection_tests, inline_history_hits, inline_catalog_reads, requests_dispatched;
 
 // Function to set a socket to non-blocking mode
 void set_nonblocking(int sockfd) {
@@ -65,37 +92,107 @@ void set_nonblocking(int sockfd) {
 #endif
 }
 
+// Forget the oldest cached reply (caller holds history_mutex). Head and count change in one
+// 8-byte store, so the ring in the file never shows one moved without the other: a crash
+// cannot make the newest entry look like the dropped one.
+static void drop_oldest_history() {
+    HistoryRing next = { (ring->head + 1) % MAX_HISTORY, ring->count - 1 };
+    __atomic_store(ring, &next, __ATOMIC_RELEASE);
+}
+
+// Store a processed request and its response, given as fragments, into the request history
+void store_in_history_vec(struct sockaddr_in *client_addr, const char *request, const ReplyVec *response, int count) {
+    if (history_suppressed) {
+        return;  // No client will retransmit it, and it would push a client's reply out of the history
+    }
+    pthread_mutex_lock(&history_mutex);
+    if (ring->count == MAX_HISTORY) {
+        drop_oldest_history();  // FIFO: Remove the oldest entry to make room for new one
+    }
+    RequestHistory *entry = &history[(ring->head + ring->count) % MAX_HISTORY];
+    entry->client_addr = *client_addr;  // Copy client address
+    strncpy(entry->request, request, BUFFER_SIZE - 1);  // Copy request
+    entry->request[BUFFER_SIZE - 1] = '\0';  // Terminated in the file too, whatever the request
+    reply_flatten(response, count, entry->response, BUFFER_SIZE);  // Copy response straight from its fragments
+    entry->stored_ms = timer_now_ms();
+    atomic_thread_fence(memory_order_release);  // The entry is complete before the count covers it
+    ring->count++;
+    pthread_mutex_unlock(&history_mutex);
+}
+
 // Store a processed request and its response into the request history
 void store_in_history(struct sockaddr_in *client_addr, const char *request, const char *response) {
-    if (history_count < MAX_HISTORY) {
-        history[history_count].client_addr = *client_addr;  // Copy client address
-        strncpy(history[history_count].request, request, BUFFER_SIZE);  // Copy request
-        strncpy(history[history_count].response, response, BUFFER_SIZE);  // Copy response
-        history_count++;
-    } else {
-        // FIFO: Remove the oldest entry to make room for new one
-        for (int i = 1; i < MAX_HISTORY; i++) {
-            history[i - 1] = history[i];
+    ReplyVec vec;
+    reply_vec_set(&vec, response, strlen(response));
+    store_in_history_vec(client_addr, request, &vec, 1);
+}
+
+// Timer callback: drop cached replies older than HISTORY_TTL_MS, then re-arm
+static void expire_history(void *arg) {
+    (void)arg;
+    uint64_t now = timer_now_ms();
+    pthread_mutex_lock(&history_mutex);
+    while (ring->count > 0 && now - history[ring->head].stored_ms >= HISTORY_TTL_MS) {
+        drop_oldest_history();  // Entries are in arrival order, so the expired ones are the oldest
+    }
+    pthread_mutex_unlock(&history_mutex);
+    history_file_checkpoint();
+    timer_schedule(&history_timer, HISTORY_SWEEP_MS);
+}
+
+// Keep the request history in the file at path from now on, restoring the replies it holds
+static int open_history_file(const char *path) {
+    HistoryRing *file_ring;
+    int64_t clock_shift_ms;
+    RequestHistory *entries = history_file_open(path, sizeof(RequestHistory), MAX_HISTORY, &file_ring, &clock_shift_ms);
+    if (entries == NULL) {
+        return -1;
+    }
+    history = entries;
+    ring = file_ring;
+
+    // Put the restored timestamps on this process's clock, then drop what expired while the server was down
+    int64_t now = (int64_t)timer_now_ms();
+    for (int i = 0; i < ring->count; i++) {
+        RequestHistory *entry = &history[(ring->head + i) % MAX_HISTORY];
+        int64_t stored = (int64_t)entry->stored_ms + clock_shift_ms;
+        entry->stored_ms = stored < 0 ? 0 : (uint64_t)(stored < now ? stored : now);  // A wall clock step back never ages a reply
+        entry->request[BUFFER_SIZE - 1] = '\0';
+        entry->response[BUFFER_SIZE - 1] = '\0';
+    }
+    int expired = 0;
+    while (ring->count > 0 && (uint64_t)now - history[ring->head].stored_ms >= HISTORY_TTL_MS) {
+        drop_oldest_history();
+        expired++;
+    }
+    printf("Request history: %d cached replies restored from %s (%d had expired).\n", ring->count, path, expired);
+    return 0;
+}
+
+// Copy the cached reply to a request into response; 1 if the request has one
+static int lookup_history(const struct sockaddr_in *client_addr, const char *request, char *response) {
+    int found = 0;
+    pthread_mutex_lock(&history_mutex);
+    for (int i = 0; i < ring->count && !found; i++) {
+        const RequestHistory *entry = &history[(ring->head + i) % MAX_HISTORY];
+        if (strcmp(entry->request, request) == 0 &&  // Check if request matches
+            entry->client_addr.sin_addr.s_addr == client_addr->sin_addr.s_addr &&  // Check client address
+            entry->client_addr.sin_port == client_addr->sin_port) {
+            strcpy(response, entry->response);  // Copy the cached response
+            found = 1;
         }
-        history[MAX_HISTORY - 1].client_addr = *client_addr;
-        strncpy(history[MAX_HISTORY - 1].request, request, BUFFER_SIZE);
-        strncpy(history[MAX_HISTORY - 1].response, response, BUFFER_SIZE);
     }
+    pthread_mutex_unlock(&history_mutex);
+    return found;
 }
 
 // Check if a request has already been processed (to avoid duplicates)
 int find_in_history(int sockfd, struct sockaddr_in *client_addr, const char *request, char *response) {
-    for (int i = 0; i < history_count; i++) {
-        if (strcmp(history[i].request, request) == 0 &&  // Check if request matches
-            history[i].client_addr.sin_addr.s_addr == client_addr->sin_addr.s_addr &&  // Check client address
-            history[i].client_addr.sin_port == client_addr->sin_port) {
-            
-            strcpy(response, history[i].response);  // Copy the cached response
-            printf("Request duplicated! Returning cached response.\n");
-            // Send the cached response to the client
-            sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
-            return 1;  // Request has already been processed
-        }
+    if (lookup_history(client_addr, request, response)) {
+        printf("Request duplicated! Returning cached response.\n");
+        // Send the cached response to the client, outside the lock
+        fault_sendto(sockfd, response, strlen(response), 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+        return 1;  // Request has already been processed
     }
     printf("Request goes further for processing...\n");
     return 0;  // No duplicate found
@@ -108,43 +205,205 @@ void *handle_client(void *arg) {
 
     MYSQL *conn = data->conn;  // Use the passed database connection
 
+    trace_current = data->trace_id;  // Trace points below record only if the request was sampled
+    db_request_deferred = 0;  // Set by handlers that finish in a database continuation
+    TRACE(TRACE_DEQUEUE, TRACE_INSTANT);
     printf("handle_client: processing request!\n");
 
-    if (use_at_least_once) {
+    if (session_handle(data->sockfd, &data->client_addr, data->buffer, conn, use_at_least_once)) {
+        // Numbered request: deduplicated (or re-executed) through the client's session window
+        printf("Session request handled.\n");
+    } else if (use_at_least_once) {
         // At-least-once: Directly re-execute the request
         printf("Processing new request (At-least-once): %u\n", data->buffer);
+        fault_account_request(&data->client_addr, data->buffer, 0);
+        TRACE(TRACE_HANDLE, TRACE_BEGIN);
         handleRequest(data->buffer, data->client_addr, data->sockfd, data->addr_len, conn);
+        TRACE(TRACE_HANDLE, TRACE_END);
 
         // Generate a new response
         snprintf(reply, sizeof(reply), "Response to: %s", data->buffer);
     } else {
         // At-most-once: Check the history to avoid duplicate processing
-        if (find_in_history(data->sockfd, &data->client_addr, data->buffer, reply)) {
+        TRACE(TRACE_HISTORY, TRACE_BEGIN);
+        int duplicate = find_in_history(data->sockfd, &data->client_addr, data->buffer, reply);
+        TRACE(TRACE_HISTORY, TRACE_END);
+        fault_account_request(&data->client_addr, data->buffer, duplicate);
+        if (duplicate) {
             // Re-reply: Return the cached response for the duplicate request
             printf("Duplicate request found (At-most-once), sending cached response.\n");
             // Cached response has already been sent in find_in_history
         } else {
             // Process the new request
             printf("Processing new request (At-most-once): %s\n", data->buffer);
+            TRACE(TRACE_HANDLE, TRACE_BEGIN);
             handleRequest(data->buffer, data->client_addr, data->sockfd, data->addr_len, conn);
+            TRACE(TRACE_HANDLE, TRACE_END);
 
-            // Generate a new response
-            snprintf(reply, sizeof(reply), "Response to: %s", data->buffer);
-            // Store the processed request and response in history
-            store_in_history(&data->client_addr, data->buffer, reply);
+            // Generate a new response; a deferred request stores its real reply when it completes
+            if (!db_request_deferred) {
+                snprintf(reply, sizeof(reply), "Response to: %s", data->buffer);
+                // Store the processed request and response in history
+                store_in_history(&data->client_addr, data->buffer, reply);
+            }
         }
     }
 
-    // Release dynamically allocated memory for client data
-    free(data);
+    trace_current = 0;
+
+    // Release everything the request allocated: O(1) arena reset, client data back to the slab
+    arena_reset(request_arena());
+    client_data_release(data);
 
     return NULL;
 }
 
+// Thread pool entry point: run handle_client on a pool worker
+static void handle_client_task(void *arg) {
+    handle_client(arg);
+}
+
+// Which catalog read a request is, if it can be answered here: the flight is served by this
+// node, so the reply comes from the catalog without a query or a forward
+enum { INLINE_NONE, INLINE_CONNECTION_TEST, INLINE_DETAILS, INLINE_BAGGAGE };
+
+static int inline_kind(const char *request, int *flight_id) {
+    if (strncmp(request, "test_connection", 15) == 0) {
+        return INLINE_CONNECTION_TEST;
+    }
+    if (sscanf(request, "query_flight_info %d", flight_id) == 1) {
+        return partition_owns(*flight_id) ? INLINE_DETAILS : INLINE_NONE;
+    }
+    if (sscanf(request, "query_baggage_availability %d", flight_id) == 1) {
+        return partition_owns(*flight_id) ? INLINE_BAGGAGE : INLINE_NONE;
+    }
+    return INLINE_NONE;
+}
+
+// Answer a cheap request on the receive thread instead of handing it to a worker: connection
+// tests, at-most-once duplicates with a cached reply, and catalog reads. Numbered session
+// requests keep their window's ordering and always go to a worker. The history is searched
+// once and the reply sent straight from the catalog, without handle_client's logging.
+static int answer_inline(struct client_data *data) {
+    static const char connection_ok[] = "Connection OK";
+    char reply[BUFFER_SIZE];
+    if (strncmp(data->buffer, "seq ", 4) == 0 || strncmp(data->buffer, "ack ", 4) == 0) {
+        return 0;
+    }
+    if (!use_at_least_once && lookup_history(&data->client_addr, data->buffer, reply)) {
+        fault_account_request(&data->client_addr, data->buffer, 1);
+        fault_sendto(request_sockfd, reply, strlen(reply), 0, (struct sockaddr *)&data->client_addr, sizeof(data->client_addr));
+        atomic_fetch_add_explicit(&inline_history_hits, 1, memory_order_relaxed);
+        if (data->trace_id) {
+            trace_record(data->trace_id, TRACE_HISTORY, TRACE_INSTANT, 0);
+        }
+        client_data_release(data);
+        return 1;
+    }
+    int flight_id = 0;
+    int kind = inline_kind(data->buffer, &flight_id);
+    if (kind == INLINE_NONE) {
+        return 0;
+    }
+
+    trace_current = data->trace_id;
+    fault_account_request(&data->client_addr, data->buffer, 0);
+    TRACE(TRACE_HANDLE, TRACE_BEGIN);
+    if (kind == INLINE_CONNECTION_TEST) {
+        fault_sendto(request_sockfd, connection_ok, sizeof(connection_ok) - 1, 0, (struct sockaddr *)&data->client_addr,
+                     sizeof(data->client_addr));
+        atomic_fetch_add_explicit(&inline_connection_tests, 1, memory_order_relaxed);
+    } else if (kind == INLINE_DETAILS) {
+        send_flight_details(request_sockfd, &data->client_addr, data->buffer, flight_id);
+        atomic_fetch_add_explicit(&inline_catalog_reads, 1, memory_order_relaxed);
+    } else {
+        send_baggage_availability(request_sockfd, &data->client_addr, data->buffer, flight_id);
+        atomic_fetch_add_explicit(&inline_catalog_reads, 1, memory_order_relaxed);
+    }
+    TRACE(TRACE_HANDLE, TRACE_END);
+    trace_current = 0;
+    client_data_release(data);
+    return 1;
+}
+
+size_t request_path_stats_report(char *buffer, size_t size) {
+    uint64_t tests = atomic_load(&inline_connection_tests), hits = atomic_load(&inline_history_hits);
+    uint64_t reads = atomic_load(&inline_catalog_reads);
+    int written = snprintf(buffer, size,
+                           "Request path: %llu answered inline (%llu connection tests, %llu history hits, %llu catalog reads), "
+                           "%llu dispatched to workers\n",
+                           (unsigned long long)(tests + hits + reads), (unsigned long long)tests, (unsigned long long)hits,
+                           (unsigned long long)reads, (unsigned long long)atomic_load(&requests_dispatched));
+    return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+}
+
+// Hand a received request to the worker pool
+static void dispatch_request_data(struct client_data *data, uint64_t recv_start) {
+    // Refuse clients over their rate before the request costs a worker or a query. Requests
+    // forwarded by other nodes all come from the peer's socket and were admitted there.
+    if (!partition_is_forward(data->buffer, &data->client_addr) && !rate_limit_admit(request_sockfd, &data->client_addr)) {
+        client_data_release(data);
+        return;
+    }
+    data->sockfd = request_sockfd;
+    data->conn = request_conn;  // Pass the database connection to the thread
+    data->trace_id = trace_sample();
+    if (data->trace_id) {
+        trace_record(data->trace_id, TRACE_RECV, TRACE_BEGIN, recv_start ? recv_start : trace_now_ns());
+        trace_record(data->trace_id, TRACE_RECV, TRACE_END, 0);
+    }
+    if (answer_inline(data)) {
+        return;
+    }
+    if (data->trace_id) {
+        trace_record(data->trace_id, TRACE_ENQUEUE, TRACE_INSTANT, 0);
+    }
+
+    // Push the request onto the pool's shared MPMC inject queue; an idle worker takes it from there
+    atomic_fetch_add_explicit(&requests_dispatched, 1, memory_order_relaxed);
+    if (thread_pool_add_task(handle_client_task, (void *)data) != 0) {
+        client_data_release(data);  // Recycle the slot if the pool is saturated and the request is dropped
+    }
+}
+
+// Fault layer callback: a held datagram arrives now
+static void deliver_held_request(const char *buffer, size_t length, const struct sockaddr_in *client_addr) {
+    struct client_data *data = client_data_acquire();
+    if (!data) {
+        perror("Malloc failed");
+        return;
+    }
+    memcpy(data->buffer, buffer, length);
+    data->buffer[length] = '\0';
+    data->client_addr = *client_addr;
+    data->addr_len = sizeof(data->client_addr);
+    dispatch_request_data(data, 0);
+}
+
+// Pick the worker count: --threads if given, otherwise one worker per online core
+static int resolve_worker_threads() {
+    if (worker_threads > 0) {
+        return worker_threads;
+    }
+#ifdef _SC_NPROCESSORS_ONLN
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores > 0) {
+        return (int)cores;
+    }
+#endif
+    return DEFAULT_WORKER_THREADS;
+}
+
 // Main function to set up the server
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        printf("Usage: %s [at-least-once | at-most-once]\n", argv[0]);
+    if (argc < 2) {
+        printf("Usage: %s [at-least-once | at-most-once] [--threads N] [--db-connections N] [--bind IP] [--port N]\n"
+               "       [--replicate-port N] [--primary HOST:PORT]... [--node HOST:PORT]...\n"
+               "       [--trace FILE] [--trace-sample N] [--capture FILE] [--history-file FILE]\n"
+               "       [--fault-drop P] [--fault-duplicate P] [--fault-delay P] [--fault-delay-ms MS]\n"
+               "       [--fault-reorder P] [--fault-seed N]\n"
+               "       [--cpu-receive LIST] [--cpu-workers LIST] [--cpu-notifier LIST] [--cpu-database LIST]\n"
+               "       [--rate-limit N] [--rate-burst N] [--rate-action reply|drop] [--memory-budget MB]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
@@ -160,6 +419,65 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    // Parse the optional settings that follow the fault-tolerance mode
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            worker_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--db-connections") == 0 && i + 1 < argc) {
+            db_connections = atoi(argv[++i]);  // Queries in flight at once
+        } else if (strcmp(argv[i], "--bind") == 0 && i + 1 < argc) {
+            server_ip = argv[++i];
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            server_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--replicate-port") == 0 && i + 1 < argc) {
+            replication_set_listen_port(atoi(argv[++i]));  // Accept backups here while primary
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];  // Write sampled request traces here
+        } else if (strcmp(argv[i], "--trace-sample") == 0 && i + 1 < argc) {
+            trace_sample_every = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture_path = argv[++i];  // Record inbound datagrams for replay
+        } else if (strcmp(argv[i], "--history-file") == 0 && i + 1 < argc) {
+            history_path = argv[++i];  // Keep the at-most-once history across restarts
+        } else if (strncmp(argv[i], "--fault-", 8) == 0 && i + 1 < argc) {
+            if (fault_set_option(argv[i] + 8, argv[i + 1]) != 0) {  // Inject network faults
+                printf("Invalid fault option: %s %s\n", argv[i], argv[i + 1]);
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        } else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+            if (memory_set_budget(argv[++i]) != 0) {  // Megabytes the accounted subsystems may hold
+                printf("Invalid memory budget: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strncmp(argv[i], "--rate-", 7) == 0 && i + 1 < argc) {
+            if (rate_limit_set_option(argv[i] + 7, argv[i + 1]) != 0) {  // Per-client request rate
+                printf("Invalid rate limit option: %s %s\n", argv[i], argv[i + 1]);
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        } else if (strncmp(argv[i], "--cpu-", 6) == 0 && i + 1 < argc) {
+            if (affinity_set_option(argv[i] + 6, argv[i + 1]) != 0) {  // Pin a role's threads to these CPUs
+                printf("Invalid CPU option: %s %s\n", argv[i], argv[i + 1]);
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        } else if (strcmp(argv[i], "--node") == 0 && i + 1 < argc) {
+            if (partition_add_node(argv[++i]) != 0) {  // One member of a partitioned deployment
+                printf("Invalid node address: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--primary") == 0 && i + 1 < argc) {
+            if (replication_add_primary(argv[++i]) != 0) {  // Start as a backup of this primary
+                printf("Invalid primary address: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            printf("Invalid option: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
 #ifdef _WIN32
     WSADATA wsaData;
     if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
@@ -169,18 +487,11 @@ int main(int argc, char *argv[]) {
 #endif
 
     int sockfd;
-    struct sockaddr_in server_addr, client_addr;
-    char *buffer = (char *)malloc(BUFFER_SIZE * sizeof(char));  // Allocate buffer memory
-    if (buffer == NULL) {
-        perror("Memory allocation failed");
-        exit(EXIT_FAILURE);
-    }
-    socklen_t addr_len = sizeof(client_addr);
+    struct sockaddr_in server_addr;
 
     // Create a UDP socket
     if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
         perror("Socket creation failed");
-        free(buffer);
         exit(EXIT_FAILURE);
     }
 
@@ -190,48 +501,115 @@ int main(int argc, char *argv[]) {
     // Configure the server address
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
-    server_addr.sin_port = htons(PORT);
+    server_addr.sin_addr.s_addr = inet_addr(server_ip);
+    server_addr.sin_port = htons(server_port);
 
     // Bind the socket to the specified IP and port
     if (bind(sockfd, (const struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         perror("Bind failed");
         close(sockfd);
-        free(buffer);
         exit(EXIT_FAILURE);
     }
 
-    printf("Server is running on port %d...\n", PORT);
+    printf("Server is running on port %d...\n", server_port);
+
+    // Work out which flights this node serves before any are loaded
+    if (partition_start(server_ip, server_port) != 0) {
+        close(sockfd);
+        exit(EXIT_FAILURE);
+    }
 
     // Connect to the database
     MYSQL *conn = connect_db();
-    query_flights(conn);  // Query and display current flights
+    if (db_pool_start(db_connections) != 0) {  // Request-path queries run on the pool's own connections
+        close(sockfd);
+        exit(EXIT_FAILURE);
+    }
+    initialize_flights(INITIAL_FLIGHT_CAPACITY);
+    if (!replication_is_backup()) {
+        query_flights(conn);  // Load the current flights into the in-memory catalog
+    }  // A backup receives its catalog from the primary instead
+    replication_start();
 
     printf("Successfully connected to the database!\n");
 
+    // Start the thread that pushes seat availability updates to follow_flight_id subscribers
+    notifier_start(sockfd);
+
+    // Restore the cached replies of the previous run if the history is kept in a file
+    if (history_path != NULL && open_history_file(history_path) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Expire cached replies by age as well as by count
+    memory_charge_fixed(MEMORY_REPLY_CACHE, sizeof(history_memory));  // MAX_HISTORY entries, in memory or mapped from the file
+    timer_init(&history_timer, expire_history, NULL);
+    timer_schedule(&history_timer, HISTORY_SWEEP_MS);
+    session_start();  // Sessions of clients that number their requests
+    rate_limit_start();  // Idle clients' buckets age out (only with --rate-limit)
+
+    // Record sampled request traces if asked to
+    if (trace_path != NULL && trace_start(trace_path, trace_sample_every) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Record inbound traffic for replay if asked to
+    if (capture_path != NULL && capture_start(capture_path) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Put the fault injection layer (idle unless --fault-* was given) around the request socket
+    request_sockfd = sockfd;
+    request_conn = conn;
+    fault_start(sockfd, deliver_held_request);
+
+    // Start the work-stealing worker pool that executes client requests
+    int num_workers = resolve_worker_threads();
+    thread_pool_init(num_workers);
+    printf("Worker pool started with %d threads.\n", num_workers);
+
+    // Pin the receive loop last: threads created from here on would inherit its mask
+    affinity_pin_self(AFFINITY_RECEIVE);
+    char placement[2048];
+    affinity_report(placement, sizeof(placement));
+    printf("%s", placement);
+    memory_stats_report(placement, sizeof(placement));  // What startup already holds against the budget
+    printf("%s", placement);
+
     // Main loop: continuously handle incoming client requests
     while (1) {
-        memset(buffer, 0, BUFFER_SIZE);  // Clear the buffer
-
         // Use select to monitor socket readiness for reading
         fd_set read_fds;
         FD_ZERO(&read_fds);
         FD_SET(sockfd, &read_fds);
 
+        // Sleep no longer than the next timer is due
+        int wait_ms = timer_next_timeout_ms(5000);
         struct timeval timeout;
-        timeout.tv_sec = 5;
-        timeout.tv_usec = 0;
+        timeout.tv_sec = wait_ms / 1000;
+        timeout.tv_usec = (wait_ms % 1000) * 1000;
 
         int activity = select(sockfd + 1, &read_fds, NULL, NULL, &timeout);
+        timer_run(timer_now_ms());  // Fire leases, cache expiries and other due timers
         if (activity < 0) {
             perror("select error");
         } else if (activity == 0) {
             continue;  // Timeout without activity
         }
 
+        // Take a recycled client_data and receive straight into its buffer (no intermediate copy)
+        struct client_data *data = client_data_acquire();
+        if (!data) {
+            perror("Malloc failed");
+            continue;
+        }
+        data->addr_len = sizeof(data->client_addr);
+        uint64_t recv_start = trace_enabled ? trace_now_ns() : 0;
+
         // Receive a client request
-        int n = recvfrom(sockfd, buffer, BUFFER_SIZE, 0, (struct sockaddr *)&client_addr, &addr_len);
+        int n = recvfrom(sockfd, data->buffer, BUFFER_SIZE - 1, 0, (struct sockaddr *)&data->client_addr, &data->addr_len);
         if (n < 0) {
+            client_data_release(data);
             if (errno == EWOULDBLOCK || errno == EAGAIN) {
                 printf("No data received yet.\n");
                 continue;
@@ -239,36 +617,23 @@ int main(int argc, char *argv[]) {
             perror("Receive failed");
             continue;
         }
-
-        // Create a new thread to handle the client's request
-        pthread_t client_thread;
-        struct client_data *data = malloc(sizeof(struct client_data));  // Allocate memory for client data
-        if (!data) {
-            perror("Malloc failed");
+        data->buffer[n] = '\0';  // Terminate the request so handlers can parse it as a string
+        capture_datagram(&data->client_addr, data->buffer, n);
+        if (fault_inbound(data->buffer, n, &data->client_addr)) {
+            client_data_release(data);  // Dropped, or held back to arrive later
             continue;
         }
 
-        // Copy the received data and client information
-        strncpy(data->buffer, buffer, BUFFER_SIZE);
-        data->client_addr = client_addr;
-        data->sockfd = sockfd;
-        data->addr_len = addr_len;
-        data->conn = conn;  // Pass the database connection to the thread
-
-        // Create a new thread to handle the request
-        if (pthread_create(&client_thread, NULL, handle_client, (void *)data) != 0) {
-            perror("Client thread creation failed");
-            free(data);  // Free memory if thread creation fails
-        }
-        pthread_detach(client_thread);  // Detach the thread so it cleans up after itself
+        dispatch_request_data(data, recv_start);
     }
 
+    thread_pool_destroy();  // Stop the workers before tearing down shared state
+
 #ifdef _WIN32
     WSACleanup();
 #endif
 
     close(sockfd);
-    free(buffer);  // Free the buffer memory
 
     // Close the database connection
     close_db(conn);
@@ -15,9 +15,20 @@
 #include <pthread.h>       // For threading support
 #include <stdint.h>        // For uint8_t and uint32_t types
 #include <mysql/mysql.h>   // MySQL database interaction
+#include "db_pool.h"       // Non-blocking queries for the request path
+#include "fragments.h"     // Pre-rendered reply fragments and gathered sends
 
 #define BUFFER_SIZE 1024   // Define buffer size for communication
 
+// Hint to the CPU that we are in a spin-wait loop
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
 // Structure to store the departure time of a flight
 typedef struct {
     int year;     // Year of departure
@@ -38,6 +49,32 @@ typedef struct {
     int baggage_availability;    // Available baggage space
 } Flight;
 
+#define MAX_CITIES 65536  // Interned city ids fit in 16 bits
+
+// Flight catalog in structure-of-arrays form; slot i of every column describes the same flight
+typedef struct {
+    // Hot, mutable counters touched by bookings and availability queries
+    int32_t *seat_availability;     // Number of available seats
+    int32_t *baggage_availability;  // Available baggage space
+    // Cold, descriptive fields
+    int32_t *flight_id;             // Unique identifier for the flight
+    uint16_t *source_city;          // Interned departure location
+    uint16_t *destination_city;     // Interned arrival location
+    uint64_t *departure;            // Departure time packed by pack_departure_time
+    float *airfare;                 // Price of the flight
+    _Atomic uint32_t *counter_version;  // Seqlock version of each flight's counters (odd while being written)
+    // Pre-rendered reply fragments (fragments.h)
+    ReplyFragment **detail_fragment;  // Descriptive lines of the detail reply, fixed for the flight's life
+    ReplyFragment **route_fragment;   // The flight's line in route search replies, fixed as well
+    ReplyFragment *_Atomic *counters_fragment;  // Seat and baggage lines, replaced when the counters change
+    int count;                      // Number of stored flights (not maintained in published snapshots)
+    int capacity;                   // Allocated slots per column
+    // Open-addressing index from flight_id to slot
+    int32_t *index_keys;            // flight_id stored in each bucket
+    _Atomic int32_t *index_slots;   // Catalog slot per bucket, -1 if empty (published with release)
+    uint32_t index_mask;            // Bucket count - 1 (bucket count is a power of two)
+} FlightCatalog;
+
 // Structure to store client-specific data for each connection
 struct client_data {
     char buffer[BUFFER_SIZE];    // Data buffer for client communication
@@ -45,51 +82,112 @@ struct client_data {
     int sockfd;                  // Socket file descriptor
     socklen_t addr_len;          // Length of client address structure
     MYSQL *conn;                 // MySQL database connection for this client
+    uint32_t trace_id;           // Trace id if the request was sampled for tracing, 0 otherwise
 };
 
 // Declare variables for flight information
-extern Flight *flights;          // Pointer to an array of flights
-extern int flight_count;         // Number of currently stored flights
-extern int max_flights;          // Maximum capacity of the flight array
+extern FlightCatalog catalog;           // The in-memory flight catalog
+extern pthread_rwlock_t catalog_lock;   // Guards the catalog columns and index for writers and scans
 
 // Callback handling declarations
 void handle_client_request(int sockfd, struct sockaddr_in *client_addr, char *buffer, MYSQL *conn);  // Handle client request
-void register_flight_monitor(int sockfd, struct sockaddr_in *client_addr, int flight_id);  // Register client to monitor a flight
-void* monitor_flights(void* arg);  // Monitor flight updates in a separate thread
+void register_flight_monitor(int sockfd, struct sockaddr_in *client_addr, int flight_id, int lease_seconds);  // Register client to monitor a flight for a lease
+void notifier_start(int sockfd);  // Start the thread that sends seat availability updates
+void notify_flight_changed(int flight_id);  // Mark a flight's counters as changed for its subscribers
+size_t notifier_stats_report(char *buffer, size_t size);  // Summarise subscribers and updates sent
 Flight* unmarshal_flight(const uint8_t* buffer, uint32_t* flight_data_length);  // Unmarshal flight data from a byte array
 
 // Data storage declarations
-void initialize_flights();        // Initialize the flight array with sample data
-Flight* find_flight_by_id(int flight_id);  // Find a flight by its ID
-int update_flight_seats(int flight_id, int seats);  // Update the number of available seats for a flight
+void initialize_flights(int initial_capacity);  // Initialize the empty flight catalog
+int find_flight_slot(int flight_id);  // Find a flight's catalog slot by its ID (caller holds catalog_lock)
+void read_slot_counters(int slot, int *seats, int *baggage);  // A slot's counters as a consistent pair (caller holds catalog_lock)
+int get_flight(int flight_id, Flight *out);  // Copy a flight out of the catalog without locking (returns 1 if found)
+int get_flight_detail_reply(int flight_id, ReplyVec *vec, char *spare, size_t spare_size);  // Point two vector elements at a flight's detail reply (caller is inside epoch_enter; 0 if not found)
+int update_flight_seats(int flight_id, int seats, int *remaining);  // Take seats from a flight (1 done, -1 not enough, 0 not found)
+int update_flight_baggage(int flight_id, int baggage, int *remaining);  // Take baggage space from a flight (same results)
+int set_flight_counters(int flight_id, int seats, int baggage);  // Overwrite a flight's counters (returns 1 if found)
+int get_flight_by_slot(int slot, Flight *out);  // Copy the flight in a catalog slot (returns 0 past the end)
 int add_flight(int flight_id, const char *source, const char *destination, DepartureTime departure_time, float airfare, int seat_availability, int baggage_availability);  // Add a new flight to the system
+void cleanup_flights();  // Release the catalog
+int find_city(const char *name);  // Look up an interned city id (-1 if unknown)
+const char *city_name(int city_id);  // Name of an interned city
+uint64_t pack_departure_time(DepartureTime time);  // Pack a departure time into a sortable 64-bit value
+DepartureTime unpack_departure_time(uint64_t packed);  // Inverse of pack_departure_time
+
+// Flight lock declarations (striped by flight_id; guard the seat and baggage counters)
+void flight_lock(int flight_id);  // Lock the stripe that covers a flight
+void flight_unlock(int flight_id);  // Unlock the stripe that covers a flight
+size_t flight_lock_stats_report(char *buffer, size_t size);  // Summarise lock acquisitions, waits and hold times
+
+// Replication declarations (primary-backup streaming of catalog mutations)
+void replication_set_listen_port(int port);  // Port on which a primary accepts backups
+int replication_add_primary(const char *address);  // Add a "host:port" primary candidate; makes this server a backup
+void replication_start();  // Pick the role and start the replication thread
+int replication_is_read_only();  // 1 while this server is a backup
+int replication_is_backup();  // 1 if this server was started as a backup
+void replication_record_counters(int flight_id, int seats, int baggage);  // Log a flight's new counters (caller holds its stripe)
+void replication_record_flight(int flight_id, int source_id, int destination_id, uint64_t departure, float airfare, int seats, int baggage);  // Log a new flight (caller holds catalog_lock)
+size_t replication_stats_report(char *buffer, size_t size);  // Summarise the replication state
+
+// Partitioning declarations (consistent-hash assignment of flights to nodes)
+int partition_add_node(const char *address);  // Add a node's "host:port" request address
+int partition_start(const char *self_ip, int self_port);  // Locate this server in the node list and build the ring
+int partition_owns(int flight_id);  // 1 if this node serves the flight
+int partition_self_address(struct sockaddr_in *out);  // The address other nodes reach this one at (-1 when not partitioned)
+int partition_is_forward(const char *request, const struct sockaddr_in *sender);  // 1 for a "fwd" request sent by another node
+int partition_route(char *request, struct sockaddr_in *client_addr, int sockfd, socklen_t len, MYSQL *conn);  // Forward or fan out a request (1 if handled)
+size_t partition_stats_report(char *buffer, size_t size);  // Summarise this node's partition
+
+// Route index declarations (caller holds catalog_lock)
+int route_index_add(int source_id, int destination_id, uint64_t departure, int slot);  // Index a flight under its route
+int route_index_range(int source_id, int destination_id, uint64_t from, uint64_t to, const int32_t **slots);  // Flights on a route departing in [from, to]
+void route_index_clear();  // Release the route index
 
 // Flight service function declarations (for handling specific flight-related requests)
 void handle_query_flight(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn);  // Handle query flight by source and destination
 void handle_query_details(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn);  // Handle detailed flight info query by flight ID
+void send_flight_details(int sockfd, struct sockaddr_in *client_addr, const char *request, int flight_id);  // Send and record a detail reply without logging
+void send_baggage_availability(int sockfd, struct sockaddr_in *client_addr, const char *request, int flight_id);  // Same for a baggage availability reply
 void handle_reservation(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn);  // Handle seat reservation request
 void handle_add_baggage(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn);  // Handle baggage addition request
 void handle_query_baggage_availability(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn);  // Handle query for baggage availability
+void handle_query_flight_window(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn);  // Handle route search within a departure window
+void handle_query_flight_filter(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn);  // Handle search by seats, airfare and baggage
+void handle_batch(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn);  // Handle several operations in one request
+ssize_t run_captured_request(int sockfd, char *request, MYSQL *conn, char *reply, size_t size);  // Run a request and capture its reply instead of sending it (-1 on failure)
+void handle_promote_replica(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn);  // Handle promotion of a backup to primary
+void handle_query_server_stats(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn);  // Handle query for server runtime statistics
 
 // Thread pool function declarations (if thread pooling is implemented in the system)
 void thread_pool_init(int num_threads);  // Initialize a thread pool with a given number of threads
-void thread_pool_add_task(void (*function)(void *), void *arg);  // Add a task to the thread pool
+int thread_pool_add_task(void (*function)(void *), void *arg);  // Add a task to the thread pool (returns -1 if the queue is full)
 void thread_pool_destroy();  // Clean up and destroy the thread pool
 
+// Memory management declarations
+struct client_data *client_data_acquire();  // Take a client_data from the recycled slab
+void client_data_release(struct client_data *data);  // Return a client_data to the slab
+
 // Server request handling declarations
 void handleRequest(char *request, struct sockaddr_in cliaddr, int sockfd, socklen_t len, MYSQL *conn);  // Main handler for processing client requests
+void dispatch_request(char *request, struct sockaddr_in cliaddr, int sockfd, socklen_t len, MYSQL *conn);  // Run a request on this server without partition routing
 void store_in_history(struct sockaddr_in* client_addr, const char* request, const char* response);  // Store processed requests in history (for at-most-once processing)
+void store_in_history_vec(struct sockaddr_in *client_addr, const char *request, const ReplyVec *response, int count);  // Same for a reply given as fragments
 int find_in_history(int sockfd, struct sockaddr_in *client_addr, const char *request, char *response);  // Check if a request has been processed before (for at-most-once processing)
+extern _Thread_local int history_suppressed;  // Set while a request runs for a server-side caller: its replies are not stored
 void* handle_client(void* arg);  // Thread function to handle individual client requests
+size_t request_path_stats_report(char *buffer, size_t size);  // Count requests answered on the receive thread and dispatched to workers
 
 // Networking utility function declarations
 void set_nonblocking(int sockfd);  // Set a socket to non-blocking mode
 
 // Database connection handling declarations
 MYSQL* connect_db();  // Connect to the MySQL database
+MYSQL* connect_db_nonblocking();  // Open a connection for the non-blocking pool (NULL on failure)
 void close_db(MYSQL *conn);  // Close the database connection
-void query_flights(MYSQL *conn);  // Query flight data from the database
-void update_seats(MYSQL *conn, int flight_id, int seats_reserved);  // Update the seat availability in the database
-void update_baggage(MYSQL *conn, int flight_id, int baggage_added);  // Update baggage availability in the database
+void query_flights(MYSQL *conn);  // Load flight data from the database into the catalog
+int update_seats(int flight_id, int seats_reserved);  // Conditionally take seats in the database (1 updated, 0 refused, -1 error)
+int update_baggage(int flight_id, int baggage_added);  // Conditionally take baggage space in the database (same results)
+void update_seats_async(int flight_id, int seats_reserved, DbCallback done, const void *state, size_t state_size);  // Same, continuing in done when the statement completes
+void update_baggage_async(int flight_id, int baggage_added, DbCallback done, const void *state, size_t state_size);  // Same for baggage space
 
 #endif // SERVER_H
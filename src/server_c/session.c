@@ -0,0 +1,306 @@
+#include <stdatomic.h>  // Counters read by query_server_stats
+#include <stdint.h>     // Fixed-width integer types
+#include <stdio.h>      // For printf and snprintf
+#include <stdlib.h>     // For calloc and free
+#include <string.h>     // For strncmp, memcpy and strlen
+#include <pthread.h>    // For the table and per-session mutexes
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
+#include "server.h"
+#include "session.h"
+#include "arena.h"   // Replies are built in the request arena before they are stored
+#include "fault.h"   // Replies pass through the fault injection layer
+#include "timer.h"   // Idle sessions are swept by a timer
+#include "memory_budget.h"  // Sessions and their kept replies are charged to the memory budget
+
+// session.c
+// Sessions live in a chained hash table keyed by client address. The table mutex covers the
+// chains and each session's user count; a session's own mutex covers its window, and is never
+// held while a request runs. A window slot is RUNNING from the moment its request is admitted
+// until its reply is stored, so a retransmission that arrives meanwhile is not run twice.
+// Requests run through run_captured_request so that the reply can be kept for retransmissions;
+// the window is their at-most-once record, so they add nothing to the request history.
+
+#define SESSION_BUCKETS 4096  // Hash chains (power of two)
+#define SESSION_IDLE_MS 300000  // A session unused this long is dropped with its replies
+#define SESSION_SWEEP_MS 10000  // How often idle sessions are looked for
+#define SESSION_REPLY_SIZE 65536  // Largest reply kept for a request
+
+enum { SLOT_EMPTY, SLOT_RUNNING, SLOT_DONE };
+
+// The state of one sequence number in a client's window
+typedef struct {
+    uint64_t seq;
+    int state;  // SLOT_EMPTY, SLOT_RUNNING or SLOT_DONE
+    char *reply;  // Reply as sent, kept until acknowledged (SLOT_DONE only)
+    size_t length;
+} SessionSlot;
+
+// One client's session
+typedef struct Session {
+    struct Session *next;  // Next session in the bucket (table_mutex)
+    struct sockaddr_in addr;  // The client
+    int users;  // Workers using the session right now (table_mutex)
+    uint64_t last_active_ms;  // (table_mutex)
+    pthread_mutex_t lock;  // Guards base and slots
+    uint64_t base;  // Lowest sequence number not yet acknowledged
+    SessionSlot slots[SESSION_WINDOW];  // Indexed by seq % SESSION_WINDOW
+} Session;
+
+static Session *buckets[SESSION_BUCKETS];
+static pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Timer sweep_timer;
+
+// Counters reported by query_server_stats
+static _Atomic uint64_t sessions_active, sessions_expired, replies_held, reply_bytes_held;
+static _Atomic uint64_t retransmissions_answered, retransmissions_running, stale_ignored, window_rejections, budget_rejections;
+
+static unsigned bucket_of(const struct sockaddr_in *addr) {
+    uint64_t key = (uint64_t)addr->sin_addr.s_addr << 16 | addr->sin_port;
+    return (unsigned)((key * 0x9E3779B97F4A7C15ull) >> 40) & (SESSION_BUCKETS - 1);
+}
+
+// Find or create the client's session and mark it in use; NULL if out of memory
+static Session *session_acquire(const struct sockaddr_in *addr, uint64_t first_base) {
+    unsigned bucket = bucket_of(addr);
+    pthread_mutex_lock(&table_mutex);
+    Session *session = buckets[bucket];
+    while (session != NULL && (session->addr.sin_addr.s_addr != addr->sin_addr.s_addr || session->addr.sin_port != addr->sin_port)) {
+        session = session->next;
+    }
+    if (session == NULL && memory_charge(MEMORY_CLIENTS, sizeof(Session)) == 0) {
+        session = (Session *)calloc(1, sizeof(Session));
+        if (session == NULL) {
+            memory_release(MEMORY_CLIENTS, sizeof(Session));
+        } else {
+            session->addr = *addr;
+            session->base = first_base;
+            pthread_mutex_init(&session->lock, NULL);
+            session->next = buckets[bucket];
+            buckets[bucket] = session;
+            atomic_fetch_add(&sessions_active, 1);
+        }
+    }
+    if (session != NULL) {
+        session->users++;
+        session->last_active_ms = timer_now_ms();
+    }
+    pthread_mutex_unlock(&table_mutex);
+    return session;
+}
+
+static void session_release(Session *session) {
+    pthread_mutex_lock(&table_mutex);
+    session->users--;
+    pthread_mutex_unlock(&table_mutex);
+}
+
+// Drop a slot's stored reply (caller holds session->lock)
+static void slot_clear(SessionSlot *slot) {
+    if (slot->state == SLOT_DONE) {
+        atomic_fetch_sub(&replies_held, 1);
+        atomic_fetch_sub(&reply_bytes_held, slot->length);
+        memory_release(MEMORY_REPLY_CACHE, slot->length);
+        free(slot->reply);
+    }
+    slot->reply = NULL;
+    slot->length = 0;
+    slot->state = SLOT_EMPTY;
+}
+
+// Release every reply up to and including ack and slide the window past it (caller holds session->lock)
+static void session_acknowledge(Session *session, uint64_t ack) {
+    if (ack < session->base) {
+        return;
+    }
+    for (int i = 0; i < SESSION_WINDOW; i++) {
+        SessionSlot *slot = &session->slots[i];
+        if (slot->state == SLOT_DONE && slot->seq <= ack) {
+            slot_clear(slot);
+        }  // A RUNNING slot is discarded when its request finishes
+    }
+    session->base = ack + 1;
+}
+
+static void send_text(int sockfd, struct sockaddr_in *client_addr, const char *text, size_t length) {
+    fault_sendto(sockfd, text, length, 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+}
+
+int session_handle(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn, int execute_duplicates) {
+    unsigned long long seq = 0, ack = 0;
+    int consumed = 0, has_ack = 0;
+    if (sscanf(request, "ack %llu%n", &ack, &consumed) == 1) {
+        // A bare acknowledgement: release replies, answer nothing
+        Session *session = session_acquire(client_addr, ack + 1);
+        if (session != NULL) {
+            pthread_mutex_lock(&session->lock);
+            session_acknowledge(session, ack);
+            pthread_mutex_unlock(&session->lock);
+            session_release(session);
+        }
+        return 1;
+    }
+    if (sscanf(request, "seq %llu%n", &seq, &consumed) != 1 || seq == 0) {
+        return 0;  // Not a session request
+    }
+    char *body = request + consumed;
+    if (sscanf(body, " ack %llu%n", &ack, &consumed) == 1) {
+        has_ack = 1;
+        body += consumed;
+    }
+    while (*body == ' ') {
+        body++;
+    }
+
+    Arena *arena = request_arena();
+    char *reply = (char *)arena_alloc(arena, SESSION_REPLY_SIZE);
+    if (reply == NULL) {
+        const char *error = "Session request failed: out of memory.\n";
+        send_text(sockfd, client_addr, error, strlen(error));
+        return 1;
+    }
+    int prefix = snprintf(reply, SESSION_REPLY_SIZE, "seq %llu\n", seq);
+    if (strncmp(body, "follow_flight_id", 16) == 0) {
+        // Updates go to the subscriber's address, which a captured request would not have
+        int length = prefix + snprintf(reply + prefix, SESSION_REPLY_SIZE - prefix,
+                                       "follow_flight_id cannot be sent in a session; send it without a seq header.\n");
+        send_text(sockfd, client_addr, reply, length);
+        return 1;
+    }
+
+    Session *session = session_acquire(client_addr, has_ack ? ack + 1 : 1);  // Sequence numbers start at 1
+    if (session == NULL) {
+        int length = prefix + snprintf(reply + prefix, SESSION_REPLY_SIZE - prefix, "Session request failed: out of memory.\n");  // Or over the memory budget
+        send_text(sockfd, client_addr, reply, length);
+        return 1;
+    }
+
+    // Admit the request into the window
+    pthread_mutex_lock(&session->lock);
+    if (has_ack) {
+        session_acknowledge(session, ack);
+    }
+    SessionSlot *slot = &session->slots[seq % SESSION_WINDOW];
+    int run = 0;
+    if (seq < session->base) {
+        atomic_fetch_add(&stale_ignored, 1);  // Acknowledged: the client already has the reply
+        fault_account_request(client_addr, request, 1);
+    } else if (seq >= session->base + SESSION_WINDOW) {
+        atomic_fetch_add(&window_rejections, 1);
+        int length = prefix + snprintf(reply + prefix, SESSION_REPLY_SIZE - prefix,
+                                       "Rejected: %d requests are unacknowledged; acknowledge earlier replies first.\n",
+                                       SESSION_WINDOW);
+        pthread_mutex_unlock(&session->lock);
+        send_text(sockfd, client_addr, reply, length);
+        session_release(session);
+        return 1;
+    } else if (slot->seq == seq && slot->state == SLOT_DONE && !execute_duplicates) {
+        atomic_fetch_add(&retransmissions_answered, 1);
+        fault_account_request(client_addr, request, 1);
+        send_text(sockfd, client_addr, slot->reply, slot->length);  // Datagram send; does not block
+    } else if (slot->seq == seq && slot->state == SLOT_RUNNING && !execute_duplicates) {
+        atomic_fetch_add(&retransmissions_running, 1);  // The reply is on its way
+        fault_account_request(client_addr, request, 1);
+    } else if (!execute_duplicates && memory_charge(MEMORY_REPLY_CACHE, SESSION_REPLY_SIZE) != 0) {
+        // No room to keep the reply for retransmissions: refuse the request rather than run it unprotected
+        atomic_fetch_add(&budget_rejections, 1);
+        int length = prefix + snprintf(reply + prefix, SESSION_REPLY_SIZE - prefix, "Server busy: retry later.\n");
+        pthread_mutex_unlock(&session->lock);
+        send_text(sockfd, client_addr, reply, length);
+        session_release(session);
+        return 1;
+    } else {
+        if (!execute_duplicates || slot->seq != seq) {
+            slot_clear(slot);  // Holds an acknowledged sequence number, if anything
+            slot->seq = seq;
+            slot->state = SLOT_RUNNING;
+        }
+        run = 1;
+    }
+    pthread_mutex_unlock(&session->lock);
+
+    if (run) {
+        fault_account_request(client_addr, request, 0);  // The header makes each sequence number distinct
+        ssize_t length = run_captured_request(sockfd, body, conn, reply + prefix, SESSION_REPLY_SIZE - prefix);
+        if (length < 0) {
+            length = snprintf(reply + prefix, SESSION_REPLY_SIZE - prefix, "Request failed: it could not be run.\n");
+        }
+        length += prefix;
+
+        // Keep the reply for retransmissions unless it was acknowledged meanwhile
+        char *stored = NULL;
+        size_t held = 0;  // Bytes of the SESSION_REPLY_SIZE reservation still in use
+        if (!execute_duplicates && (stored = (char *)malloc(length)) != NULL) {
+            memcpy(stored, reply, length);
+        }
+        pthread_mutex_lock(&session->lock);
+        if (stored != NULL && slot->seq == seq && slot->state == SLOT_RUNNING && seq >= session->base) {
+            slot->reply = stored;
+            slot->length = length;
+            slot->state = SLOT_DONE;
+            atomic_fetch_add(&replies_held, 1);
+            atomic_fetch_add(&reply_bytes_held, length);
+            held = length;
+            stored = NULL;
+        } else if (slot->seq == seq && slot->state == SLOT_RUNNING) {
+            slot->state = SLOT_EMPTY;
+        }
+        pthread_mutex_unlock(&session->lock);
+        free(stored);
+        if (!execute_duplicates) {
+            memory_release(MEMORY_REPLY_CACHE, SESSION_REPLY_SIZE - held);
+        }
+        send_text(sockfd, client_addr, reply, length);
+    }
+    session_release(session);
+    return 1;
+}
+
+// Timer callback: drop sessions that have been idle for SESSION_IDLE_MS, then re-arm
+static void sweep_sessions(void *arg) {
+    (void)arg;
+    uint64_t now = timer_now_ms();
+    pthread_mutex_lock(&table_mutex);
+    for (int bucket = 0; bucket < SESSION_BUCKETS; bucket++) {
+        Session **link = &buckets[bucket];
+        while (*link != NULL) {
+            Session *session = *link;
+            if (session->users == 0 && now - session->last_active_ms >= SESSION_IDLE_MS) {
+                *link = session->next;
+                for (int i = 0; i < SESSION_WINDOW; i++) {
+                    slot_clear(&session->slots[i]);
+                }
+                pthread_mutex_destroy(&session->lock);
+                free(session);
+                memory_release(MEMORY_CLIENTS, sizeof(Session));
+                atomic_fetch_sub(&sessions_active, 1);
+                atomic_fetch_add(&sessions_expired, 1);
+            } else {
+                link = &session->next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&table_mutex);
+    timer_schedule(&sweep_timer, SESSION_SWEEP_MS);
+}
+
+void session_start() {
+    timer_init(&sweep_timer, sweep_sessions, NULL);
+    timer_schedule(&sweep_timer, SESSION_SWEEP_MS);
+}
+
+size_t session_stats_report(char *buffer, size_t size) {
+    int written = snprintf(buffer, size,
+                           "Sessions: %llu active, %llu expired, %llu replies held (%llu bytes), %llu retransmissions answered, "
+                           "%llu while running, %llu stale ignored, %llu window rejections, %llu refused over the memory budget\n",
+                           (unsigned long long)atomic_load(&sessions_active), (unsigned long long)atomic_load(&sessions_expired),
+                           (unsigned long long)atomic_load(&replies_held), (unsigned long long)atomic_load(&reply_bytes_held),
+                           (unsigned long long)atomic_load(&retransmissions_answered),
+                           (unsigned long long)atomic_load(&retransmissions_running),
+                           (unsigned long long)atomic_load(&stale_ignored), (unsigned long long)atomic_load(&window_rejections),
+                           (unsigned long long)atomic_load(&budget_rejections));
+    return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+}
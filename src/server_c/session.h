@@ -0,0 +1,45 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stddef.h>  // For size_t
+#include <mysql/mysql.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <netinet/in.h>  // For struct sockaddr_in
+#endif
+
+// session.h
+// Per-client sessions for at-most-once without comparing request texts. A client that numbers
+// its requests sends "seq N [ack A] <request>": N increases by one per new request and A
+// acknowledges every reply up to and including A; "ack A" on its own only acknowledges. The
+// reply is "seq N\n" followed by the normal reply text.
+//
+// The server keeps, per client address, a window of SESSION_WINDOW sequence numbers starting
+// just after the last acknowledged one. A retransmission of a request in the window is answered
+// from its stored reply (or ignored while the original is still running); requests below the
+// window were acknowledged, so the client already has their replies. Stored replies are freed
+// as soon as they are acknowledged, so each client costs O(window) however long it runs.
+// Requests without a "seq" header keep using the request history.
+
+#define SESSION_WINDOW 32  // Unacknowledged requests a client may have outstanding
+
+/**
+ * @brief Serve a request that carries a session header or is a bare acknowledgement.
+ * @param execute_duplicates 1 for at-least-once: retransmissions run again instead of being answered from the window.
+ * @return 1 if the request was a session request (it has been answered), 0 if it has no session header.
+ */
+int session_handle(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn, int execute_duplicates);
+
+/**
+ * @brief Start the sweep that drops sessions of clients that went quiet.
+ */
+void session_start();
+
+/**
+ * @brief Write the session counters into buffer; returns the length written.
+ */
+size_t session_stats_report(char *buffer, size_t size);
+
+#endif // SESSION_H
@@ -0,0 +1,56 @@
+#include <stdio.h>   // For printf
+#include <string.h>  // For strlen
+
+#ifdef _WIN32
+#include <winsock2.h>  // Windows-specific socket library
+#else
+#include <netinet/in.h> // For sockaddr_in struct used in networking
+#include <sys/socket.h> // For sendto
+#endif
+
+#include "server.h"  // Subsystem report declarations
+#include "timer.h"   // Timer wheel report
+#include "trace.h"   // Tracing report
+#include "capture.h" // Traffic capture report
+#include "fault.h"   // Fault injection and request accounting report
+#include "session.h" // Client session report
+#include "db_pool.h" // Database pool report
+#include "fragments.h" // Reply fragment report
+#include "affinity.h"  // Thread placement report
+#include "rate_limit.h" // Rate limiter report
+#include "memory_budget.h" // Memory accounting report
+#include "history_file.h" // Request history file report
+
+// stats.c
+// query_server_stats: gathers the runtime counters that individual subsystems keep and
+// returns them to the client as one text report.
+
+#define STATS_BUFFER_SIZE 8192  // Upper bound on the report size
+
+// Function to handle server statistics queries
+void handle_query_server_stats(int sockfd, struct sockaddr_in *client_addr, char *request, MYSQL *conn) {
+    (void)request;
+    (void)conn;
+    char response[STATS_BUFFER_SIZE];
+    size_t length = 0;
+
+    length += request_path_stats_report(response + length, sizeof(response) - length);
+    length += flight_lock_stats_report(response + length, sizeof(response) - length);
+    length += replication_stats_report(response + length, sizeof(response) - length);
+    length += partition_stats_report(response + length, sizeof(response) - length);
+    length += notifier_stats_report(response + length, sizeof(response) - length);
+    length += timer_stats_report(response + length, sizeof(response) - length);
+    length += trace_stats_report(response + length, sizeof(response) - length);
+    length += capture_stats_report(response + length, sizeof(response) - length);
+    length += fault_stats_report(response + length, sizeof(response) - length);
+    length += session_stats_report(response + length, sizeof(response) - length);
+    length += history_file_stats_report(response + length, sizeof(response) - length);
+    length += db_pool_stats_report(response + length, sizeof(response) - length);
+    length += fragment_stats_report(response + length, sizeof(response) - length);
+    length += rate_limit_stats_report(response + length, sizeof(response) - length);
+    length += memory_stats_report(response + length, sizeof(response) - length);
+    length += affinity_report(response + length, sizeof(response) - length);
+
+    fault_sendto(sockfd, response, length, 0, (struct sockaddr *)client_addr, sizeof(*client_addr));
+    printf("Server statistics sent to client.\n");
+}
@@ -0,0 +1,88 @@
+#include <stdint.h>  // Fixed-width integer types
+#include <stdlib.h>  // For malloc and free
+#include "task_queue.h"  // TaskQueue definition
+
+// Initialise the ring and give every slot the sequence number of its own index
+int task_queue_init(TaskQueue *queue, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;  // Round up to a power of two so positions can be masked
+    }
+
+    queue->cells = (TaskQueueCell *)malloc(size * sizeof(TaskQueueCell));
+    if (queue->cells == NULL) {
+        return -1;
+    }
+    queue->mask = size - 1;
+
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&queue->cells[i].sequence, i);  // Slot i is free for the producer at position i
+    }
+    atomic_init(&queue->enqueue_pos, 0);
+    atomic_init(&queue->dequeue_pos, 0);
+    return 0;
+}
+
+// Free the ring storage
+void task_queue_destroy(TaskQueue *queue) {
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+// Claim the next producer position with a CAS, fill the slot, then hand it to consumers
+int task_queue_push(TaskQueue *queue, Task task) {
+    size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+
+    for (;;) {
+        TaskQueueCell *cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            // Slot is free for this position; try to claim it
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->task = task;
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);  // Publish to consumers
+                return 0;
+            }
+            // CAS failure reloaded pos; retry with the new position
+        } else if (diff < 0) {
+            return -1;  // Slot still holds a task from the previous lap: queue is full
+        } else {
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);  // Another producer won
+        }
+    }
+}
+
+// Claim the next consumer position with a CAS, read the slot, then recycle it for the next lap
+int task_queue_pop(TaskQueue *queue, Task *task) {
+    size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+
+    for (;;) {
+        TaskQueueCell *cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            // Slot is filled for this position; try to claim it
+            if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *task = cell->task;
+                atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);  // Free for next lap
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;  // Producer has not filled this slot yet: queue is empty
+        } else {
+            pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);  // Another consumer won
+        }
+    }
+}
+
+// Distance between the producer and consumer cursors
+size_t task_queue_size(TaskQueue *queue) {
+    size_t tail = atomic_load_explicit(&queue->enqueue_pos, memory_order_seq_cst);
+    size_t head = atomic_load_explicit(&queue->dequeue_pos, memory_order_seq_cst);
+    return tail > head ? tail - head : 0;
+}
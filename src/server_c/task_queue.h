@@ -0,0 +1,59 @@
+#ifndef TASK_QUEUE_H
+#define TASK_QUEUE_H
+
+#include <stddef.h>     // For size_t
+#include <stdatomic.h>  // C11 atomics for the per-slot sequence numbers
+
+#define TASK_QUEUE_CACHE_LINE 64  // Padding unit that keeps producer and consumer cursors apart
+
+// Define the structure for a Task, which contains a function and its arguments
+typedef struct {
+    void (*function)(void *);  // Pointer to the task function
+    void *argument;  // Pointer to the task function's argument
+} Task;
+
+// One slot of the ring. The sequence number tells producers and consumers whose turn it is:
+// sequence == position means free for the producer at that position,
+// sequence == position + 1 means filled and ready for the consumer at that position.
+typedef struct {
+    atomic_size_t sequence;  // Turn marker for this slot
+    Task task;  // Payload, published by the release store on sequence
+} TaskQueueCell;
+
+// Bounded lock-free multi-producer multi-consumer queue (Vyukov's algorithm)
+typedef struct {
+    TaskQueueCell *cells;  // Ring storage, capacity is a power of two
+    size_t mask;  // capacity - 1, used instead of a modulo
+    _Alignas(TASK_QUEUE_CACHE_LINE) atomic_size_t enqueue_pos;  // Next position producers claim
+    _Alignas(TASK_QUEUE_CACHE_LINE) atomic_size_t dequeue_pos;  // Next position consumers claim
+} TaskQueue;
+
+/**
+ * @brief Initialise a queue; capacity is rounded up to a power of two.
+ * @return 0 on success, -1 if the ring could not be allocated.
+ */
+int task_queue_init(TaskQueue *queue, size_t capacity);
+
+/**
+ * @brief Release the ring storage of a queue.
+ */
+void task_queue_destroy(TaskQueue *queue);
+
+/**
+ * @brief Enqueue a task without blocking.
+ * @return 0 on success, -1 if the queue is full.
+ */
+int task_queue_push(TaskQueue *queue, Task task);
+
+/**
+ * @brief Dequeue a task without blocking.
+ * @return 1 if a task was stored in *task, 0 if the queue is empty.
+ */
+int task_queue_pop(TaskQueue *queue, Task *task);
+
+/**
+ * @brief Approximate number of queued tasks (exact when no operation is in flight).
+ */
+size_t task_queue_size(TaskQueue *queue);
+
+#endif // TASK_QUEUE_H
@@ -2,149 +2,436 @@
 #include "server.h"  // Include the server-specific header
 #include <stdio.h>   // Standard I/O functions
 #include <stdlib.h>  // Standard library functions
+#include <string.h>  // For memset
 #include <pthread.h> // For thread management
 #include <unistd.h>  // For UNIX standard functions (like sleep)
+#include <stdatomic.h>  // C11 atomics for the lock-free deques
+#include "task_queue.h"  // Lock-free MPMC queue for tasks submitted from outside the pool
+#include "affinity.h"  // Workers start on the CPUs given by --cpu-workers
+#include "memory_budget.h"  // Deques and the inject queue are charged as queues
 
-#define MAX_THREADS 10  // Define the maximum number of threads in the pool
+#ifdef __linux__
+#include <linux/futex.h>  // FUTEX_WAIT / FUTEX_WAKE
+#include <sys/syscall.h>  // SYS_futex
+#endif
 
-// Define the structure for a Task, which contains a function and its arguments
+#define MAX_THREADS 64  // Define the maximum number of threads in the pool
+#define DEQUE_CAPACITY 1024  // Slots per work deque (must be a power of two)
+#define INJECT_CAPACITY 4096  // Slots in the queue fed by the receive thread
+#define SPIN_ROUNDS 64  // Work searches an idle worker makes before it parks
+#define CACHE_LINE 64  // Padding unit used to keep hot fields on separate cache lines
+
+typedef void (*task_function)(void *);  // Shorthand for the task function pointer type
+
+// One slot of a work deque. Thieves may read a slot while the owner overwrites it,
+// so both halves are atomics; a torn read is always discarded by the failed CAS on top.
+typedef struct {
+    _Atomic(task_function) function;  // Task function stored in this slot
+    _Atomic(void *) argument;  // Task argument stored in this slot
+} TaskSlot;
+
+// Chase-Lev work-stealing deque: the owner pushes and pops at the bottom,
+// other workers steal from the top. Only the owner ever writes bottom.
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_long top;  // Next index to steal from
+    _Alignas(CACHE_LINE) atomic_long bottom;  // Next index the owner pushes to
+    _Alignas(CACHE_LINE) TaskSlot slots[DEQUE_CAPACITY];  // Circular task storage
+} WorkDeque;
+
+// Parking spot used by an idle worker; each worker sleeps on its own futex word
+// so that a submission wakes exactly one thread.
 typedef struct {
-    void (*function)(void *);  // Pointer to the task function
-    void *argument;  // Pointer to the task function's argument
-} Task;
+    _Alignas(CACHE_LINE) atomic_int permit;  // Set by unpark, consumed by park
+#ifndef __linux__
+    pthread_mutex_t mutex;  // Fallback sleep primitive where futexes are unavailable
+    pthread_cond_t cond;
+#endif
+} Parker;
 
 // Define the structure for the ThreadPool
 typedef struct {
-    Task *task_queue;  // Queue of tasks to be executed
-    int queue_size;    // Current number of tasks in the queue
-    int queue_front;   // Front index of the task queue
-    int queue_rear;    // Rear index of the task queue
-    int queue_capacity;  // Capacity of the task queue
+    WorkDeque **deques;  // One deque per worker, allocated by the worker itself so it is node-local
+    TaskQueue inject;  // Tasks submitted by threads outside the pool (the receive thread)
+    Parker *parkers;  // One parking spot per worker
     pthread_t *threads;  // Array of threads in the pool
     int num_threads;   // Number of threads in the pool
-    pthread_mutex_t mutex;  // Mutex to protect shared data
-    pthread_cond_t cond;  // Condition variable to signal threads
-    int stop;  // Flag to indicate if the thread pool should stop
+    pthread_mutex_t idle_mutex;  // Protects the idle stack
+    int *idle_stack;  // Worker indexes currently parked, most recent on top
+    int idle_top;  // Number of entries on the idle stack
+    atomic_int idle_count;  // Lock-free view of idle_top for the submit fast path
+    atomic_int stop;  // Flag to indicate if the thread pool should stop
+    pthread_mutex_t start_mutex;  // thread_pool_init waits until every worker has its deque
+    pthread_cond_t start_cond;
+    int started;  // Workers whose deque is in place (start_mutex)
 } ThreadPool;
 
 // Static global thread pool instance
 static ThreadPool pool;
 
+// Index of the worker running on this thread, or -1 for threads outside the pool
+static _Thread_local int current_worker = -1;
+
 // Forward declaration of the worker function executed by each thread
 void *thread_worker(void *arg);
 
+// Push a task at the bottom of a deque; only the deque's owner may call this
+static int deque_push(WorkDeque *deque, Task task) {
+    long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    if (b - t >= DEQUE_CAPACITY) {
+        return -1;  // Deque is full
+    }
+
+    TaskSlot *slot = &deque->slots[b & (DEQUE_CAPACITY - 1)];
+    atomic_store_explicit(&slot->function, task.function, memory_order_relaxed);
+    atomic_store_explicit(&slot->argument, task.argument, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);  // Publish the slot before the new bottom
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    return 0;
+}
+
+// Pop a task from the bottom of a deque; only the deque's owner may call this
+static int deque_pop(WorkDeque *deque, Task *task) {
+    long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);  // Order the bottom update against thieves reading it
+    long t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);  // Deque was empty
+        return 0;
+    }
+
+    TaskSlot *slot = &deque->slots[b & (DEQUE_CAPACITY - 1)];
+    task->function = atomic_load_explicit(&slot->function, memory_order_relaxed);
+    task->argument = atomic_load_explicit(&slot->argument, memory_order_relaxed);
+
+    if (t == b) {
+        // Last task: race against thieves for it through top
+        int won = atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                                          memory_order_seq_cst, memory_order_relaxed);
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        return won;
+    }
+    return 1;
+}
+
+// Steal a task from the top of another thread's deque
+static int deque_steal(WorkDeque *deque, Task *task) {
+    long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);  // Read top before bottom
+    long b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (t >= b) {
+        return 0;  // Nothing to steal
+    }
+
+    TaskSlot *slot = &deque->slots[t & (DEQUE_CAPACITY - 1)];
+    task->function = atomic_load_explicit(&slot->function, memory_order_relaxed);
+    task->argument = atomic_load_explicit(&slot->argument, memory_order_relaxed);
+
+    // Claim the slot; losing the race means another thread took it
+    return atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                                   memory_order_seq_cst, memory_order_relaxed);
+}
+
+// Check whether a deque currently holds any tasks
+static int deque_has_work(WorkDeque *deque) {
+    long t = atomic_load_explicit(&deque->top, memory_order_seq_cst);
+    long b = atomic_load_explicit(&deque->bottom, memory_order_seq_cst);
+    return b > t;
+}
+
+// Initialise a parking spot with no pending permit
+static void parker_init(Parker *parker) {
+    atomic_init(&parker->permit, 0);
+#ifndef __linux__
+    pthread_mutex_init(&parker->mutex, NULL);
+    pthread_cond_init(&parker->cond, NULL);
+#endif
+}
+
+// Release the resources of a parking spot
+static void parker_destroy(Parker *parker) {
+#ifndef __linux__
+    pthread_mutex_destroy(&parker->mutex);
+    pthread_cond_destroy(&parker->cond);
+#else
+    (void)parker;
+#endif
+}
+
+// Block the calling worker until another thread grants it a permit
+static void park(Parker *parker) {
+#ifdef __linux__
+    while (atomic_exchange(&parker->permit, 0) == 0) {
+        // Sleep in the kernel only while the word is still 0; a racing unpark makes this return at once
+        syscall(SYS_futex, &parker->permit, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+    }
+#else
+    pthread_mutex_lock(&parker->mutex);
+    while (!atomic_load(&parker->permit)) {
+        pthread_cond_wait(&parker->cond, &parker->mutex);
+    }
+    atomic_store(&parker->permit, 0);  // Consume the permit
+    pthread_mutex_unlock(&parker->mutex);
+#endif
+}
+
+// Grant a permit to a parked (or about to park) worker
+static void unpark(Parker *parker) {
+#ifdef __linux__
+    if (atomic_exchange(&parker->permit, 1) == 0) {
+        syscall(SYS_futex, &parker->permit, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+#else
+    pthread_mutex_lock(&parker->mutex);
+    atomic_store(&parker->permit, 1);
+    pthread_cond_signal(&parker->cond);
+    pthread_mutex_unlock(&parker->mutex);
+#endif
+}
+
+// Wake a single idle worker, if any; never wakes more than one thread per call
+static void wake_one_worker() {
+    atomic_thread_fence(memory_order_seq_cst);  // Pairs with the fence in the worker's idle path
+    if (atomic_load_explicit(&pool.idle_count, memory_order_relaxed) == 0) {
+        return;  // Everyone is busy; they will find the task when they next look
+    }
+
+    int worker = -1;
+    pthread_mutex_lock(&pool.idle_mutex);
+    if (pool.idle_top > 0) {
+        worker = pool.idle_stack[--pool.idle_top];
+        atomic_fetch_sub(&pool.idle_count, 1);
+    }
+    pthread_mutex_unlock(&pool.idle_mutex);
+
+    if (worker >= 0) {
+        unpark(&pool.parkers[worker]);
+    }
+}
+
 // Initialize the thread pool with a specified number of threads
 void thread_pool_init(int num_threads) {
     if (num_threads > MAX_THREADS) {
         // Limit the number of threads to MAX_THREADS if the input exceeds the limit
         num_threads = MAX_THREADS;
     }
+    if (num_threads < 1) {
+        num_threads = 1;  // A pool needs at least one worker
+    }
 
-    pool.queue_size = 0;  // Initially, the task queue is empty
-    pool.queue_front = 0;  // Front of the task queue is at 0
-    pool.queue_rear = 0;   // Rear of the task queue is at 0
-    pool.queue_capacity = 100;  // Set default task queue capacity to 100
-    pool.stop = 0;  // Initially, the pool is not stopping
+    atomic_init(&pool.stop, 0);  // Initially, the pool is not stopping
+    atomic_init(&pool.idle_count, 0);  // No worker is parked yet
+    pool.idle_top = 0;
     pool.num_threads = num_threads;  // Set the number of threads in the pool
 
-    // Allocate memory for the task queue
-    pool.task_queue = (Task *)malloc(pool.queue_capacity * sizeof(Task));
-    if (pool.task_queue == NULL) {
+    // Allocate one deque per worker and the shared queue for the receive thread
+    pool.deques = (WorkDeque **)calloc(num_threads, sizeof(WorkDeque *));
+    pool.parkers = (Parker *)aligned_alloc(CACHE_LINE, num_threads * sizeof(Parker));
+    pool.idle_stack = (int *)malloc(num_threads * sizeof(int));
+    pool.threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+    if (pool.deques == NULL || pool.parkers == NULL || pool.idle_stack == NULL || pool.threads == NULL ||
+        task_queue_init(&pool.inject, INJECT_CAPACITY) != 0) {
         // If memory allocation fails, print an error and exit
-        perror("Failed to allocate memory for task queue");
+        perror("Failed to allocate memory for thread pool");
         exit(EXIT_FAILURE);
     }
 
-    // Allocate memory for the threads in the pool
-    pool.threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
-    if (pool.threads == NULL) {
-        // If memory allocation fails, print an error, free task queue, and exit
-        perror("Failed to allocate memory for threads");
-        free(pool.task_queue);
-        exit(EXIT_FAILURE);
+    for (int i = 0; i < num_threads; i++) {
+        parker_init(&pool.parkers[i]);
     }
+    memory_charge_fixed(MEMORY_QUEUES, num_threads * sizeof(WorkDeque) + (pool.inject.mask + 1) * sizeof(TaskQueueCell));
 
-    // Initialize the mutex and condition variable
-    pthread_mutex_init(&pool.mutex, NULL);
-    pthread_cond_init(&pool.cond, NULL);
+    // Initialize the idle-stack mutex
+    pthread_mutex_init(&pool.idle_mutex, NULL);
+    pthread_mutex_init(&pool.start_mutex, NULL);
+    pthread_cond_init(&pool.start_cond, NULL);
+    pool.started = 0;
 
-    // Create threads in the pool and have them run the thread_worker function
+    // Create threads in the pool, placed as configured, and have them run the thread_worker function
     for (int i = 0; i < num_threads; i++) {
-        pthread_create(&pool.threads[i], NULL, thread_worker, NULL);
+        if (affinity_create_thread(&pool.threads[i], AFFINITY_WORKERS, i, thread_worker, (void *)(intptr_t)i) != 0) {
+            perror("Failed to create worker thread");
+            exit(EXIT_FAILURE);
+        }
     }
-}
-
-// Add a task to the thread pool
-void thread_pool_add_task(void (*function)(void *), void *arg) {
-    pthread_mutex_lock(&pool.mutex);  // Lock the mutex to protect task queue access
 
-    // Check if the task queue is full
-    if (pool.queue_size == pool.queue_capacity) {
-        printf("Task queue is full, task cannot be added.\n");
-        pthread_mutex_unlock(&pool.mutex);  // Unlock the mutex and return
-        return;
+    // Submitters and thieves look at every deque, so none may be missing once tasks can arrive
+    pthread_mutex_lock(&pool.start_mutex);
+    while (pool.started < num_threads) {
+        pthread_cond_wait(&pool.start_cond, &pool.start_mutex);
     }
+    pthread_mutex_unlock(&pool.start_mutex);
+}
 
-    // Create a new task and add it to the queue
+// Add a task to the thread pool; returns 0 on success and -1 if the queue is full
+int thread_pool_add_task(void (*function)(void *), void *arg) {
     Task task;
     task.function = function;  // Set the function pointer for the task
     task.argument = arg;  // Set the function argument
-    pool.task_queue[pool.queue_rear] = task;  // Add task at the rear of the queue
-    pool.queue_rear = (pool.queue_rear + 1) % pool.queue_capacity;  // Move rear pointer circularly
-    pool.queue_size++;  // Increment the queue size
 
-    pthread_cond_signal(&pool.cond);  // Signal the worker threads that a new task is available
-    pthread_mutex_unlock(&pool.mutex);  // Unlock the mutex
+    int result;
+    if (current_worker >= 0) {
+        // Workers push onto their own deque without any locking
+        result = deque_push(pool.deques[current_worker], task);
+    } else {
+        // The receive thread (and any other outside thread) uses the lock-free shared queue
+        result = task_queue_push(&pool.inject, task);
+    }
+
+    if (result != 0) {
+        printf("Task queue is full, task cannot be added.\n");
+        return -1;
+    }
+
+    wake_one_worker();  // Hand the task to a parked worker, if there is one
+    return 0;
 }
 
 // Destroy the thread pool and clean up resources
 void thread_pool_destroy() {
-    pthread_mutex_lock(&pool.mutex);  // Lock the mutex
-
-    // Set the stop flag and broadcast the condition to wake up all threads
-    pool.stop = 1;
-    pthread_cond_broadcast(&pool.cond);
-    pthread_mutex_unlock(&pool.mutex);  // Unlock the mutex
+    // Set the stop flag and wake every worker so it can observe it
+    atomic_store(&pool.stop, 1);
+    for (int i = 0; i < pool.num_threads; i++) {
+        unpark(&pool.parkers[i]);
+    }
 
     // Join all the threads to ensure they finish execution before cleanup
     for (int i = 0; i < pool.num_threads; i++) {
         pthread_join(pool.threads[i], NULL);
     }
 
-    // Clean up the mutex, condition variable, task queue, and thread array
-    pthread_mutex_destroy(&pool.mutex);
-    pthread_cond_destroy(&pool.cond);
-    free(pool.task_queue);  // Free the memory allocated for the task queue
-    pool.task_queue = NULL;
+    // Clean up the parking spots, queues and thread array
+    for (int i = 0; i < pool.num_threads; i++) {
+        parker_destroy(&pool.parkers[i]);
+    }
+    pthread_mutex_destroy(&pool.idle_mutex);
+    pthread_mutex_destroy(&pool.start_mutex);
+    pthread_cond_destroy(&pool.start_cond);
+    task_queue_destroy(&pool.inject);
+    for (int i = 0; i < pool.num_threads; i++) {
+        free(pool.deques[i]);
+    }
+    memory_release(MEMORY_QUEUES, pool.num_threads * sizeof(WorkDeque) + (pool.inject.mask + 1) * sizeof(TaskQueueCell));
+    free(pool.deques);
+    pool.deques = NULL;
+    free(pool.parkers);
+    pool.parkers = NULL;
+    free(pool.idle_stack);
+    pool.idle_stack = NULL;
     free(pool.threads);  // Free the memory allocated for the threads
     pool.threads = NULL;
 }
 
-// Worker function executed by each thread in the pool
-void *thread_worker(void *arg) {
-    while (1) {
-        pthread_mutex_lock(&pool.mutex);  // Lock the mutex to access the shared task queue
+// Look for a task: own deque first, then the shared deque, then other workers
+static int find_task(int self, unsigned int *seed, Task *task) {
+    if (deque_pop(pool.deques[self], task)) {
+        return 1;
+    }
+    if (task_queue_pop(&pool.inject, task)) {
+        return 1;
+    }
 
-        // Wait for a task to be available or for the stop signal
-        while (pool.queue_size == 0 && !pool.stop) {
-            pthread_cond_wait(&pool.cond, &pool.mutex);  // Wait for condition signal
+    // Start at a pseudo-random victim so thieves spread out instead of piling onto worker 0
+    *seed = *seed * 1103515245u + 12345u;
+    int start = (int)((*seed >> 16) % (unsigned int)pool.num_threads);
+    for (int i = 0; i < pool.num_threads; i++) {
+        int victim = (start + i) % pool.num_threads;
+        if (victim != self && deque_steal(pool.deques[victim], task)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Check every deque for pending work without taking anything
+static int any_work_pending() {
+    if (task_queue_size(&pool.inject) > 0) {
+        return 1;
+    }
+    for (int i = 0; i < pool.num_threads; i++) {
+        if (deque_has_work(pool.deques[i])) {
+            return 1;
         }
+    }
+    return 0;
+}
 
-        // If the stop flag is set, break out of the loop and exit the thread
-        if (pool.stop) {
-            pthread_mutex_unlock(&pool.mutex);  // Unlock the mutex before exiting
+// Take this worker off the idle stack; returns 0 if a submitter already removed it
+static int withdraw_idle(int self) {
+    int removed = 0;
+    pthread_mutex_lock(&pool.idle_mutex);
+    for (int i = 0; i < pool.idle_top; i++) {
+        if (pool.idle_stack[i] == self) {
+            pool.idle_stack[i] = pool.idle_stack[--pool.idle_top];
+            atomic_fetch_sub(&pool.idle_count, 1);
+            removed = 1;
             break;
         }
+    }
+    pthread_mutex_unlock(&pool.idle_mutex);
+    return removed;
+}
 
-        // Get the next task from the front of the queue
-        Task task = pool.task_queue[pool.queue_front];
-        pool.queue_front = (pool.queue_front + 1) % pool.queue_capacity;  // Move front pointer circularly
-        pool.queue_size--;  // Decrement the queue size
+// Worker function executed by each thread in the pool
+void *thread_worker(void *arg) {
+    int self = (int)(intptr_t)arg;
+    unsigned int seed = (unsigned int)self * 2654435761u + 1u;
+    current_worker = self;
+
+    // Allocate and touch this worker's deque from the worker, which already runs on its own CPU
+    WorkDeque *deque = (WorkDeque *)aligned_alloc(CACHE_LINE, sizeof(WorkDeque));
+    if (deque == NULL) {
+        perror("Failed to allocate memory for thread pool");
+        exit(EXIT_FAILURE);
+    }
+    memset(deque, 0, sizeof(WorkDeque));
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    pthread_mutex_lock(&pool.start_mutex);
+    pool.deques[self] = deque;
+    pool.started++;
+    pthread_cond_broadcast(&pool.start_cond);
+    while (pool.started < pool.num_threads) {
+        pthread_cond_wait(&pool.start_cond, &pool.start_mutex);  // Stealing looks at every deque
+    }
+    pthread_mutex_unlock(&pool.start_mutex);
+
+    while (!atomic_load_explicit(&pool.stop, memory_order_relaxed)) {
+        Task task;
+        int found = 0;
 
-        pthread_mutex_unlock(&pool.mutex);  // Unlock the mutex to allow other threads access
+        // Spin briefly before sleeping: a burst of datagrams usually refills the queues within microseconds
+        for (int spin = 0; spin < SPIN_ROUNDS && !found; spin++) {
+            found = find_task(self, &seed, &task);
+            if (!found) {
+                cpu_relax();
+            }
+        }
+        if (found) {
+            // Execute the task
+            (*(task.function))(task.argument);
+            continue;
+        }
+
+        // Nothing found: announce ourselves as idle, then look once more so a task
+        // pushed between the search and the announcement is not missed
+        pthread_mutex_lock(&pool.idle_mutex);
+        pool.idle_stack[pool.idle_top++] = self;
+        atomic_fetch_add(&pool.idle_count, 1);
+        pthread_mutex_unlock(&pool.idle_mutex);
+        atomic_thread_fence(memory_order_seq_cst);  // Pairs with the fence in wake_one_worker
+
+        if (any_work_pending() || atomic_load(&pool.stop)) {
+            if (!withdraw_idle(self)) {
+                park(&pool.parkers[self]);  // A submitter already granted us a permit; consume it
+            }
+            continue;
+        }
 
-        // Execute the task
-        (*(task.function))(task.argument);
+        park(&pool.parkers[self]);  // Sleep until a submitter picks this worker
     }
     return NULL;
 }
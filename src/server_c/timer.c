@@ -0,0 +1,207 @@
+#include <stdint.h>   // Fixed-width integer types
+#include <stdio.h>    // For snprintf
+#include <time.h>     // For clock_gettime
+#include <pthread.h>  // For the wheel mutex
+#include "timer.h"
+
+// timer.c
+// Level 0 holds timers due within 256 ticks, one slot per tick; each higher level covers 256
+// times the span of the one below. Every 256 ticks the next slot of level 1 is cascaded down
+// (and likewise up the levels), so a timer is touched at most once per level before it fires.
+// Slots are circular lists with a sentinel head, which makes insertion and removal O(1).
+// Callbacks run with the wheel unlocked, so they may schedule or cancel timers themselves.
+
+#define WHEEL_LEVELS 4  // 256^4 ticks of range (about 497 days at 10 ms)
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_MAX_DELTA ((1ull << (WHEEL_LEVELS * WHEEL_BITS)) - 1)  // Longer delays are clamped
+
+static Timer wheel[WHEEL_LEVELS][WHEEL_SLOTS];  // Sentinel head of every slot
+static uint64_t wheel_tick = 0;  // Next tick to process
+static uint64_t base_ms = 0;  // Monotonic time of tick 0
+static pthread_mutex_t wheel_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t wheel_once = PTHREAD_ONCE_INIT;
+
+// Wheel counters reported by query_server_stats (guarded by wheel_mutex)
+static uint64_t timers_pending = 0, timers_scheduled = 0, timers_fired = 0, timers_cancelled = 0, timers_cascaded = 0;
+
+uint64_t timer_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void wheel_init() {
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < WHEEL_SLOTS; slot++) {
+            wheel[level][slot].next = wheel[level][slot].prev = &wheel[level][slot];
+        }
+    }
+    base_ms = timer_now_ms();
+}
+
+static void list_append(Timer *head, Timer *timer) {
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+static void list_unlink(Timer *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = timer->prev = timer;
+}
+
+// Put a timer in the slot its expiry falls in, relative to the current tick (caller holds wheel_mutex)
+static void wheel_place(Timer *timer) {
+    if (timer->expires < wheel_tick) {
+        timer->expires = wheel_tick;  // Overdue: fire on the next tick processed
+    }
+    uint64_t delta = timer->expires - wheel_tick;
+    if (delta > WHEEL_MAX_DELTA) {
+        timer->expires = wheel_tick + WHEEL_MAX_DELTA;
+        delta = WHEEL_MAX_DELTA;
+    }
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (1ull << ((level + 1) * WHEEL_BITS))) {
+        level++;
+    }
+    list_append(&wheel[level][(timer->expires >> (level * WHEEL_BITS)) & WHEEL_MASK], timer);
+}
+
+// Re-place every timer of a slot on the levels below; returns the slot index
+static int wheel_cascade(int level) {
+    int index = (int)((wheel_tick >> (level * WHEEL_BITS)) & WHEEL_MASK);
+    Timer *head = &wheel[level][index];
+    while (head->next != head) {
+        Timer *timer = head->next;
+        list_unlink(timer);
+        wheel_place(timer);
+        timers_cascaded++;
+    }
+    return index;
+}
+
+void timer_init(Timer *timer, void (*callback)(void *arg), void *arg) {
+    timer->next = timer->prev = timer;
+    timer->expires = 0;
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->pending = 0;
+}
+
+void timer_schedule(Timer *timer, uint64_t delay_ms) {
+    pthread_once(&wheel_once, wheel_init);
+    uint64_t now = timer_now_ms();
+    pthread_mutex_lock(&wheel_mutex);
+    if (timer->pending) {
+        list_unlink(timer);  // Re-arm
+    } else {
+        timer->pending = 1;
+        timers_pending++;
+    }
+    // Round up so a timer never fires early
+    timer->expires = (now - base_ms + delay_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    wheel_place(timer);
+    timers_scheduled++;
+    pthread_mutex_unlock(&wheel_mutex);
+}
+
+int timer_cancel(Timer *timer) {
+    pthread_mutex_lock(&wheel_mutex);
+    int was_pending = timer->pending;
+    if (was_pending) {
+        list_unlink(timer);
+        timer->pending = 0;
+        timers_pending--;
+        timers_cancelled++;
+    }
+    pthread_mutex_unlock(&wheel_mutex);
+    return was_pending;
+}
+
+int timer_run(uint64_t now_ms) {
+    pthread_once(&wheel_once, wheel_init);
+    uint64_t target = now_ms > base_ms ? (now_ms - base_ms) / TIMER_TICK_MS : 0;
+    int fired = 0;
+    Timer due;  // Sentinel for the slot being fired; timers in it can still be cancelled or re-armed
+
+    pthread_mutex_lock(&wheel_mutex);
+    while (wheel_tick <= target) {
+        if (timers_pending == 0) {
+            wheel_tick = target + 1;  // Nothing scheduled: skip the idle ticks
+            break;
+        }
+
+        int index = (int)(wheel_tick & WHEEL_MASK);
+        for (int level = 1; index == 0 && level < WHEEL_LEVELS; level++) {
+            index = wheel_cascade(level);  // Level 0 wrapped: bring the next span down
+        }
+        index = (int)(wheel_tick & WHEEL_MASK);
+
+        // Detach this tick's slot, then fire its timers one at a time with the wheel unlocked
+        Timer *head = &wheel[0][index];
+        due.next = due.prev = &due;
+        if (head->next != head) {
+            due.next = head->next;
+            due.prev = head->prev;
+            due.next->prev = &due;
+            due.prev->next = &due;
+            head->next = head->prev = head;
+        }
+        wheel_tick++;
+        while (due.next != &due) {
+            Timer *timer = due.next;
+            list_unlink(timer);
+            timer->pending = 0;
+            timers_pending--;
+            timers_fired++;
+            pthread_mutex_unlock(&wheel_mutex);
+            timer->callback(timer->arg);
+            fired++;
+            pthread_mutex_lock(&wheel_mutex);
+        }
+    }
+    pthread_mutex_unlock(&wheel_mutex);
+    return fired;
+}
+
+int timer_next_timeout_ms(int max_ms) {
+    pthread_once(&wheel_once, wheel_init);
+    pthread_mutex_lock(&wheel_mutex);
+    uint64_t next = 0;
+    int any = timers_pending > 0;
+    if (any) {
+        // The first occupied level-0 slot before the next wrap; otherwise the wrap, where higher levels
+        // cascade (which is the current tick itself when it has not been processed yet)
+        next = (wheel_tick + WHEEL_MASK) & ~(uint64_t)WHEEL_MASK;
+        for (uint64_t tick = wheel_tick; tick < next; tick++) {
+            Timer *head = &wheel[0][tick & WHEEL_MASK];
+            if (head->next != head) {
+                next = tick;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&wheel_mutex);
+    if (!any) {
+        return max_ms;
+    }
+    uint64_t due_ms = base_ms + next * TIMER_TICK_MS, now = timer_now_ms();
+    if (due_ms <= now) {
+        return 0;
+    }
+    return due_ms - now < (uint64_t)max_ms ? (int)(due_ms - now) : max_ms;
+}
+
+size_t timer_stats_report(char *buffer, size_t size) {
+    pthread_mutex_lock(&wheel_mutex);
+    int written = snprintf(buffer, size, "Timers: %llu pending, %llu scheduled, %llu fired, %llu cancelled, %llu cascaded\n",
+                           (unsigned long long)timers_pending, (unsigned long long)timers_scheduled,
+                           (unsigned long long)timers_fired, (unsigned long long)timers_cancelled,
+                           (unsigned long long)timers_cascaded);
+    pthread_mutex_unlock(&wheel_mutex);
+    return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+}
@@ -0,0 +1,62 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stddef.h>  // For size_t
+#include <stdint.h>  // For uint64_t
+
+// timer.h
+// Hierarchical timer wheel: four levels of 256 slots over TIMER_TICK_MS ticks, so scheduling
+// and cancelling are O(1) whatever the number of timers. Timers are intrusive: the owner embeds
+// a Timer in its own structure, so millions can be pending without an allocation or a thread
+// each. The wheel is advanced by the server's receive loop; callbacks run on that thread.
+
+#define TIMER_TICK_MS 10  // Wheel resolution
+
+// A timer; initialise with timer_init and keep it at a fixed address while it is pending
+typedef struct Timer {
+    struct Timer *next;  // Neighbours in its wheel slot
+    struct Timer *prev;
+    uint64_t expires;  // Tick at which it fires
+    void (*callback)(void *arg);  // Run on the event loop thread once the timer fires
+    void *arg;  // Passed to callback
+    int pending;  // 1 while scheduled
+} Timer;
+
+/**
+ * @brief Prepare a timer; it does nothing until scheduled.
+ */
+void timer_init(Timer *timer, void (*callback)(void *arg), void *arg);
+
+/**
+ * @brief Arm (or re-arm) a timer to fire delay_ms from now.
+ */
+void timer_schedule(Timer *timer, uint64_t delay_ms);
+
+/**
+ * @brief Disarm a timer.
+ * @return 1 if it was pending; 0 if it already fired (its callback may be running or about to run).
+ */
+int timer_cancel(Timer *timer);
+
+/**
+ * @brief Milliseconds on the monotonic clock the wheel runs on.
+ */
+uint64_t timer_now_ms();
+
+/**
+ * @brief Advance the wheel to now and run the callbacks of every timer that came due.
+ * @return The number of callbacks run.
+ */
+int timer_run(uint64_t now_ms);
+
+/**
+ * @brief How long the event loop may sleep before timer_run has work, capped at max_ms.
+ */
+int timer_next_timeout_ms(int max_ms);
+
+/**
+ * @brief Write the wheel's counters into buffer; returns the length written.
+ */
+size_t timer_stats_report(char *buffer, size_t size);
+
+#endif // TIMER_H
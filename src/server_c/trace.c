@@ -0,0 +1,153 @@
+#include <stdatomic.h>  // Ring indexes shared with the flusher
+#include <stdint.h>     // Fixed-width integer types
+#include <stdio.h>      // For fopen, fwrite and snprintf
+#include <stdlib.h>     // For calloc
+#include <string.h>     // For strlen
+#include <time.h>       // For clock_gettime
+#include "trace.h"
+#include "memory_budget.h"  // Rings are charged as buffers
+#include "timer.h"      // The flush runs on the timer wheel
+
+// trace.c
+// Each thread gets a single-producer ring on its first event; the timer wheel's thread is the
+// only consumer, so the rings need no locks: the owner publishes head, the flusher publishes
+// tail. When a ring is full, new events are dropped and counted rather than blocking a worker.
+
+#define TRACE_MAX_THREADS 256  // Threads that can record events
+#define TRACE_RING_EVENTS 16384  // Events per ring (power of two)
+#define TRACE_FLUSH_MS 200  // How often rings are drained to the trace file
+#define TRACE_DEFAULT_SAMPLE 100  // Sampling rate when none is given
+
+// A thread's event ring
+typedef struct {
+    _Alignas(64) _Atomic uint64_t head;  // Next event the owner writes
+    _Alignas(64) _Atomic uint64_t tail;  // Next event the flusher reads
+    _Atomic uint64_t dropped;  // Events lost because the ring was full
+    TraceEvent events[TRACE_RING_EVENTS];
+} TraceRing;
+
+_Thread_local uint32_t trace_current = 0;
+int trace_enabled = 0;
+
+static TraceRing *rings[TRACE_MAX_THREADS];
+static atomic_int ring_count = 0;
+static _Thread_local TraceRing *my_ring = NULL;
+static _Thread_local int my_thread = -1;  // Index of my_ring, -2 if no ring was available
+static FILE *trace_file = NULL;
+static int sample_every = TRACE_DEFAULT_SAMPLE;
+static uint32_t received = 0;  // Requests seen by trace_sample
+static _Atomic uint32_t next_id = 0;  // Last trace id handed out
+static Timer flush_timer;
+
+uint64_t trace_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Give the calling thread a ring; NULL once TRACE_MAX_THREADS threads have one
+static TraceRing *claim_ring() {
+    if (my_thread == -2) {
+        return NULL;
+    }
+    int index = atomic_fetch_add(&ring_count, 1);
+    TraceRing *ring = index < TRACE_MAX_THREADS ? (TraceRing *)calloc(1, sizeof(TraceRing)) : NULL;
+    if (ring == NULL) {
+        my_thread = -2;
+        return NULL;
+    }
+    memory_charge_fixed(MEMORY_BUFFERS, sizeof(TraceRing));  // Kept for the life of the thread
+    my_thread = index;
+    my_ring = ring;
+    __atomic_store_n(&rings[index], ring, __ATOMIC_RELEASE);  // Visible to the flusher once initialised
+    return ring;
+}
+
+void trace_record(uint32_t request_id, int stage, int phase, uint64_t timestamp_ns) {
+    TraceRing *ring = my_ring ? my_ring : claim_ring();
+    if (ring == NULL) {
+        return;
+    }
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= TRACE_RING_EVENTS) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    TraceEvent *event = &ring->events[head & (TRACE_RING_EVENTS - 1)];
+    event->timestamp_ns = timestamp_ns ? timestamp_ns : trace_now_ns();
+    event->request_id = request_id;
+    event->thread = (uint16_t)my_thread;
+    event->stage = (uint8_t)stage;
+    event->phase = (uint8_t)phase;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Timer callback: append every ring's new events to the trace file, then re-arm
+static void flush_rings(void *arg) {
+    (void)arg;
+    int count = atomic_load(&ring_count);
+    for (int i = 0; i < count && i < TRACE_MAX_THREADS; i++) {
+        TraceRing *ring = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+        if (ring == NULL) {
+            continue;  // Still being set up
+        }
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        while (tail != head) {
+            // Write the contiguous run up to the head or the end of the buffer
+            uint64_t offset = tail & (TRACE_RING_EVENTS - 1);
+            uint64_t run = head - tail < TRACE_RING_EVENTS - offset ? head - tail : TRACE_RING_EVENTS - offset;
+            fwrite(&ring->events[offset], sizeof(TraceEvent), run, trace_file);
+            tail += run;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    fflush(trace_file);
+    timer_schedule(&flush_timer, TRACE_FLUSH_MS);
+}
+
+int trace_start(const char *path, int every) {
+    trace_file = fopen(path, "wb");
+    if (trace_file == NULL) {
+        perror("Trace file creation failed");
+        return -1;
+    }
+    fwrite(TRACE_FILE_MAGIC, 1, strlen(TRACE_FILE_MAGIC), trace_file);
+    sample_every = every > 0 ? every : TRACE_DEFAULT_SAMPLE;
+    trace_enabled = 1;
+    timer_init(&flush_timer, flush_rings, NULL);
+    timer_schedule(&flush_timer, TRACE_FLUSH_MS);
+    printf("Tracing 1 in %d requests to %s\n", sample_every, path);
+    return 0;
+}
+
+uint32_t trace_sample() {
+    if (!trace_enabled || ++received % sample_every != 0) {
+        return 0;
+    }
+    uint32_t id = ++next_id;
+    if (id == 0) {
+        id = ++next_id;  // 0 means "not sampled"
+    }
+    return id;
+}
+
+size_t trace_stats_report(char *buffer, size_t size) {
+    if (!trace_enabled) {
+        int written = snprintf(buffer, size, "Tracing: off\n");
+        return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+    }
+    uint64_t recorded = 0, dropped = 0;
+    int count = atomic_load(&ring_count);
+    for (int i = 0; i < count && i < TRACE_MAX_THREADS; i++) {
+        TraceRing *ring = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+        if (ring != NULL) {
+            recorded += atomic_load(&ring->head);
+            dropped += atomic_load(&ring->dropped);
+        }
+    }
+    int written = snprintf(buffer, size, "Tracing: 1 in %d sampled, %u traced, %d threads, %llu events, %llu dropped\n",
+                           sample_every, atomic_load(&next_id), count < TRACE_MAX_THREADS ? count : TRACE_MAX_THREADS,
+                           (unsigned long long)recorded, (unsigned long long)dropped);
+    return written < 0 ? 0 : ((size_t)written < size ? (size_t)written : size - 1);
+}
@@ -0,0 +1,76 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>  // For size_t
+#include <stdint.h>  // Fixed-width integer types
+
+// trace.h
+// Sampled per-request tracing. One request in every N received is given a trace id; while a
+// thread works on it, each stage it passes through is timestamped into that thread's ring
+// buffer. Rings are drained to a binary trace file by a timer on the receive thread, and
+// trace_export converts the file to Chrome trace JSON. With sampling off, a trace point costs
+// one thread-local load and a branch.
+
+#define TRACE_FILE_MAGIC "SCTRACE1"  // First 8 bytes of a trace file
+
+// Stages of a request
+enum {
+    TRACE_RECV,     // recvfrom on the receive thread
+    TRACE_ENQUEUE,  // Handed to the worker pool (instant)
+    TRACE_DEQUEUE,  // Picked up by a worker (instant)
+    TRACE_HISTORY,  // At-most-once history lookup
+    TRACE_HANDLE,   // Parsing, handling and formatting the reply
+    TRACE_DB,       // A database call
+    TRACE_SEND,     // sendto of the reply
+    TRACE_STAGES
+};
+
+// Event phases, as Chrome trace spells them
+#define TRACE_BEGIN 'B'
+#define TRACE_END 'E'
+#define TRACE_INSTANT 'i'
+
+// One event as stored in the rings and in the trace file (16 bytes)
+typedef struct {
+    uint64_t timestamp_ns;  // Monotonic clock
+    uint32_t request_id;  // Trace id of the sampled request
+    uint16_t thread;  // Ring (thread) that recorded the event
+    uint8_t stage;  // TRACE_RECV ... TRACE_SEND
+    uint8_t phase;  // TRACE_BEGIN, TRACE_END or TRACE_INSTANT
+} TraceEvent;
+
+extern _Thread_local uint32_t trace_current;  // Sampled request this thread is working on, 0 if none
+extern int trace_enabled;  // 1 once a trace file is open
+
+// Record a stage of the current request, if it is sampled
+#define TRACE(stage, phase) do { if (trace_current) trace_record(trace_current, (stage), (phase), 0); } while (0)
+
+/**
+ * @brief Open the trace file and sample one request in every sample_every.
+ * @return 0 on success, -1 if the file cannot be created.
+ */
+int trace_start(const char *path, int sample_every);
+
+/**
+ * @brief Decide whether the next received request is traced (receive thread only).
+ * @return Its trace id, or 0 if it is not sampled.
+ */
+uint32_t trace_sample();
+
+/**
+ * @brief Append an event to the calling thread's ring.
+ * @param timestamp_ns When it happened, or 0 for now.
+ */
+void trace_record(uint32_t request_id, int stage, int phase, uint64_t timestamp_ns);
+
+/**
+ * @brief Monotonic time in nanoseconds, as used for event timestamps.
+ */
+uint64_t trace_now_ns();
+
+/**
+ * @brief Write the tracing counters into buffer; returns the length written.
+ */
+size_t trace_stats_report(char *buffer, size_t size);
+
+#endif // TRACE_H
@@ -0,0 +1,75 @@
+#include <stdint.h>  // Fixed-width integer types
+#include <stdio.h>   // For fopen, fread and printf
+#include <string.h>  // For memcmp and strcmp
+#include "trace.h"
+
+// trace_export.c
+// Converts a trace file written by `server --trace FILE` into Chrome trace JSON, which
+// chrome://tracing and Perfetto can open. By default each server thread is a track, so a
+// worker's timeline shows the requests it handled back to back; with --by-request each
+// sampled request gets its own track instead, showing where its time went across threads.
+// Timestamps are made relative to the first event.
+//
+// Build: gcc -O2 trace_export.c -o trace_export
+// Run:   ./trace_export trace.bin > trace.json
+//        ./trace_export --by-request trace.bin > trace.json
+
+static const char *stage_names[TRACE_STAGES] = {
+    "recv", "enqueue", "dequeue", "history", "handle", "db", "send"
+};
+
+int main(int argc, char *argv[]) {
+    int by_request = 0;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--by-request") == 0) {
+            by_request = 1;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL) {
+        fprintf(stderr, "Usage: %s [--by-request] <trace file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror("Cannot open trace file");
+        return 1;
+    }
+    char magic[sizeof(TRACE_FILE_MAGIC) - 1];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, TRACE_FILE_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "%s is not a trace file\n", path);
+        fclose(file);
+        return 1;
+    }
+
+    // Rings are flushed one after another, so the earliest event is not necessarily the first
+    TraceEvent event;
+    uint64_t first_ns = UINT64_MAX;
+    while (fread(&event, sizeof(event), 1, file) == 1) {
+        if (event.timestamp_ns < first_ns) {
+            first_ns = event.timestamp_ns;
+        }
+    }
+    fseek(file, sizeof(magic), SEEK_SET);
+
+    long events = 0;
+    printf("{\"traceEvents\":[\n");
+    while (fread(&event, sizeof(event), 1, file) == 1) {
+        if (event.stage >= TRACE_STAGES) {
+            continue;  // Corrupt or from a newer server
+        }
+        printf("%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,%s\"args\":{\"request\":%u,\"thread\":%u}}",
+               events ? ",\n" : "", stage_names[event.stage], event.phase, (event.timestamp_ns - first_ns) / 1000.0,
+               by_request ? event.request_id : event.thread,
+               event.phase == TRACE_INSTANT ? "\"s\":\"t\"," : "",
+               event.request_id, event.thread);
+        events++;
+    }
+    printf("\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+    fprintf(stderr, "%ld events exported\n", events);
+    return 0;
+}